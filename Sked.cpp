@@ -49,6 +49,27 @@
 #include <util/atomic.h>
 #include "./Sked.h"
 
+#if (SKED_HOST == SKED_ON)
+#include <SkedCountdown.h>
+
+/* Each instance has its own "interrupts", so instances never contend */
+#undef SKED_HOST_IRQ
+#define SKED_HOST_IRQ (&_host_irq)
+
+/* Task i's count, which the host keeps out of the task table */
+#define SKED_COUNT(i) (_counts[i])
+#else
+#define SKED_COUNT(i) (_tasks[i].count)
+#endif
+
+#if (SKED_POSTMORTEM == SKED_ON)
+#include <EEPROM.h>
+#endif
+
+#if (SKED_WATCHDOG == SKED_ON)
+#include <avr/wdt.h>
+#endif
+
 /* Fixed 100us tick resolution */
 #define SKED_TIMER1_CLK_HZ (8.0/static_cast<float>(F_CPU))
 #define SKED_TIMER1_TICK_PERIOD_S 0.000100
@@ -57,14 +78,39 @@
 #define SKED_TIMER1_TICKS_PER_PERIOD (SKED_TIMER1_TICK_PERIOD_S \
     / SKED_TIMER1_CLK_HZ)
 
-/* Different states the sked can be in */
-#define SKED_STATE_UNINIT 0
-#define SKED_STATE_INIT 1
+/* Folds to a constant when SKED_DISPATCH builds in a single mode */
+#if (SKED_DISPATCH == SKED_DISPATCH_PREEMPTIVE)
+#define SKED_IS_PREEMPTIVE(mode) (true)
+#elif (SKED_DISPATCH == SKED_DISPATCH_COOPERATIVE)
+#define SKED_IS_PREEMPTIVE(mode) (false)
+#else
+#define SKED_IS_PREEMPTIVE(mode) ((mode) == SKED_MODE_PREEMPTIVE)
+#endif
 
 /**
  * Constructor
  */
 Sked::Sked(void) {
+#if (SKED_HOST == SKED_ON)
+    skedHostIrqInit(&_host_irq);
+    _host = NULL;
+    _host_realtime = true;
+    _host_tickless = false;
+    _host_shm = NULL;
+    _host_shm_tick = 0U;
+    _host_timebase = NULL;
+    _host_cpu = SKED_CPU_ANY;
+    _host_workers = 0U;
+    hostPostInit();
+    hostTableInit();
+    /* reset() looks through the table for coroutines to destroy */
+    _task_count = 0U;
+    hostCoroInit();
+    _host_band_floors = 0U;
+    _host_spins = 0U;
+    _host_countdown = skedCountdownSelect();
+    hostProgramInit();
+#endif
     reset();
 }
 
@@ -74,20 +120,44 @@ Sked::Sked(void) {
  * those to define how it behaves going forward.
  *
  * @param mode  Must be either the preemptive or non-preemptive mode
- * @param clk_src  This tells Sked which timer to use. Currently, only TIMER1
- * is supported (SKED_SRC_TIMER1).
+ * @param clk_src  This tells Sked which timer to use. On AVR, only TIMER1
+ * is supported (SKED_SRC_TIMER1). The Linux host backend (SKED_HOST) uses
+ * SKED_SRC_MONOTONIC. SKED_SRC_DEFAULT is whichever of the two fits the build.
  *
  * @return SKED_E_OK - The initialization operation was successful.
- *         SKED_E_NOT_IMPLEMENTED - if a timer source other than SKED_SRC_TIMER1
- *         is used.
+ *         SKED_E_NOT_IMPLEMENTED - if a timer source the build doesn't
+ *         support is used.
  */
 int8_t Sked::init(sked_mode_e mode, sked_clk_src_e clk_src) {
     int8_t ret = SKED_E_OK;
 
+    /* Only the modes built in by SKED_DISPATCH can be used */
+#if (SKED_DISPATCH == SKED_DISPATCH_PREEMPTIVE)
+    if (mode != SKED_MODE_PREEMPTIVE) {
+        return SKED_E_WRONG_MODE;
+    }
+#elif (SKED_DISPATCH == SKED_DISPATCH_COOPERATIVE)
+    if (mode != SKED_MODE_NON_PREEMPTIVE) {
+        return SKED_E_WRONG_MODE;
+    }
+#endif
+
     _mode = mode;
     _clk_src = clk_src;
 
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+#if (SKED_HOST == SKED_ON)
+        if (_clk_src == SKED_SRC_MONOTONIC) {
+            /* Same 100us tick, and so the same period range, as TIMER1 */
+            _max_period_us = (uint32_t)(static_cast<float>(0xFFFF)
+                    * static_cast<float>(SKED_TIMER1_TICK_PERIOD_US));
+            _min_period_us = SKED_TIMER1_TICK_PERIOD_US;
+
+            _state = SKED_STATE_INIT;
+        } else {
+            ret = SKED_E_NOT_IMPLEMENTED;
+        }
+#else
         if (_clk_src == SKED_SRC_TIMER1) {
             /* Maximum number of us that can fit in 16-bit counter */
             _max_period_us = (uint32_t)(static_cast<float>(0xFFFF)
@@ -121,6 +191,7 @@ int8_t Sked::init(sked_mode_e mode, sked_clk_src_e clk_src) {
         } else {
             ret = SKED_E_NOT_IMPLEMENTED;
         }
+#endif
     }
 
     return ret;
@@ -131,6 +202,9 @@ int8_t Sked::init(sked_mode_e mode, sked_clk_src_e clk_src) {
  * through the list of tasks in priority order looking for tasks that are
  * ready to run. When it finds one, it changes its state and runs it.
  *
+ * If no task was ready during the pass, idle() is called to do background
+ * work.
+ *
  * If you are using Sked in a preemptive mode, this function will do nothing
  * and simply return SKED_E_WRONG_MODE.
  *
@@ -143,9 +217,49 @@ int8_t Sked::loop(void) {
         return SKED_E_NOT_INITIALIZED;
     }
 
-    if (_mode == SKED_MODE_NON_PREEMPTIVE) {
+    if (!SKED_IS_PREEMPTIVE(_mode)) {
+        bool ran = false;
+
+#if (SKED_LATE_HOOKS == SKED_ON)
+        /* Late hooks go ahead of the tasks, which can't be preempted here */
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            runLateHooks();
+        }
+#endif
+
+#if (SKED_HOST == SKED_ON)
+        /* With a worker pool (setWorkers()), the workers run the tasks and
+         * this thread only does background work */
+        if (hostPooled()) {
+            idle();
+            hostIdleWait();
+            return SKED_E_OK;
+        }
+#endif
+
+#if (SKED_HOST == SKED_ON)
+        /* The READY queues hand over the highest priority task first. Run
+         * as many as were READY coming in, as one pass of the table below
+         * would. */
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            sked_index_t jobs = _host_ready_count;
+
+            while (jobs-- > 0U) {
+                sked_index_t i = hostReadyTop(-128, 127);
+                if (i == SKED_INDEX_NONE) {
+                    break;
+                }
+
+                hostReadyRemove(i);
+                _tasks[i].state = RUNNING;
+                runTask(i);
+                hostJobDone(i);
+                ran = true;
+            }
+        } /* End of atomic block */
+#else
         /* Search for a task that is ready to run and execute it */
-        for (uint8_t i = 0; i < _task_count; i++) {
+        for (sked_index_t i = 0; i < _task_count; i++) {
             sked_task_t *task = &_tasks[i];
 
             ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
@@ -156,18 +270,22 @@ int8_t Sked::loop(void) {
                  * READY tasks according to priority. */
                 if (task->state == READY) {
                     task->state = RUNNING;
-
-                    /* Enable interrupts to allow for the tick interrupt to occur
-                     * again (as well as other interrupts) during the task function's
-                     * execution. */
-                    NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE) {
-                        task->fcn();
-                    }
-
+                    runTask(i);
                     task->state = IDLE;
+                    ran = true;
                 }
             } /* End of atomic block */
         }
+#endif
+
+        /* Nothing was ready, so this is a good time for background work */
+        if (!ran) {
+            idle();
+#if (SKED_HOST == SKED_ON)
+            /* Rather than spin, sleep until the tick thread releases work */
+            hostIdleWait();
+#endif
+        }
     } else {
         return SKED_E_WRONG_MODE;
     }
@@ -175,13 +293,357 @@ int8_t Sked::loop(void) {
     return SKED_E_OK;
 }
 
+/**
+ * Runs a task that the caller has already marked RUNNING, with interrupts
+ * enabled for the duration, and keeps the per-dispatch bookkeeping. Must be
+ * called with interrupts disabled.
+ *
+ * @param i  The index of the task to run
+ */
+void Sked::runTask(sked_index_t i) {
+    sked_task_t *task = &_tasks[i];
+
+#if (SKED_STACK_MONITOR == SKED_ON)
+    if (_dispatch_depth < SKED_STACK_LEVELS) {
+        _dispatch_chain[_dispatch_depth] = i;
+    }
+#endif
+    _dispatch_depth++;
+#if (SKED_STACK_MONITOR == SKED_ON)
+    /* The level's base, even if no tick lands on the task */
+    stackSample();
+#endif
+#if (SKED_POSTMORTEM == SKED_ON)
+    trace(SKED_TRACE_DISPATCH, i);
+#endif
+    uint32_t start_us = nowUs();
+
+#if (SKED_WATCHDOG == SKED_ON)
+    /* Leave a way back here in case the watchdog has to abort the task */
+    sked_abort_frame_t frame;
+    frame.outer = _abort_frame;
+    frame.task = i;
+    _abort_frame = &frame;
+    task->flags &= ~SKED_TASK_LATE;
+
+    if (setjmp(frame.env) == 0) {
+#endif
+        /* Enable interrupts to allow for the tick interrupt to occur
+         * again (as well as other interrupts) during the task function's
+         * execution. */
+        NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE) {
+#if (SKED_HOST == SKED_ON)
+            if (task->flags & SKED_TASK_CORO) {
+                /* Runs the coroutine to its next co_await */
+                hostCoroResume(task);
+            } else if (task->host_flags & SKED_HOST_TASK_ARG) {
+                ((sked_task_arg_fcn_t)task->fcn)(task->arg);
+            } else
+#endif
+            task->fcn();
+        }
+        task->completions++;
+#if (SKED_WATCHDOG == SKED_ON)
+    } else {
+        /* We're back here with interrupts disabled, courtesy of longjmp()
+         * restoring SREG as it was at setjmp(). */
+        if (_wdt_aborts < 0xFFFFU) {
+            _wdt_aborts++;
+        }
+    }
+    _abort_frame = frame.outer;
+#endif
+
+    uint32_t exec_us = nowUs() - start_us;
+    if (exec_us > task->max_exec_us) {
+        task->max_exec_us = exec_us;
+    }
+#if (SKED_HOST == SKED_ON)
+    hostRecordExec(i, exec_us);
+    /* Its fd can release it again now. The caller marks it IDLE before
+     * letting go of the lock, so the tick thread can't see it otherwise. */
+    if (task->flags & SKED_TASK_EVENT) {
+        hostFdArm(task, 0);
+    }
+#endif
+#if (SKED_POSTMORTEM == SKED_ON)
+    trace(SKED_TRACE_COMPLETE, i);
+#endif
+#if (SKED_STACK_MONITOR == SKED_ON)
+    stackSample();
+#endif
+    _dispatch_depth--;
+}
+
+#if (SKED_LATE_HOOKS == SKED_ON)
+/**
+ * Calls the late hook of every task that missed or overran since the last
+ * call, with interrupts enabled. Ticks that land while hooks are running only
+ * add to the pending work, which is picked up here before returning, so hooks
+ * never nest. Must be called with interrupts disabled.
+ */
+void Sked::runLateHooks(void) {
+    if (!_late_pending || _late_running) {
+        return;
+    }
+
+    _late_running = true;
+
+    while (_late_pending) {
+        _late_pending = false;
+
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            sked_task_t *task = &_tasks[i];
+            uint8_t events = 0U;
+
+            if (task->flags & SKED_TASK_MISS_PENDING) {
+                events |= SKED_LATE_MISS;
+            }
+            if (task->flags & SKED_TASK_OVERRUN_PENDING) {
+                events |= SKED_LATE_OVERRUN;
+            }
+            if (events == 0U) {
+                continue;
+            }
+
+            task->flags &= ~(SKED_TASK_MISS_PENDING
+                    | SKED_TASK_OVERRUN_PENDING);
+            sked_late_fcn_t hook = task->late_hook;
+            sked_task_fcn_t fcn = task->fcn;
+
+            NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE) {
+                hook(fcn, events);
+            }
+        }
+    }
+
+    _late_running = false;
+}
+
+/**
+ * Set a hook to be called when a task misses (it was still READY at its next
+ * release) or overruns (it was still RUNNING). The ISR only notes what
+ * happened; the hook is called soon after with interrupts enabled, from the
+ * tick interrupt ahead of any dispatch in preemptive mode, or from loop()
+ * ahead of any task in non-preemptive mode. Keep hooks short: in preemptive
+ * mode they hold off every task at or below the priority they interrupted.
+ *
+ * Tasks without a hook pay nothing beyond a NULL check when they're late.
+ *
+ * @param fcn   The task's function, as given to schedule()
+ * @param hook  Called with the task's function and the SKED_LATE_* events
+ * since it last ran, or NULL to remove the hook
+ *
+ * @return SKED_E_OK - The hook is set
+ *         SKED_E_INVALID_FUNCTION - No task runs fcn
+ */
+int8_t Sked::setLateHook(sked_task_fcn_t fcn, sked_late_fcn_t hook) {
+    int8_t ret = SKED_E_INVALID_FUNCTION;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            if (_tasks[i].fcn == fcn) {
+                _tasks[i].late_hook = hook;
+                if (hook == NULL) {
+                    _tasks[i].flags &= ~(SKED_TASK_MISS_PENDING
+                            | SKED_TASK_OVERRUN_PENDING);
+                }
+                ret = SKED_E_OK;
+            }
+        }
+    } /* End of atomic block */
+
+    return ret;
+}
+#endif
+
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+/**
+ * The next-due engine only touches task counts when a release is due. This
+ * takes off the ticks gone by since then, so every count is current, and
+ * restarts the countdown to the earliest release. Must be called with
+ * interrupts disabled.
+ */
+void Sked::releaseSync(void) {
+    uint16_t elapsed = _release_span - _release_in;
+    uint16_t next = 0xFFFFU;
+
+    for (sked_index_t i = 0; i < _task_count; i++) {
+        sked_task_t *task = &_tasks[i];
+
+        if (SKED_COUNT(i) > elapsed) {
+            SKED_COUNT(i) -= elapsed;
+        }
+
+        /* A count of 0 is released on the next tick */
+        uint16_t due = (SKED_COUNT(i) != 0U) ? SKED_COUNT(i) : 1U;
+        if (due < next) {
+            next = due;
+        }
+    }
+
+    _release_span = _release_in = next;
+}
+#endif
+
+/**
+ * Releases a task whose count has hit zero. It can be in any state:
+ *
+ * If it's already RUNNING, it means a whole task period went by and it
+ * didn't get a chance to finish in the previous period.
+ *
+ * If it's IDLE, then great, it's ready to run now
+ *
+ * If it's READY, it means that an entire period has gone by without the task
+ * being able to execute.
+ *
+ * Called from timerISR() with interrupts disabled.
+ *
+ * @param i  The index of the task being released
+ */
+inline void Sked::releaseTask(sked_index_t i) {
+    sked_task_t *task = &_tasks[i];
+
+#if (SKED_HOST == SKED_ON)
+    if (task->host_flags & SKED_HOST_TASK_FREE) {
+        /* An unscheduled slot is never released */
+        SKED_COUNT(i) = 0xFFFFU;
+        return;
+    }
+#endif
+
+#if (SKED_WATCHDOG == SKED_ON)
+    /* A critical task that's IDLE at its release finished its last job
+     * inside its deadline window. */
+    if (task->state == IDLE && (task->flags & SKED_TASK_CRITICAL)) {
+        watchdogFeed(i);
+    }
+#endif
+
+    if (task->flags & (SKED_TASK_SHED | SKED_TASK_EVENT)) {
+        /* The watchdog is shedding load, or the task is released by an event
+         * rather than its period: skip this release */
+#if (SKED_HOST == SKED_ON)
+    } else if ((task->flags & SKED_TASK_CORO) && !hostCoroDue(task)) {
+        /* A coroutine is only released when it wakes up, and
+         * hostCoroDue() has set its count to the next chance of that */
+        return;
+#endif
+    } else if (task->state == IDLE) {
+        /* Move it to the "ready to run" state */
+        task->state = READY;
+        task->activations++;
+#if (SKED_HOST == SKED_ON)
+        task->released_tick = _ticks;
+        hostReadyPush(i);
+        hostRecordRelease();
+#endif
+    } else if (task->state == RUNNING) {
+        /* Overrun */
+        task->activations++;
+        if (task->overruns < SKED_OVERRUNS_MAX) {
+            task->overruns++;
+        }
+        task->last_overrun_tick = _ticks;
+        task->flags |= SKED_TASK_LATE;
+#if (SKED_LATE_HOOKS == SKED_ON)
+        if (task->late_hook != NULL) {
+            task->flags |= SKED_TASK_OVERRUN_PENDING;
+            _late_pending = true;
+        }
+#endif
+#if (SKED_POSTMORTEM == SKED_ON)
+        trace(SKED_TRACE_OVERRUN, i);
+
+        /* Ask idle() to save the evidence of the first overrun */
+        if (_pm_armed) {
+            _pm_armed = false;
+            _pm_requested = true;
+            _pm_reason = SKED_PM_REASON_OVERRUN;
+        }
+#endif
+    } else {
+        /* Miss! */
+        task->activations++;
+        if (task->misses < SKED_MISSES_MAX) {
+            task->misses++;
+        }
+        task->last_miss_tick = _ticks;
+#if (SKED_LATE_HOOKS == SKED_ON)
+        if (task->late_hook != NULL) {
+            task->flags |= SKED_TASK_MISS_PENDING;
+            _late_pending = true;
+        }
+#endif
+#if (SKED_POSTMORTEM == SKED_ON)
+        trace(SKED_TRACE_MISS, i);
+#endif
+    }
+
+    /* Reset the count back to the period. You'll note that we don't
+     * care about the offset. Since that was baked in when the task was
+     * scheduled, it meant that its first period was offset
+     * differently and thus this task will continue to have the
+     * offset baked into each subsequent period without worrying about
+     * it. */
+    SKED_COUNT(i) = task->period;
+}
+
 /**
  * This ISR is connected to the timer overflow such that it runs at a regular
  * rate and performs internal bookkeeping tasks.
  */
 void Sked::timerISR(void) {
+#if (SKED_STACK_MONITOR == SKED_ON)
+    /* Every tick lands on top of whatever is running, which makes it a cheap
+     * sampler of how deep each dispatch level goes. */
+    stackSample();
+#endif
+
+    _ticks++;
+
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+    /* Nothing is due until the countdown to the earliest release runs out */
+    if (--_release_in == 0U) {
+        uint16_t elapsed = _release_span;
+        uint16_t next = 0xFFFFU;
+
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            sked_task_t *task = &_tasks[i];
+
+            /* Every count is at least the span, apart from a count of 0
+             * (offset 0) which releases on the first tick like it does in
+             * the linear engine. */
+            if (SKED_COUNT(i) > elapsed) {
+                SKED_COUNT(i) -= elapsed;
+            } else {
+                SKED_COUNT(i) = 0U;
+                releaseTask(i);
+            }
+
+            if (SKED_COUNT(i) < next) {
+                next = SKED_COUNT(i);
+            }
+        }
+
+        _release_span = _release_in = next;
+    }
+#elif (SKED_HOST == SKED_ON)
+    /* Count every task down in one go, then release the ones that ran out
+     * in table order, as below */
+    if (_host_countdown(_counts, _task_count, _host_released) != 0U) {
+        for (sked_index_t w = 0; w < (_task_count + 63U) / 64U; w++) {
+            uint64_t bits = _host_released[w];
+
+            while (bits != 0U) {
+                releaseTask(w * 64U + __builtin_ctzll(bits));
+                bits &= bits - 1U;
+            }
+        }
+    }
+#else
     /* This occurs periodically. Walk through each task and update its state. */
-    for (uint8_t i = 0; i < _task_count; i++) {
+    for (sked_index_t i = 0; i < _task_count; i++) {
         sked_task_t *task = &_tasks[i];
 
         /* Each task has a count which we decrement if we can */
@@ -189,71 +651,102 @@ void Sked::timerISR(void) {
             task->count--;
         }
 
-        /* When it hits zero, that task is ready to run. It can be in any
-         * state:
-         *
-         * If it's already RUNNING, it means a whole task period went by
-         * and it didn't get a chance to finish in the previous period.
-         *
-         * If it's IDLE, then great, it's ready to run now
-         *
-         * If it's READY, it means that an entire period has gone by
-         * without the task being able to execute. */
+        /* When it hits zero, that task is ready to run. */
         if (task->count == 0) {
-            if (task->state == IDLE) {
-                /* Move it to the "ready to run" state */
-                task->state = READY;
-            } else if (task->state == RUNNING) {
-                /* Overrun */
-                task->overruns = constrain(SKED_OVERRUNS_MAX,
-                        0, task->overruns+1);
-            } else {
-                /* Miss! */
-                task->misses = constrain(SKED_MISSES_MAX,
-                        0, task->misses+1);
-            }
-
-            /* Reset the count back to the period. You'll note that we don't
-             * care about the offset. Since that was baked in when the task was
-             * scheduled, it meant that its first period was offset
-             * differently and thus this task will continue to have the
-             * offset baked into each subsequent period without worrying about
-             * it. */
-            task->count = task->period;
+            releaseTask(i);
         }
     }
+#endif
+
+#if (SKED_WATCHDOG == SKED_ON)
+    /* The watchdog asked for the wedged task to be aborted. Do it once that
+     * task is the one we interrupted (anything that preempted it has
+     * finished) by jumping back to where it was dispatched. */
+    if (_wdt_abort_requested && _abort_frame != NULL
+#if (SKED_LATE_HOOKS == SKED_ON)
+            && !_late_running
+#endif
+            && (_tasks[_abort_frame->task].flags & SKED_TASK_LATE)) {
+        _wdt_abort_requested = false;
+        longjmp(_abort_frame->env, 1);
+    }
+#endif
+
+    if (SKED_IS_PREEMPTIVE(_mode)) {
+#if (SKED_LATE_HOOKS == SKED_ON)
+        /* Let the application react before anything else gets dispatched */
+        runLateHooks();
+#endif
 
-    if (_mode == SKED_MODE_PREEMPTIVE) {
-        /* After we update our state, it's time to execute an available task */
-        for (uint8_t i = 0; i < _task_count; i++) {
+#if (SKED_HOST != SKED_ON)
+        /* After we update our state, it's time to execute an available task.
+         * The table is sorted by priority, so we can stop looking as soon as
+         * we reach tasks that can't preempt the one we interrupted. */
+        uint8_t i = 0;
+        while (i < _task_count) {
             sked_task_t *task = &_tasks[i];
 
+            if (task->priority <= _current_task_priority) {
+                break;
+            }
+
             /* We can run a task when it's ready and is of higher priority than
              * the task we're running already. */
-            if ((task->state == READY)
-                    && (task->priority > _current_task_priority)) {
+            if (task->state == READY) {
+                /* Every dispatch stacks another interrupt frame and task frame
+                 * on the one stack. Past the limit, leave the task READY; it
+                 * gets picked up below as soon as the stack unwinds. */
+                if (_max_preempt_depth != 0U
+                        && _dispatch_depth >= _max_preempt_depth) {
+                    /* Counted once per release held back, not per tick it
+                     * waits, so a long wait doesn't flood the trace */
+                    if (!(task->flags & SKED_TASK_DEFERRED)) {
+                        task->flags |= SKED_TASK_DEFERRED;
+                        if (_preempt_deferrals < 0xFFFFU) {
+                            _preempt_deferrals++;
+                        }
+#if (SKED_POSTMORTEM == SKED_ON)
+                        trace(SKED_TRACE_DEFER, i);
+#endif
+                    }
+                    break;
+                }
+
+                int8_t prev_priority = _current_task_priority;
                 task->state = RUNNING;
+                task->flags &= ~SKED_TASK_DEFERRED;
 
                 /* Record the priority so we don't let other lower-prio tasks
                  * interrupt us */
                 _current_task_priority = task->priority;
 
-                /* Enable interrupts to allow for the tick interrupt to occur
-                 * again (as well as other interrupts) during the task function's
-                 * execution. */
-                NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE) {
-                    task->fcn();
-                }
+                runTask(i);
 
-                /* Important! Reset the priority back to the lowest possible or
-                 * else you'll never execute any tasks with lower priority than
-                 * the one we just ran. */
-                _current_task_priority = SKED_MIN_PRIORITY;
+                /* Important! Restore the priority of the task we preempted (or
+                 * the lowest possible if there wasn't one) or else you'll never
+                 * execute any tasks with lower priority than the one we just
+                 * ran, and tasks with lower priority than the one we preempted
+                 * could jump in ahead of it. */
+                _current_task_priority = prev_priority;
 
                 task->state = IDLE;
+
+                /* Higher priority tasks may have become ready (or been held
+                 * back by the depth limit) while we ran, so start over. */
+                i = 0;
+                continue;
             }
+
+            i++;
         }
+#endif
     }
+
+#if (SKED_HOST == SKED_ON)
+    /* On the host, tasks run on worker threads (preemptive) or the thread
+     * calling loop(). Wake whichever has work now. */
+    hostDispatch();
+#endif
 }
 
 #if (SKED_DEBUG == SKED_ON)
@@ -272,6 +765,15 @@ void Sked::debugPrintState(Stream *stream) {
         stream->println(_max_period_us);
         stream->print("### Src Timer:       ");
         switch (_clk_src) {
+#if (SKED_HOST == SKED_ON)
+            case SKED_SRC_MONOTONIC:
+                stream->println("MONOTONIC");
+                stream->print("###    Ticks:     ");
+                stream->println((unsigned long)_ticks);
+                stream->print("###    Realtime:  ");
+                stream->println(_host_realtime ? "yes" : "no");
+                break;
+#else
             case SKED_SRC_TIMER1:
                 stream->println("TIMER1");
                 stream->print("###    Count:     ");
@@ -287,6 +789,7 @@ void Sked::debugPrintState(Stream *stream) {
                 stream->print("###    Ticks Per Period: ");
                 stream->println(SKED_TIMER1_TICKS_PER_PERIOD);
                 break;
+#endif
 
             default:
                 stream->println("INVALID");
@@ -294,7 +797,7 @@ void Sked::debugPrintState(Stream *stream) {
         }
 
         stream->print("### Tasks: "); stream->println(_task_count);
-        for (uint8_t i = 0; i < _task_count; i++) {
+        for (sked_index_t i = 0; i < _task_count; i++) {
             sked_task_t *task = &_tasks[i];
 
             stream->print("###   Task[");
@@ -307,9 +810,9 @@ void Sked::debugPrintState(Stream *stream) {
             stream->print(", ");
             stream->print(task->offset);
             stream->print(", ");
-            stream->print(task->count);
+            stream->print(SKED_COUNT(i));
             stream->print(", ");
-            stream->print((uint32_t)task->fcn, HEX);
+            stream->print((uintptr_t)task->fcn, HEX);
             stream->println(")");
             stream->print("###     State: ");
             stream->println(task->state);
@@ -322,170 +825,685 @@ void Sked::debugPrintState(Stream *stream) {
 }
 #endif /* #if (SKED_DEBUG == SKED_ON) */
 
+#if (SKED_TELEMETRY == SKED_ON) || (SKED_LOG == SKED_ON) \
+    || (SKED_POSTMORTEM == SKED_ON)
 /**
- * Schedules a routine to be called at a given period, offset, and priority.
- *
- * @param period_us The period (time between successive calls) of the task
- * in microseconds. It must be greater than 0, but less than the maximum
- * and greater than the minimum (which are timer and platform dependent).
- * On the Uno, the max is ~65.5 seconds and the minimum is 100 us.
- * with TIMER1.
- * @param offset_us The offset (time to wait before executing the first task)
- * in microseconds. You can use this to make it so two tasks won't occur at
- * the same time even though they have the same period. The period may be 0,
- * but it if it's greather than 0, it should be greater than the minimum
- * period.
- * @param priority  This is an indicator of task priority. The higher this
- * value, the higher the priority of the task. If there are two tasks that
- * could run at the same time, the one with the higher priority is chosen. The
- * minimum valid priority is SKED_MIN_PRIORITY (-128 is reserved).
- * @param fcn  A pointer to a void (void) function (sked_task_fcn_t). Should
- * not be null.
- *
- * @return SKED_E_OK - The task was scheduled successfully
- *         SKED_E_NOT_INITIALIZED - you should call init() first
- *         SKED_E_TOO_MANY_TASKS - you can't have too many tasks (> SKED_MAX_TASKS)
- *         SKED_E_INVALID_PERIOD - The period isn't valid
- *         SKED_E_INVALID_OFFSET - The offset isn't valid
- *         SKED_E_INVALID_PRIORITY - The priority is not valid
- *         SKED_E_INVALID_FUNCTION - Your function pointer was null
+ * Running Fletcher-16 used to protect binary frames. The modulo is folded
+ * with an end-around carry instead of a division, which matters on an AVR.
  */
-int8_t Sked::schedule(uint32_t period_us, uint32_t offset_us, int8_t priority,
-        sked_task_fcn_t fcn) {
-    uint16_t period;
-    uint16_t offset;
+static void skedFletcher16(const uint8_t *data, uint16_t len, uint16_t *s1,
+        uint16_t *s2) {
+    uint16_t a = *s1;
+    uint16_t b = *s2;
 
-    /* Have to initialize first to get proper bounds */
-    if (_state == SKED_STATE_UNINIT) {
-        return SKED_E_NOT_INITIALIZED;
+    for (uint16_t i = 0; i < len; i++) {
+        a += data[i];
+        a = (a & 0xFFU) + (a >> 8);
+        b += a;
+        b = (b & 0xFFU) + (b >> 8);
     }
 
-    /* We may be full */
-    if (_task_count >= SKED_MAX_TASKS) {
-        return SKED_E_TOO_MANY_TASKS;
+    *s1 = a;
+    *s2 = b;
+}
+#endif
+
+/**
+ * Background work that must never hold up a task. Non-preemptive users get
+ * this for free from loop() whenever nothing is ready to run. In preemptive
+ * mode, call it from the Arduino loop().
+ *
+ * Each call does a bounded amount of work so it can be called as often as
+ * you like.
+ */
+void Sked::idle(void) {
+#if (SKED_POSTMORTEM == SKED_ON)
+    if (_pm_requested) {
+        _pm_requested = false;
+        saveSnapshot(_pm_reason);
+    }
+#endif
+#if (SKED_TELEMETRY == SKED_ON)
+    if (_telemetry_out != NULL && _telemetry_pos < _telemetry_len) {
+        uint16_t n = _telemetry_len - _telemetry_pos;
+        if (n > SKED_TELEMETRY_CHUNK) {
+            n = SKED_TELEMETRY_CHUNK;
+        }
+#if (SKED_TX_ROOM == SKED_ON)
+        int room = _telemetry_out->availableForWrite();
+        if (room < (int)n) {
+            n = (room > 0) ? (uint16_t)room : 0U;
+        }
+#endif
+
+        /* Only what fits in the TX buffer, so write() never waits */
+        if (n > 0U) {
+            _telemetry_out->write(&_telemetry_buf[_telemetry_pos], n);
+            _telemetry_pos += n;
+        }
+
+        /* Don't let a log frame land in the middle of a status frame */
+        return;
+    }
+#endif
+#if (SKED_LOG == SKED_ON)
+    if (_log_out != NULL) {
+        logSendOne();
     }
+#endif
+}
 
-    /* Check period and offset:
-     *  Both must be less than the max and greater than the min (except for
-     *  the offset, which can be 0, but if it's greater than 0, it should be
-     *  greater than 100).
-     */
-    if (period_us > _max_period_us || period_us < _min_period_us) {
-        return SKED_E_INVALID_PERIOD;
+#if (SKED_TELEMETRY == SKED_ON)
+/**
+ * Store the low `size` bytes of a value little endian.
+ *
+ * @return Where the next byte goes
+ */
+static uint8_t *skedPut(uint8_t *p, uint32_t value, uint8_t size) {
+    for (uint8_t i = 0; i < size; i++) {
+        *p++ = (uint8_t)value;
+        value >>= 8;
     }
 
-    if (offset_us > _max_period_us
-            || (offset_us > 0 && offset_us < _min_period_us)) {
-        return SKED_E_INVALID_OFFSET;
+    return p;
+}
+
+/**
+ * Select where telemetry frames go. Nothing is written until
+ * telemetrySnapshot() is called and idle() gets a chance to run.
+ *
+ * @param out  The stream to write frames to (e.g. &Serial). NULL stops
+ * telemetry output. With SKED_TX_ROOM, idle() only writes what its
+ * availableForWrite() says there's room for, so a stream that always says 0
+ * gets nothing.
+ */
+void Sked::telemetryBegin(Print *out) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        _telemetry_out = out;
+        _telemetry_len = 0U;
+        _telemetry_pos = 0U;
+#if (SKED_HOST == SKED_ON)
+        _telemetry_next = 0U;
+#endif
     }
+}
 
-    /* Priority needs to be > -127 (which we use to designate the lowest
-     * possible priority)
-     */
-    if (priority <= (int8_t)SKED_MIN_PRIORITY) {
-        return SKED_E_INVALID_PRIORITY;
+/**
+ * Capture the scheduler state and per-task statistics into a binary status
+ * frame. This is the compact replacement for debugPrintState(): the capture
+ * is a short copy with interrupts off and the frame is then trickled out by
+ * idle() without ever blocking the caller.
+ *
+ * @return SKED_E_OK - The snapshot was taken and is queued for output
+ *         SKED_E_NOT_INITIALIZED - telemetryBegin() hasn't been given a stream
+ *         SKED_E_BUSY - The previous frame hasn't been fully sent yet
+ */
+int8_t Sked::telemetrySnapshot(void) {
+    if (_telemetry_out == NULL) {
+        return SKED_E_NOT_INITIALIZED;
     }
 
-    /* Task function cannot be NULL */
-    if (fcn == (sked_task_fcn_t)NULL) {
-        return SKED_E_INVALID_FUNCTION;
+    if (_telemetry_pos < _telemetry_len) {
+        return SKED_E_BUSY;
     }
 
-    /* Convert period and offset to ticks of the timer ISR */
-    period = period_us / (uint32_t)(SKED_TIMER1_TICK_PERIOD_US);
-    offset = offset_us / (uint32_t)(SKED_TIMER1_TICK_PERIOD_US);
+    uint8_t *p = _telemetry_buf;
+    uint16_t payload_len;
+
+    *p++ = SKED_FRAME_SYNC;
+    *p++ = SKED_FRAME_STATUS;
+    *p++ = SKED_STATUS_VERSION;
+    /* Length is filled in once we know the task count */
+    p += 2;
 
-    /* Make sure to disable interrupts lest we get a tick interrupt right as
-     * we're adding a new task. */
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-        /* For now, we just do an insertion sort so that the _tasks array is
-         * always sorted first by priority from highest to lowest and then
-         * secondarily by period from lowest to highest.
-         *
-         * This prioritizes run-time speed over initialization time speed,
-         * which is a pretty sane choice for a scheduler. It means that we can
-         * always just walk the array of tasks and execute those that are in a
-         * ready state.
-         *
-         * We could change this to a full re-sort later if we find we want
-         * to change priorities on the fly (not just on insertion) */
-        uint8_t insertion_index = _task_count;
-        for (uint8_t i = 0; i < _task_count; i++) {
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+        releaseSync();
+#endif
+        *p++ = _state;
+        *p++ = (uint8_t)_mode;
+        *p++ = (uint8_t)_clk_src;
+#if (SKED_HOST == SKED_ON)
+        /* The host's table can outgrow the frame, which then has the next
+         * SKED_MAX_TASKS slots, from the start again once they run out */
+        sked_index_t first = (_telemetry_next < _task_count)
+            ? _telemetry_next : 0U;
+        sked_index_t count = (_task_count - first < SKED_MAX_TASKS)
+            ? _task_count - first : SKED_MAX_TASKS;
+        _telemetry_next = first + count;
+#else
+        sked_index_t first = 0U;
+        sked_index_t count = _task_count;
+#endif
+        *p++ = (uint8_t)count;
+        *p++ = (uint8_t)_current_task_priority;
+        *p++ = sizeof(sked_stat_t);
+        *p++ = sizeof(sked_count_t);
+        p = skedPut(p, _ticks, sizeof(_ticks));
+#if (SKED_HOST == SKED_ON)
+        p = skedPut(p, first, sizeof(first));
+        p = skedPut(p, _task_count, sizeof(_task_count));
+#endif
+
+        for (sked_index_t i = first; i < first + count; i++) {
             sked_task_t *task = &_tasks[i];
 
-            if (task->priority < priority) {
-                /* This is where we need to insert */
-                insertion_index = i;
-                break;
-            } else if (task->priority == priority) {
-                /* Sort by lowest period having higher priority amongst tasks
-                 * that have the same priority. */
-                insertion_index = i;
-                for (uint8_t j = i; j < _task_count
-                        && _tasks[j].priority == priority; j++) {
-                    if (period < _tasks[j].period) {
-                        insertion_index = j;
-                        break;
-                    }
-                }
-            }
+            *p++ = (uint8_t)task->priority;
+            *p++ = (uint8_t)task->state;
+            p = skedPut(p, task->period, sizeof(task->period));
+            p = skedPut(p, task->offset, sizeof(task->offset));
+            p = skedPut(p, SKED_COUNT(i), sizeof(SKED_COUNT(i)));
+            p = skedPut(p, task->misses, sizeof(task->misses));
+            p = skedPut(p, task->overruns, sizeof(task->overruns));
+            p = skedPut(p, task->activations, sizeof(task->activations));
+            p = skedPut(p, task->completions, sizeof(task->completions));
+            p = skedPut(p, task->max_exec_us, sizeof(task->max_exec_us));
         }
+    } /* End of atomic block */
 
-        /* Move tasks down to make room if needed */
-        if (_task_count > 0) {
-            for (int16_t i = _task_count-1; i >= insertion_index; i--) {
-                _tasks[i+1] = _tasks[i];
-            }
-        }
+    payload_len = (uint16_t)(p - &_telemetry_buf[5]);
+    _telemetry_buf[3] = (uint8_t)(payload_len);
+    _telemetry_buf[4] = (uint8_t)(payload_len >> 8);
 
-        /* Insert the new task */
-        sked_task_t *new_task = &_tasks[insertion_index];
-        new_task->state = IDLE;
-        new_task->overruns = 0U;
-        new_task->misses = 0U;
-        new_task->period = period;
-        new_task->offset = offset;
-        new_task->priority = priority;
-        new_task->fcn = fcn;
-        /* NOTE: We start the count at the offset. This means that offset tasks
-         * will not become ready on the first tick. */
-        new_task->count = offset;
-
-        _task_count++;
-    } /* End of atomic block */
+    uint16_t s1 = 0U;
+    uint16_t s2 = 0U;
+    skedFletcher16(&_telemetry_buf[1], (uint16_t)(p - &_telemetry_buf[1]),
+            &s1, &s2);
+    *p++ = (uint8_t)s1;
+    *p++ = (uint8_t)s2;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        _telemetry_pos = 0U;
+        _telemetry_len = (uint16_t)(p - _telemetry_buf);
+    }
 
     return SKED_E_OK;
 }
 
 /**
- * Provides you with the current task count. Will return 0 out of reset or
- * after a call to reset().
- *
- * @return The number of tasks [0, SKED_MAX_TASKS]
+ * @return The number of telemetry bytes still waiting for idle() to send them
  */
-uint8_t Sked::getTaskCount(void) {
-    return _task_count;
-}
+uint16_t Sked::telemetryPending(void) {
+    uint16_t pending;
 
-/**
- * This started out being just for testing, but provides you with access to
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pending = _telemetry_len - _telemetry_pos;
+    }
+
+    return pending;
+}
+#endif /* #if (SKED_TELEMETRY == SKED_ON) */
+
+#if (SKED_LOG == SKED_ON)
+/**
+ * Select where log frames go.
+ *
+ * @param out  The stream to write frames to (e.g. &Serial). NULL stops log
+ * output, but messages are still queued (and dropped once the buffer fills).
+ * As with telemetryBegin(), a frame is only written once the stream's
+ * availableForWrite() has room for all of it.
+ */
+void Sked::logBegin(Print *out) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        _log_out = out;
+    }
+}
+
+/**
+ * Queue a log message. This is safe to call from any task (or ISR) because it
+ * never touches the UART: it copies the format ID and the raw argument bytes
+ * into a ring buffer and returns. idle() sends the queued messages as binary
+ * frames and tools/skeddecode.py turns them back into text.
+ *
+ * Declare IDs with SKED_LOG_FORMAT() so the decoder can find the format.
+ *
+ * @param id  The format ID. 0 (SKED_LOG_ID_DROPPED) is reserved.
+ * @param args  The arguments packed in the order of the format conversions.
+ * May be NULL if len is 0.
+ * @param len  The number of argument bytes [0, SKED_LOG_MAX_ARGS]
+ *
+ * @return SKED_E_OK - The message was queued
+ *         SKED_E_INVALID_OPERATION - Too many argument bytes
+ *         SKED_E_BUSY - The buffer is full. The message was dropped and
+ *         counted (see getLogDropped()).
+ */
+int8_t Sked::logMsg(uint8_t id, const void *args, uint8_t len) {
+    const uint8_t *a = (const uint8_t *)args;
+    int8_t ret = SKED_E_OK;
+
+    if (len > SKED_LOG_MAX_ARGS) {
+        return SKED_E_INVALID_OPERATION;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        /* Head and tail run freely and are masked on use, so the difference
+         * is always the number of bytes queued. */
+        uint8_t used = (uint8_t)(_log_head - _log_tail);
+
+        if ((uint8_t)(SKED_LOG_BUF_SIZE - used) < (uint8_t)(len + 2U)) {
+            _log_dropped++;
+            ret = SKED_E_BUSY;
+        } else {
+            _log_buf[_log_head++ & (SKED_LOG_BUF_SIZE - 1U)] = id;
+            _log_buf[_log_head++ & (SKED_LOG_BUF_SIZE - 1U)] = len;
+            for (uint8_t i = 0; i < len; i++) {
+                _log_buf[_log_head++ & (SKED_LOG_BUF_SIZE - 1U)] = a[i];
+            }
+        }
+    } /* End of atomic block */
+
+    return ret;
+}
+
+/**
+ * @return The number of log messages dropped because the buffer was full.
+ * Wraps at 65535.
+ */
+uint16_t Sked::getLogDropped(void) {
+    uint16_t dropped;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        dropped = _log_dropped;
+    }
+
+    return dropped;
+}
+
+/**
+ * Take one message off the ring buffer and write it out as a log frame. Once
+ * the buffer is drained, any new drops are reported with a
+ * SKED_LOG_ID_DROPPED message carrying the running drop count. With
+ * SKED_TX_ROOM, a message stays in the buffer until the stream has room for
+ * its whole frame, so write() never waits.
+ */
+void Sked::logSendOne(void) {
+    uint8_t frame[SKED_FRAME_OVERHEAD + 1U + SKED_LOG_MAX_ARGS];
+    uint8_t *p = &frame[5];
+    bool have_msg = false;
+#if (SKED_TX_ROOM == SKED_ON)
+    int room = _log_out->availableForWrite();
+#else
+    /* No way to ask, so count on the largest frame fitting */
+    int room = (int)sizeof(frame);
+#endif
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_log_head != _log_tail) {
+            uint8_t len = _log_buf[(uint8_t)(_log_tail + 1U)
+                & (SKED_LOG_BUF_SIZE - 1U)];
+
+            if (room >= (int)(SKED_FRAME_OVERHEAD + 1U + len)) {
+                *p++ = _log_buf[_log_tail++ & (SKED_LOG_BUF_SIZE - 1U)];
+                _log_tail++;
+                for (uint8_t i = 0; i < len; i++) {
+                    *p++ = _log_buf[_log_tail++ & (SKED_LOG_BUF_SIZE - 1U)];
+                }
+                have_msg = true;
+            }
+        } else if (_log_dropped != _log_dropped_reported
+                && room >= (int)(SKED_FRAME_OVERHEAD + 3U)) {
+            _log_dropped_reported = _log_dropped;
+            *p++ = SKED_LOG_ID_DROPPED;
+            *p++ = (uint8_t)(_log_dropped_reported);
+            *p++ = (uint8_t)(_log_dropped_reported >> 8);
+            have_msg = true;
+        }
+    } /* End of atomic block */
+
+    if (!have_msg) {
+        return;
+    }
+
+    uint8_t payload_len = (uint8_t)(p - &frame[5]);
+    frame[0] = SKED_FRAME_SYNC;
+    frame[1] = SKED_FRAME_LOG;
+    frame[2] = SKED_LOG_VERSION;
+    frame[3] = payload_len;
+    frame[4] = 0U;
+
+    uint16_t s1 = 0U;
+    uint16_t s2 = 0U;
+    skedFletcher16(&frame[1], (uint16_t)(p - &frame[1]), &s1, &s2);
+    *p++ = (uint8_t)s1;
+    *p++ = (uint8_t)s2;
+
+    _log_out->write(frame, (size_t)(p - frame));
+}
+#endif /* #if (SKED_LOG == SKED_ON) */
+
+/**
+ * Schedules a routine to be called at a given period, offset, and priority.
+ *
+ * @param period_us The period (time between successive calls) of the task
+ * in microseconds. It must be greater than 0, but less than the maximum
+ * and greater than the minimum (which are timer and platform dependent).
+ * On the Uno, the max is ~65.5 seconds and the minimum is 100 us.
+ * with TIMER1.
+ * @param offset_us The offset (time to wait before executing the first task)
+ * in microseconds. You can use this to make it so two tasks won't occur at
+ * the same time even though they have the same period. The period may be 0,
+ * but it if it's greather than 0, it should be greater than the minimum
+ * period.
+ * @param priority  This is an indicator of task priority. The higher this
+ * value, the higher the priority of the task. If there are two tasks that
+ * could run at the same time, the one with the higher priority is chosen. The
+ * minimum valid priority is SKED_MIN_PRIORITY (-128 is reserved).
+ * @param fcn  A pointer to a void (void) function (sked_task_fcn_t). Should
+ * not be null.
+ *
+ * @return SKED_E_OK - The task was scheduled successfully
+ *         SKED_E_NOT_INITIALIZED - you should call init() first
+ *         SKED_E_TOO_MANY_TASKS - you can't have too many tasks (> SKED_MAX_TASKS)
+ *         SKED_E_INVALID_PERIOD - The period isn't valid
+ *         SKED_E_INVALID_OFFSET - The offset isn't valid
+ *         SKED_E_INVALID_PRIORITY - The priority is not valid
+ *         SKED_E_INVALID_FUNCTION - Your function pointer was null
+ */
+int8_t Sked::schedule(uint32_t period_us, uint32_t offset_us, int8_t priority,
+        sked_task_fcn_t fcn) {
+    return scheduleTask(period_us, offset_us, priority, fcn, NULL);
+}
+
+/**
+ * schedule(), which also hands back where the task went in the table.
+ *
+ * @param index  Where to put the task's index, or NULL
+ */
+int8_t Sked::scheduleTask(uint32_t period_us, uint32_t offset_us,
+        int8_t priority, sked_task_fcn_t fcn, sked_index_t *index) {
+    uint16_t period;
+    uint16_t offset;
+    int8_t ret = SKED_E_OK;
+
+    /* Have to initialize first to get proper bounds */
+    if (_state == SKED_STATE_UNINIT) {
+        return SKED_E_NOT_INITIALIZED;
+    }
+
+    /* We may be full */
+    if (tableFull()) {
+        return SKED_E_TOO_MANY_TASKS;
+    }
+
+    /* Check period and offset:
+     *  Both must be less than the max and greater than the min (except for
+     *  the offset, which can be 0, but if it's greater than 0, it should be
+     *  greater than 100).
+     */
+    if (period_us > _max_period_us || period_us < _min_period_us) {
+        return SKED_E_INVALID_PERIOD;
+    }
+
+    if (offset_us > _max_period_us
+            || (offset_us > 0 && offset_us < _min_period_us)) {
+        return SKED_E_INVALID_OFFSET;
+    }
+
+    /* Priority needs to be > -127 (which we use to designate the lowest
+     * possible priority)
+     */
+    if (priority <= (int8_t)SKED_MIN_PRIORITY) {
+        return SKED_E_INVALID_PRIORITY;
+    }
+
+    /* Task function cannot be NULL */
+    if (fcn == (sked_task_fcn_t)NULL) {
+        return SKED_E_INVALID_FUNCTION;
+    }
+
+    /* Convert period and offset to ticks of the timer ISR */
+    period = period_us / (uint32_t)(SKED_TIMER1_TICK_PERIOD_US);
+    offset = offset_us / (uint32_t)(SKED_TIMER1_TICK_PERIOD_US);
+
+    /* Make sure to disable interrupts lest we get a tick interrupt right as
+     * we're adding a new task. */
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+#if (SKED_HOST == SKED_ON)
+        /* Another thread may have taken the last slot (or post() node)
+         * since */
+        if (tableFull()) {
+            ret = SKED_E_TOO_MANY_TASKS;
+            break;
+        }
+#endif
+        sked_index_t i = insertTask(period, offset, priority, fcn);
+        if (index != NULL) {
+            *index = i;
+        }
+    } /* End of atomic block */
+
+    return ret;
+}
+
+/**
+ * @return Whether the table has no room for another task
+ */
+bool Sked::tableFull(void) {
+#if (SKED_HOST == SKED_ON)
+    return _tasks == NULL || (_host_free == SKED_INDEX_NONE
+        && _task_count >= SKED_HOST_MAX_TASKS) || hostPostFull(1U);
+#else
+    return _task_count >= SKED_MAX_TASKS;
+#endif
+}
+
+/**
+ * Adds a task to the table, keeping it sorted. Called by schedule() once the
+ * arguments check out, with interrupts disabled.
+ *
+ * On the host, the table isn't sorted: the READY queues keep priority order
+ * instead (see hostReadyPush()), so a task takes the slot unschedule() last
+ * freed, or else the next one at the end, and keeps it.
+ *
+ * @return The index the task went in at
+ */
+sked_index_t Sked::insertTask(uint16_t period, uint16_t offset,
+        int8_t priority, sked_task_fcn_t fcn) {
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+    /* The new task's count starts from now, so bring the others up to
+     * date first */
+    releaseSync();
+#endif
+
+#if (SKED_HOST == SKED_ON)
+    /* No sorting: a task's index is its handle for as long as it's
+     * scheduled, so it takes a free slot and priority order is left to the
+     * READY queues */
+    sked_index_t insertion_index = hostSlotTake();
+#else
+    /* For now, we just do an insertion sort so that the _tasks array is
+     * always sorted first by priority from highest to lowest and then
+     * secondarily by period from lowest to highest.
+     *
+     * This prioritizes run-time speed over initialization time speed,
+     * which is a pretty sane choice for a scheduler. It means that we can
+     * always just walk the array of tasks and execute those that are in a
+     * ready state.
+     *
+     * We could change this to a full re-sort later if we find we want
+     * to change priorities on the fly (not just on insertion) */
+    uint8_t insertion_index = _task_count;
+    for (sked_index_t i = 0; i < _task_count; i++) {
+        sked_task_t *task = &_tasks[i];
+
+        if (task->priority < priority) {
+            /* This is where we need to insert */
+            insertion_index = i;
+            break;
+        } else if (task->priority == priority) {
+            /* Sort by lowest period having higher priority amongst tasks
+             * that have the same priority. */
+            insertion_index = i;
+            for (uint8_t j = i; j < _task_count
+                    && _tasks[j].priority == priority; j++) {
+                if (period < _tasks[j].period) {
+                    insertion_index = j;
+                    break;
+                }
+            }
+        }
+    }
+
+    /* Move tasks down to make room if needed */
+    if (_task_count > 0) {
+        for (int16_t i = _task_count-1; i >= insertion_index; i--) {
+            _tasks[i+1] = _tasks[i];
+        }
+    }
+    _task_count++;
+#endif
+
+    initTask(insertion_index, period, offset, priority, fcn);
+
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+    releaseSync();
+#endif
+#if (SKED_HOST == SKED_ON)
+    /* It may be due before the tick thread next wakes up */
+    hostArmWake(false);
+    /* Monitors see the new task */
+    if (hostShmHeader()) {
+        hostShmTask(insertion_index, false);
+    }
+#endif
+
+    return insertion_index;
+}
+
+/**
+ * Fills in slot i for a new task, with its count at the offset and
+ * statistics at 0. With interrupts disabled.
+ */
+void Sked::initTask(sked_index_t i, uint16_t period, uint16_t offset,
+        int8_t priority, sked_task_fcn_t fcn) {
+    sked_task_t *new_task = &_tasks[i];
+
+    new_task->state = IDLE;
+    new_task->overruns = 0U;
+    new_task->misses = 0U;
+    new_task->activations = 0U;
+    new_task->completions = 0U;
+    new_task->last_miss_tick = 0U;
+    new_task->last_overrun_tick = 0U;
+    new_task->max_exec_us = 0U;
+#if (SKED_LATE_HOOKS == SKED_ON)
+    new_task->late_hook = NULL;
+#endif
+    new_task->flags = 0U;
+    new_task->period = period;
+    new_task->offset = offset;
+    new_task->priority = priority;
+    new_task->fcn = fcn;
+    /* NOTE: We start the count at the offset. This means that offset tasks
+     * will not become ready on the first tick. */
+#if (SKED_HOST != SKED_ON)
+    new_task->count = offset;
+#else
+    /* Counts run from the last tick timerISR() saw, which a tickless tick
+     * thread may not have caught up with yet */
+    uint32_t count = offset + hostTickLag();
+    _counts[i] = (count > 0xFFFFU) ? 0xFFFFU : (uint16_t)count;
+    new_task->slack = 0U;
+    new_task->last_exec_us = 0U;
+    new_task->total_exec_us = 0U;
+    for (uint8_t b = 0; b < SKED_LATENCY_BUCKETS; b++) {
+        new_task->exec_hist[b] = 0U;
+    }
+    new_task->host_flags = 0U;
+    new_task->arg = NULL;
+    new_task->ready_next = SKED_INDEX_NONE;
+    new_task->ready_prev = SKED_INDEX_NONE;
+    hostPostLink(i);
+#endif
+}
+
+/**
+ * Provides you with the current task count. Will return 0 out of reset or
+ * after a call to reset().
+ *
+ * On the host, it's the number of slots in the table, which includes any
+ * that unschedule() freed and nothing has taken since.
+ *
+ * @return The number of tasks [0, SKED_MAX_TASKS], or on the host (where
+ * sked_index_t is 32 bits) [0, SKED_HOST_MAX_TASKS]
+ */
+sked_index_t Sked::getTaskCount(void) {
+    return _task_count;
+}
+
+/**
+ * This started out being just for testing, but provides you with access to
  * the underlying task structure. Don't make any changes unless you know what
  * you're doing.
  *
- * Keep in mind that when new tasks are added, they're insertion sorted. That
- * means higher indexes in the table mean lower priority tasks.
+ * On AVR, keep in mind that when new tasks are added, they're insertion
+ * sorted. That means higher indexes in the table mean lower priority tasks,
+ * and a task's index moves when a higher priority one is added.
+ *
+ * On the host, the table isn't sorted. A task keeps the index it was given
+ * for as long as it's scheduled: the slot unschedule() last freed, or else
+ * the next one at the end of the table.
  *
  * @param task_index The index of the task you want [0, getTaskCount())
  *
  * @return A pointer to the task structure at that index or NULL if there is
  * no such task
  */
-sked_task_t *Sked::getTaskInfo(uint8_t task_index) {
-    if (task_index < _task_count) {
-        return &_tasks[task_index];
-    } else {
+sked_task_t *Sked::getTaskInfo(sked_index_t task_index) {
+    if (task_index >= _task_count) {
+        return NULL;
+    }
+#if (SKED_HOST == SKED_ON)
+    if (_tasks[task_index].host_flags & SKED_HOST_TASK_FREE) {
         return NULL;
     }
+#endif
+
+    return &_tasks[task_index];
+}
+
+/**
+ * Zero every task's statistics (misses, overruns, activations, completions,
+ * last miss/overrun ticks and execution times) in one go, so that counts
+ * read at the end of a monitoring window all cover the same window.
+ */
+void Sked::resetStats(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            sked_task_t *task = &_tasks[i];
+
+            task->misses = 0U;
+            task->overruns = 0U;
+            task->activations = 0U;
+            task->completions = 0U;
+            task->last_miss_tick = 0U;
+            task->last_overrun_tick = 0U;
+            task->max_exec_us = 0U;
+#if (SKED_HOST == SKED_ON)
+            task->last_exec_us = 0U;
+            task->total_exec_us = 0U;
+            for (uint8_t b = 0; b < SKED_LATENCY_BUCKETS; b++) {
+                task->exec_hist[b] = 0U;
+            }
+#endif
+        }
+#if (SKED_HOST == SKED_ON)
+        hostShmPublish();
+#endif
+    } /* End of atomic block */
+}
+
+/**
+ * @return The number of ticks since reset(). Each tick is 100us.
+ */
+uint32_t Sked::getTicks(void) {
+    uint32_t ticks;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ticks = _ticks;
+    }
+
+    return ticks;
 }
 
 /**
@@ -493,6 +1511,13 @@ sked_task_t *Sked::getTaskInfo(uint8_t task_index) {
  * useful. This resets the internal structure
  */
 void Sked::reset(void) {
+#if (SKED_HOST == SKED_ON)
+    /* The threads need the lock to finish, so stop them before taking it */
+    hostStop();
+    hostPostReset();
+    hostCoroReset();
+#endif
+
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
         /* Don't bother to initialize any of the task slots because _task_count
          * determines which are valid. */
@@ -502,7 +1527,82 @@ void Sked::reset(void) {
         _state = SKED_STATE_UNINIT;
         _current_task_priority = SKED_MIN_PRIORITY;
         _mode = SKED_MODE_PREEMPTIVE;
+        _ticks = 0U;
+        _dispatch_depth = 0U;
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+        _release_in = 0xFFFFU;
+        _release_span = 0xFFFFU;
+#endif
+#if (SKED_LATE_HOOKS == SKED_ON)
+        _late_pending = false;
+        _late_running = false;
+#endif
+#if (SKED_WATCHDOG == SKED_ON)
+        _abort_frame = NULL;
+        _wdt_stage = 0U;
+        _wdt_abort_requested = false;
+        _wdt_aborts = 0U;
+        if (_wdt_enabled) {
+            wdt_disable();
+            _wdt_enabled = false;
+        }
+#endif
+#if (SKED_POSTMORTEM == SKED_ON)
+        _trace_head = 0U;
+        for (uint8_t i = 0; i < SKED_TRACE_LEN; i++) {
+            _trace[i].event = 0U;
+        }
+        _pm_armed = true;
+        _pm_requested = false;
+        _pm_reason = SKED_PM_REASON_OVERRUN;
+        _pm_saving = false;
+        _pm_progress = 0U;
+#endif
+        _max_preempt_depth = SKED_MAX_PREEMPT_DEPTH;
+        _preempt_deferrals = 0U;
+#if (SKED_STACK_MONITOR == SKED_ON)
+        for (uint8_t i = 0; i < SKED_STACK_LEVELS; i++) {
+            _stack_levels[i].min_sp = 0xFFFFU;
+        }
+        _stack_paint_low = NULL;
+        _stack_paint_high = NULL;
+#endif
+#if (SKED_TELEMETRY == SKED_ON)
+        _telemetry_out = NULL;
+        _telemetry_len = 0U;
+        _telemetry_pos = 0U;
+#if (SKED_HOST == SKED_ON)
+        _telemetry_next = 0U;
+#endif
+#endif
+#if (SKED_LOG == SKED_ON)
+        _log_out = NULL;
+        _log_head = 0U;
+        _log_tail = 0U;
+        _log_dropped = 0U;
+        _log_dropped_reported = 0U;
+#endif
+
+#if (SKED_HOST == SKED_ON)
+        /* Every slot is free to take from the end again, and nothing is
+         * READY */
+        _host_free = SKED_INDEX_NONE;
+        _host_live = 0U;
+        for (uint16_t q = 0; q < 256U; q++) {
+            _host_ready_head[q] = SKED_INDEX_NONE;
+            _host_ready_tail[q] = SKED_INDEX_NONE;
+        }
+        for (uint8_t w = 0; w < 4U; w++) {
+            _host_ready_map[w] = 0U;
+        }
+        _host_ready_count = 0U;
+#if (SKED_SNAPSHOT == SKED_ON)
+        _host_resume_ns = 0U;
+#endif
 
+        /* Monitors see the table go empty */
+        hostShmPublish();
+#else
         if (_clk_src == SKED_SRC_TIMER1) {
             /* Set Initial Timer value */
             TCNT1 = 0x0000U;
@@ -514,21 +1614,91 @@ void Sked::reset(void) {
             /* Clear any pending interrupt */
             TIFR1 = _BV(ICF1);
         }
+#endif
     } /* ATOMIC_BLOCK(ATOMIC_RESTORESTATE) */
 }
 
+/**
+ * The time since start() in microseconds, read from the tick count and the
+ * timer's current count. Must be called with interrupts disabled.
+ */
+uint32_t Sked::nowUs(void) {
+#if (SKED_HOST == SKED_ON)
+    return hostNowUs();
+#else
+    uint32_t ticks = _ticks;
+    uint16_t count = TCNT1;
+
+    /* The counter may have wrapped without the tick having been counted yet
+     * because interrupts are off. */
+    if ((TIFR1 & _BV(ICF1))
+            && count < (uint16_t)(SKED_TIMER1_TICKS_PER_PERIOD / 2)) {
+        ticks++;
+    }
+
+    return ticks * (uint32_t)SKED_TIMER1_TICK_PERIOD_US
+        + ((uint32_t)count * 8UL) / (F_CPU / 1000000UL);
+#endif
+}
+
+/**
+ * Limit how many tasks may be stacked on top of each other by preemption.
+ * Each level costs an interrupt frame plus the task's own stack, so this puts
+ * a hard bound on stack use no matter how releases bunch up. When the limit
+ * is reached, a higher priority task that becomes ready waits (still READY)
+ * until one of the running tasks finishes.
+ *
+ * Only meaningful in preemptive mode. reset() restores the compile-time
+ * default, SKED_MAX_PREEMPT_DEPTH.
+ *
+ * @param depth  The maximum number of nested tasks, or 0 for no limit
+ */
+void Sked::setMaxPreemptionDepth(uint8_t depth) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        _max_preempt_depth = depth;
+    }
+}
+
+/**
+ * @return The number of times a ready task was held back by the preemption
+ * depth limit (saturates at 65535)
+ */
+uint16_t Sked::getPreemptionDeferrals(void) {
+    uint16_t deferrals;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        deferrals = _preempt_deferrals;
+    }
+
+    return deferrals;
+}
+
 /**
  * Call this after init() and scheduling tasks to actually start executing
  * tasks.
  *
+ * On the host backend this starts the tick thread and, in preemptive mode,
+ * the worker threads (see host/SkedHost.cpp).
+ *
  * @return SKED_E_OK - Sked was successfully started
  *         SKED_E_NOT_INITIALIZED - You have not called init()
+ *         SKED_E_INVALID_OPERATION - The host backend couldn't start its
+ *         threads
  */
 int8_t Sked::start(void) {
     if (_state == SKED_STATE_UNINIT) {
         return SKED_E_NOT_INITIALIZED;
     }
 
+#if (SKED_STACK_MONITOR == SKED_ON)
+    stackPaint();
+#endif
+
+#if (SKED_HOST == SKED_ON)
+    if (_clk_src == SKED_SRC_MONOTONIC) {
+        return hostStart();
+    }
+#else
     if (_clk_src == SKED_SRC_TIMER1) {
         /* Set Initial Timer value */
         TCNT1 = 0x0000U;
@@ -540,17 +1710,945 @@ int8_t Sked::start(void) {
          * TIMSK1.ICIE1 */
         TIMSK1 = _BV(ICIE1);
     }
+#endif
 
     return SKED_E_OK;
 }
 
+#if (SKED_WATCHDOG == SKED_ON)
+/**
+ * Mark a task as critical (or not). The watchdog is only fed while every
+ * critical task keeps finishing each job before its next release, so a
+ * critical task that wedges or keeps overrunning sets off the recovery
+ * stages described in watchdogEnable(). The mark stays with the task when
+ * tasks added later move it to another index.
+ *
+ * @param fcn  The task's function, as passed to schedule()
+ * @param critical  true to make the task critical
+ *
+ * @return SKED_E_OK - The task was updated
+ *         SKED_E_INVALID_FUNCTION - No task runs that function
+ */
+int8_t Sked::setCritical(sked_task_fcn_t fcn, bool critical) {
+    int8_t ret = SKED_E_INVALID_FUNCTION;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            if (_tasks[i].fcn == fcn) {
+                if (critical) {
+                    _tasks[i].flags |= SKED_TASK_CRITICAL;
+                } else {
+                    _tasks[i].flags &= ~(SKED_TASK_CRITICAL | SKED_TASK_FED);
+                }
+                ret = SKED_E_OK;
+            }
+        }
+    } /* End of atomic block */
+
+    return ret;
+}
+
+/**
+ * Hand the AVR watchdog over to Sked. Sked feeds it only while every
+ * critical task (see setCritical()) finishes within its period. If the
+ * watchdog times out anyway, recovery escalates one stage per timeout:
+ *
+ *   1. Abort: the overrunning task is abandoned where it stands and the
+ *      scheduler carries on from where it dispatched it.
+ *   2. Shed load: every non-critical task stops being released, and (with
+ *      SKED_POSTMORTEM) idle() is asked to save a post-mortem snapshot.
+ *   3. Reset: nothing is released or feeds the watchdog any more, and the
+ *      next timeout resets the board, once the snapshot is written if idle()
+ *      is still writing it.
+ *
+ * A wedged task is therefore dealt with within three timeouts. The first two
+ * stages are undone (shed tasks released again) as soon as the watchdog is
+ * fed.
+ *
+ * @param timeout  One of the WDTO_* values from <avr/wdt.h>. Must be longer
+ * than the period of every critical task.
+ *
+ * @return SKED_E_OK - The watchdog is running
+ *         SKED_E_NOT_INITIALIZED - You have not called init()
+ *         SKED_E_INVALID_OPERATION - There are no critical tasks
+ *         SKED_E_INVALID_PERIOD - A critical task's period is longer than
+ *         the timeout, so it could never feed the watchdog in time
+ */
+int8_t Sked::watchdogEnable(uint8_t timeout) {
+    if (_state == SKED_STATE_UNINIT) {
+        return SKED_E_NOT_INITIALIZED;
+    }
+
+    /* The watchdog runs at roughly 16ms << timeout */
+    uint32_t timeout_ticks = (16000UL << timeout)
+        / (uint32_t)SKED_TIMER1_TICK_PERIOD_US;
+    bool critical = false;
+    for (sked_index_t i = 0; i < _task_count; i++) {
+        if (_tasks[i].flags & SKED_TASK_CRITICAL) {
+            if (_tasks[i].period >= timeout_ticks) {
+                return SKED_E_INVALID_PERIOD;
+            }
+            critical = true;
+        }
+    }
+
+    if (!critical) {
+        return SKED_E_INVALID_OPERATION;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            _tasks[i].flags &= ~SKED_TASK_FED;
+        }
+        _wdt_stage = 0U;
+        _wdt_abort_requested = false;
+
+        /* Interrupt and system reset mode: the first timeout interrupts us
+         * and clears WDIE, the next one resets unless we set WDIE again. */
+        wdt_reset();
+        MCUSR &= ~_BV(WDRF);
+        WDTCSR = _BV(WDCE) | _BV(WDE);
+        WDTCSR = _BV(WDIE) | _BV(WDE)
+            | ((timeout & 0x08U) ? _BV(WDP3) : 0U) | (timeout & 0x07U);
+
+        _wdt_enabled = true;
+    } /* End of atomic block */
+
+    return SKED_E_OK;
+}
+
+/**
+ * Give the watchdog back. Anything shed is released again.
+ */
+void Sked::watchdogDisable(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        wdt_disable();
+        _wdt_enabled = false;
+        _wdt_abort_requested = false;
+        _wdt_stage = 0U;
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            _tasks[i].flags &= ~SKED_TASK_SHED;
+        }
+    } /* End of atomic block */
+}
+
+/**
+ * @return The current recovery stage (0 when all is well)
+ */
+uint8_t Sked::getWatchdogStage(void) {
+    return _wdt_stage;
+}
+
+/**
+ * @return The number of tasks the watchdog has aborted (saturates at 65535)
+ */
+uint16_t Sked::getWatchdogAborts(void) {
+    uint16_t aborts;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        aborts = _wdt_aborts;
+    }
+
+    return aborts;
+}
+
+/**
+ * Note that critical task i met its deadline and feed the watchdog once every
+ * critical task has since the last feed. Called from timerISR().
+ */
+void Sked::watchdogFeed(uint8_t i) {
+    _tasks[i].flags |= SKED_TASK_FED;
+
+    /* Past the last stage, it's left to reset the board */
+    if (!_wdt_enabled || _wdt_stage > 2U) {
+        return;
+    }
+
+    for (sked_index_t j = 0; j < _task_count; j++) {
+        if ((_tasks[j].flags & (SKED_TASK_CRITICAL | SKED_TASK_FED))
+                == SKED_TASK_CRITICAL) {
+            return;
+        }
+    }
+
+    wdt_reset();
+    for (sked_index_t j = 0; j < _task_count; j++) {
+        _tasks[j].flags &= ~SKED_TASK_FED;
+    }
+
+    if (_wdt_stage != 0U) {
+        /* Recovered: undo the stages */
+        _wdt_stage = 0U;
+        _wdt_abort_requested = false;
+        for (sked_index_t j = 0; j < _task_count; j++) {
+            _tasks[j].flags &= ~SKED_TASK_SHED;
+        }
+    }
+}
+
+/**
+ * Called when the watchdog times out. Moves on to the next recovery stage.
+ */
+void Sked::watchdogISR(void) {
+    _wdt_stage++;
+
+    if (_wdt_stage == 1U) {
+        /* timerISR() does the abort once it sees the late task */
+        _wdt_abort_requested = true;
+        WDTCSR |= _BV(WDIE);
+    } else if (_wdt_stage == 2U) {
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            if (!(_tasks[i].flags & SKED_TASK_CRITICAL)) {
+                _tasks[i].flags |= SKED_TASK_SHED;
+            }
+        }
+#if (SKED_POSTMORTEM == SKED_ON)
+        /* The EEPROM is far too slow to write from here; idle() does it
+         * while the load is shed */
+        _pm_requested = true;
+        _pm_reason = SKED_PM_REASON_WATCHDOG;
+        _wdt_pm_progress = _pm_progress;
+#endif
+        WDTCSR |= _BV(WDIE);
+    } else {
+#if (SKED_POSTMORTEM == SKED_ON)
+        /* Give a snapshot that's being written another timeout, for as long
+         * as it keeps getting further, so the reset doesn't cut it short */
+        if (_pm_saving && _pm_progress != _wdt_pm_progress) {
+            _wdt_pm_progress = _pm_progress;
+            _wdt_stage--;
+            WDTCSR |= _BV(WDIE);
+            return;
+        }
+#endif
+        /* WDIE is now clear, so the next timeout resets the board. Rather
+         * than wait for it in here, holding off every other interrupt,
+         * return to a scheduler that has stopped: nothing is released any
+         * more, and watchdogFeed() no longer calls wdt_reset() */
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            _tasks[i].flags |= SKED_TASK_SHED;
+        }
+    }
+}
+
+/**
+ * ISR - Watchdog timeout
+ */
+ISR(WDT_vect) {
+    sked.watchdogISR();
+}
+#endif /* #if (SKED_WATCHDOG == SKED_ON) */
+
+#if (SKED_POSTMORTEM == SKED_ON)
+/* Each EEPROM slot holds a marker byte, the snapshot and a Fletcher-16 of
+ * both. */
+#define SKED_PM_MAGIC 0x5DU
+#define SKED_PM_SLOT_SIZE (1U + sizeof(sked_pm_snapshot_t) + 2U)
+#ifndef SKED_PM_EEPROM_BASE
+#define SKED_PM_EEPROM_BASE (E2END + 1U - (SKED_PM_SLOTS * SKED_PM_SLOT_SIZE))
+#endif
+
+/* A compile-time check the AVR toolchain's C++03 takes: the build fails
+ * with a negative array size, in a typedef named after the problem, when
+ * cond is false */
+#define SKED_STATIC_ASSERT(cond, name) typedef char name[(cond) ? 1 : -1]
+
+/* Otherwise the base wraps round and the slots land on whatever the
+ * application keeps at the bottom of EEPROM */
+SKED_STATIC_ASSERT(SKED_PM_SLOTS * SKED_PM_SLOT_SIZE <= E2END + 1UL,
+    sked_pm_slots_dont_fit_in_eeprom_lower_SKED_PM_SLOTS_or_SKED_MAX_TASKS);
+SKED_STATIC_ASSERT((uint32_t)SKED_PM_EEPROM_BASE
+    + SKED_PM_SLOTS * SKED_PM_SLOT_SIZE <= E2END + 1UL,
+    sked_pm_eeprom_base_leaves_no_room_for_the_slots);
+
+/**
+ * @return A statistic cut down to 16 bits for a snapshot, saturating
+ */
+static uint16_t skedPmStat(uint32_t value) {
+    return (value > 0xFFFFUL) ? 0xFFFFU : (uint16_t)value;
+}
+
+/**
+ * Add an event to the trace ring. Must be called with interrupts disabled.
+ */
+void Sked::trace(uint8_t event, uint8_t task) {
+    sked_trace_event_t *e = &_trace[_trace_head++ & (SKED_TRACE_LEN - 1U)];
+
+    e->tick = (uint16_t)_ticks;
+    e->event = event;
+    e->task = task;
+}
+
+/**
+ * Checks one EEPROM slot and returns its sequence number if it holds a
+ * complete snapshot.
+ */
+static bool skedPmSlotValid(uint16_t addr, uint16_t *seq) {
+    uint16_t s1 = 0U;
+    uint16_t s2 = 0U;
+    uint8_t b;
+
+    if (EEPROM.read(addr) != SKED_PM_MAGIC) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < SKED_PM_SLOT_SIZE - 2U; i++) {
+        b = EEPROM.read(addr + i);
+        skedFletcher16(&b, 1U, &s1, &s2);
+    }
+
+    if (EEPROM.read(addr + SKED_PM_SLOT_SIZE - 2U) != (uint8_t)s1
+            || EEPROM.read(addr + SKED_PM_SLOT_SIZE - 1U) != (uint8_t)s2) {
+        return false;
+    }
+
+    /* seq follows the marker and the version byte */
+    *seq = EEPROM.read(addr + 2U) | ((uint16_t)EEPROM.read(addr + 3U) << 8);
+    return true;
+}
+
+/**
+ * Finds the slot holding the newest complete snapshot.
+ *
+ * @return The slot index, or SKED_PM_SLOTS if there is none
+ */
+static uint8_t skedPmNewestSlot(uint16_t *newest_seq) {
+    uint8_t newest = SKED_PM_SLOTS;
+    uint16_t seq;
+
+    for (uint8_t i = 0; i < SKED_PM_SLOTS; i++) {
+        if (skedPmSlotValid(SKED_PM_EEPROM_BASE + i * SKED_PM_SLOT_SIZE,
+                    &seq)) {
+            /* Sequence numbers wrap, so compare by difference */
+            if (newest == SKED_PM_SLOTS
+                    || (int16_t)(seq - *newest_seq) > 0) {
+                newest = i;
+                *newest_seq = seq;
+            }
+        }
+    }
+
+    return newest;
+}
+
+static void skedEepromUpdate(uint16_t addr, uint8_t value) {
+    /* Writes are slow and wear the cell, so skip unchanged bytes */
+    if (EEPROM.read(addr) != value) {
+        EEPROM.write(addr, value);
+    }
+}
+
+/**
+ * Save the task statistics and the tail of the trace to EEPROM so they
+ * survive a reset. Called automatically from idle() after the first overrun
+ * (once per reset()), and once the watchdog starts shedding load.
+ *
+ * Snapshots go round-robin through SKED_PM_SLOTS slots to spread the wear.
+ * The slot being written is invalidated first and only marked valid once its
+ * checksum is in place, so losing power part way through leaves the
+ * previous snapshot intact.
+ *
+ * EEPROM writes take a few milliseconds per byte, so this can take hundreds
+ * of milliseconds, and the snapshot is built on the stack (see
+ * sizeof(sked_pm_snapshot_t)). Only call it from the background.
+ *
+ * @param reason  SKED_PM_REASON_* (or anything of your own above those)
+ *
+ * @return SKED_E_OK - The snapshot was saved
+ */
+int8_t Sked::saveSnapshot(uint8_t reason) {
+    sked_pm_snapshot_t snap;
+    uint16_t seq = 0U;
+    uint8_t slot = skedPmNewestSlot(&seq);
+
+    /* Write over the oldest slot and never the newest */
+    if (slot == SKED_PM_SLOTS) {
+        slot = 0U;
+        seq = 0U;
+    } else {
+        slot = (slot + 1U) % SKED_PM_SLOTS;
+        seq++;
+    }
+
+    snap.version = SKED_PM_VERSION;
+    snap.seq = seq;
+    snap.reason = reason;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        snap.ticks = _ticks;
+        snap.task_count = _task_count;
+        for (uint8_t i = 0; i < SKED_MAX_TASKS; i++) {
+            sked_pm_task_t *t = &snap.tasks[i];
+
+            if (i < _task_count) {
+                t->priority = _tasks[i].priority;
+                t->period = _tasks[i].period;
+                t->misses = skedPmStat(_tasks[i].misses);
+                t->overruns = skedPmStat(_tasks[i].overruns);
+                t->activations = (uint16_t)_tasks[i].activations;
+                t->completions = (uint16_t)_tasks[i].completions;
+                t->last_miss_tick = _tasks[i].last_miss_tick;
+                t->last_overrun_tick = _tasks[i].last_overrun_tick;
+                t->max_exec_us = _tasks[i].max_exec_us;
+            } else {
+                memset(t, 0, sizeof(*t));
+            }
+        }
+
+        snap.trace_count = 0U;
+        for (uint8_t i = 0; i < SKED_TRACE_LEN; i++) {
+            sked_trace_event_t *e = &_trace[(uint8_t)(_trace_head + i)
+                & (SKED_TRACE_LEN - 1U)];
+
+            /* Unused entries have no event */
+            if (e->event != 0U) {
+                snap.trace[snap.trace_count++] = *e;
+            }
+        }
+        for (uint8_t i = snap.trace_count; i < SKED_TRACE_LEN; i++) {
+            memset(&snap.trace[i], 0, sizeof(snap.trace[i]));
+        }
+    } /* End of atomic block */
+
+    uint16_t addr = SKED_PM_EEPROM_BASE + slot * SKED_PM_SLOT_SIZE;
+    const uint8_t *p = (const uint8_t *)&snap;
+    uint8_t magic = SKED_PM_MAGIC;
+    uint16_t s1 = 0U;
+    uint16_t s2 = 0U;
+
+    /* Invalidate, write the body and checksum, then mark it valid */
+    _pm_saving = true;
+    skedEepromUpdate(addr, 0xFFU);
+    skedFletcher16(&magic, 1U, &s1, &s2);
+    for (uint16_t i = 0; i < sizeof(snap); i++) {
+        skedEepromUpdate(addr + 1U + i, p[i]);
+        _pm_progress++;
+    }
+    skedFletcher16(p, sizeof(snap), &s1, &s2);
+    skedEepromUpdate(addr + SKED_PM_SLOT_SIZE - 2U, (uint8_t)s1);
+    skedEepromUpdate(addr + SKED_PM_SLOT_SIZE - 1U, (uint8_t)s2);
+    skedEepromUpdate(addr, SKED_PM_MAGIC);
+    _pm_saving = false;
+
+    return SKED_E_OK;
+}
+
+/**
+ * Read back the newest snapshot saved by saveSnapshot(), e.g. in setup()
+ * after an unexpected reset.
+ *
+ * @param snap  Where to put the snapshot
+ *
+ * @return SKED_E_OK - snap holds the newest snapshot
+ *         SKED_E_NO_DATA - There is no valid snapshot in EEPROM
+ */
+int8_t Sked::loadSnapshot(sked_pm_snapshot_t *snap) {
+    uint16_t seq;
+    uint8_t slot = skedPmNewestSlot(&seq);
+
+    if (slot == SKED_PM_SLOTS) {
+        return SKED_E_NO_DATA;
+    }
+
+    uint16_t addr = SKED_PM_EEPROM_BASE + slot * SKED_PM_SLOT_SIZE + 1U;
+    uint8_t *p = (uint8_t *)snap;
+    for (uint16_t i = 0; i < sizeof(*snap); i++) {
+        p[i] = EEPROM.read(addr + i);
+    }
+
+    if (snap->version != SKED_PM_VERSION) {
+        return SKED_E_NO_DATA;
+    }
+
+    return SKED_E_OK;
+}
+#endif /* #if (SKED_POSTMORTEM == SKED_ON) */
+
+#if (SKED_SNAPSHOT == SKED_ON)
+/**
+ * Running Adler-32 of a snapshot, which runs to megabytes on the host, too
+ * much for Fletcher-16. Start sum at 1.
+ */
+static void skedAdler32(const uint8_t *data, size_t len, uint32_t *sum) {
+    uint32_t a = *sum & 0xFFFFU;
+    uint32_t b = *sum >> 16;
+
+    while (len > 0U) {
+        /* The most bytes that can be summed before b could overflow */
+        size_t n = (len < 5552U) ? len : 5552U;
+
+        len -= n;
+        while (n-- > 0U) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521UL;
+        b %= 65521UL;
+    }
+
+    *sum = (b << 16) | a;
+}
+
+/**
+ * @return The size of a snapshot of task_count tasks
+ */
+static size_t skedSnapSize(uint32_t task_count) {
+    size_t each = sizeof(sked_task_t);
+
+#if (SKED_HOST == SKED_ON)
+    each += sizeof(uint16_t);
+#endif
+
+    return sizeof(sked_snap_header_t) + (size_t)task_count * each;
+}
+
+/**
+ * @return The checksum of a snapshot, which covers everything but the
+ * checksum itself
+ */
+static uint32_t skedSnapChecksum(const uint8_t *snap, size_t len) {
+    sked_snap_header_t header;
+    uint32_t sum = 1U;
+
+    memcpy(&header, snap, sizeof(header));
+    header.checksum = 0U;
+    skedAdler32((const uint8_t *)&header, sizeof(header), &sum);
+    skedAdler32(snap + sizeof(header), len - sizeof(header), &sum);
+
+    return sum;
+}
+
+/**
+ * @return How big a buffer snapshot() needs for the tasks there are now
+ */
+size_t Sked::snapshotSize(void) {
+    size_t size;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        size = skedSnapSize(_task_count);
+    }
+
+    return size;
+}
+
+/**
+ * Save the whole task table, counts, phases and statistics and all, for
+ * restore() to carry on from after a restart: of the host process, or of an
+ * AVR that keeps buf somewhere a soft reset leaves alone (.noinit RAM, or
+ * EEPROM). The snapshot is the table as it is in memory, so it's only good
+ * for the same build of the same program.
+ *
+ * Jobs that are READY or running aren't kept; after restore(), each task is
+ * next released on its period. On the host, task functions are kept as
+ * offsets into the program, which is loaded somewhere else each run, so
+ * they must be in the program itself and not a shared library, and
+ * scheduleArg() args aren't kept at all (see setArg()).
+ *
+ * The table is copied with interrupts disabled, which holds up the tick for
+ * as long as that takes: on the order of 10 ms for 100k tasks on the host.
+ *
+ * @param buf  Where to write the snapshot
+ * @param size  Bytes at buf (see snapshotSize())
+ * @param len  Where to put the size of the snapshot, or of the buffer it
+ * needs if buf is too small, or NULL
+ *
+ * @return SKED_E_OK - buf holds the snapshot
+ *         SKED_E_NOT_INITIALIZED - You have not called init()
+ *         SKED_E_TOO_MANY_TASKS - buf is too small for the tasks there are
+ *         SKED_E_INVALID_OPERATION - There are tasks from scheduleFd() or
+ *         spawn(), whose fds and coroutines don't outlive the process
+ *         SKED_E_INVALID_FUNCTION - A task function isn't in the program
+ */
+int8_t Sked::snapshot(void *buf, size_t size, size_t *len) {
+    uint8_t *p = (uint8_t *)buf;
+    sked_snap_header_t header;
+    size_t snap_size = 0U;
+    int8_t ret = SKED_E_OK;
+
+    if (_state == SKED_STATE_UNINIT) {
+        return SKED_E_NOT_INITIALIZED;
+    }
+
+    /* No stray bytes in the padding, as it's checksummed */
+    memset(&header, 0, sizeof(header));
+    header.magic = SKED_SNAP_MAGIC;
+    header.version = SKED_SNAP_VERSION;
+    header.task_size = sizeof(sked_task_t);
+    header.mode = (uint8_t)_mode;
+#if (SKED_HOST == SKED_ON)
+    memcpy(header.build_id, _host_build_id, sizeof(header.build_id));
+#endif
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        snap_size = skedSnapSize(_task_count);
+        if (buf == NULL || size < snap_size) {
+            ret = SKED_E_TOO_MANY_TASKS;
+            break;
+        }
+
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+        releaseSync();
+#endif
+        header.task_count = _task_count;
+        header.ticks = _ticks;
+#if (SKED_HOST == SKED_ON)
+        header.tick_ns = hostTickNs();
+#endif
+
+        /* buf needn't be aligned, so each task goes by way of a copy */
+        uint8_t *out = p + sizeof(header);
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            sked_task_t task = _tasks[i];
+
+            if (task.flags & (SKED_TASK_EVENT | SKED_TASK_CORO)) {
+                ret = SKED_E_INVALID_OPERATION;
+                break;
+            }
+#if (SKED_HOST == SKED_ON)
+            if (!(task.host_flags & SKED_HOST_TASK_FREE)) {
+                uintptr_t fcn = (uintptr_t)task.fcn;
+
+                if (!hostCodeOut(&fcn)) {
+                    ret = SKED_E_INVALID_FUNCTION;
+                    break;
+                }
+                task.fcn = (sked_task_fcn_t)fcn;
+            }
+#if (SKED_LATE_HOOKS == SKED_ON)
+            if (task.host_flags & SKED_HOST_TASK_FREE) {
+                task.late_hook = NULL;
+            } else if (task.late_hook != NULL) {
+                uintptr_t hook = (uintptr_t)task.late_hook;
+
+                if (!hostCodeOut(&hook)) {
+                    ret = SKED_E_INVALID_FUNCTION;
+                    break;
+                }
+                task.late_hook = (sked_late_fcn_t)hook;
+            }
+#endif
+            task.arg = NULL;
+#endif
+            memcpy(out, &task, sizeof(task));
+            out += sizeof(task);
+        }
+#if (SKED_HOST == SKED_ON)
+        memcpy(out, _counts, _task_count * sizeof(uint16_t));
+#endif
+    } /* End of atomic block */
+
+    if (len != NULL) {
+        *len = snap_size;
+    }
+    if (ret != SKED_E_OK) {
+        return ret;
+    }
+
+    memcpy(p, &header, sizeof(header));
+    header.checksum = skedSnapChecksum(p, snap_size);
+    memcpy(p, &header, sizeof(header));
+
+    return SKED_E_OK;
+}
+
+/**
+ * Carry on from a snapshot(). Call it after init(), in the mode the
+ * snapshot was taken in, instead of scheduling tasks, and then start().
+ * The table is copied back in one go and then checked task by task, so
+ * this is much quicker than scheduling the tasks again, and every count
+ * and statistic is where it was.
+ *
+ * On the host, start() counts the ticks gone by since the snapshot, so
+ * getTicks() carries on from the clock and each task is released on the
+ * same beat as before the restart. On AVR there's no telling how long a
+ * reset took, so it carries on as though it took no time.
+ *
+ * scheduleArg() tasks come back with a NULL arg; give them theirs with
+ * setArg() before start().
+ *
+ * @param buf  The snapshot
+ * @param size  Bytes at buf
+ *
+ * @return SKED_E_OK - The tasks are back
+ *         SKED_E_NOT_INITIALIZED - You have not called init()
+ *         SKED_E_BUSY - There are tasks scheduled already, or Sked is
+ *         running
+ *         SKED_E_NO_DATA - buf doesn't hold a whole, intact snapshot from
+ *         this build of Sked
+ *         SKED_E_WRONG_MODE - The snapshot was taken in the other mode
+ *         SKED_E_TOO_MANY_TASKS - It has more tasks than fit
+ *         SKED_E_INVALID_FUNCTION - It's from another build of the program
+ *         SKED_E_INVALID_PERIOD, SKED_E_INVALID_PRIORITY,
+ *         SKED_E_INVALID_OPERATION - A task wouldn't pass schedule()
+ */
+int8_t Sked::restore(const void *buf, size_t size) {
+    const uint8_t *p = (const uint8_t *)buf;
+    sked_snap_header_t header;
+    int8_t ret = SKED_E_OK;
+
+    if (_state == SKED_STATE_UNINIT) {
+        return SKED_E_NOT_INITIALIZED;
+    }
+
+    if (buf == NULL || size < sizeof(header)) {
+        return SKED_E_NO_DATA;
+    }
+    memcpy(&header, p, sizeof(header));
+    if (header.magic != SKED_SNAP_MAGIC
+            || header.version != SKED_SNAP_VERSION
+            || header.task_size != sizeof(sked_task_t)) {
+        return SKED_E_NO_DATA;
+    }
+
+#if (SKED_HOST == SKED_ON)
+    if (_tasks == NULL || header.task_count > SKED_HOST_MAX_TASKS) {
+#else
+    if (header.task_count > SKED_MAX_TASKS) {
+#endif
+        return SKED_E_TOO_MANY_TASKS;
+    }
+
+    size_t snap_size = skedSnapSize(header.task_count);
+    if (size < snap_size || skedSnapChecksum(p, snap_size)
+            != header.checksum) {
+        return SKED_E_NO_DATA;
+    }
+
+    if (header.mode != (uint8_t)_mode) {
+        return SKED_E_WRONG_MODE;
+    }
+
+#if (SKED_HOST == SKED_ON)
+    if (memcmp(header.build_id, _host_build_id, sizeof(header.build_id))
+            != 0) {
+        return SKED_E_INVALID_FUNCTION;
+    }
+#endif
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+#if (SKED_HOST == SKED_ON)
+        if (_task_count != 0U || _host != NULL) {
+#else
+        if (_task_count != 0U) {
+#endif
+            ret = SKED_E_BUSY;
+            break;
+        }
+
+        sked_index_t count = (sked_index_t)header.task_count;
+        memcpy(_tasks, p + sizeof(header), count * sizeof(sked_task_t));
+#if (SKED_HOST == SKED_ON)
+        memcpy(_counts, p + sizeof(header) + count * sizeof(sked_task_t),
+            count * sizeof(uint16_t));
+#endif
+
+        for (sked_index_t i = 0; i < count && ret == SKED_E_OK; i++) {
+            ret = restoreTask(i);
+        }
+        if (ret != SKED_E_OK) {
+            /* Leave the table empty, as it was */
+#if (SKED_HOST == SKED_ON)
+            _host_free = SKED_INDEX_NONE;
+            _host_live = 0U;
+            hostPostReset();
+#endif
+            break;
+        }
+
+        _task_count = count;
+        _ticks = header.ticks;
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+        _release_in = _release_span = 0xFFFFU;
+        releaseSync();
+#endif
+#if (SKED_HOST == SKED_ON)
+        _host_resume_ns = header.tick_ns;
+        hostShmPublish();
+#endif
+    } /* End of atomic block */
+
+    return ret;
+}
+
+/**
+ * Checks task i of the table restore() has just copied in, as schedule()
+ * would have, and makes it fit for this run: whatever job it had is gone,
+ * and on the host its function is moved to where the program is now. Must
+ * be called with interrupts disabled.
+ */
+int8_t Sked::restoreTask(sked_index_t i) {
+    sked_task_t *task = &_tasks[i];
+
+#if (SKED_HOST == SKED_ON)
+    if (task->host_flags & SKED_HOST_TASK_FREE) {
+        task->ready_next = _host_free;
+        _host_free = i;
+        return SKED_E_OK;
+    }
+
+    uintptr_t fcn = (uintptr_t)task->fcn;
+    if (!hostCodeIn(&fcn)) {
+        return SKED_E_INVALID_FUNCTION;
+    }
+    task->fcn = (sked_task_fcn_t)fcn;
+#if (SKED_LATE_HOOKS == SKED_ON)
+    if (task->late_hook != NULL) {
+        uintptr_t hook = (uintptr_t)task->late_hook;
+
+        if (!hostCodeIn(&hook)) {
+            return SKED_E_INVALID_FUNCTION;
+        }
+        task->late_hook = (sked_late_fcn_t)hook;
+    }
+#endif
+#endif
+
+    if (task->fcn == (sked_task_fcn_t)NULL) {
+        return SKED_E_INVALID_FUNCTION;
+    }
+    if (task->priority <= (int8_t)SKED_MIN_PRIORITY) {
+        return SKED_E_INVALID_PRIORITY;
+    }
+    if (task->period < _min_period_us / (uint32_t)(SKED_TIMER1_TICK_PERIOD_US)
+            || task->period
+            > _max_period_us / (uint32_t)(SKED_TIMER1_TICK_PERIOD_US)) {
+        return SKED_E_INVALID_PERIOD;
+    }
+    if (task->flags & (SKED_TASK_EVENT | SKED_TASK_CORO | SKED_TASK_SLEEP)) {
+        return SKED_E_INVALID_OPERATION;
+    }
+
+    task->state = IDLE;
+    /* Nothing is late, shed or fed yet */
+    task->flags &= SKED_TASK_CRITICAL;
+#if (SKED_HOST == SKED_ON)
+    task->host_flags &= SKED_HOST_TASK_ARG;
+    task->arg = NULL;
+    task->ready_next = SKED_INDEX_NONE;
+    task->ready_prev = SKED_INDEX_NONE;
+    task->released_tick = 0U;
+    task->fd = -1;
+    task->fd_events = 0U;
+    task->coro = NULL;
+    task->wake_tick = 0U;
+    if (hostPostFull(1U)) {
+        return SKED_E_TOO_MANY_TASKS;
+    }
+    _host_live++;
+    hostPostLink(i);
+#endif
+
+    return SKED_E_OK;
+}
+#endif /* #if (SKED_SNAPSHOT == SKED_ON) */
+
+#if (SKED_STACK_MONITOR == SKED_ON)
+/* Provided by avr-libc: the end of static data and the top of the heap */
+extern uint8_t __heap_start;
+extern void *__brkval;
+
+/* Don't paint right up to the stack pointer; leave room for the interrupt
+ * frame of anything that fires while we're painting. */
+#define SKED_STACK_PAINT_GUARD 16U
+
+/**
+ * Fill everything between the top of the heap and the current stack pointer
+ * with SKED_STACK_PAINT. Bytes that still hold the pattern later on have never
+ * been used by the stack.
+ *
+ * Memory that malloc() hands out after this point will look like used stack,
+ * which only makes the reported margin more conservative.
+ */
+void Sked::stackPaint(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint8_t *low = (__brkval == NULL) ? &__heap_start
+            : (uint8_t *)__brkval;
+        uint8_t *high = (uint8_t *)(SP - SKED_STACK_PAINT_GUARD);
+
+        for (uint8_t *p = low; p < high; p++) {
+            *p = SKED_STACK_PAINT;
+        }
+
+        _stack_paint_low = low;
+        _stack_paint_high = high;
+    } /* End of atomic block */
+}
+
+/**
+ * Record the current stack pointer against the current dispatch level, along
+ * with the chain of tasks that got us here, if it's the deepest seen so far.
+ * Must be called with interrupts disabled.
+ */
+void Sked::stackSample(void) {
+    uint16_t sp = SP;
+    uint8_t level = _dispatch_depth;
+
+    if (level >= SKED_STACK_LEVELS) {
+        level = SKED_STACK_LEVELS - 1U;
+    }
+
+    sked_stack_level_t *l = &_stack_levels[level];
+    if (sp < l->min_sp) {
+        l->min_sp = sp;
+        for (uint8_t i = 0; i < level; i++) {
+            l->chain[i] = _dispatch_chain[i];
+        }
+    }
+}
+
+/**
+ * Report the smallest amount of free stack there has ever been since start().
+ * This scans the painted region, so it's best called from the background
+ * (e.g. while idle).
+ *
+ * @return The number of bytes between the top of the heap and the deepest
+ * point the stack has reached, or 0 if start() hasn't been called
+ */
+uint16_t Sked::getStackFree(void) {
+    uint8_t *p = _stack_paint_low;
+
+    if (p == NULL) {
+        return 0U;
+    }
+
+    while (p < _stack_paint_high && *p == SKED_STACK_PAINT) {
+        p++;
+    }
+
+    return (uint16_t)(p - _stack_paint_low);
+}
+
+/**
+ * Provides the deepest stack pointer seen at a dispatch level and the tasks
+ * that were running when it was seen. RAMEND - min_sp is the stack used at
+ * that point. Level 0 is the background, level 1 is a single task, level 2
+ * a task preempted by another and so on. The stack pointer is sampled on
+ * every tick and as each dispatch starts and ends, so a peak inside a task
+ * only shows up here if a tick lands on it; getStackFree() sees them all.
+ *
+ * @param level The dispatch level [0, SKED_STACK_LEVELS)
+ *
+ * @return A pointer to the level's record, or NULL if there's no such level.
+ * min_sp is 0xFFFF if nothing has been seen at that level yet.
+ */
+const sked_stack_level_t *Sked::getStackLevel(uint8_t level) {
+    if (level < SKED_STACK_LEVELS) {
+        return &_stack_levels[level];
+    } else {
+        return NULL;
+    }
+}
+#endif /* #if (SKED_STACK_MONITOR == SKED_ON) */
+
 /**
  * ISR - Timer1 Capture Interrupt. This function will go into the vector
  * table. It executes when TCNT1 matches ICR1 every 100us.
  */
+#if (SKED_HOST != SKED_ON)
 ISR(TIMER1_CAPT_vect) {
     sked.timerISR();
 }
+#endif
 
 /* The intent is that a single scheduler is instantiated. */
 Sked sked;
@@ -23,7 +23,9 @@
 
 #include <Platform.h>
 
+#ifndef SKED_MAX_TASKS
 #define SKED_MAX_TASKS	16
+#endif
 
 #define SKED_E_OK	0
 #define SKED_E_NOT_INITIALIZED -1
@@ -34,16 +36,215 @@
 #define SKED_E_INVALID_PRIORITY -6
 #define SKED_E_INVALID_OPERATION -7
 #define SKED_E_WRONG_MODE -8
+#define SKED_E_BUSY -9
+#define SKED_E_NO_DATA -10
 #define SKED_E_NOT_IMPLEMENTED -99
 
-#define SKED_OVERRUNS_MAX 255U
-#define SKED_MISSES_MAX   255U
-
 #define SKED_MIN_PRIORITY -127
 
+/* Different states the sked can be in */
+#define SKED_STATE_UNINIT 0
+#define SKED_STATE_INIT 1
+
 #define SKED_OFF 	0
 #define SKED_ON 	1
 
+/* Index of a task in the table. The host backend's table isn't bound by
+ * SKED_MAX_TASKS: it grows in place to SKED_HOST_MAX_TASKS, so indexes stay
+ * put and double as handles (see unschedule()). */
+#if (SKED_HOST == SKED_ON)
+#ifndef SKED_HOST_MAX_TASKS
+#define SKED_HOST_MAX_TASKS (1UL << 20)
+#endif
+typedef uint32_t sked_index_t;
+#define SKED_INDEX_NONE 0xFFFFFFFFUL
+#else
+typedef uint8_t sked_index_t;
+#endif
+
+#if (SKED_WATCHDOG == SKED_ON)
+#include <setjmp.h>
+#endif
+
+#if (SKED_HOST == SKED_ON)
+#include <util/atomic.h>
+#endif
+
+/* Build policies. Each firmware picks the strategies it needs and only those
+ * get compiled in.
+ *
+ * SKED_RELEASE picks how timerISR() finds released tasks:
+ *   SKED_RELEASE_LINEAR (default) - count every task down on every tick
+ *   SKED_RELEASE_NEXT_DUE - count down to the earliest release only and
+ *     touch the task table then. Most ticks cost a decrement, but task counts
+ *     are only current at a release (telemetry brings them up to date).
+ *
+ * SKED_DISPATCH picks which modes init() accepts:
+ *   SKED_DISPATCH_ANY (default) - either, chosen at run time
+ *   SKED_DISPATCH_PREEMPTIVE - SKED_MODE_PREEMPTIVE only
+ *   SKED_DISPATCH_COOPERATIVE - SKED_MODE_NON_PREEMPTIVE only
+ * With a single mode the other one's dispatch code isn't built and there's no
+ * mode test in timerISR() or loop(). */
+#define SKED_RELEASE_LINEAR   0
+#define SKED_RELEASE_NEXT_DUE 1
+
+#define SKED_DISPATCH_ANY         0
+#define SKED_DISPATCH_PREEMPTIVE  1
+#define SKED_DISPATCH_COOPERATIVE 2
+
+/* Task statistics. misses and overruns saturate; activations and completions
+ * wrap, so take differences to get rates. SKED_STATS_32BIT widens all of them
+ * to 32 bits at a cost of 10 bytes of RAM per task. */
+#if (SKED_STATS_32BIT == SKED_ON)
+typedef uint32_t sked_stat_t;
+typedef uint32_t sked_count_t;
+#define SKED_OVERRUNS_MAX 0xFFFFFFFFUL
+#define SKED_MISSES_MAX   0xFFFFFFFFUL
+#else
+typedef uint8_t sked_stat_t;
+typedef uint16_t sked_count_t;
+#define SKED_OVERRUNS_MAX 255U
+#define SKED_MISSES_MAX   255U
+#endif
+
+/* Binary frames written to a stream by idle(). Every frame is:
+ *   SYNC | TYPE | VERSION | LEN (2, little endian) | PAYLOAD | CHECKSUM (2)
+ * The checksum is a Fletcher-16 over TYPE through the end of PAYLOAD. See
+ * tools/skeddecode.py for a decoder. */
+#define SKED_FRAME_SYNC 0xA5U
+#define SKED_FRAME_OVERHEAD 7U
+
+#define SKED_FRAME_STATUS 0x01U
+#if (SKED_HOST == SKED_ON)
+/* The host's table outgrows a frame, so a status frame has up to
+ * SKED_MAX_TASKS slots from FIRST on, and says how many there are in all
+ * (both 4 bytes, after the tick count). Each snapshot carries on from the
+ * slot after the last one's. */
+#define SKED_STATUS_VERSION 3U
+#define SKED_STATUS_HDR_LEN 19U
+#else
+#define SKED_STATUS_VERSION 2U
+#define SKED_STATUS_HDR_LEN 11U
+#endif
+#define SKED_STATUS_TASK_LEN (12U + 2U * sizeof(sked_stat_t) \
+    + 2U * sizeof(sked_count_t))
+
+/* Whether Print has availableForWrite() for idle() to ask how much the
+ * stream takes without waiting. The host's does, and so does the AVR core
+ * from Arduino 1.8.6 on; Arduino 1.0's, which common.mk builds against,
+ * doesn't, so idle() counts on a chunk or a log frame fitting. */
+#ifndef SKED_TX_ROOM
+#if (SKED_HOST == SKED_ON) || (defined(ARDUINO) && ARDUINO >= 10806)
+#define SKED_TX_ROOM SKED_ON
+#else
+#define SKED_TX_ROOM SKED_OFF
+#endif
+#endif
+
+/* Maximum number of bytes that idle() hands to the stream per call. Keep this
+ * at or below the free space of the UART TX buffer so that write() never
+ * blocks. With SKED_TX_ROOM it hands over fewer when the stream's
+ * availableForWrite() says there's less room. */
+#ifndef SKED_TELEMETRY_CHUNK
+#define SKED_TELEMETRY_CHUNK 16U
+#endif
+
+#define SKED_FRAME_LOG 0x02U
+#define SKED_LOG_VERSION 1U
+
+/* Log messages are queued into a ring buffer of this many bytes (must be a
+ * power of two no larger than 128). Each message takes 2 bytes plus its
+ * arguments. */
+#ifndef SKED_LOG_BUF_SIZE
+#define SKED_LOG_BUF_SIZE 64U
+#endif
+#define SKED_LOG_MAX_ARGS 8U
+
+/* Log format ID 0 is reserved for the "messages were dropped" record */
+#define SKED_LOG_ID_DROPPED 0U
+
+/* Declares a log format ID for use with logMsg(). The format string costs
+ * nothing on the target; it's read out of the source by tools/skeddecode.py,
+ * which expands the binary record back into text. Arguments are packed little
+ * endian in the order of the conversions, where a plain conversion is an AVR
+ * int (2 bytes), 'l' is 4 bytes and 'hh' or 'c' is 1 byte. */
+#define SKED_LOG_FORMAT(name, id, fmt) enum { name = (id) }
+
+#define SKED_TELEMETRY_BUF_SIZE (SKED_FRAME_OVERHEAD + SKED_STATUS_HDR_LEN \
+    + (SKED_MAX_TASKS * SKED_STATUS_TASK_LEN))
+
+/* Default limit on how many tasks can be nested by preemption (0 is no
+ * limit). See setMaxPreemptionDepth(). */
+#ifndef SKED_MAX_PREEMPT_DEPTH
+#define SKED_MAX_PREEMPT_DEPTH 0U
+#endif
+
+/* Stack monitoring (AVR only). Free stack is painted with this pattern at
+ * start() and the deepest stack pointer is tracked per dispatch level, where
+ * level 0 is the background (loop()) and level n is n nested tasks. Deeper
+ * nesting is folded into the last level. */
+#define SKED_STACK_PAINT 0xC5U
+#ifndef SKED_STACK_LEVELS
+#define SKED_STACK_LEVELS 4U
+#endif
+
+/* Post-mortem snapshots: the trace keeps the last SKED_TRACE_LEN scheduler
+ * events (must be a power of two) and snapshots are saved round-robin into
+ * SKED_PM_SLOTS EEPROM slots at the top of EEPROM unless
+ * SKED_PM_EEPROM_BASE says otherwise. */
+#ifndef SKED_TRACE_LEN
+#define SKED_TRACE_LEN 8U
+#endif
+#ifndef SKED_PM_SLOTS
+#define SKED_PM_SLOTS 2U
+#endif
+#define SKED_PM_VERSION 3U
+
+/* Warm restart snapshots (see snapshot()): a header, the task table as it is
+ * in memory and, on the host, the task counts. Only good for restore() into
+ * the same build, which the header checks as far as it can. */
+#define SKED_SNAP_MAGIC   0x4E534B53UL	/* "SKSN" */
+#define SKED_SNAP_VERSION 1U
+
+/* Why a snapshot was saved */
+#define SKED_PM_REASON_USER 0U
+#define SKED_PM_REASON_OVERRUN 1U
+#define SKED_PM_REASON_WATCHDOG 2U
+
+/* Scheduler events kept in the trace */
+#define SKED_TRACE_DISPATCH 1U
+#define SKED_TRACE_COMPLETE 2U
+#define SKED_TRACE_MISS 3U
+#define SKED_TRACE_OVERRUN 4U
+#define SKED_TRACE_DEFER 5U
+
+/* Task flags */
+#define SKED_TASK_CRITICAL 0x01U	/* Must meet its deadlines to feed the WDT */
+#define SKED_TASK_SHED     0x02U	/* Not released while the WDT sheds load */
+#define SKED_TASK_LATE     0x04U	/* The current job has overrun */
+#define SKED_TASK_MISS_PENDING    0x08U	/* Late hook owed a miss */
+#define SKED_TASK_OVERRUN_PENDING 0x10U	/* Late hook owed an overrun */
+#define SKED_TASK_EVENT    0x20U	/* Released by an fd, not its period (host) */
+#define SKED_TASK_CORO     0x40U	/* Resumes a coroutine, not fcn (host) */
+#define SKED_TASK_SLEEP    0x80U	/* Coroutine due at wake_tick (host) */
+#define SKED_TASK_DEFERRED 0x100U	/* Held back by the preemption depth limit */
+#define SKED_TASK_FED      0x200U	/* Met its deadline since the last WDT feed */
+
+/* Host task flags, in sked_task_t.host_flags */
+#define SKED_HOST_TASK_ARG    0x01U	/* fcn is a sked_task_arg_fcn_t */
+#define SKED_HOST_TASK_FREE   0x02U	/* Free slot (see unschedule()) */
+#define SKED_HOST_TASK_QUEUED 0x04U	/* On its priority's READY queue */
+
+/* Events passed to a late hook (see setLateHook()), or'd together if both
+ * happened since the hook last ran */
+#define SKED_LATE_MISS    0x01U
+#define SKED_LATE_OVERRUN 0x02U
+
+#if (SKED_HOST == SKED_ON) && ((SKED_WATCHDOG == SKED_ON) \
+        || (SKED_POSTMORTEM == SKED_ON) || (SKED_STACK_MONITOR == SKED_ON))
+#error "The watchdog, post-mortem and stack monitor are AVR only"
+#endif
+
 typedef enum {
 	IDLE = 0,
 	READY,
@@ -52,6 +253,13 @@ typedef enum {
 
 typedef enum {
 	SKED_SRC_TIMER1 = 1,
+	/* Host backend: a tick thread on CLOCK_MONOTONIC */
+	SKED_SRC_MONOTONIC = 0x10,
+#if (SKED_HOST == SKED_ON)
+	SKED_SRC_DEFAULT = SKED_SRC_MONOTONIC,
+#else
+	SKED_SRC_DEFAULT = SKED_SRC_TIMER1,
+#endif
 } sked_clk_src_e;
 
 typedef enum {
@@ -60,33 +268,656 @@ typedef enum {
 } sked_mode_e;
 
 typedef void (*sked_task_fcn_t)(void);
+typedef void (*sked_late_fcn_t)(sked_task_fcn_t fcn, uint8_t events);
+#if (SKED_HOST == SKED_ON)
+/* Host backend: a task function that's handed its own context, so one
+ * function can serve many tasks (see scheduleArg()) */
+typedef void (*sked_task_arg_fcn_t)(void *arg);
+#endif
+
+#if (SKED_HOST == SKED_ON)
+/* Host backend: buckets of the log2 histograms of latency and execution
+ * time */
+#define SKED_LATENCY_BUCKETS 16
+#endif
 
 typedef struct {
 	sked_task_fcn_t fcn;
+#if (SKED_HOST != SKED_ON)
+	/* Ticks to the next release. The host backend keeps these apart, in
+	 * Sked's _counts[] (see getCountdown()). */
 	uint16_t count;
+#endif
 	uint16_t period;
 	uint16_t offset;
-	uint8_t misses;
-	uint8_t overruns;
+	sked_stat_t misses;
+	sked_stat_t overruns;
 	int8_t priority;
 	sked_task_state_e state;
+	/* Releases and finished jobs */
+	sked_count_t activations;
+	sked_count_t completions;
+	/* Tick (see getTicks()) of the last miss and the last overrun */
+	uint32_t last_miss_tick;
+	uint32_t last_overrun_tick;
+	/* Longest time from dispatch to completion, including any time spent
+	 * preempted */
+	uint32_t max_exec_us;
+	uint16_t flags;
+#if (SKED_LATE_HOOKS == SKED_ON)
+	sked_late_fcn_t late_hook;
+#endif
+#if (SKED_HOST == SKED_ON)
+	/* Tick of the last IDLE -> READY release, for dispatch latency */
+	uint32_t released_tick;
+	/* SKED_TASK_EVENT tasks: the fd and epoll events that release them */
+	int fd;
+	uint32_t fd_events;
+	/* SKED_TASK_CORO tasks: the coroutine frame from spawn(), NULL once it
+	 * has finished, and the tick a sleeping one is due */
+	void *coro;
+	uint32_t wake_tick;
+	/* How many ticks late a release may be, so it can share a wakeup of the
+	 * tick thread with others (see setSlack()) */
+	uint16_t slack;
+	uint8_t host_flags;
+	/* SKED_HOST_TASK_ARG tasks: what fcn is called with */
+	void *arg;
+	/* Neighbours on the READY queue of its priority, oldest first, or
+	 * SKED_INDEX_NONE. A free slot links the free list through ready_next. */
+	sked_index_t ready_next;
+	sked_index_t ready_prev;
+	/* Execution time of the last job and of all of them, and hist[i] counts
+	 * jobs that took under 2^i us (the last bucket takes the rest) */
+	uint32_t last_exec_us;
+	uint64_t total_exec_us;
+	uint32_t exec_hist[SKED_LATENCY_BUCKETS];
+#endif
 } sked_task_t;
 
+#if (SKED_HOST == SKED_ON)
+/* Host backend: no CPU affinity (see setCpu()) */
+#define SKED_CPU_ANY -1
+
+/* Host backend: what one worker of the non-preemptive pool has done (see
+ * setWorkers()) */
+typedef struct {
+	/* Jobs run */
+	uint32_t runs;
+	/* Of those, how many it took from another worker's queue */
+	uint32_t steals;
+} sked_worker_stats_t;
+
+/* Host backend: activity of post() since the last reset() */
+typedef struct {
+	/* post() calls for a scheduled task */
+	uint32_t posts;
+	/* Of those, how many queued the task; the rest found it queued already */
+	uint32_t enqueued;
+	/* Times a post() had to wake the parked tick thread */
+	uint32_t wakeups;
+	/* Batches drained, and the largest */
+	uint32_t drains;
+	uint32_t max_batch;
+	/* Drained activations that released the task, and those that found it
+	 * READY or RUNNING already */
+	uint32_t released;
+	uint32_t coalesced;
+} sked_post_stats_t;
+
+/* Host backend: layout of the file exportStats() keeps up to date, for
+ * monitors to map and read at any rate (see tools/skedtop.py): a header,
+ * then a task record for every slot the table can grow to (max_tasks, which
+ * is SKED_HOST_MAX_TASKS), of which the first task_count are in use (a slot
+ * unschedule() freed has an fcn of 0). Records past task_count are never
+ * written, so they're holes in the file that take no memory. Everything is
+ * native endian with natural alignment.
+ *
+ * The header and each record have a sequence number that's odd while Sked
+ * is writing to it. To read one, read seq, copy it, and read seq again; if
+ * seq was odd or changed, try again. Sked never waits for readers. */
+#define SKED_SHM_MAGIC   0x4D48534BUL	/* "KSHM" */
+#define SKED_SHM_VERSION 2U
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	/* Size of a task record, which only ever grows at the end */
+	uint16_t task_size;
+	uint32_t seq;
+	uint8_t mode;
+	uint8_t reserved[3];
+	/* Records the file has room for, and how many of them are in use */
+	uint32_t max_tasks;
+	uint32_t task_count;
+	uint32_t ticks;
+	uint32_t tick_us;
+	/* CLOCK_MONOTONIC when this was last written */
+	uint64_t updated_ns;
+} sked_shm_header_t;
+
+typedef struct {
+	uint32_t seq;
+	int8_t priority;
+	uint8_t state;
+	uint8_t flags;
+	uint8_t reserved;
+	uint32_t period_us;
+	uint32_t activations;
+	uint32_t completions;
+	uint32_t misses;
+	uint32_t overruns;
+	uint32_t max_exec_us;
+	uint32_t last_exec_us;
+	uint32_t reserved2;
+	uint64_t total_exec_us;
+	/* The task function's address, to look up in the symbol table */
+	uint64_t fcn;
+	uint32_t exec_hist[SKED_LATENCY_BUCKETS];
+} sked_shm_task_t;
+
+/* Host backend: layout of a timebase file, which shareTimebase() makes and
+ * joinTimebase() maps, so Sked instances in different processes count the
+ * same ticks: tick 0 was due at epoch_ns on CLOCK_MONOTONIC, and tick n
+ * tick_ns after each other. Native endian. epoch_ns never changes once
+ * magic is set, but seq is odd while it's being written, as in
+ * sked_shm_header_t. */
+#define SKED_TIMEBASE_MAGIC   0x42544B53UL	/* "SKTB" */
+#define SKED_TIMEBASE_VERSION 1U
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+	uint32_t seq;
+	uint32_t tick_ns;
+	uint64_t epoch_ns;
+} sked_timebase_t;
+
+/* Host backend: bytes of the program's GNU build ID kept to tell its builds
+ * apart */
+#define SKED_BUILD_ID_LEN 20U
+
+/* Host backend: layout of a schedule file, made from a task list by
+ * tools/skedsched.py or saveSchedule(), which loadSchedule() maps and adds
+ * the tasks of in one go: a header, then a record per task in the order
+ * they go into the table. Task functions are offsets into the program, so a
+ * file only suits the build its build ID says. Native endian. */
+#define SKED_SCHED_MAGIC   0x48534B53UL	/* "SKSH" */
+#define SKED_SCHED_VERSION 1U
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t task_count;
+	uint32_t reserved[2];
+	uint8_t build_id[SKED_BUILD_ID_LEN];
+} sked_sched_header_t;
+
+typedef struct {
+	/* The task function's offset into the program's code */
+	uint64_t fcn;
+	/* What a SKED_HOST_TASK_ARG task's function is called with */
+	uint64_t arg;
+	uint32_t period_us;
+	uint32_t offset_us;
+	uint32_t slack_us;
+	int8_t priority;
+	/* SKED_HOST_TASK_ARG, or 0 for a plain schedule() task */
+	uint8_t host_flags;
+	uint16_t reserved;
+} sked_sched_record_t;
+
+/* Host backend: how often the tick thread woke up for the timer and how late
+ * that made periodic releases, since start(). Wakeups per second are
+ * wakeups * 10000 / ticks. */
+typedef struct {
+	/* Ticks gone by */
+	uint32_t ticks;
+	uint32_t wakeups;
+	/* Releases of IDLE tasks, and how long after their tick they happened */
+	uint32_t releases;
+	uint64_t late_total_us;
+	uint32_t late_max_us;
+} sked_wake_stats_t;
+
+/* Host backend: how the tick thread's sleep-then-spin wakeups for setSpin()
+ * bands have gone since start(). It sleeps until margin_ns before the
+ * release and spins on the clock for the rest; the margin follows the
+ * timer's wakeup latency. */
+typedef struct {
+	/* Wakeups it spun for, and how many of those the timer woke it too late
+	 * for anyway */
+	uint32_t spins;
+	uint32_t overshoots;
+	uint64_t spin_total_us;
+	uint32_t spin_max_us;
+	/* The margin now, and the mean timer latency it's based on */
+	uint32_t margin_ns;
+	uint32_t timer_late_ns;
+} sked_spin_stats_t;
+
+/* Host backend: coroutine frames of spawn() tasks come from a pool of this
+ * many blocks per Sked, each big enough for a frame of this many bytes.
+ * Creating a coroutine with a bigger frame, or with every block in use,
+ * fails (see host/SkedCoro.h). By default there's a block for every task
+ * the table can hold; only the blocks that have been used take memory. */
+#ifndef SKED_CORO_FRAMES
+#define SKED_CORO_FRAMES SKED_HOST_MAX_TASKS
+#endif
+#ifndef SKED_CORO_FRAME_SIZE
+#define SKED_CORO_FRAME_SIZE 1024U
+#endif
+
+/* Host backend: use of the coroutine frame pool since the last reset() */
+typedef struct {
+	/* Blocks in use now, and the most there have been */
+	uint32_t in_use;
+	uint32_t max_in_use;
+	/* Frames handed out, and coroutines that couldn't get one */
+	uint32_t allocs;
+	uint32_t fails;
+	/* Biggest frame asked for, in bytes */
+	uint32_t max_size;
+} sked_coro_stats_t;
+
+class SkedCoro;
+class SkedSleep;
+
+/* Host backend: release-to-start latency of the tasks in one priority band */
+
+typedef struct {
+	/* Lowest task priority in the band */
+	int8_t priority;
+	uint32_t count;
+	uint64_t total_us;
+	uint32_t max_us;
+	/* hist[i] counts latencies under 2^i us; the last bucket takes the rest */
+	uint32_t hist[SKED_LATENCY_BUCKETS];
+} sked_latency_t;
+#endif
+
+typedef struct {
+	/* Low 16 bits of the tick count when the event happened */
+	uint16_t tick;
+	uint8_t event;
+	uint8_t task;
+} sked_trace_event_t;
+
+/* A task's statistics in a post-mortem snapshot. They're kept in this fixed,
+ * compact form whatever SKED_STATS_32BIT says, so SKED_PM_SLOTS snapshots
+ * still fit an Uno's 1 KB of EEPROM: misses and overruns saturate at 65535,
+ * and activations and completions keep their low 16 bits. */
+typedef struct {
+	int8_t priority;
+	uint16_t period;
+	uint16_t misses;
+	uint16_t overruns;
+	uint16_t activations;
+	uint16_t completions;
+	uint32_t last_miss_tick;
+	uint32_t last_overrun_tick;
+	uint32_t max_exec_us;
+} sked_pm_task_t;
+
+/* What's stored in EEPROM by saveSnapshot() and read by loadSnapshot() */
+typedef struct {
+	uint8_t version;
+	uint16_t seq;
+	uint8_t reason;
+	uint32_t ticks;
+	uint8_t task_count;
+	sked_pm_task_t tasks[SKED_MAX_TASKS];
+	uint8_t trace_count;
+	/* Oldest first */
+	sked_trace_event_t trace[SKED_TRACE_LEN];
+} sked_pm_snapshot_t;
+
+/* Header of what snapshot() writes and restore() reads */
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	/* sizeof(sked_task_t), which changes with the build options */
+	uint16_t task_size;
+	uint32_t task_count;
+	uint32_t ticks;
+	uint8_t mode;
+	uint8_t reserved[3];
+	/* Adler-32 of the whole snapshot, with this field 0 */
+	uint32_t checksum;
+#if (SKED_HOST == SKED_ON)
+	/* CLOCK_MONOTONIC when tick `ticks` was due, or 0 if Sked wasn't
+	 * running */
+	uint64_t tick_ns;
+	/* The program's GNU build ID, since task functions are kept as offsets
+	 * into it */
+	uint8_t build_id[SKED_BUILD_ID_LEN];
+#endif
+} sked_snap_header_t;
+
+typedef struct {
+	/* Lowest stack pointer seen at this level (the stack grows down) */
+	uint16_t min_sp;
+	/* Task indexes that were running, outermost first, when min_sp was seen.
+	 * Only the first `level` entries are meaningful. */
+	uint8_t chain[SKED_STACK_LEVELS];
+} sked_stack_level_t;
+
+#if (SKED_WATCHDOG == SKED_ON)
+/* Lives on the stack for as long as a task runs so the watchdog can abort
+ * it */
+typedef struct sked_abort_frame {
+	jmp_buf env;
+	struct sked_abort_frame *outer;
+	uint8_t task;
+} sked_abort_frame_t;
+#endif
+
 class Sked {
 private:
 	uint8_t _state;
 	uint32_t _min_period_us;
 	uint32_t _max_period_us;
 	sked_clk_src_e _clk_src;
+#if (SKED_HOST == SKED_ON)
+	/* Reserved for SKED_HOST_MAX_TASKS and backed as it fills up, so a
+	 * task never moves (see hostTableInit()) */
+	sked_task_t *_tasks;
+#else
 	sked_task_t _tasks[SKED_MAX_TASKS];
-	uint8_t _task_count;
+#endif
+	sked_index_t _task_count;
 	int8_t _current_task_priority;
 	sked_mode_e _mode;
+	uint32_t _ticks;
+	uint8_t _dispatch_depth;
+	uint8_t _max_preempt_depth;
+	uint16_t _preempt_deferrals;
+
+	uint32_t nowUs(void);
+	void runTask(sked_index_t i);
+	void releaseTask(sked_index_t i);
+	bool tableFull(void);
+	int8_t scheduleTask(uint32_t period_us, uint32_t offset_us,
+		int8_t priority, sked_task_fcn_t fcn, sked_index_t *index);
+	sked_index_t insertTask(uint16_t period, uint16_t offset, int8_t priority,
+		sked_task_fcn_t fcn);
+	void initTask(sked_index_t i, uint16_t period, uint16_t offset,
+		int8_t priority, sked_task_fcn_t fcn);
+#if (SKED_HOST == SKED_ON)
+	/* This instance's "interrupts off" */
+	sked_host_irq_t _host_irq;
+	struct sked_host_s *_host;
+	bool _host_realtime;
+	bool _host_tickless;
+	/* exportStats(): the mapping, and the tick it was last all written */
+	sked_shm_header_t *_host_shm;
+	uint32_t _host_shm_tick;
+	/* shareTimebase() or joinTimebase(): the mapping start() lines the
+	 * ticks up with, or NULL */
+	sked_timebase_t *_host_timebase;
+	int16_t _host_cpu;
+	uint8_t _host_workers;
+	struct sked_host_post_s *_host_post;
+	struct sked_host_coro_s *_host_coro;
+	int8_t _host_band_floor[SKED_MAX_TASKS];
+	uint8_t _host_band_floors;
+	/* Task counts in table order, apart from the table so timerISR() can
+	 * count them all down in one go (host/SkedCountdown.h), and the mask it
+	 * gets back. Reserved alongside _tasks. */
+	uint16_t *_counts;
+	uint64_t *_host_released;
+	/* scheduleFd(): by fd, 1 more than the index of the task that last
+	 * watched it (0 if none has), so a ready fd finds its task at once.
+	 * Also reserved alongside _tasks. */
+	sked_index_t *_host_fd_task;
+	/* Slots unschedule() has freed, most recent first, and the tasks in
+	 * use */
+	sked_index_t _host_free;
+	sked_index_t _host_live;
+	/* A FIFO of READY tasks per priority (priority + 128), with a bit set
+	 * in _host_ready_map for each one that isn't empty, so the highest
+	 * priority READY task is found without looking through the table. In
+	 * the worker pool, a dealt task leaves the queue while it's READY. */
+	sked_index_t _host_ready_head[256];
+	sked_index_t _host_ready_tail[256];
+	uint64_t _host_ready_map[4];
+	sked_index_t _host_ready_count;
+	uint32_t (*_host_countdown)(uint16_t *counts, uint32_t n,
+		uint64_t *mask);
+	/* setSpin(): priorities whose bands the tick thread spins for */
+	int8_t _host_spin[SKED_MAX_TASKS];
+	uint8_t _host_spins;
+
+	/* The coroutine types in host/SkedCoro.h use the pool and the waits */
+	friend struct SkedCoroPromise;
+	friend class SkedSleep;
+	friend class SkedChannelBase;
+
+	int8_t hostStart(void);
+	void hostStop(void);
+	uint32_t hostNowUs(void);
+	void hostDispatch(void);
+	void hostIdleWait(void);
+	uint32_t hostTickLag(void);
+	void hostTickTo(uint64_t now_ns);
+	uint32_t hostSkipTicks(uint32_t max);
+	uint32_t hostNextWake(void);
+	void hostArmWake(bool force);
+	bool hostSpinDue(uint32_t tick);
+	void hostSpinRecord(uint64_t woke_ns, uint64_t spin_ns, uint64_t now_ns);
+	void hostRecordRelease(void);
+	void hostRecordExec(sked_index_t i, uint32_t exec_us);
+	void hostShmTask(sked_index_t i, bool done);
+	bool hostShmHeader(void);
+	void hostShmPublish(void);
+	void hostShmRefresh(void);
+	int8_t hostTimebaseSet(const char *path, bool create);
+	void hostTimebaseAlign(void);
+	void hostAdvance(uint64_t gone, uint32_t ticks, uint64_t tick_ns);
+	bool hostPooled(void);
+	void hostPoolPush(void);
+	void hostPostInit(void);
+	void hostPostFree(void);
+	bool hostPostFull(uint32_t more);
+	void hostPostLink(sked_index_t i);
+	void hostPostUnlink(sked_index_t i);
+	void hostPostReset(void);
+	uint32_t hostPostDrain(void);
+	int hostFdArm(sked_task_t *task, int op);
+	uint8_t hostFdRelease(int fd);
+	sked_index_t hostFdTask(int fd);
+	void hostCoroInit(void);
+	void hostCoroPoolFree(void);
+	void hostCoroReset(void);
+	void *hostCoroAlloc(size_t size);
+	static void hostCoroFree(void *frame);
+	void hostCoroResume(sked_task_t *task);
+	sked_task_t *hostCoroTask(void *frame);
+	bool hostCoroDue(sked_task_t *task);
+	void hostCoroArm(sked_task_t *task, uint32_t ticks);
+	int8_t hostCoroWait(void *frame, uint32_t ticks);
+	void hostCoroWake(void *frame);
+	void hostTableInit(void);
+	void hostTableFree(void);
+	void hostReadyPush(sked_index_t i);
+	void hostReadyRemove(sked_index_t i);
+	void hostJobDone(sked_index_t i);
+	void hostSlotFree(sked_index_t i);
+	void hostTaskFree(sked_index_t i, bool busy);
+	sked_index_t hostReadyTop(int8_t low, int8_t high);
+	int8_t hostBandKey(int8_t priority);
+	void hostBandRange(int8_t key, int8_t *low, int8_t *high);
+	int16_t hostBandOf(int8_t priority);
+	bool hostHigherReady(int8_t key);
+	void hostRankBands(void);
+	static void *hostTickMain(void *arg);
+	static void *hostWorkerMain(void *arg);
+	static void *hostPoolMain(void *arg);
+	/* Where the program's code is loaded, and its build ID */
+	uintptr_t _host_code_base;
+	uintptr_t _host_code_low;
+	uintptr_t _host_code_high;
+	uint8_t _host_build_id[SKED_BUILD_ID_LEN];
+
+	void hostProgramInit(void);
+	bool hostCodeOut(uintptr_t *addr);
+	bool hostCodeIn(uintptr_t *addr);
+	sked_index_t hostSlotTake(void);
+#if (SKED_SNAPSHOT == SKED_ON)
+	/* restore(): when the snapshot's tick was due, for start() to carry
+	 * on from, or 0 */
+	uint64_t _host_resume_ns;
+
+	uint64_t hostTickNs(void);
+	void hostResume(void);
+#endif
+#endif
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+	uint16_t _release_in;
+	uint16_t _release_span;
+
+	void releaseSync(void);
+#endif
+#if (SKED_LATE_HOOKS == SKED_ON)
+	bool _late_pending;
+	bool _late_running;
+
+	void runLateHooks(void);
+#endif
+#if (SKED_STACK_MONITOR == SKED_ON)
+	uint8_t _dispatch_chain[SKED_STACK_LEVELS];
+	sked_stack_level_t _stack_levels[SKED_STACK_LEVELS];
+	uint8_t *_stack_paint_low;
+	uint8_t *_stack_paint_high;
+
+	void stackSample(void);
+	void stackPaint(void);
+#endif
+#if (SKED_WATCHDOG == SKED_ON)
+	sked_abort_frame_t *_abort_frame;
+	uint8_t _wdt_stage;
+	bool _wdt_enabled;
+	bool _wdt_abort_requested;
+	uint16_t _wdt_aborts;
+#if (SKED_POSTMORTEM == SKED_ON)
+	/* _pm_progress at the last final-stage timeout */
+	uint16_t _wdt_pm_progress;
+#endif
+
+	void watchdogFeed(uint8_t i);
+#endif
+#if (SKED_POSTMORTEM == SKED_ON)
+	sked_trace_event_t _trace[SKED_TRACE_LEN];
+	uint8_t _trace_head;
+	bool _pm_armed;
+	bool _pm_requested;
+	uint8_t _pm_reason;
+	/* saveSnapshot() is writing, and how many bytes it has written, for
+	 * the watchdog to wait for */
+	volatile bool _pm_saving;
+	volatile uint16_t _pm_progress;
+
+	void trace(uint8_t event, uint8_t task);
+#endif
+#if (SKED_SNAPSHOT == SKED_ON)
+	int8_t restoreTask(sked_index_t i);
+#endif
+#if (SKED_TELEMETRY == SKED_ON)
+	Print *_telemetry_out;
+	uint8_t _telemetry_buf[SKED_TELEMETRY_BUF_SIZE];
+	uint16_t _telemetry_len;
+	uint16_t _telemetry_pos;
+#if (SKED_HOST == SKED_ON)
+	/* The slot the next status frame starts at */
+	sked_index_t _telemetry_next;
+#endif
+#endif
+#if (SKED_LOG == SKED_ON)
+	Print *_log_out;
+	uint8_t _log_buf[SKED_LOG_BUF_SIZE];
+	uint8_t _log_head;
+	uint8_t _log_tail;
+	uint16_t _log_dropped;
+	uint16_t _log_dropped_reported;
+
+	void logSendOne(void);
+#endif
 
 public:
 	Sked();
+#if (SKED_HOST == SKED_ON)
+	~Sked();
+	int8_t setCpu(int16_t cpu);
+	int16_t getCpu(void);
+	void setRealtime(bool enable);
+	bool isRealtime(void);
+	void setTickless(bool enable);
+	int8_t setSlack(sked_task_fcn_t fcn, uint32_t slack_us);
+	void getWakeStats(sked_wake_stats_t *stats);
+	int8_t setSpin(int8_t priority, bool enable);
+	void getSpinStats(sked_spin_stats_t *stats);
+	uint16_t getCountdown(sked_index_t i);
+	int8_t exportStats(const char *path);
+	int8_t shareTimebase(const char *path);
+	int8_t joinTimebase(const char *path);
+	int8_t setPriorityBands(const int8_t *floors, uint8_t count);
+	uint8_t getBandCount(void);
+	int8_t getDispatchLatency(uint8_t band, sked_latency_t *latency);
+	int8_t setWorkers(uint8_t count);
+	int8_t post(sked_task_fcn_t fcn);
+	int8_t scheduleFd(int fd, uint32_t events, int8_t priority,
+		sked_task_fcn_t fcn);
+	int8_t scheduleArg(uint32_t period_us, uint32_t offset_us,
+		int8_t priority, sked_task_arg_fcn_t fcn, void *arg,
+		sked_index_t *handle);
+	int8_t unschedule(sked_index_t handle);
+	int8_t setArg(sked_index_t handle, void *arg);
+	int8_t loadSchedule(const char *path);
+	int8_t saveSchedule(const char *path);
+	void getPostStats(sked_post_stats_t *stats);
+	int8_t spawn(SkedCoro &&coro, int8_t priority);
+	SkedSleep sleepFor(uint32_t us);
+	void getCoroStats(sked_coro_stats_t *stats);
+	int8_t getWorkerStats(uint8_t worker, sked_worker_stats_t *stats);
+#endif
 #if (SKED_DEBUG == SKED_ON)
 	void debugPrintState(Stream *stream);
+#endif
+#if (SKED_TELEMETRY == SKED_ON)
+	void telemetryBegin(Print *out);
+	int8_t telemetrySnapshot(void);
+	uint16_t telemetryPending(void);
+#endif
+#if (SKED_WATCHDOG == SKED_ON)
+	int8_t setCritical(sked_task_fcn_t fcn, bool critical);
+	int8_t watchdogEnable(uint8_t timeout);
+	void watchdogDisable(void);
+	uint8_t getWatchdogStage(void);
+	uint16_t getWatchdogAborts(void);
+	void watchdogISR(void);
+#endif
+#if (SKED_LATE_HOOKS == SKED_ON)
+	int8_t setLateHook(sked_task_fcn_t fcn, sked_late_fcn_t hook);
+#endif
+#if (SKED_POSTMORTEM == SKED_ON)
+	int8_t saveSnapshot(uint8_t reason);
+	int8_t loadSnapshot(sked_pm_snapshot_t *snap);
+#endif
+#if (SKED_SNAPSHOT == SKED_ON)
+	size_t snapshotSize(void);
+	int8_t snapshot(void *buf, size_t size, size_t *len);
+	int8_t restore(const void *buf, size_t size);
+#endif
+#if (SKED_STACK_MONITOR == SKED_ON)
+	uint16_t getStackFree(void);
+	const sked_stack_level_t *getStackLevel(uint8_t level);
+#endif
+#if (SKED_LOG == SKED_ON)
+	void logBegin(Print *out);
+	int8_t logMsg(uint8_t id, const void *args, uint8_t len);
+	uint16_t getLogDropped(void);
 #endif
 	int8_t init(sked_mode_e mode, sked_clk_src_e clk_src);
 	int8_t schedule(uint32_t period_us, uint32_t offset_us, int8_t priority, 
@@ -95,8 +926,13 @@ public:
 	void reset(void);
 	int8_t start(void);
 	int8_t loop(void);
-	sked_task_t *getTaskInfo(uint8_t i);
-	uint8_t getTaskCount(void);
+	void idle(void);
+	void setMaxPreemptionDepth(uint8_t depth);
+	uint16_t getPreemptionDeferrals(void);
+	void resetStats(void);
+	uint32_t getTicks(void);
+	sked_task_t *getTaskInfo(sked_index_t i);
+	sked_index_t getTaskCount(void);
 };
 
 extern Sked sked;
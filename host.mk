@@ -0,0 +1,95 @@
+# Linux host backend (see host/SkedHost.cpp). Builds Sked with SKED_HOST=1
+# against the Arduino stand-ins in host/ and runs the tests in tests/host.
+#
+#   make -f host.mk test                  Build and run every host test
+#   make -f host.mk test TEST=test_host   Just one
+#   make -f host.mk clean
+
+BUILD = build-host
+
+ifeq ($(TEST),)
+TESTS := $(basename $(notdir $(wildcard tests/host/test_*.cpp)))
+else
+TESTS := $(TEST)
+endif
+
+CXX = g++
+# C++20 for the coroutine tasks (host/SkedCoro.h). Sketches bump volatile
+# counters shared with tasks the AVR way, which C++20 deprecates.
+CXXSTANDARD = -std=gnu++20
+CXXWARN = -Wall -Wextra -Wno-unused-parameter -Wno-volatile
+OPT = 2
+
+# Place -D or -U options here
+CDEFS = -DSKED_HOST=1
+
+# Turn on debug
+CDEFS += -DSKED_DEBUG=1
+
+# Turn on binary telemetry (see tools/skeddecode.py)
+CDEFS += -DSKED_TELEMETRY=1
+
+# Turn on deferred logging (see tools/skeddecode.py)
+CDEFS += -DSKED_LOG=1
+
+# Turn on per-task late (miss/overrun) hooks
+CDEFS += -DSKED_LATE_HOOKS=1
+
+# Turn on warm restart snapshots (see snapshot())
+CDEFS += -DSKED_SNAPSHOT=1
+
+# A coroutine frame pool test_coro can use all of, yet bigger than
+# SKED_MAX_TASKS
+CDEFS += -DSKED_CORO_FRAMES=256
+
+# Place -I options here. host/ comes first so <Platform.h> and
+# <util/atomic.h> are the host stand-ins.
+CXXINCS = -Ihost -I.
+
+CXXFLAGS = $(CXXSTANDARD) -O$(OPT) -g $(CXXWARN) $(CDEFS) $(CXXINCS) -pthread
+LDFLAGS = -pthread
+
+HOST_SRC = \
+  Sked.cpp \
+  host/SkedHost.cpp \
+  host/SkedPartition.cpp \
+  host/SkedCoro.cpp \
+  host/SkedCountdown.cpp \
+  host/Platform.cpp \
+  host/main.cpp
+
+HOST_OBJ = $(addprefix $(BUILD)/,$(HOST_SRC:.cpp=.o))
+HEADERS = Sked.h $(wildcard host/*.h host/util/*.h)
+
+
+all: $(addprefix $(BUILD)/,$(TESTS))
+
+
+# A test passes when the suite reports no failures or errors
+test: all
+	@for t in $(TESTS); do \
+	  echo "### $$t"; \
+	  $(BUILD)/$$t > $(BUILD)/$$t.log 2>&1; status=$$?; \
+	  cat $(BUILD)/$$t.log; echo; \
+	  if [ $$status -ne 0 ] \
+	      || ! grep -q "###  Failed:  0" $(BUILD)/$$t.log \
+	      || ! grep -q "###  Errored: 0" $(BUILD)/$$t.log; then \
+	    echo "!!! $$t FAILED"; exit 1; \
+	  fi; \
+	done
+
+
+$(BUILD)/%.o: %.cpp $(HEADERS)
+	@mkdir -p $(dir $@)
+	$(CXX) $(CXXFLAGS) -c $< -o $@
+
+$(BUILD)/test_%: $(BUILD)/tests/host/test_%.o $(HOST_OBJ)
+	$(CXX) $(LDFLAGS) $^ -o $@
+
+
+clean:
+	rm -rf $(BUILD)
+
+
+.PHONY: all test clean
+.SECONDARY:
@@ -0,0 +1,217 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Host implementation of the Arduino core pieces declared in Platform.h.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include "./Platform.h"
+
+size_t Print::write(const uint8_t *buf, size_t size) {
+    size_t n = 0;
+
+    while (size--) {
+        n += write(*buf++);
+    }
+
+    return n;
+}
+
+size_t Print::printNumber(unsigned long long n, int base, bool negative) {
+    char buf[8 * sizeof(n) + 2];
+    char *p = &buf[sizeof(buf) - 1];
+
+    if (base < 2) {
+        base = DEC;
+    }
+
+    *p = '\0';
+    do {
+        uint8_t digit = n % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        n /= base;
+    } while (n != 0);
+
+    if (negative) {
+        *--p = '-';
+    }
+
+    return print(p);
+}
+
+size_t Print::print(const char *s) {
+    return write((const uint8_t *)s, strlen(s));
+}
+
+size_t Print::print(char c) {
+    return write((uint8_t)c);
+}
+
+size_t Print::print(int n, int base) {
+    return print((long long)n, base);
+}
+
+size_t Print::print(unsigned int n, int base) {
+    return print((unsigned long long)n, base);
+}
+
+size_t Print::print(long n, int base) {
+    return print((long long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+    return print((unsigned long long)n, base);
+}
+
+size_t Print::print(long long n, int base) {
+    /* Like Arduino, only base 10 gets a sign */
+    if (base == DEC && n < 0) {
+        return printNumber(-(unsigned long long)n, base, true);
+    }
+
+    return printNumber((unsigned long long)n, base, false);
+}
+
+size_t Print::print(unsigned long long n, int base) {
+    return printNumber(n, base, false);
+}
+
+size_t Print::print(double n, int digits) {
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return print(buf);
+}
+
+size_t Print::println(void) {
+    return print("\r\n");
+}
+
+size_t Print::println(const char *s) {
+    return print(s) + println();
+}
+
+size_t Print::println(char c) {
+    return print(c) + println();
+}
+
+size_t Print::println(int n, int base) {
+    return print(n, base) + println();
+}
+
+size_t Print::println(unsigned int n, int base) {
+    return print(n, base) + println();
+}
+
+size_t Print::println(long n, int base) {
+    return print(n, base) + println();
+}
+
+size_t Print::println(unsigned long n, int base) {
+    return print(n, base) + println();
+}
+
+size_t Print::println(long long n, int base) {
+    return print(n, base) + println();
+}
+
+size_t Print::println(unsigned long long n, int base) {
+    return print(n, base) + println();
+}
+
+size_t Print::println(double n, int digits) {
+    return print(n, digits) + println();
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+    (void)baud;
+}
+
+size_t HardwareSerial::write(uint8_t b) {
+    return fwrite(&b, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t size) {
+    return fwrite(buf, 1, size, stdout);
+}
+
+/* stdout never makes a write wait, so this is just the room an Uno's TX
+ * buffer has */
+int HardwareSerial::availableForWrite(void) {
+    return 63;
+}
+
+int HardwareSerial::available(void) {
+    return 0;
+}
+
+int HardwareSerial::read(void) {
+    return -1;
+}
+
+void HardwareSerial::flush(void) {
+    fflush(stdout);
+}
+
+HardwareSerial Serial;
+
+static uint64_t platformNowUs(void) {
+    static struct timespec epoch = {0, 0};
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (epoch.tv_sec == 0 && epoch.tv_nsec == 0) {
+        epoch = now;
+    }
+
+    return (uint64_t)(now.tv_sec - epoch.tv_sec) * 1000000ULL
+        + (now.tv_nsec - epoch.tv_nsec) / 1000;
+}
+
+/* Like the Arduino core, the clock starts when the program does */
+static uint64_t platform_started = platformNowUs();
+
+unsigned long millis(void) {
+    return (unsigned long)(platformNowUs() / 1000ULL);
+}
+
+unsigned long micros(void) {
+    return (unsigned long)platformNowUs();
+}
+
+void delay(unsigned long ms) {
+    usleep(ms * 1000UL);
+}
+
+void delayMicroseconds(unsigned int us) {
+    usleep(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    (void)pin;
+    (void)val;
+}
@@ -0,0 +1,364 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Coroutine tasks (see SkedCoro.h). A spawned coroutine is a task with
+ * SKED_TASK_CORO set, which runTask() resumes instead of calling fcn. Its
+ * period is never used: timerISR() only releases it when it's asleep
+ * (SKED_TASK_SLEEP) and its wake_tick has come, and a channel releases it
+ * directly. Sleeps longer than a count can hold are made of several counts.
+ */
+
+#include <sys/mman.h>
+#include "./SkedHost.h"
+#include "./SkedCoro.h"
+
+/* ATOMIC_BLOCK in here means this instance's lock */
+#undef SKED_HOST_IRQ
+#define SKED_HOST_IRQ (&_host_irq)
+
+/* Stands in for the function of a coroutine task, which is never called */
+static void skedCoroTask(void) {
+}
+
+/* Bytes reserved for the frame pool */
+static size_t skedCoroPoolSize(void) {
+    return (size_t)SKED_CORO_FRAMES * sizeof(sked_host_frame_t);
+}
+
+/* The pool block a frame is in */
+static sked_host_frame_t *skedCoroBlock(void *frame) {
+    return (sked_host_frame_t *)((uint8_t *)frame
+        - offsetof(sked_host_frame_t, data));
+}
+
+/**
+ * Reserve the frame pool. If the address space can't be had, the pool is
+ * empty and every coroutine comes back invalid.
+ */
+void Sked::hostCoroInit(void) {
+    _host_coro = new sked_host_coro_s();
+    _host_coro->frames = (sked_host_frame_t *)skedHostReserve(
+        skedCoroPoolSize());
+    _host_coro->fresh = 0U;
+    _host_coro->free_list = NULL;
+}
+
+void Sked::hostCoroPoolFree(void) {
+    if (_host_coro->frames != NULL) {
+        munmap(_host_coro->frames, skedCoroPoolSize());
+    }
+    delete _host_coro;
+}
+
+/**
+ * Destroy the frames of spawned coroutines, which go back to the pool.
+ * Called from reset(), with the threads stopped.
+ */
+void Sked::hostCoroReset(void) {
+    for (sked_index_t i = 0; i < _task_count; i++) {
+        sked_task_t *task = &_tasks[i];
+
+        if ((task->flags & SKED_TASK_CORO) && task->coro != NULL) {
+            std::coroutine_handle<>::from_address(task->coro).destroy();
+            task->coro = NULL;
+        }
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sked_coro_stats_t *stats = &_host_coro->stats;
+
+        /* Frames of coroutines that weren't spawned are still out */
+        stats->max_in_use = stats->in_use;
+        stats->allocs = 0U;
+        stats->fails = 0U;
+        stats->max_size = 0U;
+    }
+}
+
+/**
+ * A block from the pool for a coroutine frame.
+ *
+ * @return The frame, or NULL if it's too big or the pool is empty
+ */
+void *Sked::hostCoroAlloc(size_t size) {
+    void *frame = NULL;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sked_host_coro_s *coro = _host_coro;
+        sked_host_frame_t *block = coro->free_list;
+
+        if (size > coro->stats.max_size) {
+            coro->stats.max_size = size;
+        }
+        if (size > SKED_CORO_FRAME_SIZE) {
+            coro->stats.fails++;
+            break;
+        }
+
+        if (block != NULL) {
+            coro->free_list = block->next;
+        } else if (coro->frames != NULL && coro->fresh < SKED_CORO_FRAMES) {
+            /* One that's never been used */
+            block = &coro->frames[coro->fresh++];
+        } else {
+            coro->stats.fails++;
+            break;
+        }
+        block->owner = this;
+        block->task = SKED_INDEX_NONE;
+        coro->stats.allocs++;
+        coro->stats.in_use++;
+        if (coro->stats.in_use > coro->stats.max_in_use) {
+            coro->stats.max_in_use = coro->stats.in_use;
+        }
+        frame = block->data;
+    }
+
+    return frame;
+}
+
+/**
+ * Put a frame's block back in the pool it came from.
+ */
+void Sked::hostCoroFree(void *frame) {
+    sked_host_frame_t *block = skedCoroBlock(frame);
+    Sked *self = block->owner;
+
+    SKED_HOST_ATOMIC(&self->_host_irq) {
+        block->next = self->_host_coro->free_list;
+        self->_host_coro->free_list = block;
+        self->_host_coro->stats.in_use--;
+    }
+}
+
+/**
+ * Run a coroutine task up to its next co_await, or to its end, in which case
+ * its frame goes back to the pool and its slot is freed for the next task
+ * scheduled once the job is over. Called from runTask() without the lock
+ * held, with the task RUNNING.
+ */
+void Sked::hostCoroResume(sked_task_t *task) {
+    std::coroutine_handle<> h = std::coroutine_handle<>::from_address(
+        task->coro);
+
+    h.resume();
+
+    if (h.done()) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            task->coro = NULL;
+            hostTaskFree(task - _tasks, true);
+        }
+        h.destroy();
+    }
+}
+
+/**
+ * Called by releaseTask() with the lock held when a coroutine task's count
+ * runs out.
+ *
+ * @return true if it's due to be released now. If not, its count has been
+ * set to the next tick it could be.
+ */
+bool Sked::hostCoroDue(sked_task_t *task) {
+    uint16_t *count = &_counts[task - _tasks];
+
+    if (!(task->flags & SKED_TASK_SLEEP)) {
+        /* Waiting for a wake(), or finished */
+        *count = 0xFFFFU;
+        return false;
+    }
+
+    int32_t left = (int32_t)(task->wake_tick - _ticks);
+    if (left <= 0) {
+        /* Still on its way out of the job that went to sleep */
+        if (task->state != IDLE) {
+            *count = 1U;
+            return false;
+        }
+
+        task->flags &= ~SKED_TASK_SLEEP;
+        return true;
+    }
+
+    *count = (left > 0xFFFF) ? 0xFFFFU : (uint16_t)left;
+    return false;
+}
+
+/**
+ * Have timerISR() release a coroutine task in this many ticks. With the lock
+ * held.
+ */
+void Sked::hostCoroArm(sked_task_t *task, uint32_t ticks) {
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+    releaseSync();
+#endif
+    /* From the tick it is now, which a tickless tick thread may not have got
+     * to yet */
+    ticks += hostTickLag();
+    task->flags |= SKED_TASK_SLEEP;
+    task->wake_tick = _ticks + ticks;
+    _counts[task - _tasks] = (ticks > 0xFFFFU) ? 0xFFFFU : (uint16_t)ticks;
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+    releaseSync();
+#endif
+    hostArmWake(false);
+}
+
+/**
+ * @return The spawned task a frame belongs to, or NULL if it isn't one of
+ * this Sked's. With the lock held.
+ */
+sked_task_t *Sked::hostCoroTask(void *frame) {
+    sked_host_frame_t *block = skedCoroBlock(frame);
+
+    if (block->owner != this || block->task >= _task_count) {
+        return NULL;
+    }
+
+    sked_task_t *task = &_tasks[block->task];
+    if (!(task->flags & SKED_TASK_CORO) || task->coro != frame) {
+        return NULL;
+    }
+
+    return task;
+}
+
+/**
+ * Suspend the running coroutine task with this frame until it's woken, or
+ * for a number of ticks. From an awaiter's await_suspend().
+ *
+ * @param ticks  How long to sleep, or 0 to wait for hostCoroWake()
+ *
+ * @return SKED_E_OK or SKED_E_INVALID_OPERATION if the frame isn't a
+ * spawned task's
+ */
+int8_t Sked::hostCoroWait(void *frame, uint32_t ticks) {
+    int8_t ret = SKED_E_INVALID_OPERATION;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sked_task_t *task = hostCoroTask(frame);
+
+        if (task != NULL) {
+            if (ticks > 0U) {
+                hostCoroArm(task, ticks);
+            }
+            ret = SKED_E_OK;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Release the coroutine task with this frame, from any thread. If it's still
+ * on its way out of the job that started waiting, it goes on the next tick
+ * instead.
+ */
+void Sked::hostCoroWake(void *frame) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sked_task_t *task = hostCoroTask(frame);
+
+        if (task == NULL) {
+            break;
+        }
+
+        if (task->state == IDLE) {
+            task->flags &= ~SKED_TASK_SLEEP;
+            task->state = READY;
+            task->activations++;
+            task->released_tick = _ticks;
+            hostReadyPush(task - _tasks);
+            hostDispatch();
+        } else {
+            hostCoroArm(task, 1U);
+        }
+    }
+}
+
+/**
+ * Schedule a coroutine as a task. It first runs on the tick after this (or
+ * after start()), and from then on whenever what it awaits comes through.
+ * Each resume is a job, dispatched by priority among the other tasks, and
+ * once the coroutine returns its slot is freed, as by unschedule().
+ *
+ * @param coro  The result of calling the coroutine, whose first parameter is
+ * this Sked; Sked owns the frame from here on
+ * @param priority  As for schedule()
+ *
+ * @return SKED_E_OK - The coroutine was scheduled
+ *         SKED_E_NOT_INITIALIZED - Call init() first
+ *         SKED_E_TOO_MANY_TASKS - No room for more tasks
+ *         SKED_E_INVALID_PRIORITY - The priority isn't valid
+ *         SKED_E_INVALID_FUNCTION - coro has no frame; the pool couldn't
+ *         hold it
+ */
+int8_t Sked::spawn(SkedCoro &&coro, int8_t priority) {
+    int8_t ret = SKED_E_OK;
+
+    if (_state == SKED_STATE_UNINIT) {
+        return SKED_E_NOT_INITIALIZED;
+    }
+    if (priority <= (int8_t)SKED_MIN_PRIORITY) {
+        return SKED_E_INVALID_PRIORITY;
+    }
+    if (!coro.isValid()) {
+        return SKED_E_INVALID_FUNCTION;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (tableFull()) {
+            ret = SKED_E_TOO_MANY_TASKS;
+            break;
+        }
+
+        /* The longest period there is, though it's never released by it */
+        sked_index_t i = insertTask(0xFFFFU, 0U, priority, skedCoroTask);
+        sked_task_t *task = &_tasks[i];
+        task->flags |= SKED_TASK_CORO;
+        task->coro = coro.release();
+        skedCoroBlock(task->coro)->task = i;
+        hostCoroArm(task, 1U);
+    }
+
+    return ret;
+}
+
+/**
+ * co_await sked.sleepFor(us) in a spawned coroutine suspends it for that
+ * long, rounded up to whole ticks (at least one). Like a period, it's counted
+ * in ticks from the one it's awaited in, so it can end up to a tick short.
+ * See SkedSleep.
+ */
+SkedSleep Sked::sleepFor(uint32_t us) {
+    const uint64_t tick_us = SKED_HOST_TICK_NS / 1000ULL;
+    uint32_t ticks = (uint32_t)(((uint64_t)us + tick_us - 1U) / tick_us);
+
+    return SkedSleep(this, (ticks == 0U) ? 1U : ticks);
+}
+
+/**
+ * Copy out the frame pool counters.
+ */
+void Sked::getCoroStats(sked_coro_stats_t *stats) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *stats = _host_coro->stats;
+    }
+}
@@ -0,0 +1,308 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * C++20 coroutine tasks for the host backend. A coroutine returning SkedCoro
+ * is a task written as sequential code: each co_await hands the thread back
+ * and the task is released again when what it's waiting for happens, then
+ * dispatched by priority like any other task, with the same statistics (one
+ * activation and completion per resume). No thread is kept per task.
+ *
+ *   SkedCoro blink(Sked &s, SkedChannel<int, 8> &ch) {
+ *       for (;;) {
+ *           int on = co_await ch.recv();
+ *           digitalWrite(13, on);
+ *           co_await s.sleepFor(500000);
+ *       }
+ *   }
+ *   ...
+ *   sked.spawn(blink(sked, ch), 2);
+ *
+ * The first parameter of the coroutine must be the Sked that will run it:
+ * its frame comes from that Sked's pool (SKED_CORO_FRAMES blocks of
+ * SKED_CORO_FRAME_SIZE bytes), never the global heap. If the pool can't hold
+ * it, the SkedCoro comes back empty and spawn() turns it away.
+ *
+ * Waits are awaited from the spawned coroutine itself, not one it calls.
+ */
+
+#ifndef HOST_SKEDCORO_H
+#define HOST_SKEDCORO_H
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <coroutine>
+#include <Sked.h>
+
+class SkedCoro;
+
+struct SkedCoroPromise {
+    template <typename... Args>
+    static void *operator new(size_t size, Sked &sked, Args &&...) noexcept {
+        return sked.hostCoroAlloc(size);
+    }
+
+    static void operator delete(void *frame) noexcept {
+        Sked::hostCoroFree(frame);
+    }
+
+    static SkedCoro get_return_object_on_allocation_failure(void) noexcept;
+    SkedCoro get_return_object(void) noexcept;
+
+    /* Nothing runs until the first release after spawn(), and the frame
+     * stays until the task is done with it */
+    std::suspend_always initial_suspend(void) noexcept {
+        return {};
+    }
+    std::suspend_always final_suspend(void) noexcept {
+        return {};
+    }
+
+    void return_void(void) noexcept {
+    }
+
+    void unhandled_exception(void) noexcept {
+        abort();
+    }
+};
+
+/* Owns a coroutine frame until spawn() takes it */
+class SkedCoro {
+private:
+    void *_frame;
+
+public:
+    typedef SkedCoroPromise promise_type;
+
+    explicit SkedCoro(void *frame = NULL) : _frame(frame) {
+    }
+
+    SkedCoro(SkedCoro &&other) noexcept : _frame(other._frame) {
+        other._frame = NULL;
+    }
+
+    SkedCoro &operator=(SkedCoro &&other) noexcept {
+        if (this != &other) {
+            this->~SkedCoro();
+            _frame = other.release();
+        }
+        return *this;
+    }
+
+    SkedCoro(const SkedCoro &) = delete;
+    SkedCoro &operator=(const SkedCoro &) = delete;
+
+    ~SkedCoro() {
+        if (_frame != NULL) {
+            std::coroutine_handle<>::from_address(_frame).destroy();
+        }
+    }
+
+    /* false if the pool had no room for it */
+    bool isValid(void) const {
+        return _frame != NULL;
+    }
+
+    void *release(void) {
+        void *frame = _frame;
+        _frame = NULL;
+        return frame;
+    }
+};
+
+inline SkedCoro SkedCoroPromise::get_return_object_on_allocation_failure(
+        void) noexcept {
+    return SkedCoro();
+}
+
+inline SkedCoro SkedCoroPromise::get_return_object(void) noexcept {
+    return SkedCoro(std::coroutine_handle<SkedCoroPromise>::from_promise(
+        *this).address());
+}
+
+/* What co_await sked.sleepFor() waits on. Gives SKED_E_OK, or
+ * SKED_E_INVALID_OPERATION without waiting if it isn't awaited from a
+ * spawned coroutine. */
+class SkedSleep {
+private:
+    Sked *_sked;
+    uint32_t _ticks;
+    int8_t _ret;
+
+public:
+    SkedSleep(Sked *sked, uint32_t ticks)
+        : _sked(sked), _ticks(ticks), _ret(SKED_E_OK) {
+    }
+
+    bool await_ready(void) const noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> h) noexcept {
+        _ret = _sked->hostCoroWait(h.address(), _ticks);
+        return _ret == SKED_E_OK;
+    }
+
+    int8_t await_resume(void) const noexcept {
+        return _ret;
+    }
+};
+
+/* The part of SkedChannel that doesn't depend on what it carries: its lock
+ * and the coroutine waiting in recv() */
+class SkedChannelBase {
+protected:
+    Sked *_sked;
+    pthread_mutex_t _mutex;
+    void *_waiter;
+
+    explicit SkedChannelBase(Sked &sked) : _sked(&sked), _waiter(NULL) {
+        pthread_mutex_init(&_mutex, NULL);
+    }
+
+    ~SkedChannelBase() {
+        pthread_mutex_destroy(&_mutex);
+    }
+
+    /* With _mutex held */
+    bool wait(void *frame) {
+        if (_sked->hostCoroWait(frame, 0U) != SKED_E_OK) {
+            return false;
+        }
+        _waiter = frame;
+        return true;
+    }
+
+    /* Without _mutex held */
+    void wake(void *frame) {
+        if (frame != NULL) {
+            _sked->hostCoroWake(frame);
+        }
+    }
+};
+
+/* A bounded queue of N values of T from any thread or task to one coroutine
+ * task, which waits in co_await recv() while it's empty. */
+template <typename T, uint8_t N>
+class SkedChannel : public SkedChannelBase {
+private:
+    T _items[N];
+    uint8_t _head;
+    uint8_t _count;
+
+    class Recv {
+    private:
+        SkedChannel *_ch;
+
+    public:
+        explicit Recv(SkedChannel *ch) : _ch(ch) {
+        }
+
+        bool await_ready(void) const noexcept {
+            return _ch->available() > 0U;
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) noexcept {
+            bool waiting = false;
+
+            pthread_mutex_lock(&_ch->_mutex);
+            /* Something may have come in since await_ready() */
+            if (_ch->_count == 0U) {
+                waiting = _ch->wait(h.address());
+            }
+            pthread_mutex_unlock(&_ch->_mutex);
+
+            return waiting;
+        }
+
+        /* Only empty if it wasn't awaited from a spawned coroutine */
+        T await_resume(void) noexcept {
+            T value = T();
+
+            _ch->tryRecv(&value);
+            return value;
+        }
+    };
+
+public:
+    explicit SkedChannel(Sked &sked)
+        : SkedChannelBase(sked), _head(0U), _count(0U) {
+    }
+
+    /**
+     * Queue a value and wake the coroutine waiting for it, if there is one.
+     * From any thread, task or coroutine.
+     *
+     * @return SKED_E_OK or SKED_E_BUSY if the channel is full
+     */
+    int8_t send(const T &value) {
+        void *waiter = NULL;
+
+        pthread_mutex_lock(&_mutex);
+        if (_count == N) {
+            pthread_mutex_unlock(&_mutex);
+            return SKED_E_BUSY;
+        }
+        _items[(uint8_t)((_head + _count) % N)] = value;
+        _count++;
+        waiter = _waiter;
+        _waiter = NULL;
+        pthread_mutex_unlock(&_mutex);
+
+        wake(waiter);
+
+        return SKED_E_OK;
+    }
+
+    /**
+     * Take the oldest value without waiting.
+     *
+     * @return true if there was one
+     */
+    bool tryRecv(T *value) {
+        bool got = false;
+
+        pthread_mutex_lock(&_mutex);
+        if (_count > 0U) {
+            *value = _items[_head];
+            _head = (uint8_t)((_head + 1U) % N);
+            _count--;
+            got = true;
+        }
+        pthread_mutex_unlock(&_mutex);
+
+        return got;
+    }
+
+    /* co_await recv() gives the oldest value, waiting for one if need be */
+    Recv recv(void) {
+        return Recv(this);
+    }
+
+    uint8_t available(void) {
+        pthread_mutex_lock(&_mutex);
+        uint8_t count = _count;
+        pthread_mutex_unlock(&_mutex);
+
+        return count;
+    }
+};
+
+#endif /* HOST_SKEDCORO_H */
@@ -0,0 +1,178 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Countdown kernels. The vector ones count 16 counters down per instruction
+ * with a saturating subtract (which is the "stop at 0" for free), compare
+ * the results with 0, narrow the compare to a byte per counter and take the
+ * release bits with a movemask. Whatever doesn't fill a vector goes through
+ * the scalar loop.
+ *
+ * x86 kernels are built for their instruction set with target attributes
+ * and only picked if the CPU reports it, so one binary runs anywhere. SSE2
+ * is part of x86-64, so the 128-bit kernel needs nothing newer.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "./SkedCountdown.h"
+
+static uint32_t skedCountdownTail(uint16_t *counts, uint32_t i, uint32_t n,
+        uint64_t *mask) {
+    uint32_t released = 0U;
+
+    for (; i < n; i++) {
+        if (counts[i] != 0U) {
+            counts[i]--;
+        }
+        if (counts[i] == 0U) {
+            mask[i / 64U] |= 1ULL << (i % 64U);
+            released++;
+        }
+    }
+
+    return released;
+}
+
+uint32_t skedCountdownScalar(uint16_t *counts, uint32_t n, uint64_t *mask) {
+    memset(mask, 0, ((n + 63U) / 64U) * sizeof(*mask));
+
+    return skedCountdownTail(counts, 0U, n, mask);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+uint32_t skedCountdownSse2(uint16_t *counts, uint32_t n, uint64_t *mask) {
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t released = 0U;
+    uint32_t i = 0U;
+
+    memset(mask, 0, ((n + 63U) / 64U) * sizeof(*mask));
+
+    for (; i + 16U <= n; i += 16U) {
+        __m128i *p = (__m128i *)&counts[i];
+        __m128i a = _mm_subs_epu16(_mm_loadu_si128(p), one);
+        __m128i b = _mm_subs_epu16(_mm_loadu_si128(p + 1), one);
+
+        _mm_storeu_si128(p, a);
+        _mm_storeu_si128(p + 1, b);
+
+        /* 0xFFFF or 0 per counter, so the signed pack keeps it */
+        uint32_t bits = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(
+            _mm_cmpeq_epi16(a, zero), _mm_cmpeq_epi16(b, zero)));
+        if (bits != 0U) {
+            mask[i / 64U] |= (uint64_t)bits << (i % 64U);
+            released += (uint32_t)__builtin_popcount(bits);
+        }
+    }
+
+    return released + skedCountdownTail(counts, i, n, mask);
+}
+
+__attribute__((target("avx2")))
+uint32_t skedCountdownAvx2(uint16_t *counts, uint32_t n, uint64_t *mask) {
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t released = 0U;
+    uint32_t i = 0U;
+
+    memset(mask, 0, ((n + 63U) / 64U) * sizeof(*mask));
+
+    for (; i + 32U <= n; i += 32U) {
+        __m256i *p = (__m256i *)&counts[i];
+        __m256i a = _mm256_subs_epu16(_mm256_loadu_si256(p), one);
+        __m256i b = _mm256_subs_epu16(_mm256_loadu_si256(p + 1), one);
+
+        _mm256_storeu_si256(p, a);
+        _mm256_storeu_si256(p + 1, b);
+
+        /* The pack works within 128-bit lanes, leaving the quarters in the
+         * order a0 b0 a1 b1; put them back as a0 a1 b0 b1 */
+        __m256i zeros = _mm256_permute4x64_epi64(_mm256_packs_epi16(
+            _mm256_cmpeq_epi16(a, zero), _mm256_cmpeq_epi16(b, zero)), 0xD8);
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(zeros);
+        if (bits != 0U) {
+            mask[i / 64U] |= (uint64_t)bits << (i % 64U);
+            released += (uint32_t)__builtin_popcount(bits);
+        }
+    }
+
+    return released + skedCountdownTail(counts, i, n, mask);
+}
+#endif
+
+/* Slowest first */
+static const sked_countdown_t sked_countdown_kernels[] = {
+    {"scalar", skedCountdownScalar},
+#if defined(__x86_64__) || defined(__i386__)
+    {"sse2", skedCountdownSse2},
+    {"avx2", skedCountdownAvx2},
+#endif
+};
+
+/**
+ * @param kernels  Set to the kernels this CPU can run, slowest first
+ *
+ * @return How many there are
+ */
+uint8_t skedCountdownKernels(const sked_countdown_t **kernels) {
+    uint8_t count = 1U;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        count = 2U;
+        if (__builtin_cpu_supports("avx2")) {
+            count = 3U;
+        }
+    }
+#endif
+
+    *kernels = sked_countdown_kernels;
+    return count;
+}
+
+static sked_countdown_fcn_t skedCountdownPick(void) {
+    const sked_countdown_t *kernels;
+    uint8_t count = skedCountdownKernels(&kernels);
+    const char *name = getenv("SKED_COUNTDOWN");
+
+    for (uint8_t k = 0; name != NULL && k < count; k++) {
+        if (strcmp(kernels[k].name, name) == 0) {
+            return kernels[k].fcn;
+        }
+    }
+
+    return kernels[count - 1U].fcn;
+}
+
+/**
+ * @return The kernel for timerISR(): the fastest this CPU can run, unless
+ * SKED_COUNTDOWN in the environment names one of the others (e.g. "scalar")
+ */
+sked_countdown_fcn_t skedCountdownSelect(void) {
+    /* Picked once, by whichever Sked is constructed first */
+    static const sked_countdown_fcn_t selected = skedCountdownPick();
+
+    return selected;
+}
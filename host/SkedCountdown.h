@@ -0,0 +1,55 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Countdown kernels for the host backend. On the host, task counts are kept
+ * in an array of their own rather than in the task table, and each tick
+ * timerISR() counts the whole array down in one call instead of walking the
+ * table. Kernels take any number of counters, so they can be measured on
+ * tables far bigger than a Sked holds.
+ */
+
+#ifndef HOST_SKEDCOUNTDOWN_H
+#define HOST_SKEDCOUNTDOWN_H
+
+#include <stdint.h>
+
+/* Counts every counter down by one, stopping at 0, and sets bit i of mask
+ * (64 to a word) for each counter that's 0 afterwards, clearing the rest:
+ * timerISR()'s release step for a whole table. mask needs (n + 63) / 64
+ * words. Returns how many counters are at 0. */
+typedef uint32_t (*sked_countdown_fcn_t)(uint16_t *counts, uint32_t n,
+    uint64_t *mask);
+
+typedef struct {
+    const char *name;
+    sked_countdown_fcn_t fcn;
+} sked_countdown_t;
+
+uint32_t skedCountdownScalar(uint16_t *counts, uint32_t n, uint64_t *mask);
+#if defined(__x86_64__) || defined(__i386__)
+uint32_t skedCountdownSse2(uint16_t *counts, uint32_t n, uint64_t *mask);
+uint32_t skedCountdownAvx2(uint16_t *counts, uint32_t n, uint64_t *mask);
+#endif
+
+uint8_t skedCountdownKernels(const sked_countdown_t **kernels);
+sked_countdown_fcn_t skedCountdownSelect(void);
+
+#endif /* HOST_SKEDCOUNTDOWN_H */
@@ -0,0 +1,3236 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *---------------------------------------------------------------------------
+ *
+ * Linux backend for Sked (build with SKED_HOST=1, see host.mk).
+ *
+ * The rest of Sked runs unchanged on top of three things:
+ *   - "Interrupts off" (ATOMIC_BLOCK) is a lock per Sked instance, see
+ *     host/util/atomic.h.
+ *   - TIMER1 is a tick thread waiting in epoll on a timerfd that expires
+ *     every 100us on absolute CLOCK_MONOTONIC deadlines, and calls
+ *     timerISR() with the lock held. If it wakes late, it runs timerISR()
+ *     once per tick it missed, so counts, misses and overruns mean exactly
+ *     what they do on AVR. The same epoll set carries post() wakeups and
+ *     the fds of tasks from scheduleFd(), so I/O releases tasks as soon as
+ *     it's ready, in the same priority order as periodic work. With
+ *     setTickless(), the timerfd is only set for the next tick a release
+ *     is due on, and setSlack() lets releases wait to share a wakeup.
+ *     Releases in setSpin() bands get a timer set a little early and the
+ *     rest of the wait spun out on the clock, since the kernel's timers
+ *     jitter by tens of microseconds.
+ *   - In preemptive mode, nesting tasks on one stack becomes one worker
+ *     thread per priority band (each distinct task priority unless
+ *     setPriorityBands() says otherwise). With SCHED_FIFO, the kernel
+ *     preempts lower bands the way the tick interrupt does on AVR. Tasks in
+ *     a band share a thread, so they never preempt each other, and a task
+ *     never runs concurrently with itself.
+ *
+ * Without the privilege for SCHED_FIFO, priority is emulated: lower bands
+ * run at higher nice levels, and a worker won't start a job while a higher
+ * band has one waiting or running, as on a single core. Each band measures
+ * its release-to-start latency either way (getDispatchLatency()).
+ *
+ * In non-preemptive mode, tasks run from whatever thread calls loop(), which
+ * sleeps instead of spinning when nothing is ready, or with setWorkers(), on
+ * a work-stealing pool of threads.
+ *
+ * The task table isn't a fixed, sorted array as on AVR: it's reserved for
+ * SKED_HOST_MAX_TASKS and filled in as tasks are added, each keeping its
+ * index for life. Priority order is kept by a FIFO of READY tasks per
+ * priority instead, so dispatch never looks through the table. A big, fixed
+ * set of tasks can go in all at once from a file (loadSchedule()).
+ *
+ * Instances are independent, each with its own lock, tick thread and workers,
+ * and setCpu() keeps one on a single CPU. SkedPartition (host/SkedPartition.h)
+ * spreads tasks over one instance per core that way. Instances in
+ * different processes can count the same ticks from an epoch kept in a
+ * shared file (shareTimebase(), joinTimebase()), and release in phase.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "./SkedHost.h"
+
+/* ATOMIC_BLOCK in here means this instance's lock */
+#undef SKED_HOST_IRQ
+#define SKED_HOST_IRQ (&_host_irq)
+
+void skedHostIrqInit(sked_host_irq_t *irq) {
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&irq->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    irq->depth = 0U;
+}
+
+void skedHostIrqDestroy(sked_host_irq_t *irq) {
+    pthread_mutex_destroy(&irq->mutex);
+}
+
+void skedHostIrqLock(sked_host_irq_t *irq) {
+    pthread_mutex_lock(&irq->mutex);
+    irq->depth++;
+}
+
+void skedHostIrqUnlock(sked_host_irq_t *irq) {
+    irq->depth--;
+    pthread_mutex_unlock(&irq->mutex);
+}
+
+/**
+ * Let go of the lock however deeply it's held, for NONATOMIC_BLOCK. The
+ * calling thread must hold it.
+ *
+ * @return The depth to hand back to skedHostIrqRestore()
+ */
+unsigned skedHostIrqRelease(sked_host_irq_t *irq) {
+    unsigned depth = irq->depth;
+
+    irq->depth = 0U;
+    for (unsigned i = 0; i < depth; i++) {
+        pthread_mutex_unlock(&irq->mutex);
+    }
+
+    return depth;
+}
+
+void skedHostIrqRestore(sked_host_irq_t *irq, unsigned depth) {
+    if (depth == 0U) {
+        return;
+    }
+
+    for (unsigned i = 0; i < depth; i++) {
+        pthread_mutex_lock(&irq->mutex);
+    }
+    irq->depth = depth;
+}
+
+/**
+ * Wait on a condition variable with the lock held (at any depth), letting go
+ * of it entirely while waiting, as NONATOMIC_BLOCK would.
+ *
+ * @param deadline  CLOCK_MONOTONIC time to give up at, or NULL to wait as
+ * long as it takes
+ */
+void skedHostIrqWait(sked_host_irq_t *irq, pthread_cond_t *cv,
+        const struct timespec *deadline) {
+    unsigned depth = irq->depth;
+
+    irq->depth = 0U;
+    for (unsigned i = 1; i < depth; i++) {
+        pthread_mutex_unlock(&irq->mutex);
+    }
+
+    if (deadline != NULL) {
+        pthread_cond_timedwait(cv, &irq->mutex, deadline);
+    } else {
+        pthread_cond_wait(cv, &irq->mutex);
+    }
+
+    for (unsigned i = 1; i < depth; i++) {
+        pthread_mutex_lock(&irq->mutex);
+    }
+    irq->depth = depth;
+}
+
+/**
+ * The lock ATOMIC_BLOCK takes outside of Sked itself.
+ */
+sked_host_irq_t *skedHostIrqGlobal(void) {
+    static sked_host_irq_t irq = {PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP, 0U};
+
+    return &irq;
+}
+
+uint64_t skedHostClockNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void skedHostTimespecAddNs(struct timespec *ts, uint64_t ns) {
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+}
+
+static uint64_t skedHostEpochNs(struct sked_host_s *host) {
+    return (uint64_t)host->epoch.tv_sec * 1000000000ULL + host->epoch.tv_nsec;
+}
+
+/**
+ * @return The histogram bucket of a time: the first i it's under 2^i us
+ * for, or the last one
+ */
+static uint8_t skedHostBucket(uint32_t us) {
+    uint8_t bucket = 0U;
+
+    while (bucket < SKED_LATENCY_BUCKETS - 1U && us >= (1UL << bucket)) {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static void skedHostCondInit(pthread_cond_t *cv) {
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cv, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* Bytes to reserve for SKED_HOST_MAX_TASKS of something, in whole pages
+ * so the parts of the table that follow stay aligned */
+size_t skedHostTableSize(size_t each) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    return ((size_t)SKED_HOST_MAX_TASKS * each + page - 1U) / page * page;
+}
+
+/**
+ * Reserve address space that's only backed by memory as it's first
+ * touched, and reads as zeros until then.
+ *
+ * @return The mapping, or NULL if the address space can't be had
+ */
+void *skedHostReserve(size_t size) {
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    return (map != MAP_FAILED) ? map : NULL;
+}
+
+/**
+ * Start a thread, at the given SCHED_FIFO priority if rt_prio isn't 0, and
+ * only on the given CPU if cpu isn't SKED_CPU_ANY.
+ *
+ * @return 0 on success, EPERM if real-time scheduling isn't allowed, or
+ * another errno
+ */
+static int skedHostThread(pthread_t *thread, void *(*fcn)(void *), void *arg,
+        int rt_prio, int16_t cpu) {
+    pthread_attr_t attr;
+    int err;
+
+    pthread_attr_init(&attr);
+    if (cpu != SKED_CPU_ANY) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    if (rt_prio != 0) {
+        struct sched_param param;
+
+        param.sched_priority = rt_prio;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+
+    err = pthread_create(thread, &attr, fcn, arg);
+    pthread_attr_destroy(&attr);
+
+    return err;
+}
+
+Sked::~Sked(void) {
+    reset();
+    hostPostFree();
+    hostCoroPoolFree();
+    exportStats(NULL);
+    joinTimebase(NULL);
+    hostTableFree();
+    skedHostIrqDestroy(&_host_irq);
+}
+
+/* Bytes of the mapping hostTableInit() reserves: the tasks, the counts, the
+ * fd map and the release mask, in that order */
+static size_t skedHostTableMapSize(void) {
+    return skedHostTableSize(sizeof(sked_task_t))
+        + skedHostTableSize(sizeof(uint16_t))
+        + skedHostTableSize(sizeof(sked_index_t))
+        + skedHostTableSize(1U) / 8U + sizeof(uint64_t);
+}
+
+/**
+ * Reserve the task table and the counts for SKED_HOST_MAX_TASKS. Nothing is
+ * backed by memory until it's first touched, so a table costs what it
+ * holds, it grows a page at a time without moving, and pointers to tasks
+ * stay good for as long as the task does. If the address space can't be
+ * had, the table stays empty and schedule() says it's full.
+ */
+void Sked::hostTableInit(void) {
+    size_t tasks = skedHostTableSize(sizeof(sked_task_t));
+    size_t counts = skedHostTableSize(sizeof(uint16_t));
+    size_t fds = skedHostTableSize(sizeof(sked_index_t));
+    uint8_t *map = (uint8_t *)skedHostReserve(skedHostTableMapSize());
+
+    if (map == NULL) {
+        _tasks = NULL;
+        _counts = NULL;
+        _host_fd_task = NULL;
+        _host_released = NULL;
+        return;
+    }
+
+    /* Page aligned, so the counts suit the widest countdown kernel */
+    _tasks = (sked_task_t *)map;
+    _counts = (uint16_t *)(map + tasks);
+    _host_fd_task = (sked_index_t *)(map + tasks + counts);
+    _host_released = (uint64_t *)(map + tasks + counts + fds);
+}
+
+void Sked::hostTableFree(void) {
+    if (_tasks != NULL) {
+        munmap(_tasks, skedHostTableMapSize());
+        _tasks = NULL;
+    }
+}
+
+/**
+ * Run this instance's tick and worker threads on one CPU only. Takes effect
+ * at the next start(). With one instance per CPU (see SkedPartition), each
+ * core releases and runs its own tasks without sharing a lock with the
+ * others.
+ *
+ * @param cpu  CPU number, or SKED_CPU_ANY to let the kernel choose
+ *
+ * @return SKED_E_OK - Set for the next start()
+ *         SKED_E_BUSY - Sked is running; reset() first
+ *         SKED_E_INVALID_OPERATION - No such CPU
+ */
+int8_t Sked::setCpu(int16_t cpu) {
+    int8_t ret = SKED_E_OK;
+
+    if (cpu != SKED_CPU_ANY && (cpu < 0 || cpu >= CPU_SETSIZE
+            || cpu >= sysconf(_SC_NPROCESSORS_CONF))) {
+        return SKED_E_INVALID_OPERATION;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host != NULL) {
+            ret = SKED_E_BUSY;
+            break;
+        }
+
+        _host_cpu = cpu;
+    }
+
+    return ret;
+}
+
+/**
+ * @return The CPU set by setCpu()
+ */
+int16_t Sked::getCpu(void) {
+    return _host_cpu;
+}
+
+/**
+ * Ask for SCHED_FIFO threads (the default). Takes effect at the next start().
+ * Without the privilege for it (CAP_SYS_NICE or an RLIMIT_RTPRIO), Sked falls
+ * back to normal threads; see isRealtime().
+ *
+ * @param enable  false to always use normal threads
+ */
+void Sked::setRealtime(bool enable) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        _host_realtime = enable;
+    }
+}
+
+/**
+ * Have the tick thread sleep until the next release is due instead of waking
+ * up every tick, and then run timerISR() for the ticks gone by. Releases
+ * happen on the same ticks as they would otherwise, but the tick count only
+ * moves when the thread wakes up, and with setSlack() several releases can
+ * share one wakeup. Takes effect at the next start(). See getWakeStats().
+ *
+ * @param enable  true to go tickless, false to tick every 100us (the
+ * default)
+ */
+void Sked::setTickless(bool enable) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        _host_tickless = enable;
+    }
+}
+
+/**
+ * Let a task's releases be up to this late, so that a tickless tick thread
+ * (see setTickless()) can wake up once for several of them: it sleeps until
+ * the earliest time some task can't wait any longer, and everything due by
+ * then goes out together. Keep it well under the period, or releases merge
+ * into misses. The job still sees its release as the tick it was due on, so
+ * the lateness shows up in getDispatchLatency() and getWakeStats().
+ *
+ * @param fcn  A scheduled task function
+ * @param slack_us  How late its releases may be, 0 (the default) for none
+ *
+ * @return SKED_E_OK - The slack was set
+ *         SKED_E_INVALID_FUNCTION - No task runs that function
+ *         SKED_E_INVALID_PERIOD - slack_us is longer than a count can hold
+ */
+int8_t Sked::setSlack(sked_task_fcn_t fcn, uint32_t slack_us) {
+    int8_t ret = SKED_E_INVALID_FUNCTION;
+    uint32_t slack = slack_us / (uint32_t)(SKED_HOST_TICK_NS / 1000ULL);
+
+    if (slack > 0xFFFFU) {
+        return SKED_E_INVALID_PERIOD;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            if (_tasks[i].fcn == fcn) {
+                _tasks[i].slack = (uint16_t)slack;
+                ret = SKED_E_OK;
+            }
+        }
+
+        /* Less slack can mean waking up sooner */
+        if (ret == SKED_E_OK) {
+            hostArmWake(false);
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Copy out the tick thread's wakeup counters, all 0 unless Sked is running.
+ */
+void Sked::getWakeStats(sked_wake_stats_t *stats) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host == NULL) {
+            stats->ticks = 0U;
+            stats->wakeups = 0U;
+            stats->releases = 0U;
+            stats->late_total_us = 0U;
+            stats->late_max_us = 0U;
+            break;
+        }
+
+        *stats = _host->wake;
+        stats->ticks = (uint32_t)((skedHostClockNs() - skedHostEpochNs(_host))
+            / SKED_HOST_TICK_NS);
+    }
+}
+
+/**
+ * Have the tick thread sleep until shortly before each release in the band
+ * holding this priority and spin on the clock for the rest, so the band's
+ * jobs are released within a microsecond or so of their tick instead of
+ * whenever the kernel's timer gets around to it. The margin it leaves for
+ * spinning calibrates itself from how late the timer has been going off
+ * (see getSpinStats()). Spinning costs up to the margin in CPU time per
+ * release on the tick thread's core, so keep it to the bands that need it.
+ * With only one CPU online, or one set by setCpu(), the tick thread shares
+ * it with the workers and sleeps as usual instead. Set it before start();
+ * changes only take effect while running if Sked is tickless or already has
+ * a spinning band.
+ *
+ * @param priority  Any priority in the band
+ * @param enable  true to spin for the band's releases, false to sleep
+ *
+ * @return SKED_E_OK - The band spins (or doesn't)
+ *         SKED_E_INVALID_PRIORITY - There are already as many spinning
+ *         priorities as there can be tasks
+ */
+int8_t Sked::setSpin(int8_t priority, bool enable) {
+    int8_t ret = SKED_E_OK;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint8_t s = 0U;
+
+        while (s < _host_spins && _host_spin[s] != priority) {
+            s++;
+        }
+
+        if (!enable) {
+            if (s < _host_spins) {
+                _host_spin[s] = _host_spin[--_host_spins];
+            }
+        } else if (s == _host_spins) {
+            if (_host_spins == SKED_MAX_TASKS) {
+                ret = SKED_E_INVALID_PRIORITY;
+                break;
+            }
+            _host_spin[_host_spins++] = priority;
+            /* The next wakeup may want to be earlier now */
+            hostArmWake(false);
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Copy out how the setSpin() wakeups have gone, all 0 unless Sked is
+ * running.
+ */
+void Sked::getSpinStats(sked_spin_stats_t *stats) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host == NULL) {
+            memset(stats, 0, sizeof(*stats));
+            break;
+        }
+
+        *stats = _host->spin;
+    }
+}
+
+/**
+ * The host keeps task counts out of sked_task_t (see host/SkedCountdown.h);
+ * this is where getTaskInfo() callers find them.
+ *
+ * @param i  Task index, as for getTaskInfo()
+ *
+ * @return Ticks until the task's next release, or 0 if there's no such task
+ */
+uint16_t Sked::getCountdown(sked_index_t i) {
+    uint16_t count = 0U;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (i >= _task_count) {
+            break;
+        }
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+        releaseSync();
+#endif
+        count = _counts[i];
+    }
+
+    return count;
+}
+
+static size_t skedHostShmSize(void) {
+    return sizeof(sked_shm_header_t)
+        + (size_t)SKED_HOST_MAX_TASKS * sizeof(sked_shm_task_t);
+}
+
+/**
+ * Keep every task's counters, execution times and histogram in a file that
+ * monitors can map and read without a syscall or lock on Sked's side (see
+ * sked_shm_header_t and tools/skedtop.py). A task's record is written when
+ * each of its jobs finishes, and everything is written again when the table
+ * changes and every SKED_HOST_SHM_TICKS ticks, so misses of a task that
+ * never finishes show up too. Put the file on a tmpfs (/dev/shm) so it's
+ * never written back to disk.
+ *
+ * The file has a record for every slot the table can grow to, so its
+ * apparent size is the header plus SKED_HOST_MAX_TASKS records (about
+ * 120MiB as things stand). It's sparse, though: only the records of slots
+ * in use ever take memory. Records a previous run left in it are cleared when it's
+ * opened, so none of them can turn up again once the table grows.
+ *
+ * @param path  File to create or overwrite, or NULL to stop exporting
+ *
+ * @return SKED_E_OK or SKED_E_INVALID_OPERATION if the file can't be
+ * created and mapped
+ */
+int8_t Sked::exportStats(const char *path) {
+    size_t size = skedHostShmSize();
+    sked_shm_header_t *shm = NULL;
+    sked_shm_header_t *old;
+
+    if (path != NULL) {
+        int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return SKED_E_INVALID_OPERATION;
+        }
+        bool sized = (ftruncate(fd, size) == 0);
+        /* A hole reads back as zeros without taking memory, and unlike
+         * truncating, doesn't pull the records out from under a monitor
+         * that still has them mapped */
+        if (sized && fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                sizeof(sked_shm_header_t),
+                size - sizeof(sked_shm_header_t)) != 0) {
+            /* No holes on this filesystem: cut the records off instead */
+            sized = (ftruncate(fd, sizeof(sked_shm_header_t)) == 0
+                && ftruncate(fd, size) == 0);
+        }
+        if (sized) {
+            void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+            shm = (map != MAP_FAILED) ? (sked_shm_header_t *)map : NULL;
+        }
+        close(fd);
+        if (shm == NULL) {
+            return SKED_E_INVALID_OPERATION;
+        }
+
+        /* Readers take a 0 magic as not ready yet */
+        memset(shm, 0, sizeof(sked_shm_header_t));
+        shm->version = SKED_SHM_VERSION;
+        shm->task_size = sizeof(sked_shm_task_t);
+        shm->max_tasks = SKED_HOST_MAX_TASKS;
+        shm->tick_us = SKED_HOST_TICK_NS / 1000ULL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        old = _host_shm;
+        _host_shm = shm;
+        if (shm != NULL) {
+            hostShmPublish();
+            std::atomic_ref<uint32_t>(shm->magic).store(SKED_SHM_MAGIC,
+                std::memory_order_release);
+        }
+    }
+
+    if (old != NULL) {
+        munmap(old, size);
+    }
+
+    return SKED_E_OK;
+}
+
+/**
+ * Write one task's record of the exported stats. With the lock held, which
+ * makes this the only writer.
+ *
+ * @param done  Its job just finished: it's still RUNNING, but the caller
+ * marks it IDLE as soon as runTask() returns
+ */
+void Sked::hostShmTask(sked_index_t i, bool done) {
+    sked_shm_task_t *rec = (sked_shm_task_t *)(_host_shm + 1) + i;
+    const sked_task_t *task = &_tasks[i];
+    std::atomic_ref<uint32_t> seq(rec->seq);
+    uint32_t s = seq.load(std::memory_order_relaxed);
+
+    seq.store(s + 1U, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    rec->priority = task->priority;
+    rec->state = done ? (uint8_t)IDLE : (uint8_t)task->state;
+    rec->flags = (uint8_t)task->flags;
+    rec->period_us = (uint32_t)task->period
+        * (uint32_t)(SKED_HOST_TICK_NS / 1000ULL);
+    rec->activations = task->activations;
+    rec->completions = task->completions;
+    rec->misses = task->misses;
+    rec->overruns = task->overruns;
+    rec->max_exec_us = task->max_exec_us;
+    rec->last_exec_us = task->last_exec_us;
+    rec->total_exec_us = task->total_exec_us;
+    rec->fcn = (uint64_t)(uintptr_t)task->fcn;
+    memcpy(rec->exec_hist, task->exec_hist, sizeof(rec->exec_hist));
+
+    seq.store(s + 2U, std::memory_order_release);
+}
+
+/**
+ * Write the header of the exported stats, if there are any. With the lock
+ * held.
+ *
+ * @return Whether stats are being exported
+ */
+bool Sked::hostShmHeader(void) {
+    sked_shm_header_t *shm = _host_shm;
+
+    if (shm == NULL) {
+        return false;
+    }
+
+    std::atomic_ref<uint32_t> seq(shm->seq);
+    uint32_t s = seq.load(std::memory_order_relaxed);
+
+    seq.store(s + 1U, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    shm->task_count = _task_count;
+    shm->mode = (uint8_t)_mode;
+    shm->ticks = _ticks;
+    shm->updated_ns = skedHostClockNs();
+    seq.store(s + 2U, std::memory_order_release);
+
+    return true;
+}
+
+/**
+ * Write the whole of the exported stats, if there are any. With the lock
+ * held.
+ */
+void Sked::hostShmPublish(void) {
+    if (!hostShmHeader()) {
+        return;
+    }
+
+    for (sked_index_t i = 0; i < _task_count; i++) {
+        hostShmTask(i, false);
+    }
+    _host_shm_tick = _ticks;
+}
+
+/**
+ * Write the header of the exported stats, and the records of tasks whose
+ * counts moved on without a job finishing: releases, misses and overruns
+ * are counted by timerISR(), which doesn't export them itself. Called from
+ * the tick thread every SKED_HOST_SHM_TICKS ticks, with the lock held.
+ */
+void Sked::hostShmRefresh(void) {
+    if (!hostShmHeader()) {
+        return;
+    }
+
+    const sked_shm_task_t *recs = (const sked_shm_task_t *)(_host_shm + 1);
+    for (sked_index_t i = 0; i < _task_count; i++) {
+        const sked_task_t *task = &_tasks[i];
+
+        if (recs[i].activations != task->activations
+                || recs[i].misses != task->misses
+                || recs[i].overruns != task->overruns
+                || recs[i].state != (uint8_t)task->state) {
+            hostShmTask(i, false);
+        }
+    }
+    _host_shm_tick = _ticks;
+}
+
+/**
+ * Called from runTask() with the lock held once a job is done: add its
+ * execution time to the task's histogram and totals, and export them.
+ */
+void Sked::hostRecordExec(sked_index_t i, uint32_t exec_us) {
+    sked_task_t *task = &_tasks[i];
+
+    task->last_exec_us = exec_us;
+    task->total_exec_us += exec_us;
+    task->exec_hist[skedHostBucket(exec_us)]++;
+
+    if (_host_shm != NULL) {
+        hostShmTask(i, true);
+    }
+}
+
+/**
+ * Map the timebase file at path, making it with an epoch of now first if
+ * create is true and it doesn't hold one yet.
+ *
+ * @return SKED_E_OK - Mapped in *timebase
+ *         SKED_E_INVALID_OPERATION - It couldn't be opened or mapped
+ *         SKED_E_NO_DATA - It doesn't hold a timebase with Sked's tick (yet)
+ */
+static int8_t skedHostTimebaseMap(const char *path, bool create,
+        sked_timebase_t **timebase) {
+    size_t size = sizeof(sked_timebase_t);
+    struct stat st;
+    void *map = MAP_FAILED;
+    int8_t ret = SKED_E_OK;
+    int fd = open(path, create ? (O_RDWR | O_CREAT | O_CLOEXEC)
+        : (O_RDONLY | O_CLOEXEC), 0644);
+
+    if (fd < 0) {
+        return SKED_E_INVALID_OPERATION;
+    }
+
+    if (create) {
+        /* One process at a time gets to decide on the epoch */
+        flock(fd, LOCK_EX);
+        if (fstat(fd, &st) == 0 && ((size_t)st.st_size >= size
+                || ftruncate(fd, size) == 0)) {
+            map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                0);
+        }
+    } else if (fstat(fd, &st) == 0) {
+        if ((size_t)st.st_size < size) {
+            close(fd);
+            return SKED_E_NO_DATA;
+        }
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+
+    if (map == MAP_FAILED) {
+        close(fd);
+        return SKED_E_INVALID_OPERATION;
+    }
+
+    sked_timebase_t *tb = (sked_timebase_t *)map;
+    std::atomic_ref<uint32_t> magic(tb->magic);
+    bool valid = magic.load(std::memory_order_acquire) == SKED_TIMEBASE_MAGIC
+        && tb->version == SKED_TIMEBASE_VERSION
+        && tb->tick_ns == SKED_HOST_TICK_NS;
+
+    if (create && (!valid || tb->epoch_ns > skedHostClockNs())) {
+        /* A new beat, from now on */
+        std::atomic_ref<uint32_t> seq(tb->seq);
+        uint32_t s = seq.load(std::memory_order_relaxed) | 1U;
+
+        seq.store(s, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        tb->version = SKED_TIMEBASE_VERSION;
+        tb->reserved = 0U;
+        tb->tick_ns = SKED_HOST_TICK_NS;
+        tb->epoch_ns = skedHostClockNs();
+        seq.store(s + 1U, std::memory_order_release);
+        magic.store(SKED_TIMEBASE_MAGIC, std::memory_order_release);
+        valid = true;
+    }
+
+    /* The lock only serializes checking the header and setting it up;
+     * it's let go of here, as close() alone wouldn't while the mapping
+     * holds the file open */
+    if (create) {
+        flock(fd, LOCK_UN);
+    }
+    close(fd);
+
+    if (!valid) {
+        munmap(map, size);
+        ret = SKED_E_NO_DATA;
+    } else {
+        *timebase = tb;
+    }
+
+    return ret;
+}
+
+/**
+ * Count ticks on a beat other processes can share: the timebase in the file
+ * at path (typically under /dev/shm), which is given an epoch of now if it
+ * doesn't have one yet. From the next start(), this instance lines up with
+ * it the same way as joinTimebase(). An existing timebase is kept, so the
+ * process that hosts it can restart without putting the others out of
+ * phase; remove the file for a new one.
+ *
+ * @param path  The file, or NULL to count ticks from start() again
+ *
+ * @return SKED_E_OK - Lined up from the next start()
+ *         SKED_E_BUSY - Sked is running; reset() first
+ *         SKED_E_INVALID_OPERATION - The file couldn't be made or mapped
+ */
+int8_t Sked::shareTimebase(const char *path) {
+    return hostTimebaseSet(path, true);
+}
+
+/**
+ * From the next start(), count ticks from the epoch of the timebase in the
+ * file at path, which another process made with shareTimebase(). The tick
+ * count becomes the ticks since the epoch, the tick thread wakes up on the
+ * same boundaries as everyone else's, and each task's count moves on as
+ * though it had been scheduled at tick 0. Tasks with the same period and
+ * offset are then released on the same tick in every process, and a
+ * pipeline of them keeps its phases. Every instance reads the same
+ * CLOCK_MONOTONIC, so nothing passes between them per tick and they never
+ * drift apart.
+ *
+ * After restore(), the snapshot's counts carry on from its tick count
+ * instead, which is the shared one if it was taken on the same timebase.
+ * Tasks released by fds or waiting coroutines stay as they are.
+ *
+ * @param path  The file, or NULL to count ticks from start() again
+ *
+ * @return SKED_E_OK - Lined up from the next start()
+ *         SKED_E_BUSY - Sked is running; reset() first
+ *         SKED_E_INVALID_OPERATION - The file couldn't be opened or mapped
+ *         SKED_E_NO_DATA - The file has no timebase yet, or one with a
+ *         different tick
+ */
+int8_t Sked::joinTimebase(const char *path) {
+    return hostTimebaseSet(path, false);
+}
+
+int8_t Sked::hostTimebaseSet(const char *path, bool create) {
+    sked_timebase_t *timebase = NULL;
+    sked_timebase_t *old = NULL;
+    int8_t ret = SKED_E_OK;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host != NULL) {
+            ret = SKED_E_BUSY;
+        }
+    }
+    if (ret != SKED_E_OK) {
+        return ret;
+    }
+
+    if (path != NULL) {
+        ret = skedHostTimebaseMap(path, create, &timebase);
+        if (ret != SKED_E_OK) {
+            return ret;
+        }
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host != NULL) {
+            ret = SKED_E_BUSY;
+            old = timebase;
+            break;
+        }
+
+        old = _host_timebase;
+        _host_timebase = timebase;
+    }
+
+    if (old != NULL) {
+        munmap(old, sizeof(sked_timebase_t));
+    }
+
+    return ret;
+}
+
+/**
+ * start() with a shared timebase: take the tick count to the ticks since
+ * its epoch, and the epoch back to the last tick boundary, moving each
+ * count on by the ticks in between. With the lock held.
+ */
+void Sked::hostTimebaseAlign(void) {
+    sked_timebase_t *tb = _host_timebase;
+    std::atomic_ref<uint32_t> seq(tb->seq);
+    uint64_t epoch_ns;
+    uint32_t s;
+
+    do {
+        s = seq.load(std::memory_order_acquire);
+        epoch_ns = tb->epoch_ns;
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((s & 1U) || seq.load(std::memory_order_relaxed) != s);
+
+    uint64_t now_ns = skedHostEpochNs(_host);
+    if (epoch_ns > now_ns) {
+        /* Not this boot's clock: there's no beat to keep */
+        return;
+    }
+
+    uint64_t shared = (now_ns - epoch_ns) / SKED_HOST_TICK_NS;
+    uint64_t gone = shared;
+    if (_ticks != 0U) {
+        /* restore(): the counts are as of the snapshot's tick count */
+        int32_t behind = (int32_t)((uint32_t)shared - _ticks);
+
+        gone = (behind > 0) ? (uint32_t)behind : 0U;
+    }
+
+    hostAdvance(gone, (uint32_t)shared,
+        epoch_ns + shared * SKED_HOST_TICK_NS);
+}
+
+/**
+ * @return Whether the running threads got SCHED_FIFO priorities
+ */
+bool Sked::isRealtime(void) {
+    bool realtime = false;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        realtime = (_host != NULL) && _host->realtime;
+    }
+
+    return realtime;
+}
+
+/**
+ * Split preemptive-mode tasks into priority bands, one worker thread each,
+ * instead of one per distinct priority. Useful with more priorities than
+ * cores or SCHED_FIFO levels. Band i holds the priorities from floors[i] up
+ * to floors[i-1]; priorities below the last floor join the last band.
+ *
+ * @param floors  Lowest priority of each band, highest band first, or NULL
+ * to go back to one band per priority
+ * @param count   Number of bands
+ *
+ * @return SKED_E_OK - Bands are set for the next start()
+ *         SKED_E_BUSY - Sked is running; reset() first
+ *         SKED_E_INVALID_PRIORITY - floors aren't strictly descending or
+ *         there are too many
+ */
+int8_t Sked::setPriorityBands(const int8_t *floors, uint8_t count) {
+    int8_t ret = SKED_E_OK;
+
+    if (floors == NULL) {
+        count = 0U;
+    }
+    if (count > SKED_MAX_TASKS) {
+        return SKED_E_INVALID_PRIORITY;
+    }
+    for (uint8_t i = 1; i < count; i++) {
+        if (floors[i] >= floors[i - 1]) {
+            return SKED_E_INVALID_PRIORITY;
+        }
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host != NULL) {
+            ret = SKED_E_BUSY;
+            break;
+        }
+
+        for (uint8_t i = 0; i < count; i++) {
+            _host_band_floor[i] = floors[i];
+        }
+        _host_band_floors = count;
+    }
+
+    return ret;
+}
+
+/**
+ * Run non-preemptive tasks on a pool of worker threads instead of in loop().
+ * Each released job goes to one worker's queue, and idle workers steal from
+ * busy ones, so independent tasks spread across cores. A task still never
+ * runs concurrently with itself, and loop() is left to run idle(). Takes
+ * effect at the next start().
+ *
+ * @param count  Number of workers, or 0 to run tasks in loop() (the default)
+ *
+ * @return SKED_E_OK - Set for the next start()
+ *         SKED_E_BUSY - Sked is running; reset() first
+ *         SKED_E_INVALID_OPERATION - More than SKED_HOST_MAX_WORKERS
+ */
+int8_t Sked::setWorkers(uint8_t count) {
+    int8_t ret = SKED_E_OK;
+
+    if (count > SKED_HOST_MAX_WORKERS) {
+        return SKED_E_INVALID_OPERATION;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host != NULL) {
+            ret = SKED_E_BUSY;
+            break;
+        }
+
+        _host_workers = count;
+    }
+
+    return ret;
+}
+
+/**
+ * Copy out what a pool worker has done since start().
+ *
+ * @return SKED_E_OK or SKED_E_NO_DATA if there's no such worker
+ */
+int8_t Sked::getWorkerStats(uint8_t worker, sked_worker_stats_t *stats) {
+    int8_t ret = SKED_E_NO_DATA;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host == NULL || worker >= _host->worker_count) {
+            break;
+        }
+
+        stats->runs = _host->workers[worker].runs;
+        stats->steals = _host->workers[worker].steals;
+        ret = SKED_E_OK;
+    }
+
+    return ret;
+}
+
+/**
+ * @return The number of bands (worker threads) running
+ */
+uint8_t Sked::getBandCount(void) {
+    uint8_t count = 0U;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host != NULL) {
+            count = _host->band_count;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Copy out how long the tasks of a band waited between being released (the
+ * tick they became READY on) and starting to run. Highest band first.
+ *
+ * @return SKED_E_OK or SKED_E_NO_DATA if there's no such band
+ */
+int8_t Sked::getDispatchLatency(uint8_t band, sked_latency_t *latency) {
+    int8_t ret = SKED_E_NO_DATA;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host == NULL) {
+            break;
+        }
+
+        /* Bands are kept in the order they started; find the band-th from
+         * the top */
+        for (uint8_t b = 0; b < _host->band_count; b++) {
+            uint8_t rank = 0U;
+
+            for (uint8_t o = 0; o < _host->band_count; o++) {
+                if (_host->bands[o].key > _host->bands[b].key) {
+                    rank++;
+                }
+            }
+            if (rank == band) {
+                *latency = _host->bands[b].latency;
+                ret = SKED_E_OK;
+                break;
+            }
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Put a task that's just gone READY at the back of its priority's queue.
+ * With the lock held, as for every READY queue function.
+ */
+void Sked::hostReadyPush(sked_index_t i) {
+    sked_task_t *task = &_tasks[i];
+    uint8_t q = (uint8_t)((int16_t)task->priority + 128);
+    sked_index_t tail = _host_ready_tail[q];
+
+    task->ready_next = SKED_INDEX_NONE;
+    task->ready_prev = tail;
+    if (tail != SKED_INDEX_NONE) {
+        _tasks[tail].ready_next = i;
+    } else {
+        _host_ready_head[q] = i;
+        _host_ready_map[q >> 6] |= 1ULL << (q & 63U);
+    }
+    _host_ready_tail[q] = i;
+    task->host_flags |= SKED_HOST_TASK_QUEUED;
+    _host_ready_count++;
+}
+
+/**
+ * Take a task off its READY queue, to run it or deal it to the pool.
+ */
+void Sked::hostReadyRemove(sked_index_t i) {
+    sked_task_t *task = &_tasks[i];
+    uint8_t q = (uint8_t)((int16_t)task->priority + 128);
+
+    if (task->ready_prev != SKED_INDEX_NONE) {
+        _tasks[task->ready_prev].ready_next = task->ready_next;
+    } else {
+        _host_ready_head[q] = task->ready_next;
+    }
+    if (task->ready_next != SKED_INDEX_NONE) {
+        _tasks[task->ready_next].ready_prev = task->ready_prev;
+    } else {
+        _host_ready_tail[q] = task->ready_prev;
+    }
+    if (_host_ready_head[q] == SKED_INDEX_NONE) {
+        _host_ready_map[q >> 6] &= ~(1ULL << (q & 63U));
+    }
+    task->host_flags &= ~SKED_HOST_TASK_QUEUED;
+    _host_ready_count--;
+}
+
+/**
+ * @return The task at the front of the highest priority READY queue from
+ * low to high, or SKED_INDEX_NONE if they're all empty
+ */
+sked_index_t Sked::hostReadyTop(int8_t low, int8_t high) {
+    int16_t q = (int16_t)high + 128;
+    int16_t end = (int16_t)low + 128;
+
+    while (q >= end) {
+        uint64_t bits = _host_ready_map[q >> 6] & (~0ULL >> (63 - (q & 63)));
+
+        if (bits != 0U) {
+            int16_t top = (q & ~63) + 63 - __builtin_clzll(bits);
+            return (top >= end) ? _host_ready_head[top] : SKED_INDEX_NONE;
+        }
+        q = (q & ~63) - 1;
+    }
+
+    return SKED_INDEX_NONE;
+}
+
+/**
+ * A job is over: the task is IDLE, unless unschedule() got to it while it
+ * was out of the lock, or it was a coroutine that returned, in which case
+ * its slot is free now. With the lock held.
+ */
+void Sked::hostJobDone(sked_index_t i) {
+    _tasks[i].state = IDLE;
+    if (_tasks[i].host_flags & SKED_HOST_TASK_FREE) {
+        hostSlotFree(i);
+    }
+}
+
+/**
+ * Put an unscheduled task's slot on the free list for insertTask().
+ */
+void Sked::hostSlotFree(sked_index_t i) {
+    _tasks[i].ready_next = _host_free;
+    _host_free = i;
+}
+
+/**
+ * Mark a task's slot free: nothing finds it by its function and its count
+ * never runs out again. Its slot goes on the free list now, or if it's
+ * busy, by hostJobDone() once its job is over. With the lock held.
+ *
+ * @param busy  It's running, or has been dealt to a pool worker
+ */
+void Sked::hostTaskFree(sked_index_t i, bool busy) {
+    sked_task_t *task = &_tasks[i];
+
+    hostPostUnlink(i);
+    task->fcn = NULL;
+    task->flags = 0U;
+    task->host_flags = SKED_HOST_TASK_FREE;
+    task->period = 0xFFFFU;
+    _counts[i] = 0xFFFFU;
+    _host_live--;
+    if (!busy) {
+        task->state = IDLE;
+        hostSlotFree(i);
+    }
+
+    if (_host_shm != NULL) {
+        hostShmTask(i, false);
+    }
+}
+
+/**
+ * @return The key (lowest priority) of the band a task priority falls in
+ */
+int8_t Sked::hostBandKey(int8_t priority) {
+    if (_host_band_floors == 0U) {
+        return priority;
+    }
+
+    for (uint8_t i = 0; i < _host_band_floors; i++) {
+        if (priority >= _host_band_floor[i]) {
+            return _host_band_floor[i];
+        }
+    }
+
+    return _host_band_floor[_host_band_floors - 1U];
+}
+
+/**
+ * The priorities in the band with this key, for its READY queues
+ */
+void Sked::hostBandRange(int8_t key, int8_t *low, int8_t *high) {
+    *low = key;
+    *high = key;
+
+    for (uint8_t i = 0; i < _host_band_floors; i++) {
+        if (_host_band_floor[i] == key) {
+            *high = (i == 0U) ? 127 : (int8_t)(_host_band_floor[i - 1U] - 1);
+            /* The last band takes everything below it */
+            if (i == _host_band_floors - 1U) {
+                *low = -128;
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * Give the workers priorities in the same order as their bands: SCHED_FIFO
+ * levels below the tick thread, or else nice levels. Called whenever a band
+ * is added.
+ */
+void Sked::hostRankBands(void) {
+    for (uint8_t b = 0; b < _host->band_count; b++) {
+        sked_host_band_t *band = &_host->bands[b];
+        int rank = 0;
+
+        for (uint8_t o = 0; o < _host->band_count; o++) {
+            if (_host->bands[o].key > band->key) {
+                rank++;
+            }
+        }
+
+        if (_host->realtime) {
+            struct sched_param param;
+            param.sched_priority = SKED_HOST_RT_TICK_PRIO - 1 - rank;
+            if (param.sched_priority < 1) {
+                param.sched_priority = 1;
+            }
+            pthread_setschedparam(band->thread, SCHED_FIFO, &param);
+        } else {
+            int nice = rank * SKED_HOST_NICE_STEP;
+            band->nice = (nice < 19) ? nice : 19;
+            band->renice = true;
+        }
+    }
+}
+
+/**
+ * Find the band for a task priority, starting its worker if there isn't one
+ * yet. Called with the lock held.
+ *
+ * @return The band's index, or -1 if its thread couldn't be started
+ */
+int16_t Sked::hostBandOf(int8_t priority) {
+    int8_t key = hostBandKey(priority);
+    uint8_t b;
+
+    for (b = 0; b < _host->band_count; b++) {
+        if (_host->bands[b].key == key) {
+            return b;
+        }
+    }
+
+    sked_host_band_t *band = &_host->bands[b];
+    band->sked = this;
+    band->key = key;
+    band->waiting = false;
+    band->running = false;
+    band->nice = 0;
+    band->renice = false;
+    memset(&band->latency, 0, sizeof(band->latency));
+    band->latency.priority = key;
+    skedHostCondInit(&band->cv);
+
+    if (skedHostThread(&band->thread, hostWorkerMain, band,
+            _host->realtime ? SKED_HOST_RT_TICK_PRIO - 1 : 0, _host_cpu) != 0) {
+        pthread_cond_destroy(&band->cv);
+        return -1;
+    }
+
+    _host->band_count++;
+    hostRankBands();
+
+    return b;
+}
+
+/**
+ * @return Whether a task in a band above key is waiting to start or running
+ */
+bool Sked::hostHigherReady(int8_t key) {
+    int8_t low;
+    int8_t high;
+
+    hostBandRange(key, &low, &high);
+    if (high < 127 && hostReadyTop(high + 1, 127) != SKED_INDEX_NONE) {
+        return true;
+    }
+
+    for (uint8_t b = 0; b < _host->band_count; b++) {
+        if (_host->bands[b].key > key && _host->bands[b].running) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void skedHostRecordLatency(sked_latency_t *latency, uint64_t ns) {
+    uint32_t us = (ns / 1000ULL < 0xFFFFFFFFULL)
+        ? (uint32_t)(ns / 1000ULL) : 0xFFFFFFFFUL;
+    uint8_t bucket = skedHostBucket(us);
+
+    latency->count++;
+    latency->total_us += us;
+    if (us > latency->max_us) {
+        latency->max_us = us;
+    }
+    latency->hist[bucket]++;
+}
+
+/**
+ * Runs the READY tasks of one band, highest priority (and then the longest
+ * READY) first, for as long as there are any, then waits for hostDispatch()
+ * to say there are more.
+ */
+void *Sked::hostWorkerMain(void *arg) {
+    sked_host_band_t *band = (sked_host_band_t *)arg;
+    Sked *self = band->sked;
+    struct sked_host_s *host = self->_host;
+
+    SKED_HOST_ATOMIC(&self->_host_irq) {
+        int8_t low;
+        int8_t high;
+
+        self->hostBandRange(band->key, &low, &high);
+
+        while (!host->stopping) {
+            if (band->renice) {
+                band->renice = false;
+                setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid),
+                        band->nice);
+            }
+
+            sked_index_t next = self->hostReadyTop(low, high);
+
+            /* Emulated priority: as on one core, lower bands wait for the
+             * higher ones to finish */
+            if (next != SKED_INDEX_NONE && !host->realtime
+                    && self->hostHigherReady(band->key)) {
+                next = SKED_INDEX_NONE;
+            }
+
+            if (next == SKED_INDEX_NONE) {
+                band->waiting = true;
+                skedHostIrqWait(&self->_host_irq, &band->cv, NULL);
+                band->waiting = false;
+                continue;
+            }
+
+            sked_task_t *task = &self->_tasks[next];
+            self->hostReadyRemove(next);
+            task->state = RUNNING;
+
+            uint64_t released_ns = host->tick_due_ns - (uint64_t)(uint32_t)
+                (self->_ticks - task->released_tick) * SKED_HOST_TICK_NS;
+            skedHostRecordLatency(&band->latency,
+                    skedHostClockNs() - released_ns);
+
+            band->running = true;
+            self->runTask(next);
+            band->running = false;
+            self->hostJobDone(next);
+
+            /* Lower bands held back for this one can go now */
+            if (!host->realtime) {
+                for (uint8_t b = 0; b < host->band_count; b++) {
+                    if (host->bands[b].key < band->key
+                            && host->bands[b].waiting) {
+                        host->bands[b].waiting = false;
+                        pthread_cond_signal(&host->bands[b].cv);
+                    }
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * The TIMER1 stand-in, and the event loop for post() and fd tasks. The
+ * timerfd keeps to absolute deadlines so error never builds up, and any ticks
+ * slept through are made up.
+ */
+void *Sked::hostTickMain(void *arg) {
+    Sked *self = (Sked *)arg;
+    struct sked_host_s *host = self->_host;
+    struct sked_host_post_s *post = self->_host_post;
+    struct epoll_event events[SKED_HOST_EPOLL_EVENTS];
+    uint64_t due = skedHostEpochNs(host) + SKED_HOST_TICK_NS;
+
+    while (!host->stopping) {
+        /* Pairs with post(): either this sees its node, or it sees this
+         * parked */
+        post->parked.store(true, std::memory_order_seq_cst);
+        bool pending = post->head.load(std::memory_order_seq_cst) != post->tail;
+        int count = epoll_wait(host->epoll_fd, events, SKED_HOST_EPOLL_EVENTS,
+                pending ? 0 : -1);
+        post->parked.store(false, std::memory_order_relaxed);
+
+        if (host->stopping) {
+            break;
+        }
+
+        uint64_t ticks = 0U;
+        int fds[SKED_HOST_EPOLL_EVENTS];
+        uint8_t fd_count = 0U;
+
+        for (int e = 0; e < count; e++) {
+            uint64_t value;
+
+            if (events[e].data.u64 == SKED_HOST_EV_TICK) {
+                if (read(host->timer_fd, &value, sizeof(value)) > 0) {
+                    ticks += value;
+                }
+            } else if (events[e].data.u64 == SKED_HOST_EV_POST) {
+                if (read(post->wake_fd, &value, sizeof(value)) < 0) {
+                    /* Emptied already; same thing */
+                }
+                post->wake_pending.store(false, std::memory_order_release);
+            } else {
+                fds[fd_count++] = (int)events[e].data.u64;
+            }
+        }
+
+        bool timer = (ticks > 0U);
+        uint64_t now = skedHostClockNs();
+        uint64_t woke = now;
+        uint64_t spin = 0U;
+
+        if (timer && host->oneshot) {
+            /* Set early for a setSpin() band: spin the rest of the way,
+             * without the lock so the workers can get on */
+            spin = host->spin_ns.load(std::memory_order_relaxed);
+            while (now < spin) {
+                now = skedHostClockNs();
+            }
+            if (!host->tickless) {
+                /* The timerfd only says it's time to look */
+                ticks = (now >= due) ? (now - due) / SKED_HOST_TICK_NS + 1U
+                    : 0U;
+            }
+        }
+        uint64_t late = (ticks > 0U && now > due) ? now - due : 0U;
+
+        SKED_HOST_ATOMIC(&self->_host_irq) {
+            /* Posted and I/O activations go out with the tick's releases */
+            uint32_t released = self->hostPostDrain();
+            for (uint8_t f = 0; f < fd_count; f++) {
+                released += self->hostFdRelease(fds[f]);
+            }
+
+            if (timer && host->oneshot) {
+                self->hostSpinRecord(woke, spin, now);
+            }
+
+            if (host->tickless) {
+                /* The timerfd only says it's time to look; the clock says
+                 * how many ticks have gone by */
+                if (timer) {
+                    host->wake.wakeups++;
+                }
+                self->hostTickTo(now);
+                if (released > 0U) {
+                    self->hostDispatch();
+                }
+                self->hostArmWake(true);
+            } else if (!timer) {
+                /* timerISR() would have dispatched them */
+                if (released > 0U) {
+                    self->hostDispatch();
+                }
+            } else {
+                if (ticks > 0U) {
+                    host->wake.wakeups++;
+                    host->wake_ns = now;
+                    if (late > host->tick_late_max_ns) {
+                        host->tick_late_max_ns = (late < 0xFFFFFFFFULL)
+                            ? (uint32_t)late : 0xFFFFFFFFUL;
+                    }
+                    host->tick_catchups += (uint32_t)(ticks - 1U);
+                } else if (released > 0U) {
+                    self->hostDispatch();
+                }
+
+                while (ticks-- > 0U) {
+                    host->tick_due_ns = due;
+                    due += SKED_HOST_TICK_NS;
+                    self->timerISR();
+                }
+                self->hostArmWake(true);
+            }
+
+            /* Jobs export their own records, but misses and the tick count
+             * only go out from here */
+            if (self->_host_shm != NULL && self->_ticks
+                    - self->_host_shm_tick >= SKED_HOST_SHM_TICKS) {
+                self->hostShmRefresh();
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void Sked::hostPostInit(void) {
+    struct sked_host_post_s *post = new sked_host_post_s();
+    size_t slots = 1U;
+
+    /* At least twice SKED_HOST_MAX_TASKS, as a power of two */
+    while (slots < 2U * (size_t)SKED_HOST_MAX_TASKS) {
+        slots <<= 1;
+    }
+    size_t nodes = skedHostTableSize(sizeof(sked_host_post_node_t));
+    size_t index = slots * sizeof(post->index[0]);
+    size_t links = skedHostTableSize(sizeof(sked_index_t));
+    uint8_t *map = (uint8_t *)skedHostReserve(nodes + index + 2U * links);
+
+    if (map != NULL) {
+        post->nodes = (sked_host_post_node_t *)map;
+        post->index = (std::atomic<sked_host_post_node_t *> *)(map + nodes);
+        post->index_mask = slots - 1U;
+        post->task_next = (sked_index_t *)(map + nodes + index);
+        post->task_prev = (sked_index_t *)(map + nodes + index + links);
+    }
+    post->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    _host_post = post;
+    hostPostReset();
+}
+
+void Sked::hostPostFree(void) {
+    struct sked_host_post_s *post = _host_post;
+
+    if (post->nodes != NULL) {
+        munmap(post->nodes, skedHostTableSize(sizeof(sked_host_post_node_t))
+            + (post->index_mask + 1U) * sizeof(post->index[0])
+            + 2U * skedHostTableSize(sizeof(sked_index_t)));
+    }
+    close(post->wake_fd);
+    delete post;
+}
+
+/* Where a task function's probe of the post() index starts */
+static size_t skedHostPostHash(const struct sked_host_post_s *post,
+        sked_task_fcn_t fcn) {
+    return (size_t)(((uint64_t)(uintptr_t)fcn * 0x9E3779B97F4A7C15ULL)
+        >> 32) & post->index_mask;
+}
+
+/**
+ * Find a task function's post() node. Safe without the lock.
+ *
+ * @return The node, or NULL if the function has never been scheduled
+ */
+static sked_host_post_node_t *skedHostPostFind(struct sked_host_post_s *post,
+        sked_task_fcn_t fcn) {
+    if (post->nodes == NULL) {
+        return NULL;
+    }
+
+    for (size_t slot = skedHostPostHash(post, fcn); ;
+            slot = (slot + 1U) & post->index_mask) {
+        sked_host_post_node_t *node =
+            post->index[slot].load(std::memory_order_acquire);
+
+        if (node == NULL || node->fcn == fcn) {
+            return node;
+        }
+    }
+}
+
+/**
+ * @return Whether post() could run out of nodes for this many more tasks,
+ * in which case schedule() says the table is full. With the lock held.
+ */
+bool Sked::hostPostFull(uint32_t more) {
+    struct sked_host_post_s *post = _host_post;
+
+    return post->nodes == NULL
+        || more > SKED_HOST_MAX_TASKS - post->node_count;
+}
+
+/**
+ * Put task i on its function's list for post(), giving the function a node
+ * first if it doesn't have one; hostPostFull() says whether there's one to
+ * give. Called from initTask() with the lock held.
+ */
+void Sked::hostPostLink(sked_index_t i) {
+    struct sked_host_post_s *post = _host_post;
+    sked_task_fcn_t fcn = _tasks[i].fcn;
+    size_t slot = skedHostPostHash(post, fcn);
+    sked_host_post_node_t *node;
+
+    while ((node = post->index[slot].load(std::memory_order_relaxed))
+            != NULL && node->fcn != fcn) {
+        slot = (slot + 1U) & post->index_mask;
+    }
+
+    if (node == NULL) {
+        node = &post->nodes[post->node_count++];
+        node->fcn = fcn;
+        node->queued.store(false, std::memory_order_relaxed);
+        node->first = SKED_INDEX_NONE;
+        /* post() only finds the node once it's filled in */
+        post->index[slot].store(node, std::memory_order_release);
+    }
+
+    post->task_prev[i] = SKED_INDEX_NONE;
+    post->task_next[i] = node->first;
+    if (node->first != SKED_INDEX_NONE) {
+        post->task_prev[node->first] = i;
+    }
+    node->first = i;
+}
+
+/**
+ * Take task i off its function's list, before the slot is freed. The node
+ * stays bound. With the lock held.
+ */
+void Sked::hostPostUnlink(sked_index_t i) {
+    struct sked_host_post_s *post = _host_post;
+    sked_index_t next = post->task_next[i];
+    sked_index_t prev = post->task_prev[i];
+
+    if (next != SKED_INDEX_NONE) {
+        post->task_prev[next] = prev;
+    }
+    if (prev != SKED_INDEX_NONE) {
+        post->task_next[prev] = next;
+    } else {
+        skedHostPostFind(post, _tasks[i].fcn)->first = next;
+    }
+}
+
+/**
+ * Empty the queue and unbind every node. Called from reset(), with the tick
+ * thread stopped; post() must not be running concurrently.
+ */
+void Sked::hostPostReset(void) {
+    struct sked_host_post_s *post = _host_post;
+
+    if (post->nodes != NULL && post->node_count > 0U) {
+        /* Back to zeros, and to no memory */
+        madvise(post->index, (post->index_mask + 1U) * sizeof(post->index[0]),
+            MADV_DONTNEED);
+    }
+    post->node_count = 0U;
+    post->stub.next.store(NULL, std::memory_order_relaxed);
+    post->head.store(&post->stub, std::memory_order_relaxed);
+    post->tail = &post->stub;
+    post->parked.store(false, std::memory_order_relaxed);
+    post->wake_pending.store(false, std::memory_order_relaxed);
+    post->posts.store(0U, std::memory_order_relaxed);
+    post->enqueued.store(0U, std::memory_order_relaxed);
+    post->wakeups.store(0U, std::memory_order_relaxed);
+    post->drains = 0U;
+    post->max_batch = 0U;
+    post->released = 0U;
+    post->coalesced = 0U;
+
+    uint64_t value;
+    while (read(post->wake_fd, &value, sizeof(value)) > 0) {
+    }
+}
+
+static void skedHostPostPush(struct sked_host_post_s *post,
+        sked_host_post_node_t *node) {
+    node->next.store(NULL, std::memory_order_relaxed);
+    sked_host_post_node_t *prev =
+        post->head.exchange(node, std::memory_order_seq_cst);
+    prev->next.store(node, std::memory_order_release);
+}
+
+/**
+ * Take the oldest node off the queue. Consumer only.
+ *
+ * @return The node, or NULL if the queue is empty or a producer is halfway
+ * through adding the next one (it will be there at the next drain)
+ */
+static sked_host_post_node_t *skedHostPostPop(struct sked_host_post_s *post) {
+    sked_host_post_node_t *tail = post->tail;
+    sked_host_post_node_t *next = tail->next.load(std::memory_order_acquire);
+
+    if (tail == &post->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        post->tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next != NULL) {
+        post->tail = next;
+        return tail;
+    }
+
+    if (tail != post->head.load(std::memory_order_acquire)) {
+        return NULL;
+    }
+
+    /* tail is the last node: put the stub back behind it so it can go */
+    skedHostPostPush(post, &post->stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != NULL) {
+        post->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+/**
+ * Release a task from any thread, without waiting for its period: an IDLE
+ * task becomes READY at once, as if its period had come around, and its
+ * periodic releases carry on as before. If it's READY or RUNNING already,
+ * the activation merges into that one. Lock-free: on the fast path it's a
+ * few atomic operations, and the only syscall is waking the tick thread when
+ * it's parked between ticks. Must not race reset().
+ *
+ * @param fcn  A scheduled task function
+ *
+ * @return SKED_E_OK or SKED_E_INVALID_FUNCTION if fcn isn't scheduled
+ */
+int8_t Sked::post(sked_task_fcn_t fcn) {
+    struct sked_host_post_s *post = _host_post;
+    sked_host_post_node_t *node = skedHostPostFind(post, fcn);
+
+    if (node == NULL) {
+        return SKED_E_INVALID_FUNCTION;
+    }
+
+    post->posts.fetch_add(1U, std::memory_order_relaxed);
+
+    /* Already on its way to the tick thread */
+    if (node->queued.exchange(true, std::memory_order_acq_rel)) {
+        return SKED_E_OK;
+    }
+
+    skedHostPostPush(post, node);
+    post->enqueued.fetch_add(1U, std::memory_order_relaxed);
+
+    /* Pairs with hostPostSleep(): either it sees this node, or this sees it
+     * parked */
+    if (post->parked.load(std::memory_order_seq_cst)
+            && !post->wake_pending.exchange(true, std::memory_order_acq_rel)) {
+        uint64_t one = 1U;
+        post->wakeups.fetch_add(1U, std::memory_order_relaxed);
+        if (write(post->wake_fd, &one, sizeof(one)) < 0) {
+            /* Full counter: it's awake already */
+        }
+    }
+
+    return SKED_E_OK;
+}
+
+/**
+ * Copy out the post() counters.
+ */
+void Sked::getPostStats(sked_post_stats_t *stats) {
+    struct sked_host_post_s *post = _host_post;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        stats->posts = post->posts.load(std::memory_order_relaxed);
+        stats->enqueued = post->enqueued.load(std::memory_order_relaxed);
+        stats->wakeups = post->wakeups.load(std::memory_order_relaxed);
+        stats->drains = post->drains;
+        stats->max_batch = post->max_batch;
+        stats->released = post->released;
+        stats->coalesced = post->coalesced;
+    }
+}
+
+/**
+ * Schedule a task that's released whenever an fd is ready (a socket, pipe,
+ * eventfd, serial port...) rather than on a period. The tick thread waits for
+ * it in the same epoll set as the tick, so there's no extra thread and no
+ * polling interval, and it's dispatched in priority order with the periodic
+ * tasks. Readiness is one-shot: the fd isn't watched again until the job has
+ * run, so the task should read what's there (or it's released again at
+ * once).
+ *
+ * @param fd  A file descriptor epoll can watch; Sked doesn't close it
+ * @param events  epoll events to wait for, e.g. EPOLLIN
+ * @param priority, fcn  As for schedule()
+ *
+ * @return SKED_E_OK - The task was scheduled
+ *         SKED_E_NOT_INITIALIZED - Call init() first
+ *         SKED_E_TOO_MANY_TASKS - No room for more tasks
+ *         SKED_E_INVALID_PRIORITY - The priority isn't valid
+ *         SKED_E_INVALID_FUNCTION - fcn is NULL
+ *         SKED_E_INVALID_OPERATION - epoll can't watch fd, another task
+ *         has it already, or it's SKED_HOST_MAX_TASKS or more
+ */
+int8_t Sked::scheduleFd(int fd, uint32_t events, int8_t priority,
+        sked_task_fcn_t fcn) {
+    int8_t ret = SKED_E_OK;
+
+    if (_state == SKED_STATE_UNINIT) {
+        return SKED_E_NOT_INITIALIZED;
+    }
+    if (priority <= (int8_t)SKED_MIN_PRIORITY) {
+        return SKED_E_INVALID_PRIORITY;
+    }
+    if (fcn == (sked_task_fcn_t)NULL) {
+        return SKED_E_INVALID_FUNCTION;
+    }
+    /* Past the fd map */
+    if (fd < 0 || (uint32_t)fd >= SKED_HOST_MAX_TASKS) {
+        return SKED_E_INVALID_OPERATION;
+    }
+
+    /* Try it on a scratch epoll set, so a bad fd is turned away before the
+     * task goes in */
+    int probe = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    event.events = events;
+    event.data.u64 = 0U;
+    int err = (probe < 0) ? -1 : epoll_ctl(probe, EPOLL_CTL_ADD, fd, &event);
+    if (probe >= 0) {
+        close(probe);
+    }
+    if (err != 0) {
+        return SKED_E_INVALID_OPERATION;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (tableFull()) {
+            ret = SKED_E_TOO_MANY_TASKS;
+            break;
+        }
+
+        if (hostFdTask(fd) != SKED_INDEX_NONE) {
+            ret = SKED_E_INVALID_OPERATION;
+            break;
+        }
+
+        /* The longest period there is, though it's never released by it */
+        sked_index_t i = insertTask(0xFFFFU, 0xFFFFU, priority, fcn);
+        sked_task_t *task = &_tasks[i];
+        task->flags |= SKED_TASK_EVENT;
+        task->fd = fd;
+        task->fd_events = events;
+        _host_fd_task[fd] = i + 1U;
+
+        if (_host != NULL) {
+            hostFdArm(task, EPOLL_CTL_ADD);
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Schedule a task whose function is called with its own context, as for
+ * schedule(). A simulator with a task per device can run them all through
+ * one function, each with its device's state. The table on the host grows
+ * to SKED_HOST_MAX_TASKS, a task's index never changes, and adding one or
+ * taking it away with unschedule() doesn't depend on how many there are.
+ *
+ * @param period_us, offset_us, priority  As for schedule()
+ * @param fcn  Called with arg each time the task runs
+ * @param arg  Anything; Sked only passes it on
+ * @param handle  Where to put the task's index, for getTaskInfo() and
+ * unschedule(), or NULL
+ *
+ * @return As for schedule()
+ */
+int8_t Sked::scheduleArg(uint32_t period_us, uint32_t offset_us,
+        int8_t priority, sked_task_arg_fcn_t fcn, void *arg,
+        sked_index_t *handle) {
+    int8_t ret;
+
+    /* The lock nests, and the task mustn't run before it has its arg */
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sked_index_t i;
+
+        ret = scheduleTask(period_us, offset_us, priority,
+                (sked_task_fcn_t)fcn, &i);
+        if (ret != SKED_E_OK) {
+            break;
+        }
+
+        _tasks[i].host_flags |= SKED_HOST_TASK_ARG;
+        _tasks[i].arg = arg;
+        if (handle != NULL) {
+            *handle = i;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Give a scheduleArg() task a new arg, as after restore(), which can't keep
+ * them.
+ *
+ * @param handle  The task's index
+ * @param arg  What its function is called with from now on
+ *
+ * @return SKED_E_OK - The task has its new arg
+ *         SKED_E_INVALID_OPERATION - There's no scheduleArg() task there
+ */
+int8_t Sked::setArg(sked_index_t handle, void *arg) {
+    int8_t ret = SKED_E_INVALID_OPERATION;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (handle < _task_count && (_tasks[handle].host_flags
+                & (SKED_HOST_TASK_ARG | SKED_HOST_TASK_FREE))
+                == SKED_HOST_TASK_ARG) {
+            _tasks[handle].arg = arg;
+            ret = SKED_E_OK;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Take the slot for a new task: the one unschedule() last freed, or else
+ * the next one at the end. With the lock held, and the table not full.
+ */
+sked_index_t Sked::hostSlotTake(void) {
+    sked_index_t i = _task_count;
+
+    if (_host_free != SKED_INDEX_NONE) {
+        i = _host_free;
+        _host_free = _tasks[i].ready_next;
+    } else {
+        _task_count++;
+    }
+    _host_live++;
+
+    return i;
+}
+
+/**
+ * Add every task in a schedule file (see sked_sched_header_t), as
+ * schedule() or scheduleArg() would in the order they're in the file, but
+ * all under one hold of the lock. The file is mapped and the records are
+ * used straight from the mapping, with nothing to parse, so the file costs
+ * about a page fault per 4 KB. All of it is checked before any task goes
+ * in, so either every task goes in or none does.
+ *
+ * tools/skedsched.py makes a file from a task list and the built program,
+ * and saveSchedule() makes one from the tasks there are. A scheduleArg()
+ * task's arg comes from the file as it is, so it's a number, such as an
+ * index into the program's own tables, rather than a pointer.
+ *
+ * @param path  The schedule file
+ *
+ * @return SKED_E_OK - Every task is in
+ *         SKED_E_NOT_INITIALIZED - You have not called init()
+ *         SKED_E_NO_DATA - The file can't be read, or isn't a schedule
+ *         SKED_E_INVALID_FUNCTION - It's for another build of the program
+ *         SKED_E_TOO_MANY_TASKS - They don't all fit
+ *         SKED_E_INVALID_PERIOD, SKED_E_INVALID_OFFSET,
+ *         SKED_E_INVALID_PRIORITY - A task wouldn't pass schedule()
+ */
+int8_t Sked::loadSchedule(const char *path) {
+    const uint32_t tick_us = SKED_HOST_TICK_NS / 1000ULL;
+    struct stat st;
+    void *map = MAP_FAILED;
+    int8_t ret = SKED_E_OK;
+
+    if (_state == SKED_STATE_UNINIT) {
+        return SKED_E_NOT_INITIALIZED;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return SKED_E_NO_DATA;
+    }
+    if (fstat(fd, &st) == 0
+            && st.st_size >= (off_t)sizeof(sked_sched_header_t)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return SKED_E_NO_DATA;
+    }
+
+    const sked_sched_header_t *header = (const sked_sched_header_t *)map;
+    const sked_sched_record_t *records =
+        (const sked_sched_record_t *)(header + 1);
+    uint32_t count = header->task_count;
+
+    if (header->magic != SKED_SCHED_MAGIC
+            || header->version != SKED_SCHED_VERSION
+            || header->record_size != sizeof(sked_sched_record_t)
+            || (size_t)st.st_size != sizeof(*header)
+            + (size_t)count * sizeof(sked_sched_record_t)) {
+        ret = SKED_E_NO_DATA;
+    } else if (memcmp(header->build_id, _host_build_id,
+            sizeof(header->build_id)) != 0) {
+        ret = SKED_E_INVALID_FUNCTION;
+    }
+
+    /* As scheduleTask() checks them */
+    for (uint32_t r = 0; r < count && ret == SKED_E_OK; r++) {
+        const sked_sched_record_t *rec = &records[r];
+        uintptr_t fcn = (uintptr_t)rec->fcn;
+
+        if (rec->period_us > _max_period_us
+                || rec->period_us < _min_period_us
+                || rec->slack_us / tick_us > 0xFFFFU) {
+            ret = SKED_E_INVALID_PERIOD;
+        } else if (rec->offset_us > _max_period_us
+                || (rec->offset_us > 0U && rec->offset_us < _min_period_us)) {
+            ret = SKED_E_INVALID_OFFSET;
+        } else if (rec->priority <= (int8_t)SKED_MIN_PRIORITY) {
+            ret = SKED_E_INVALID_PRIORITY;
+        } else if ((rec->host_flags & ~SKED_HOST_TASK_ARG) != 0U) {
+            ret = SKED_E_NO_DATA;
+        } else if (!hostCodeIn(&fcn)) {
+            ret = SKED_E_INVALID_FUNCTION;
+        }
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (ret != SKED_E_OK) {
+            break;
+        }
+        if (_tasks == NULL || count > SKED_HOST_MAX_TASKS - _host_live
+                || hostPostFull(count)) {
+            ret = SKED_E_TOO_MANY_TASKS;
+            break;
+        }
+
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+        releaseSync();
+#endif
+        for (uint32_t r = 0; r < count; r++) {
+            const sked_sched_record_t *rec = &records[r];
+            uintptr_t fcn = (uintptr_t)rec->fcn;
+            sked_index_t i = hostSlotTake();
+
+            hostCodeIn(&fcn);
+            initTask(i, rec->period_us / tick_us, rec->offset_us / tick_us,
+                rec->priority, (sked_task_fcn_t)fcn);
+            _tasks[i].slack = (uint16_t)(rec->slack_us / tick_us);
+            _tasks[i].host_flags = rec->host_flags;
+            _tasks[i].arg = (void *)(uintptr_t)rec->arg;
+        }
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+        releaseSync();
+#endif
+        hostArmWake(false);
+        hostShmPublish();
+    }
+
+    munmap(map, st.st_size);
+
+    return ret;
+}
+
+/**
+ * Write the tasks there are to a schedule file for loadSchedule(), in table
+ * order, e.g. for a program to lay out its own schedule once. Only what
+ * schedule(), scheduleArg() and setSlack() set goes in: no counts,
+ * statistics or late hooks (snapshot() keeps those). args are written as
+ * they are, so they're only any use to another run if they're numbers
+ * rather than pointers.
+ *
+ * @param path  File to create or overwrite
+ *
+ * @return SKED_E_OK - The file is written
+ *         SKED_E_INVALID_OPERATION - There are tasks from scheduleFd() or
+ *         spawn(), which can't go in a file, or it can't be written
+ *         SKED_E_INVALID_FUNCTION - A task function isn't in the program
+ */
+int8_t Sked::saveSchedule(const char *path) {
+    const uint32_t tick_us = SKED_HOST_TICK_NS / 1000ULL;
+    sked_sched_header_t header;
+    sked_sched_record_t *records = NULL;
+    uint32_t count = 0U;
+    int8_t ret = SKED_E_OK;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        records = (sked_sched_record_t *)calloc(_host_live + 1U,
+            sizeof(*records));
+        if (records == NULL) {
+            ret = SKED_E_INVALID_OPERATION;
+            break;
+        }
+
+        for (sked_index_t i = 0; i < _task_count; i++) {
+            sked_task_t *task = &_tasks[i];
+
+            if (task->host_flags & SKED_HOST_TASK_FREE) {
+                continue;
+            }
+            if (task->flags & (SKED_TASK_EVENT | SKED_TASK_CORO)) {
+                ret = SKED_E_INVALID_OPERATION;
+                break;
+            }
+
+            uintptr_t fcn = (uintptr_t)task->fcn;
+            if (!hostCodeOut(&fcn)) {
+                ret = SKED_E_INVALID_FUNCTION;
+                break;
+            }
+
+            sked_sched_record_t *rec = &records[count++];
+            rec->fcn = fcn;
+            rec->period_us = task->period * tick_us;
+            rec->offset_us = task->offset * tick_us;
+            rec->slack_us = task->slack * tick_us;
+            rec->priority = task->priority;
+            rec->host_flags = task->host_flags & SKED_HOST_TASK_ARG;
+            if (rec->host_flags != 0U) {
+                rec->arg = (uint64_t)(uintptr_t)task->arg;
+            }
+        }
+    }
+
+    if (ret == SKED_E_OK) {
+        memset(&header, 0, sizeof(header));
+        header.magic = SKED_SCHED_MAGIC;
+        header.version = SKED_SCHED_VERSION;
+        header.record_size = sizeof(sked_sched_record_t);
+        header.task_count = count;
+        memcpy(header.build_id, _host_build_id, sizeof(header.build_id));
+
+        FILE *file = fopen(path, "wb");
+        if (file == NULL) {
+            ret = SKED_E_INVALID_OPERATION;
+        } else {
+            if (fwrite(&header, sizeof(header), 1U, file) != 1U
+                    || fwrite(records, sizeof(*records), count, file)
+                    != count) {
+                ret = SKED_E_INVALID_OPERATION;
+            }
+            if (fclose(file) != 0) {
+                ret = SKED_E_INVALID_OPERATION;
+            }
+        }
+    }
+    free(records);
+
+    return ret;
+}
+
+/**
+ * Take a task out of the table. It's never released again, and its index
+ * goes to the next task scheduled. A job that's running (or, with
+ * setWorkers(), one that's been handed to a worker) is left to finish or
+ * dropped, and the slot is freed after. Coroutine tasks can't be taken
+ * out; they end by returning, which frees their slot the same way.
+ *
+ * @param handle  The task's index, from scheduleArg() or getTaskInfo()
+ *
+ * @return SKED_E_OK - The task is gone
+ *         SKED_E_INVALID_OPERATION - There's no task there, or it's a
+ *         coroutine
+ */
+int8_t Sked::unschedule(sked_index_t handle) {
+    int8_t ret = SKED_E_OK;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (handle >= _task_count) {
+            ret = SKED_E_INVALID_OPERATION;
+            break;
+        }
+
+        sked_task_t *task = &_tasks[handle];
+        if ((task->host_flags & SKED_HOST_TASK_FREE)
+                || (task->flags & SKED_TASK_CORO)) {
+            ret = SKED_E_INVALID_OPERATION;
+            break;
+        }
+
+        if ((task->flags & SKED_TASK_EVENT) && _host != NULL) {
+            epoll_ctl(_host->epoll_fd, EPOLL_CTL_DEL, task->fd, NULL);
+        }
+
+        bool busy = (task->state == RUNNING);
+        if (task->host_flags & SKED_HOST_TASK_QUEUED) {
+            hostReadyRemove(handle);
+        } else if (task->state == READY) {
+            /* Dealt to a pool worker, which frees it */
+            busy = true;
+        }
+
+        hostTaskFree(handle, busy);
+    }
+
+    return ret;
+}
+
+/**
+ * Watch a task's fd (again), for one event.
+ *
+ * @param op  EPOLL_CTL_ADD the first time, or 0 to re-arm
+ *
+ * @return 0 or -1 as for epoll_ctl()
+ */
+int Sked::hostFdArm(sked_task_t *task, int op) {
+    struct epoll_event event;
+
+    if (_host == NULL) {
+        return 0;
+    }
+
+    event.events = task->fd_events | EPOLLONESHOT;
+    event.data.u64 = (uint64_t)(uint32_t)task->fd;
+
+    return epoll_ctl(_host->epoll_fd, (op == 0) ? EPOLL_CTL_MOD : op,
+            task->fd, &event);
+}
+
+/**
+ * Tick thread, with the lock held: release the task of a ready fd.
+ *
+ * @return 1 if it was released, 0 if not
+ */
+uint8_t Sked::hostFdRelease(int fd) {
+    sked_index_t i = hostFdTask(fd);
+
+    if (i == SKED_INDEX_NONE) {
+        return 0U;
+    }
+
+    /* One-shot, so it's IDLE unless reset() raced it */
+    sked_task_t *task = &_tasks[i];
+    if (task->state == IDLE) {
+        task->state = READY;
+        task->activations++;
+        task->released_tick = _ticks;
+        hostReadyPush(i);
+        return 1U;
+    }
+
+    return 0U;
+}
+
+/**
+ * @return The index of the scheduleFd() task watching fd, or SKED_INDEX_NONE
+ * if there isn't one. With the lock held.
+ */
+sked_index_t Sked::hostFdTask(int fd) {
+    if (fd < 0 || (uint32_t)fd >= SKED_HOST_MAX_TASKS) {
+        return SKED_INDEX_NONE;
+    }
+
+    /* The map isn't cleared when a task goes, so check it's still there */
+    sked_index_t i = _host_fd_task[fd] - 1U;
+    if (i >= _task_count || !(_tasks[i].flags & SKED_TASK_EVENT)
+            || _tasks[i].fd != fd) {
+        return SKED_INDEX_NONE;
+    }
+
+    return i;
+}
+
+/**
+ * Tick thread, with the lock held: release the tasks of one batch of posted
+ * activations.
+ *
+ * @return How many activations there were
+ */
+uint32_t Sked::hostPostDrain(void) {
+    struct sked_host_post_s *post = _host_post;
+    uint32_t batch = 0U;
+
+    /* Each node can only be in the queue once, so a batch is bounded by the
+     * functions there are */
+    while (batch < post->node_count) {
+        sked_host_post_node_t *node = skedHostPostPop(post);
+        if (node == NULL) {
+            break;
+        }
+
+        /* From here on a new post() queues it again */
+        node->queued.store(false, std::memory_order_release);
+        batch++;
+
+        for (sked_index_t i = node->first; i != SKED_INDEX_NONE;
+                i = post->task_next[i]) {
+            sked_task_t *task = &_tasks[i];
+
+            if (task->state == IDLE) {
+                task->state = READY;
+                task->activations++;
+                task->released_tick = _ticks;
+                hostReadyPush(i);
+                post->released++;
+            } else {
+                post->coalesced++;
+            }
+        }
+    }
+
+    if (batch > 0U) {
+        post->drains++;
+        if (batch > post->max_batch) {
+            post->max_batch = batch;
+        }
+    }
+
+    return batch;
+}
+
+/**
+ * How far the tick count is behind the clock. Only ever more than 0 when
+ * tickless, between wakeups. With the lock held.
+ */
+uint32_t Sked::hostTickLag(void) {
+    struct sked_host_s *host = _host;
+
+    if (host == NULL || !host->tickless) {
+        return 0U;
+    }
+
+    uint32_t now_tick = host->tick_base + (uint32_t)((skedHostClockNs()
+        - skedHostEpochNs(host)) / SKED_HOST_TICK_NS);
+    int32_t lag = (int32_t)(now_tick - _ticks);
+
+    return (lag > 0) ? (uint32_t)lag : 0U;
+}
+
+/**
+ * Tickless tick thread, with the lock held: bring the tick count up to the
+ * clock, running timerISR() for each tick something is due on and skipping
+ * straight over the rest.
+ */
+void Sked::hostTickTo(uint64_t now_ns) {
+    struct sked_host_s *host = _host;
+    uint64_t epoch_ns = skedHostEpochNs(host);
+    uint32_t now_tick = host->tick_base
+        + (uint32_t)((now_ns - epoch_ns) / SKED_HOST_TICK_NS);
+
+    host->wake_ns = now_ns;
+
+    while ((int32_t)(now_tick - _ticks) > 0) {
+        /* The last tick always goes through timerISR() */
+        hostSkipTicks(now_tick - _ticks - 1U);
+
+        host->tick_due_ns = epoch_ns
+            + (uint64_t)(_ticks + 1U - host->tick_base) * SKED_HOST_TICK_NS;
+        timerISR();
+    }
+}
+
+/**
+ * Move the tick count on by up to max ticks in one go, stopping short of the
+ * first one a task's count runs out on. With the lock held.
+ *
+ * @return How many ticks it moved on
+ */
+uint32_t Sked::hostSkipTicks(uint32_t max) {
+    uint32_t skip = max;
+
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+    releaseSync();
+#endif
+    for (sked_index_t i = 0; i < _task_count && skip > 0U; i++) {
+        if (_tasks[i].host_flags & SKED_HOST_TASK_FREE) {
+            continue;
+        }
+
+        /* A count of 0 runs out on the next tick */
+        uint32_t due = (_counts[i] != 0U) ? _counts[i] : 1U;
+
+        if (due - 1U < skip) {
+            skip = due - 1U;
+        }
+    }
+
+    if (skip == 0U) {
+        return 0U;
+    }
+
+    for (sked_index_t i = 0; i < _task_count; i++) {
+        _counts[i] -= (uint16_t)skip;
+    }
+    _ticks += skip;
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+    releaseSync();
+#endif
+
+    return skip;
+}
+
+/**
+ * @return Ticks from the current tick count to the first one the tick
+ * thread has to wake up for: the earliest any task's release plus its slack
+ * falls on. Tasks released some other way (fds, waiting coroutines) don't
+ * count.
+ */
+uint32_t Sked::hostNextWake(void) {
+    uint32_t next = SKED_HOST_TICKLESS_MAX;
+
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+    releaseSync();
+#endif
+    for (sked_index_t i = 0; i < _task_count; i++) {
+        sked_task_t *task = &_tasks[i];
+
+        if ((task->flags & SKED_TASK_EVENT) || ((task->flags & SKED_TASK_CORO)
+                && !(task->flags & SKED_TASK_SLEEP))
+                || (task->host_flags & SKED_HOST_TASK_FREE)) {
+            continue;
+        }
+
+        uint32_t due = (_counts[i] != 0U) ? _counts[i] : 1U;
+        due += task->slack;
+        if (due < next) {
+            next = due;
+        }
+    }
+
+    return next;
+}
+
+/**
+ * Set the timerfd for the next tick the tick thread has to wake up for:
+ * tickless, the first one something is due on, and otherwise just the next
+ * one. If a setSpin() band has a release then, it goes off the spin margin
+ * early. Only when the timerfd is set per wakeup. With the lock held.
+ *
+ * @param force  false to only ever move the wakeup earlier, as when a task
+ * changes; the tick thread itself passes true once it's awake
+ */
+void Sked::hostArmWake(bool force) {
+    struct sked_host_s *host = _host;
+
+    if (host == NULL || !host->oneshot) {
+        return;
+    }
+
+    uint32_t tick = _ticks + (host->tickless ? hostNextWake() : 1U);
+    uint64_t offset_ns = (uint64_t)(tick - host->tick_base)
+        * SKED_HOST_TICK_NS;
+    uint64_t margin_ns = (host->can_spin && hostSpinDue(tick))
+        ? host->spin.margin_ns : 0U;
+    if (margin_ns > offset_ns) {
+        margin_ns = offset_ns;
+    }
+
+    uint64_t arm_ns = skedHostEpochNs(host) + offset_ns - margin_ns;
+    if (!force && arm_ns >= host->arm_ns) {
+        return;
+    }
+
+    struct itimerspec when;
+    when.it_value = host->epoch;
+    skedHostTimespecAddNs(&when.it_value, offset_ns - margin_ns);
+    when.it_interval.tv_sec = 0;
+    when.it_interval.tv_nsec = 0;
+
+    host->wake_tick = tick;
+    host->arm_ns = arm_ns;
+    host->spin_ns.store((margin_ns > 0U) ? arm_ns + margin_ns : 0U,
+        std::memory_order_relaxed);
+    timerfd_settime(host->timer_fd, TFD_TIMER_ABSTIME, &when, NULL);
+}
+
+/**
+ * @return Whether a task in a setSpin() band is released by the given tick.
+ * With the lock held.
+ */
+bool Sked::hostSpinDue(uint32_t tick) {
+    if (_host_spins == 0U) {
+        return false;
+    }
+
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+    releaseSync();
+#endif
+    for (sked_index_t i = 0; i < _task_count; i++) {
+        sked_task_t *task = &_tasks[i];
+
+        if ((task->flags & SKED_TASK_EVENT) || ((task->flags & SKED_TASK_CORO)
+                && !(task->flags & SKED_TASK_SLEEP))
+                || (task->host_flags & SKED_HOST_TASK_FREE)) {
+            continue;
+        }
+
+        uint32_t due = (_counts[i] != 0U) ? _counts[i] : 1U;
+        if (due > tick - _ticks) {
+            continue;
+        }
+
+        int8_t key = hostBandKey(task->priority);
+        for (uint8_t s = 0; s < _host_spins; s++) {
+            if (hostBandKey(_host_spin[s]) == key) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Called by the tick thread with the lock held each time the timerfd goes
+ * off when it's set per wakeup: fold how late it went off into the margin,
+ * and count the spin, if there was one.
+ *
+ * @param woke_ns  When the tick thread woke up
+ * @param spin_ns  When it spun until, or 0 if it didn't
+ * @param now_ns  When it stopped spinning
+ */
+void Sked::hostSpinRecord(uint64_t woke_ns, uint64_t spin_ns,
+        uint64_t now_ns) {
+    struct sked_host_s *host = _host;
+    int64_t late = (woke_ns > host->arm_ns)
+        ? (int64_t)(woke_ns - host->arm_ns) : 0;
+    int64_t err = late - host->spin_late_ns;
+
+    /* A stall of a millisecond or more, as a VM has now and then, would
+     * otherwise run the margin up to the maximum for a long while after */
+    if (err > (int64_t)SKED_HOST_SPIN_OUTLIER_NS) {
+        err = SKED_HOST_SPIN_OUTLIER_NS;
+    }
+    host->spin_late_ns += err / 8;
+    host->spin_dev_ns += ((err < 0 ? -err : err) - host->spin_dev_ns) / 4;
+
+    int64_t margin = host->spin_late_ns + 4 * host->spin_dev_ns;
+    if (margin < (int64_t)SKED_HOST_SPIN_MIN_NS) {
+        margin = SKED_HOST_SPIN_MIN_NS;
+    } else if (margin > (int64_t)SKED_HOST_SPIN_MAX_NS) {
+        margin = SKED_HOST_SPIN_MAX_NS;
+    }
+    host->spin.margin_ns = (uint32_t)margin;
+    host->spin.timer_late_ns = (uint32_t)host->spin_late_ns;
+
+    if (spin_ns == 0U) {
+        return;
+    }
+
+    uint32_t spin_us = (uint32_t)((now_ns - woke_ns) / 1000U);
+
+    host->spin.spins++;
+    if (woke_ns > spin_ns) {
+        host->spin.overshoots++;
+    }
+    host->spin.spin_total_us += spin_us;
+    if (spin_us > host->spin.spin_max_us) {
+        host->spin.spin_max_us = spin_us;
+    }
+}
+
+/**
+ * Called from releaseTask() with the lock held when a task goes from IDLE to
+ * READY: count it, and how long after its tick the tick thread got to it.
+ */
+void Sked::hostRecordRelease(void) {
+    struct sked_host_s *host = _host;
+
+    if (host == NULL) {
+        return;
+    }
+
+    uint64_t late_ns = (host->wake_ns > host->tick_due_ns)
+        ? host->wake_ns - host->tick_due_ns : 0U;
+    uint32_t late_us = (late_ns / 1000U < 0xFFFFFFFFULL)
+        ? (uint32_t)(late_ns / 1000U) : 0xFFFFFFFFUL;
+
+    host->wake.releases++;
+    host->wake.late_total_us += late_us;
+    if (late_us > host->wake.late_max_us) {
+        host->wake.late_max_us = late_us;
+    }
+}
+
+/**
+ * Called at the end of timerISR() with the lock held. Wakes the workers of
+ * READY tasks, or the thread waiting in loop().
+ */
+void Sked::hostDispatch(void) {
+    if (_host == NULL) {
+        return;
+    }
+
+    if (_mode != SKED_MODE_PREEMPTIVE) {
+        if (_host->worker_count > 0U) {
+            hostPoolPush();
+        } else if (_host->loop_waiting && _host_ready_count > 0U) {
+            pthread_cond_signal(&_host->loop_cv);
+        }
+        return;
+    }
+
+    /* One look per priority with anything READY */
+    for (uint8_t w = 0; w < 4U; w++) {
+        uint64_t bits = _host_ready_map[w];
+
+        while (bits != 0U) {
+            int8_t priority = (int8_t)((int16_t)(w * 64U
+                + __builtin_ctzll(bits)) - 128);
+            bits &= bits - 1U;
+
+            /* A task scheduled after start() may need a new worker */
+            int16_t b = hostBandOf(priority);
+            if (b < 0) {
+                continue;
+            }
+
+            if (_host->bands[b].waiting) {
+                _host->bands[b].waiting = false;
+                pthread_cond_signal(&_host->bands[b].cv);
+            }
+        }
+    }
+}
+
+/**
+ * Non-preemptive mode with a worker pool: deal READY jobs out to the workers
+ * in turn, highest priority first, waking the one that gets each if it's
+ * parked, or else any parked worker so it can steal. Called with the lock
+ * held.
+ */
+void Sked::hostPoolPush(void) {
+    while (_host_ready_count > 0U) {
+        sked_host_worker_t *worker = NULL;
+
+        for (uint8_t k = 0; worker == NULL && k < _host->worker_count; k++) {
+            sked_host_worker_t *next = &_host->workers[_host->worker_next];
+            _host->worker_next = (_host->worker_next + 1U)
+                % _host->worker_count;
+
+            pthread_mutex_lock(&next->mutex);
+            if (next->count < SKED_HOST_MAX_TASKS) {
+                /* Keeps hold of its mutex */
+                worker = next;
+            } else {
+                pthread_mutex_unlock(&next->mutex);
+            }
+        }
+        if (worker == NULL) {
+            /* Full up; hostPoolMain() deals the rest as jobs finish */
+            break;
+        }
+
+        sked_index_t i = hostReadyTop(-128, 127);
+        hostReadyRemove(i);
+
+        worker->jobs[(worker->head + worker->count) % SKED_HOST_MAX_TASKS]
+            = i;
+        worker->count++;
+        bool woke = worker->parked;
+        if (woke) {
+            worker->parked = false;
+            pthread_cond_signal(&worker->cv);
+        }
+        pthread_mutex_unlock(&worker->mutex);
+
+        for (uint8_t w = 0; !woke && w < _host->worker_count; w++) {
+            sked_host_worker_t *idle = &_host->workers[w];
+
+            pthread_mutex_lock(&idle->mutex);
+            if (idle->parked) {
+                idle->parked = false;
+                pthread_cond_signal(&idle->cv);
+                woke = true;
+            }
+            pthread_mutex_unlock(&idle->mutex);
+        }
+    }
+}
+
+/**
+ * A worker of the non-preemptive pool: runs jobs from its own queue, steals
+ * when that's empty, and parks when there's nothing anywhere.
+ */
+void *Sked::hostPoolMain(void *arg) {
+    sked_host_worker_t *worker = (sked_host_worker_t *)arg;
+    Sked *self = worker->sked;
+    struct sked_host_s *host = self->_host;
+
+    while (!host->stopping) {
+        sked_index_t job = SKED_INDEX_NONE;
+
+        pthread_mutex_lock(&worker->mutex);
+        if (worker->count > 0U) {
+            job = worker->jobs[worker->head];
+            worker->head = (worker->head + 1U) % SKED_HOST_MAX_TASKS;
+            worker->count--;
+        }
+        pthread_mutex_unlock(&worker->mutex);
+
+        for (uint8_t k = 1; job == SKED_INDEX_NONE && k < host->worker_count;
+                k++) {
+            sked_host_worker_t *victim =
+                &host->workers[(worker->index + k) % host->worker_count];
+
+            pthread_mutex_lock(&victim->mutex);
+            if (victim->count > 0U) {
+                victim->count--;
+                job = victim->jobs[(victim->head + victim->count)
+                    % SKED_HOST_MAX_TASKS];
+                worker->steals++;
+            }
+            pthread_mutex_unlock(&victim->mutex);
+        }
+
+        if (job == SKED_INDEX_NONE) {
+            pthread_mutex_lock(&worker->mutex);
+            if (worker->count == 0U && !host->stopping) {
+                worker->parked = true;
+                while (worker->parked && !host->stopping) {
+                    pthread_cond_wait(&worker->cv, &worker->mutex);
+                }
+                worker->parked = false;
+            }
+            pthread_mutex_unlock(&worker->mutex);
+            continue;
+        }
+
+        SKED_HOST_ATOMIC(&self->_host_irq) {
+            sked_task_t *task = &self->_tasks[job];
+
+            /* Only READY tasks are queued, but reset() may have got there
+             * first, and unschedule() leaves a dealt task for here to
+             * free */
+            if (task->state == READY) {
+                if (!(task->host_flags & SKED_HOST_TASK_FREE)) {
+                    task->state = RUNNING;
+                    self->runTask(job);
+                    worker->runs++;
+                }
+                self->hostJobDone(job);
+            }
+
+            /* There's room for another */
+            self->hostPoolPush();
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @return Whether a worker pool is running the tasks
+ */
+bool Sked::hostPooled(void) {
+    bool pooled = false;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pooled = (_host != NULL) && (_host->worker_count > 0U);
+    }
+
+    return pooled;
+}
+
+/**
+ * Non-preemptive mode: called by loop() when nothing ran. Sleeps until the
+ * tick thread releases something, or at most 10ms so idle() still gets
+ * regular calls.
+ */
+void Sked::hostIdleWait(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host == NULL) {
+            break;
+        }
+
+        /* The pool runs READY tasks, so there's no waiting for them here */
+        if (_host->worker_count == 0U && _host_ready_count > 0U) {
+            return;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        skedHostTimespecAddNs(&deadline, 10000000ULL);
+
+        _host->loop_waiting = true;
+        skedHostIrqWait(&_host_irq, &_host->loop_cv, &deadline);
+        _host->loop_waiting = false;
+    }
+}
+
+/**
+ * @return Microseconds since start()
+ */
+uint32_t Sked::hostNowUs(void) {
+    if (_host == NULL) {
+        return 0U;
+    }
+
+    uint64_t epoch = (uint64_t)_host->epoch.tv_sec * 1000000000ULL
+        + _host->epoch.tv_nsec;
+
+    return (uint32_t)((skedHostClockNs() - epoch) / 1000ULL);
+}
+
+/* The program's code and build ID, as dl_iterate_phdr() finds them */
+typedef struct {
+    uintptr_t base;
+    uintptr_t low;
+    uintptr_t high;
+    uint8_t *build_id;
+} sked_host_program_t;
+
+/**
+ * Copy the GNU build ID out of a PT_NOTE segment, if it has one.
+ */
+static void skedHostBuildId(const uint8_t *p, size_t len, uint8_t *build_id) {
+    const uint8_t *end = p + len;
+
+    while (p + sizeof(ElfW(Nhdr)) <= end) {
+        const ElfW(Nhdr) *note = (const ElfW(Nhdr) *)p;
+        const uint8_t *name = p + sizeof(*note);
+        const uint8_t *desc = name + ((note->n_namesz + 3U) & ~3U);
+
+        if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4U
+                && memcmp(name, "GNU", 4U) == 0) {
+            memcpy(build_id, desc, (note->n_descsz < SKED_BUILD_ID_LEN)
+                ? note->n_descsz : SKED_BUILD_ID_LEN);
+            return;
+        }
+        p = desc + ((note->n_descsz + 3U) & ~3U);
+    }
+}
+
+static int skedHostProgramPhdr(struct dl_phdr_info *info, size_t size,
+        void *data) {
+    sked_host_program_t *program = (sked_host_program_t *)data;
+
+    program->base = info->dlpi_addr;
+    for (ElfW(Half) h = 0; h < info->dlpi_phnum; h++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[h];
+        uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+
+        if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_X)) {
+            if (program->low == 0U || start < program->low) {
+                program->low = start;
+            }
+            if (start + phdr->p_memsz > program->high) {
+                program->high = start + phdr->p_memsz;
+            }
+        } else if (phdr->p_type == PT_NOTE) {
+            skedHostBuildId((const uint8_t *)start, phdr->p_memsz,
+                program->build_id);
+        }
+    }
+
+    /* The program itself comes first, and that's all */
+    return 1;
+}
+
+/**
+ * Find where the program's code is loaded and its build ID, for
+ * snapshot() to keep task functions as offsets into it. It's loaded
+ * somewhere else each run, but its code stays put while it runs. A program
+ * without a build ID gets all zeroes, and restore() can't tell its builds
+ * apart.
+ */
+void Sked::hostProgramInit(void) {
+    sked_host_program_t program;
+
+    memset(_host_build_id, 0, sizeof(_host_build_id));
+    program.base = 0U;
+    program.low = 0U;
+    program.high = 0U;
+    program.build_id = _host_build_id;
+    dl_iterate_phdr(skedHostProgramPhdr, &program);
+
+    _host_code_base = program.base;
+    _host_code_low = program.low;
+    _host_code_high = program.high;
+}
+
+/**
+ * Turn the address of a function into its offset into the program.
+ *
+ * @return false if it isn't in the program's code
+ */
+bool Sked::hostCodeOut(uintptr_t *addr) {
+    if (*addr < _host_code_low || *addr >= _host_code_high) {
+        return false;
+    }
+
+    *addr -= _host_code_base;
+    return true;
+}
+
+/**
+ * Undo hostCodeOut() for this run.
+ *
+ * @return false if the offset is outside the program's code
+ */
+bool Sked::hostCodeIn(uintptr_t *addr) {
+    uintptr_t fcn = *addr + _host_code_base;
+
+    if (fcn < _host_code_low || fcn >= _host_code_high) {
+        return false;
+    }
+
+    *addr = fcn;
+    return true;
+}
+
+/**
+ * start(), picking up a beat from before it: move each periodic task's count
+ * on by gone ticks, as though it had been released all along, and carry on
+ * from tick count ticks, which was due at tick_ns. With the lock held.
+ */
+void Sked::hostAdvance(uint64_t gone, uint32_t ticks, uint64_t tick_ns) {
+    struct sked_host_s *host = _host;
+
+    for (sked_index_t i = 0; i < _task_count; i++) {
+        const sked_task_t *task = &_tasks[i];
+
+        if ((task->flags & (SKED_TASK_EVENT | SKED_TASK_CORO))
+                || (task->host_flags & SKED_HOST_TASK_FREE)) {
+            continue;
+        }
+
+        /* Releases were due at due, due + period, ... from the old tick;
+         * the count is to the first one after the new one */
+        uint64_t due = (_counts[i] != 0U) ? _counts[i] : 1U;
+        uint64_t period = task->period;
+
+        if (due > gone) {
+            _counts[i] = (uint16_t)(due - gone);
+        } else {
+            _counts[i] = (uint16_t)(period - (gone - due) % period);
+        }
+    }
+
+    _ticks = ticks;
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+    _release_in = _release_span = 0xFFFFU;
+    releaseSync();
+#endif
+
+    host->epoch.tv_sec = (time_t)(tick_ns / 1000000000ULL);
+    host->epoch.tv_nsec = (long)(tick_ns % 1000000000ULL);
+    host->tick_base = _ticks;
+    host->wake_tick = _ticks;
+    host->tick_due_ns = tick_ns;
+}
+
+#if (SKED_SNAPSHOT == SKED_ON)
+/**
+ * @return CLOCK_MONOTONIC when the current tick was due, or 0 if Sked isn't
+ * running. With the lock held.
+ */
+uint64_t Sked::hostTickNs(void) {
+    if (_host == NULL) {
+        return 0U;
+    }
+
+    return skedHostEpochNs(_host)
+        + (uint64_t)(_ticks - _host->tick_base) * SKED_HOST_TICK_NS;
+}
+
+/**
+ * start() after restore(): carry on from the snapshot's tick on the same
+ * beat. The epoch goes back to the last tick boundary of the old run, and
+ * the tick count and each count move on by the ticks gone by since. The
+ * releases in between never happened, so they don't count as misses. With
+ * the lock held.
+ */
+void Sked::hostResume(void) {
+    uint64_t now_ns = skedHostEpochNs(_host);
+    uint64_t resume_ns = _host_resume_ns;
+
+    _host_resume_ns = 0U;
+    if (resume_ns > now_ns) {
+        /* Not this boot's clock: there's no beat to keep */
+        return;
+    }
+
+    uint64_t gone = (now_ns - resume_ns) / SKED_HOST_TICK_NS;
+
+    hostAdvance(gone, _ticks + (uint32_t)gone,
+        resume_ns + gone * SKED_HOST_TICK_NS);
+}
+#endif
+
+/**
+ * Start the tick thread and, in preemptive mode, a worker per task priority.
+ * If SCHED_FIFO was asked for but isn't allowed, everything runs as normal
+ * threads instead.
+ */
+int8_t Sked::hostStart(void) {
+    int8_t ret = SKED_E_OK;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (_host != NULL) {
+            /* Already running */
+            break;
+        }
+
+        _host = new sked_host_s();
+        _host->stopping = false;
+        _host->epoll_fd = -1;
+        _host->timer_fd = -1;
+        _host->tick_started = false;
+        _host->tick_due_ns = skedHostClockNs();
+        _host->tick_late_max_ns = 0U;
+        _host->tick_catchups = 0U;
+        _host->tickless = _host_tickless;
+        _host->tick_base = _ticks;
+        _host->wake_tick = _ticks;
+        _host->wake_ns = 0U;
+        _host->wake.wakeups = 0U;
+        _host->wake.releases = 0U;
+        _host->wake.late_total_us = 0U;
+        _host->wake.late_max_us = 0U;
+        _host->band_count = 0U;
+        _host->worker_count = 0U;
+        _host->worker_next = 0U;
+        _host->loop_waiting = false;
+        _host->realtime = _host_realtime;
+        skedHostCondInit(&_host->loop_cv);
+        clock_gettime(CLOCK_MONOTONIC, &_host->epoch);
+        if (_host_timebase != NULL) {
+            /* The shared epoch stands in for the snapshot's */
+            hostTimebaseAlign();
+#if (SKED_SNAPSHOT == SKED_ON)
+            _host_resume_ns = 0U;
+        } else if (_host_resume_ns != 0U) {
+            hostResume();
+#endif
+        }
+
+        /* The tick thread's epoll set: the tick, post() wakeups and the fd
+         * tasks */
+        _host->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        _host->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                TFD_CLOEXEC | TFD_NONBLOCK);
+        if (_host->epoll_fd < 0 || _host->timer_fd < 0) {
+            ret = SKED_E_INVALID_OPERATION;
+            break;
+        }
+
+        /* Spinning on the only CPU the tick thread has would keep the
+         * workers off it until the release it's spinning for */
+        _host->can_spin = _host_cpu == SKED_CPU_ANY
+            && sysconf(_SC_NPROCESSORS_ONLN) > 1;
+        _host->oneshot = _host->tickless
+            || (_host_spins > 0U && _host->can_spin);
+        _host->arm_ns = 0U;
+        _host->spin_ns = 0U;
+        _host->spin_late_ns = SKED_HOST_SPIN_INIT_NS / 2U;
+        _host->spin_dev_ns = SKED_HOST_SPIN_INIT_NS / 8U;
+        memset(&_host->spin, 0, sizeof(_host->spin));
+        _host->spin.margin_ns = SKED_HOST_SPIN_INIT_NS;
+        _host->spin.timer_late_ns = SKED_HOST_SPIN_INIT_NS / 2U;
+
+        if (_host->oneshot) {
+            hostArmWake(true);
+        } else {
+            struct itimerspec tick;
+            tick.it_value = _host->epoch;
+            skedHostTimespecAddNs(&tick.it_value, SKED_HOST_TICK_NS);
+            tick.it_interval.tv_sec = 0;
+            tick.it_interval.tv_nsec = SKED_HOST_TICK_NS;
+            timerfd_settime(_host->timer_fd, TFD_TIMER_ABSTIME, &tick, NULL);
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = SKED_HOST_EV_TICK;
+        epoll_ctl(_host->epoll_fd, EPOLL_CTL_ADD, _host->timer_fd, &event);
+        event.data.u64 = SKED_HOST_EV_POST;
+        epoll_ctl(_host->epoll_fd, EPOLL_CTL_ADD, _host_post->wake_fd, &event);
+
+        for (sked_index_t i = 0; i < _task_count && ret == SKED_E_OK; i++) {
+            if ((_tasks[i].flags & SKED_TASK_EVENT)
+                    && hostFdArm(&_tasks[i], EPOLL_CTL_ADD) != 0) {
+                ret = SKED_E_INVALID_OPERATION;
+            }
+        }
+        if (ret != SKED_E_OK) {
+            break;
+        }
+
+        int err = skedHostThread(&_host->tick_thread, hostTickMain, this,
+                _host->realtime ? SKED_HOST_RT_TICK_PRIO : 0, _host_cpu);
+        if (err == EPERM && _host->realtime) {
+            /* No privilege for SCHED_FIFO: fall back to normal threads */
+            _host->realtime = false;
+            err = skedHostThread(&_host->tick_thread, hostTickMain, this, 0,
+                    _host_cpu);
+        }
+        if (err != 0) {
+            ret = SKED_E_INVALID_OPERATION;
+            break;
+        }
+        _host->tick_started = true;
+
+        if (_mode == SKED_MODE_PREEMPTIVE) {
+            for (sked_index_t i = 0; i < _task_count; i++) {
+                if (!(_tasks[i].host_flags & SKED_HOST_TASK_FREE)
+                        && hostBandOf(_tasks[i].priority) < 0) {
+                    ret = SKED_E_INVALID_OPERATION;
+                    break;
+                }
+            }
+        } else {
+            for (uint8_t w = 0; w < _host_workers; w++) {
+                sked_host_worker_t *worker = &_host->workers[w];
+
+                worker->sked = this;
+                worker->index = w;
+                worker->parked = false;
+                worker->head = 0U;
+                worker->count = 0U;
+                worker->runs = 0U;
+                worker->steals = 0U;
+                /* Room for every task, backed as the queue goes round */
+                worker->jobs = (sked_index_t *)skedHostReserve(
+                    skedHostTableSize(sizeof(sked_index_t)));
+                if (worker->jobs == NULL) {
+                    ret = SKED_E_INVALID_OPERATION;
+                    break;
+                }
+                pthread_mutex_init(&worker->mutex, NULL);
+                skedHostCondInit(&worker->cv);
+
+                if (skedHostThread(&worker->thread, hostPoolMain, worker,
+                        _host->realtime ? SKED_HOST_RT_TICK_PRIO - 1 : 0,
+                        _host_cpu) != 0) {
+                    pthread_mutex_destroy(&worker->mutex);
+                    pthread_cond_destroy(&worker->cv);
+                    munmap(worker->jobs,
+                        skedHostTableSize(sizeof(sked_index_t)));
+                    ret = SKED_E_INVALID_OPERATION;
+                    break;
+                }
+                _host->worker_count++;
+            }
+        }
+    }
+
+    if (ret != SKED_E_OK) {
+        hostStop();
+    }
+
+    return ret;
+}
+
+/**
+ * Stop and join every thread. Called by reset(), without the lock held. Must
+ * not be called from a task.
+ */
+void Sked::hostStop(void) {
+    struct sked_host_s *host;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        host = _host;
+        if (host != NULL) {
+            host->stopping = true;
+            for (uint8_t b = 0; b < host->band_count; b++) {
+                pthread_cond_signal(&host->bands[b].cv);
+            }
+            pthread_cond_broadcast(&host->loop_cv);
+            for (uint8_t w = 0; w < host->worker_count; w++) {
+                pthread_mutex_lock(&host->workers[w].mutex);
+                pthread_cond_signal(&host->workers[w].cv);
+                pthread_mutex_unlock(&host->workers[w].mutex);
+            }
+        }
+    }
+
+    if (host == NULL) {
+        return;
+    }
+
+    if (host->tick_started) {
+        pthread_join(host->tick_thread, NULL);
+    }
+    for (uint8_t b = 0; b < host->band_count; b++) {
+        pthread_join(host->bands[b].thread, NULL);
+        pthread_cond_destroy(&host->bands[b].cv);
+    }
+    for (uint8_t w = 0; w < host->worker_count; w++) {
+        pthread_join(host->workers[w].thread, NULL);
+        pthread_mutex_destroy(&host->workers[w].mutex);
+        pthread_cond_destroy(&host->workers[w].cv);
+        munmap(host->workers[w].jobs, skedHostTableSize(sizeof(sked_index_t)));
+    }
+    pthread_cond_destroy(&host->loop_cv);
+    if (host->epoll_fd >= 0) {
+        close(host->epoll_fd);
+    }
+    if (host->timer_fd >= 0) {
+        close(host->timer_fd);
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        _host = NULL;
+    }
+    delete host;
+}
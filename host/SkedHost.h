@@ -0,0 +1,280 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Internals of the Linux host backend, shared by the host/ sources. Not for
+ * applications; use the Sked API.
+ */
+
+#ifndef HOST_SKEDHOST_H
+#define HOST_SKEDHOST_H
+
+#include <pthread.h>
+#include <time.h>
+#include <util/atomic.h>
+#include <atomic>
+#include <cstddef>
+#include "../Sked.h"
+
+/* Same 100us tick as TIMER1 */
+#define SKED_HOST_TICK_NS 100000ULL
+
+/* SCHED_FIFO priority of the tick thread. Workers get the ones below it, the
+ * highest Sked priority nearest the top. */
+#ifndef SKED_HOST_RT_TICK_PRIO
+#define SKED_HOST_RT_TICK_PRIO 80
+#endif
+
+/* Without SCHED_FIFO, each band below the top one runs this much nicer than
+ * the one above it */
+#ifndef SKED_HOST_NICE_STEP
+#define SKED_HOST_NICE_STEP 10
+#endif
+
+/* One worker thread per priority band in preemptive mode: by default each
+ * distinct task priority, or the ranges given to setPriorityBands(). Tasks in
+ * a band share a thread, so they never preempt each other (as with equal
+ * priorities on AVR), and the highest priority READY one goes first. */
+typedef struct {
+    Sked *sked;
+    /* Lowest priority in the band, which identifies it */
+    int8_t key;
+    pthread_t thread;
+    pthread_cond_t cv;
+    bool waiting;
+    /* Has a job out of the lock in runTask() */
+    bool running;
+    /* Fallback priority, applied by the worker itself */
+    int nice;
+    bool renice;
+    sked_latency_t latency;
+} sked_host_band_t;
+
+/* Bands there can be: one per valid priority at most */
+#define SKED_HOST_MAX_BANDS 256
+
+/* Most workers setWorkers() can start */
+#ifndef SKED_HOST_MAX_WORKERS
+#define SKED_HOST_MAX_WORKERS 16
+#endif
+
+/* A worker of the non-preemptive pool. Released jobs (task indexes) are dealt
+ * out of the READY queues to the workers' queues in turn, highest priority
+ * first. A queue is reserved for every task the table can hold, so there's
+ * always room. A worker runs its own jobs from the head, oldest (and so highest
+ * priority) first, and when it runs out, steals from the tail of the
+ * others', so the least urgent work is what moves. A task is only ever
+ * queued once until it runs, so it can't run concurrently with itself. */
+typedef struct {
+    Sked *sked;
+    uint8_t index;
+    pthread_t thread;
+    /* Guards the queue and parked. Taken after the Sked lock, never
+     * before it. */
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;
+    bool parked;
+    sked_index_t *jobs;
+    uint32_t head;
+    uint32_t count;
+    std::atomic<uint32_t> runs;
+    std::atomic<uint32_t> steals;
+} sked_host_worker_t;
+
+/* post() is a Vyukov multi-producer, single-consumer queue of activation
+ * nodes, one node per task function, so posting never allocates. A node is
+ * only ever in the queue once: a post() for a task that's already queued
+ * just counts. The tick thread drains it, in batches under one hold of the
+ * lock. */
+typedef struct sked_host_post_node {
+    std::atomic<struct sked_host_post_node *> next;
+    std::atomic<bool> queued;
+    sked_task_fcn_t fcn;
+    /* The tasks with this function, linked through task_next; guarded by
+     * the Sked lock */
+    sked_index_t first;
+} sked_host_post_node_t;
+
+struct sked_host_post_s {
+    /* Reserved for SKED_HOST_MAX_TASKS functions, and backed as they're
+     * bound. NULL if the address space couldn't be had. */
+    sked_host_post_node_t *nodes;
+    /* Nodes bound to a task function; only grows until reset(). Guarded by
+     * the Sked lock. */
+    uint32_t node_count;
+    /* Open-addressed hash of task function to node, at least twice as big
+     * as nodes so it's never more than half full. Written with the lock
+     * held, read by post() without it; a slot never changes once it's set,
+     * until reset(). */
+    std::atomic<sked_host_post_node_t *> *index;
+    size_t index_mask;
+    /* Per task slot: the next and previous task with the same function */
+    sked_index_t *task_next;
+    sked_index_t *task_prev;
+    sked_host_post_node_t stub;
+    /* Producers swap themselves in here... */
+    std::atomic<sked_host_post_node_t *> head;
+    /* ...and the consumer takes from here */
+    sked_host_post_node_t *tail;
+
+    /* The tick thread parks in epoll_wait() between ticks, with wake_fd (an
+     * eventfd) in the set. A producer writes to it only when the thread is
+     * parked, and only once per park. */
+    int wake_fd;
+    std::atomic<bool> parked;
+    std::atomic<bool> wake_pending;
+
+    std::atomic<uint32_t> posts;
+    std::atomic<uint32_t> enqueued;
+    std::atomic<uint32_t> wakeups;
+    /* Only touched by the consumer, with the lock held */
+    uint32_t drains;
+    uint32_t max_batch;
+    uint32_t released;
+    uint32_t coalesced;
+};
+
+/* A block of the coroutine frame pool. While it's free it's on the free
+ * list; while it holds a frame it remembers whose pool it came from, since a
+ * frame is deleted without its Sked, and once spawn() has it, the task it
+ * belongs to, so a wait finds it without a search. */
+typedef struct sked_host_frame {
+    union {
+        struct sked_host_frame *next;
+        Sked *owner;
+    };
+    sked_index_t task;
+    alignas(std::max_align_t) uint8_t data[SKED_CORO_FRAME_SIZE];
+} sked_host_frame_t;
+
+/* Guarded by the Sked lock. The frames are reserved, and backed as they're
+ * first handed out: the free list only has those that have been used, and
+ * fresh ones come from the end of the ones that have. */
+struct sked_host_coro_s {
+    sked_host_frame_t *frames;
+    uint32_t fresh;
+    sked_host_frame_t *free_list;
+    sked_coro_stats_t stats;
+};
+
+/* epoll data of the tick thread's own fds; task fds use the fd number */
+#define SKED_HOST_EV_TICK 0x100000000ULL
+#define SKED_HOST_EV_POST 0x100000001ULL
+
+/* How often the tick thread writes out all of the exportStats() file, in
+ * ticks */
+#ifndef SKED_HOST_SHM_TICKS
+#define SKED_HOST_SHM_TICKS 1000U
+#endif
+
+/* Longest a tickless tick thread sleeps, in ticks, when nothing is due */
+#ifndef SKED_HOST_TICKLESS_MAX
+#define SKED_HOST_TICKLESS_MAX 10000U
+#endif
+
+/* Bounds on the margin a setSpin() wakeup leaves for spinning, where it
+ * starts before there are any wakeups to go by, and the most one wakeup's
+ * lateness can count for past the mean */
+#ifndef SKED_HOST_SPIN_MIN_NS
+#define SKED_HOST_SPIN_MIN_NS 2000U
+#endif
+#ifndef SKED_HOST_SPIN_MAX_NS
+#define SKED_HOST_SPIN_MAX_NS 500000U
+#endif
+#ifndef SKED_HOST_SPIN_INIT_NS
+#define SKED_HOST_SPIN_INIT_NS 50000U
+#endif
+#ifndef SKED_HOST_SPIN_OUTLIER_NS
+#define SKED_HOST_SPIN_OUTLIER_NS 50000U
+#endif
+
+/* Most events the tick thread takes from one epoll_wait() */
+#ifndef SKED_HOST_EPOLL_EVENTS
+#define SKED_HOST_EPOLL_EVENTS 16
+#endif
+
+struct sked_host_s {
+    std::atomic<bool> stopping;
+    struct timespec epoch;
+
+    /* The tick thread waits on one epoll set for the tick timerfd, post()
+     * wakeups and the fds of SKED_TASK_EVENT tasks */
+    int epoll_fd;
+    int timer_fd;
+
+    pthread_t tick_thread;
+    bool tick_started;
+    /* When the tick timerISR() last ran for was due */
+    uint64_t tick_due_ns;
+    /* Longest the tick thread woke up after a tick was due, and the ticks
+     * it had to make up for because of it */
+    uint32_t tick_late_max_ns;
+    uint32_t tick_catchups;
+
+    /* setTickless(): rather than every tick, the timerfd goes off once at
+     * wake_tick, the first tick something is due (give or take its slack),
+     * and the tick thread runs timerISR() for the ticks gone by. Tick
+     * tick_base was at epoch. */
+    bool tickless;
+    uint32_t tick_base;
+    uint32_t wake_tick;
+    /* When the tick thread last woke up, for how late releases were */
+    uint64_t wake_ns;
+    sked_wake_stats_t wake;
+
+    /* Tickless, or with setSpin() bands, the timerfd is set once per wakeup,
+     * for arm_ns. When that's early for a setSpin() band's release, spin_ns
+     * is when the release is due, and the tick thread spins until then
+     * before taking the lock. spin_late_ns and spin_dev_ns are the mean and
+     * mean deviation of how late the timer goes off, which set the margin
+     * the way TCP sets its retransmit timeout. can_spin is false when the
+     * tick thread has no CPU to itself, and then it never spins. */
+    bool oneshot;
+    bool can_spin;
+    uint64_t arm_ns;
+    std::atomic<uint64_t> spin_ns;
+    int64_t spin_late_ns;
+    int64_t spin_dev_ns;
+    sked_spin_stats_t spin;
+
+    sked_host_band_t bands[SKED_HOST_MAX_BANDS];
+    uint8_t band_count;
+
+    sked_host_worker_t workers[SKED_HOST_MAX_WORKERS];
+    uint8_t worker_count;
+    /* Worker the next released job goes to */
+    uint8_t worker_next;
+
+    /* Non-preemptive mode: loop() sleeps here when nothing is READY */
+    pthread_cond_t loop_cv;
+    bool loop_waiting;
+
+    /* Whether the threads actually got SCHED_FIFO */
+    bool realtime;
+};
+
+void skedHostIrqWait(sked_host_irq_t *irq, pthread_cond_t *cv,
+        const struct timespec *deadline);
+size_t skedHostTableSize(size_t each);
+void *skedHostReserve(size_t size);
+uint64_t skedHostClockNs(void);
+void skedHostTimespecAddNs(struct timespec *ts, uint64_t ns);
+
+#endif /* HOST_SKEDHOST_H */
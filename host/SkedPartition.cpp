@@ -0,0 +1,314 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Partitioned scheduling across Sked instances. Packing is first-fit
+ * decreasing: pinned tasks are placed first, then the rest from the highest
+ * utilization down, each on the first core it fits on. A core is full when
+ * its load would pass the capacity (100% by default; lower it to leave
+ * headroom, e.g. 69% for the rate monotonic bound) or its task table is full.
+ *
+ * Core n runs on CPU n, wrapping around if there are more cores than CPUs.
+ */
+
+#include <unistd.h>
+#include "./SkedPartition.h"
+
+/**
+ * Constructor
+ *
+ * @param cores  Number of Sked instances, or 0 for one per online CPU
+ */
+SkedPartition::SkedPartition(uint8_t cores) {
+    if (cores == 0U) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        cores = (online > 0) ? (uint8_t)((online < SKED_PART_MAX_CORES)
+            ? online : SKED_PART_MAX_CORES) : 1U;
+    }
+    if (cores > SKED_PART_MAX_CORES) {
+        cores = SKED_PART_MAX_CORES;
+    }
+
+    _core_count = cores;
+    for (uint8_t c = 0; c < _core_count; c++) {
+        _cores[c] = new Sked();
+    }
+
+    _mode = SKED_MODE_PREEMPTIVE;
+    _realtime = true;
+    _capacity_ppm = 1000000UL;
+    _running = false;
+    _task_count = 0U;
+    reset();
+}
+
+SkedPartition::~SkedPartition() {
+    for (uint8_t c = 0; c < _core_count; c++) {
+        delete _cores[c];
+    }
+}
+
+/**
+ * Set the mode every core runs in. In non-preemptive mode, the caller has to
+ * run loop() for each core (getCore()) from a thread of its own.
+ */
+int8_t SkedPartition::init(sked_mode_e mode) {
+    if (_running) {
+        return SKED_E_BUSY;
+    }
+
+    _mode = mode;
+    return SKED_E_OK;
+}
+
+/**
+ * Ask for SCHED_FIFO threads on every core; see Sked::setRealtime().
+ */
+void SkedPartition::setRealtime(bool enable) {
+    _realtime = enable;
+}
+
+/**
+ * How much of each core packing may use. Pinned tasks aren't held to it.
+ *
+ * @param percent  1 to 100
+ */
+void SkedPartition::setCapacity(uint8_t percent) {
+    if (percent == 0U || percent > 100U) {
+        percent = 100U;
+    }
+
+    _capacity_ppm = (uint32_t)percent * 10000UL;
+}
+
+/**
+ * Add a task. It's placed on a core, and handed to that core's Sked, at
+ * start().
+ *
+ * @param period_us, offset_us, priority, fcn  As for Sked::schedule()
+ * @param wcet_us  Worst case execution time; with the period, this is the
+ * utilization the task is packed by
+ * @param core  Core to pin the task to, or SKED_CORE_ANY
+ *
+ * @return SKED_E_OK - Added
+ *         SKED_E_BUSY - Already started; reset() first
+ *         SKED_E_TOO_MANY_TASKS - No room for more tasks
+ *         SKED_E_INVALID_PERIOD - The period is 0 or shorter than wcet_us
+ *         SKED_E_INVALID_FUNCTION - fcn is NULL
+ *         SKED_E_INVALID_OPERATION - No such core
+ */
+int8_t SkedPartition::schedule(uint32_t period_us, uint32_t offset_us,
+        int8_t priority, sked_task_fcn_t fcn, uint32_t wcet_us, int8_t core) {
+    if (_running) {
+        return SKED_E_BUSY;
+    }
+    if (_task_count >= SKED_PART_MAX_TASKS) {
+        return SKED_E_TOO_MANY_TASKS;
+    }
+    if (period_us == 0U || wcet_us > period_us) {
+        return SKED_E_INVALID_PERIOD;
+    }
+    if (fcn == (sked_task_fcn_t)NULL) {
+        return SKED_E_INVALID_FUNCTION;
+    }
+    if (core != SKED_CORE_ANY && (core < 0 || core >= _core_count)) {
+        return SKED_E_INVALID_OPERATION;
+    }
+
+    sked_part_task_t *task = &_tasks[_task_count];
+    task->period_us = period_us;
+    task->offset_us = offset_us;
+    task->priority = priority;
+    task->fcn = fcn;
+    task->util_ppm = (uint32_t)((uint64_t)wcet_us * 1000000ULL / period_us);
+    task->pinned = core;
+    task->core = SKED_CORE_ANY;
+    _task_count++;
+
+    return SKED_E_OK;
+}
+
+/**
+ * Place every task on a core.
+ *
+ * @return SKED_E_OK or SKED_E_TOO_MANY_TASKS if they don't all fit
+ */
+int8_t SkedPartition::pack(void) {
+    uint8_t order[SKED_PART_MAX_TASKS];
+    uint8_t unpinned = 0U;
+
+    for (uint8_t c = 0; c < _core_count; c++) {
+        _load_ppm[c] = 0U;
+    }
+
+    for (uint8_t i = 0; i < _task_count; i++) {
+        sked_part_task_t *task = &_tasks[i];
+
+        task->core = SKED_CORE_ANY;
+        if (task->pinned == SKED_CORE_ANY) {
+            /* Insertion sort, highest utilization first; ties keep the order
+             * they were scheduled in */
+            uint8_t j = unpinned++;
+            while (j > 0 && _tasks[order[j - 1]].util_ppm < task->util_ppm) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = i;
+            continue;
+        }
+
+        /* A core's table holds all of them, so only the load limits it */
+        task->core = task->pinned;
+        _load_ppm[task->core] += task->util_ppm;
+    }
+
+    for (uint8_t k = 0; k < unpinned; k++) {
+        sked_part_task_t *task = &_tasks[order[k]];
+
+        for (uint8_t c = 0; c < _core_count; c++) {
+            if (_load_ppm[c] + task->util_ppm <= _capacity_ppm) {
+                task->core = c;
+                _load_ppm[c] += task->util_ppm;
+                break;
+            }
+        }
+
+        if (task->core == SKED_CORE_ANY) {
+            return SKED_E_TOO_MANY_TASKS;
+        }
+    }
+
+    return SKED_E_OK;
+}
+
+/**
+ * Pack the tasks onto cores and start every core that got any.
+ *
+ * @return SKED_E_OK - Started
+ *         SKED_E_TOO_MANY_TASKS - The tasks don't fit on the cores
+ *         Otherwise, the first error from a core's init(), schedule() or
+ *         start(). Nothing is left running.
+ */
+int8_t SkedPartition::start(void) {
+    int8_t ret;
+
+    if (_running) {
+        return SKED_E_OK;
+    }
+
+    ret = pack();
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1) {
+        online = 1;
+    }
+
+    for (uint8_t c = 0; c < _core_count && ret == SKED_E_OK; c++) {
+        Sked *core = _cores[c];
+        bool used = false;
+
+        core->reset();
+        core->setRealtime(_realtime);
+        ret = core->setCpu((int16_t)(c % online));
+        if (ret == SKED_E_OK) {
+            ret = core->init(_mode, SKED_SRC_MONOTONIC);
+        }
+
+        for (uint8_t i = 0; i < _task_count && ret == SKED_E_OK; i++) {
+            sked_part_task_t *task = &_tasks[i];
+
+            if (task->core == (int8_t)c) {
+                ret = core->schedule(task->period_us, task->offset_us,
+                        task->priority, task->fcn);
+                used = true;
+            }
+        }
+
+        /* A core with nothing to run doesn't need a tick thread */
+        if (ret == SKED_E_OK && used) {
+            ret = core->start();
+        }
+    }
+
+    if (ret != SKED_E_OK) {
+        for (uint8_t c = 0; c < _core_count; c++) {
+            _cores[c]->reset();
+        }
+        return ret;
+    }
+
+    _running = true;
+    return SKED_E_OK;
+}
+
+/**
+ * Stop every core and forget all tasks
+ */
+void SkedPartition::reset(void) {
+    for (uint8_t c = 0; c < _core_count; c++) {
+        _cores[c]->reset();
+        _load_ppm[c] = 0U;
+    }
+
+    _task_count = 0U;
+    _running = false;
+}
+
+uint8_t SkedPartition::getCoreCount(void) {
+    return _core_count;
+}
+
+/**
+ * @return A core's Sked, for its statistics and the like, or NULL
+ */
+Sked *SkedPartition::getCore(uint8_t core) {
+    if (core >= _core_count) {
+        return NULL;
+    }
+
+    return _cores[core];
+}
+
+/**
+ * @return The core task i (in the order scheduled) was placed on, or
+ * SKED_CORE_ANY before start()
+ */
+int8_t SkedPartition::getTaskCore(uint8_t i) {
+    if (i >= _task_count) {
+        return SKED_CORE_ANY;
+    }
+
+    return _tasks[i].core;
+}
+
+/**
+ * @return The declared utilization placed on a core, parts per million
+ */
+uint32_t SkedPartition::getLoad(uint8_t core) {
+    if (core >= _core_count) {
+        return 0U;
+    }
+
+    return _load_ppm[core];
+}
+
+uint8_t SkedPartition::getTaskCount(void) {
+    return _task_count;
+}
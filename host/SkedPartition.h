@@ -0,0 +1,89 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Partitioned scheduling for the host backend: one Sked instance per core,
+ * each with its own tick thread, lock and statistics, and every task assigned
+ * to exactly one of them. Tasks are pinned to a core by the caller or packed
+ * onto cores by their declared utilization (worst case execution time over
+ * period) at start().
+ */
+
+#ifndef HOST_SKEDPARTITION_H
+#define HOST_SKEDPARTITION_H
+
+#include <Sked.h>
+
+#ifndef SKED_PART_MAX_CORES
+#define SKED_PART_MAX_CORES 16
+#endif
+
+#ifndef SKED_PART_MAX_TASKS
+#define SKED_PART_MAX_TASKS 64
+#endif
+
+/* Let start() pick the core */
+#define SKED_CORE_ANY -1
+
+typedef struct {
+    uint32_t period_us;
+    uint32_t offset_us;
+    int8_t priority;
+    sked_task_fcn_t fcn;
+    /* Declared utilization, parts per million */
+    uint32_t util_ppm;
+    /* Pinned core, or SKED_CORE_ANY */
+    int8_t pinned;
+    /* Core it ended up on, once started */
+    int8_t core;
+} sked_part_task_t;
+
+class SkedPartition {
+private:
+    Sked *_cores[SKED_PART_MAX_CORES];
+    uint8_t _core_count;
+    sked_part_task_t _tasks[SKED_PART_MAX_TASKS];
+    uint8_t _task_count;
+    sked_mode_e _mode;
+    bool _realtime;
+    uint32_t _capacity_ppm;
+    uint32_t _load_ppm[SKED_PART_MAX_CORES];
+    bool _running;
+
+    int8_t pack(void);
+
+public:
+    SkedPartition(uint8_t cores = 0);
+    ~SkedPartition();
+    int8_t init(sked_mode_e mode);
+    void setRealtime(bool enable);
+    void setCapacity(uint8_t percent);
+    int8_t schedule(uint32_t period_us, uint32_t offset_us, int8_t priority,
+        sked_task_fcn_t fcn, uint32_t wcet_us, int8_t core = SKED_CORE_ANY);
+    int8_t start(void);
+    void reset(void);
+    uint8_t getCoreCount(void);
+    Sked *getCore(uint8_t core);
+    int8_t getTaskCore(uint8_t i);
+    uint32_t getLoad(uint8_t core);
+    uint8_t getTaskCount(void);
+};
+
+#endif /* HOST_SKEDPARTITION_H */
@@ -0,0 +1,109 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Stand-in for avr-libc's <util/atomic.h> on the host backend. There are no
+ * interrupts to turn off, so "interrupts off" is a lock shared with the tick
+ * thread and the worker threads (see host/SkedHost.cpp). Like SREG, it nests:
+ * ATOMIC_BLOCK inside ATOMIC_BLOCK is fine, and NONATOMIC_BLOCK lets go of it
+ * entirely and takes it back to the same depth afterwards.
+ *
+ * Each Sked instance is its own "core" with its own lock: Sked.cpp points
+ * ATOMIC_BLOCK at it by redefining SKED_HOST_IRQ, so instances never contend.
+ * Everywhere else, ATOMIC_BLOCK takes a process-wide one.
+ */
+
+#ifndef HOST_UTIL_ATOMIC_H
+#define HOST_UTIL_ATOMIC_H
+
+#include <pthread.h>
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 1
+#define NONATOMIC_RESTORESTATE 0
+#define NONATOMIC_FORCEOFF 1
+
+typedef struct {
+    /* Recursive, so the owner can nest */
+    pthread_mutex_t mutex;
+    /* How deeply the owner holds it; only touched by the owner */
+    unsigned depth;
+} sked_host_irq_t;
+
+void skedHostIrqInit(sked_host_irq_t *irq);
+void skedHostIrqDestroy(sked_host_irq_t *irq);
+void skedHostIrqLock(sked_host_irq_t *irq);
+void skedHostIrqUnlock(sked_host_irq_t *irq);
+unsigned skedHostIrqRelease(sked_host_irq_t *irq);
+void skedHostIrqRestore(sked_host_irq_t *irq, unsigned depth);
+sked_host_irq_t *skedHostIrqGlobal(void);
+
+class SkedIrqOff {
+public:
+    explicit SkedIrqOff(sked_host_irq_t *irq) : _irq(irq), _once(true) {
+        skedHostIrqLock(_irq);
+    }
+    ~SkedIrqOff() {
+        skedHostIrqUnlock(_irq);
+    }
+    bool once(void) {
+        bool first = _once;
+        _once = false;
+        return first;
+    }
+
+private:
+    sked_host_irq_t *_irq;
+    bool _once;
+};
+
+class SkedIrqOn {
+public:
+    explicit SkedIrqOn(sked_host_irq_t *irq)
+        : _irq(irq), _once(true), _depth(skedHostIrqRelease(irq)) {}
+    ~SkedIrqOn() {
+        skedHostIrqRestore(_irq, _depth);
+    }
+    bool once(void) {
+        bool first = _once;
+        _once = false;
+        return first;
+    }
+
+private:
+    sked_host_irq_t *_irq;
+    bool _once;
+    unsigned _depth;
+};
+
+#ifndef SKED_HOST_IRQ
+#define SKED_HOST_IRQ skedHostIrqGlobal()
+#endif
+
+/* The guard's destructor also runs on break and return, as leaving an AVR
+ * ATOMIC_BLOCK early restores SREG. */
+#define SKED_HOST_ATOMIC(irq) \
+    for (SkedIrqOff _sked_irq_off(irq); _sked_irq_off.once(); )
+#define SKED_HOST_NONATOMIC(irq) \
+    for (SkedIrqOn _sked_irq_on(irq); _sked_irq_on.once(); )
+#define ATOMIC_BLOCK(type) SKED_HOST_ATOMIC(SKED_HOST_IRQ)
+#define NONATOMIC_BLOCK(type) SKED_HOST_NONATOMIC(SKED_HOST_IRQ)
+
+#endif /* HOST_UTIL_ATOMIC_H */
@@ -0,0 +1,204 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests priority bands on the host backend: grouping priorities onto worker
+ * threads, the emulated priority used without SCHED_FIFO, and dispatch
+ * latency. Build and run with make -f host.mk test.
+ */
+
+#include <Sked.h>
+#include "../utest.h"
+
+TestSuite ts;
+
+volatile uint16_t fast_runs;
+volatile uint16_t slow_runs;
+volatile uint16_t order_fails;
+volatile uint16_t high_runs;
+volatile uint16_t low_runs;
+
+void task_fast(void) {
+    fast_runs++;
+}
+
+void task_slow(void) {
+    /* Hog a CPU for 5ms */
+    uint32_t start = micros();
+    while ((micros() - start) < 5000) {
+    }
+    slow_runs++;
+}
+
+void task_high(void) {
+    uint32_t start = micros();
+    while ((micros() - start) < 500) {
+    }
+    high_runs++;
+}
+
+void task_low(void) {
+    /* Released on the same tick as task_high, so it must start after */
+    low_runs++;
+    if (low_runs != high_runs) {
+        order_fails++;
+    }
+}
+
+static void printLatency(void) {
+    sked_latency_t latency;
+
+    Serial.print("Realtime: ");
+    Serial.println(sked.isRealtime() ? "yes" : "no");
+
+    for (uint8_t b = 0; sked.getDispatchLatency(b, &latency) == SKED_E_OK;
+            b++) {
+        Serial.print("Band ");
+        Serial.print(latency.priority);
+        Serial.print(": n=");
+        Serial.print(latency.count);
+        Serial.print(" mean=");
+        Serial.print(latency.count ? latency.total_us / latency.count : 0);
+        Serial.print("us max=");
+        Serial.print(latency.max_us);
+        Serial.print("us hist=");
+        for (uint8_t i = 0; i < SKED_LATENCY_BUCKETS; i++) {
+            Serial.print(latency.hist[i]);
+            Serial.print(i + 1U < SKED_LATENCY_BUCKETS ? "," : "");
+        }
+        Serial.println();
+    }
+}
+
+/**
+ * Bands must be strictly descending and can only change while stopped.
+ * Priorities collapse onto their band's worker.
+ */
+Test(test_bands_config, ts) {
+    const int8_t bad[] = {0, 10};
+    const int8_t bands[] = {10, 0};
+
+    sked.reset();
+    assertEquals(SKED_E_INVALID_PRIORITY, sked.setPriorityBands(bad, 2));
+    assertEquals(SKED_E_OK, sked.setPriorityBands(bands, 2));
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 20, task_fast));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 15, task_fast));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 5, task_fast));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, -5, task_fast));
+    assertEquals(SKED_E_OK, sked.start());
+
+    /* 20 and 15 share the top band; 5 and -5 the bottom */
+    assertEquals(2, sked.getBandCount());
+    assertEquals(SKED_E_BUSY, sked.setPriorityBands(NULL, 0));
+
+    sked_latency_t latency;
+    assertEquals(SKED_E_OK, sked.getDispatchLatency(0, &latency));
+    assertEquals(10, latency.priority);
+    assertEquals(SKED_E_OK, sked.getDispatchLatency(1, &latency));
+    assertEquals(0, latency.priority);
+    assertEquals(SKED_E_NO_DATA, sked.getDispatchLatency(2, &latency));
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.setPriorityBands(NULL, 0));
+    assertEquals(0, sked.getBandCount());
+}
+
+/**
+ * Without SCHED_FIFO, a lower band doesn't start a job while a higher band
+ * has one waiting or running, even with a spare CPU.
+ */
+Test(test_bands_emulated, ts) {
+    order_fails = 0;
+    slow_runs = 0;
+    high_runs = 0;
+    low_runs = 0;
+
+    sked.reset();
+    sked.setRealtime(false);
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(5000, 0, 10, task_high));
+    assertEquals(SKED_E_OK, sked.schedule(5000, 0, 0, task_low));
+    assertEquals(SKED_E_OK, sked.schedule(20000, 0, -10, task_slow));
+    assertEquals(SKED_E_OK, sked.start());
+    assertTrue(!sked.isRealtime());
+
+    delay(200);
+
+    printLatency();
+    Serial.print("Order failures: ");
+    Serial.println(order_fails);
+    assertTrue(sked.getTaskInfo(1)->completions > 30);
+    assertTrue(order_fails < 3);
+    assertTrue(slow_runs >= 5);
+
+    sked.reset();
+}
+
+/**
+ * Every band records release-to-start latency, with or without SCHED_FIFO
+ * (which falls back to normal threads without the privilege).
+ */
+Test(test_bands_latency, ts) {
+    for (uint8_t rt = 0; rt < 2; rt++) {
+        fast_runs = 0;
+        slow_runs = 0;
+
+        sked.reset();
+        sked.setRealtime(rt != 0);
+        assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+                SKED_SRC_MONOTONIC));
+        assertEquals(SKED_E_OK, sked.schedule(1000, 0, 10, task_fast));
+        assertEquals(SKED_E_OK, sked.schedule(20000, 0, 0, task_slow));
+        assertEquals(SKED_E_OK, sked.start());
+
+        delay(200);
+
+        printLatency();
+        sked_latency_t latency;
+        assertEquals(SKED_E_OK, sked.getDispatchLatency(0, &latency));
+        assertTrue(latency.count > 150);
+        assertTrue(latency.max_us >= latency.total_us / latency.count);
+        assertEquals(SKED_E_OK, sked.getDispatchLatency(1, &latency));
+        assertTrue(latency.count >= 5);
+        Serial.print("Fast task misses: ");
+        Serial.println(sked.getTaskInfo(0)->misses);
+        /* Nice levels only bias the time-sharing scheduler, so the
+         * fallback can't promise the fast task won't miss */
+        if (sked.isRealtime()) {
+            assertTrue(sked.getTaskInfo(0)->misses < 5);
+        }
+    }
+
+    sked.reset();
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,349 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests coroutine tasks on the host backend (host/SkedCoro.h): sleeping,
+ * channels, priority order and the frame pool. Build and run with
+ * make -f host.mk test.
+ */
+
+#include <new>
+#include <atomic>
+#include <Sked.h>
+#include <SkedCoro.h>
+#include "../utest.h"
+
+TestSuite ts;
+
+/* Counts what goes to the global heap, which coroutine frames mustn't */
+std::atomic<uint32_t> heap_allocs;
+
+void *operator new(size_t size) {
+    heap_allocs++;
+    void *p = malloc(size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept {
+    free(p);
+}
+
+volatile uint32_t wakes;
+volatile uint32_t woke_us[16];
+volatile bool finished;
+
+SkedCoro sleeper(Sked &s, uint8_t rounds, uint32_t us) {
+    for (uint8_t r = 0; r < rounds; r++) {
+        woke_us[r] = micros();
+        wakes++;
+        co_await s.sleepFor(us);
+    }
+    finished = true;
+}
+
+/* A coroutine that's never spawned, or awaited from the wrong place */
+SkedCoro stray(Sked &s, int8_t *ret) {
+    *ret = co_await s.sleepFor(1000);
+}
+
+/**
+ * Sleeps last as long as asked, to within a tick, the task counts a job per resume,
+ * and its frame goes back to the pool when it returns.
+ */
+Test(test_coro_sleep, ts) {
+    sked_coro_stats_t stats;
+
+    sked.reset();
+    wakes = 0;
+    finished = false;
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+
+    uint32_t before = heap_allocs;
+    SkedCoro coro = sleeper(sked, 10, 2000);
+    assertEquals((unsigned long)before, (unsigned long)heap_allocs);
+    assertTrue(coro.isValid());
+    sked.getCoroStats(&stats);
+    assertEquals(1, stats.in_use);
+
+    assertEquals(SKED_E_OK, sked.spawn(static_cast<SkedCoro &&>(coro), 3));
+    assertTrue(!coro.isValid());
+    sked_task_t *task = sked.getTaskInfo(0);
+    assertTrue(task->flags & SKED_TASK_CORO);
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    while (!finished) {
+        if ((millis() - start) > 1000) {
+            fail("Timeout occurred");
+        }
+        sked.loop();
+    }
+
+    assertEquals(10UL, (unsigned long)wakes);
+    for (uint8_t r = 1; r < 10; r++) {
+        assertTrue(woke_us[r] - woke_us[r - 1] >= 1900);
+    }
+
+    assertEquals(11UL, (unsigned long)task->activations);
+    assertEquals(11UL, (unsigned long)task->completions);
+    assertTrue(task->coro == NULL);
+    assertEquals(0UL, (unsigned long)task->misses);
+    assertEquals(0UL, (unsigned long)task->overruns);
+
+    sked.getCoroStats(&stats);
+    assertEquals(0, stats.in_use);
+    assertEquals(1, stats.max_in_use);
+    assertEquals(1UL, (unsigned long)stats.allocs);
+
+    /* Nothing more to run, and its slot goes to the next task */
+    delay(5);
+    sked.loop();
+    assertEquals(11UL, (unsigned long)task->activations);
+    assertTrue(sked.getTaskInfo(0) == NULL);
+    assertEquals(SKED_E_OK, sked.spawn(sleeper(sked, 1, 1000), 3));
+    assertTrue(sked.getTaskInfo(0)->flags & SKED_TASK_CORO);
+
+    sked.reset();
+}
+
+SkedChannel<uint32_t, 4> *channel;
+volatile uint32_t received;
+volatile uint32_t received_sum;
+volatile bool in_order;
+volatile uint32_t sent;
+
+SkedCoro consumer(Sked &s, uint32_t count) {
+    for (uint32_t n = 0; n < count; n++) {
+        uint32_t value = co_await channel->recv();
+        if (value != n) {
+            in_order = false;
+        }
+        received_sum += value;
+        received++;
+    }
+    finished = true;
+}
+
+void task_producer(void) {
+    for (uint8_t n = 0; n < 3; n++) {
+        if (channel->send((uint32_t)sent) == SKED_E_OK) {
+            sent++;
+        }
+    }
+}
+
+/**
+ * A coroutine waiting on a channel is released by sends from a periodic
+ * task, from another thread, and gets everything in order.
+ */
+Test(test_coro_channel, ts) {
+    const uint32_t count = 300;
+
+    sked.reset();
+    sked.setRealtime(false);
+    received = 0;
+    received_sum = 0;
+    sent = 0;
+    in_order = true;
+    finished = false;
+    channel = new SkedChannel<uint32_t, 4>(sked);
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.spawn(consumer(sked, count), 5));
+    assertEquals(SKED_E_OK, sked.schedule(500, 0, 1, task_producer));
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    while (!finished) {
+        if ((millis() - start) > 2000) {
+            fail("Timeout occurred");
+        }
+        delay(1);
+    }
+
+    assertEquals((unsigned long)count, (unsigned long)received);
+    assertEquals((unsigned long)(count * (count - 1) / 2),
+        (unsigned long)received_sum);
+    assertTrue(in_order);
+
+    sked.reset();
+    delete channel;
+}
+
+volatile uint8_t order[16];
+volatile uint8_t order_len;
+
+SkedCoro ranked(Sked &s, uint8_t id) {
+    for (uint8_t r = 0; r < 4; r++) {
+        co_await s.sleepFor(1000);
+        order[order_len++] = id;
+    }
+}
+
+/**
+ * Coroutines due on the same tick resume in priority order, as tasks do.
+ */
+Test(test_coro_priority, ts) {
+    sked.reset();
+    order_len = 0;
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.spawn(ranked(sked, 1), 1));
+    assertEquals(SKED_E_OK, sked.spawn(ranked(sked, 9), 9));
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    while (order_len < 8) {
+        if ((millis() - start) > 1000) {
+            fail("Timeout occurred");
+        }
+        sked.loop();
+    }
+
+    for (uint8_t r = 0; r < 4; r++) {
+        assertEquals(9, order[2 * r]);
+        assertEquals(1, order[2 * r + 1]);
+    }
+
+    sked.reset();
+}
+
+std::atomic<uint32_t> crowd_done;
+
+SkedCoro crowd(Sked &s, uint32_t us) {
+    co_await s.sleepFor(us);
+    co_await s.sleepFor(us);
+    crowd_done++;
+}
+
+/**
+ * Far more coroutines than SKED_MAX_TASKS each find their own task when
+ * they wait, and give their slots back when they're done.
+ */
+Test(test_coro_many, ts) {
+    const uint32_t count = SKED_MAX_TASKS * 8U;
+    sked_coro_stats_t stats;
+
+    crowd_done = 0U;
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    for (uint32_t c = 0; c < count; c++) {
+        assertEquals(SKED_E_OK, sked.spawn(crowd(sked, 1000U + c * 10U), 0));
+    }
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    while (crowd_done < count) {
+        if ((millis() - start) > 1000) {
+            fail("Timeout occurred");
+        }
+        sked.loop();
+    }
+
+    sked.getCoroStats(&stats);
+    assertEquals(0UL, (unsigned long)stats.in_use);
+    assertEquals((unsigned long)count, (unsigned long)stats.max_in_use);
+    delay(2);
+    sked.loop();
+    for (uint32_t c = 0; c < count; c++) {
+        assertTrue(sked.getTaskInfo(c) == NULL);
+    }
+
+    sked.reset();
+}
+
+SkedCoro hog(Sked &s) {
+    volatile uint8_t big[2 * SKED_CORO_FRAME_SIZE];
+
+    big[0] = 1;
+    co_await s.sleepFor(100);
+    big[1] = big[0];
+}
+
+/**
+ * spawn() needs init() like schedule() does, the pool turns away frames too big for a block and coroutines beyond the
+ * last block, and awaiting outside a spawned coroutine doesn't wait.
+ */
+Test(test_coro_pool, ts) {
+    sked_coro_stats_t stats;
+    int8_t ret;
+    int8_t stray_ret = SKED_E_OK;
+
+    sked.reset();
+    ret = sked.spawn(sleeper(sked, 1, 100), 0);
+    assertEquals(SKED_E_NOT_INITIALIZED, ret);
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+
+    SkedCoro big = hog(sked);
+    assertTrue(!big.isValid());
+    ret = sked.spawn(static_cast<SkedCoro &&>(big), 0);
+    assertEquals(SKED_E_INVALID_FUNCTION, ret);
+
+    {
+        SkedCoro coros[SKED_CORO_FRAMES];
+        for (uint32_t c = 0; c < SKED_CORO_FRAMES; c++) {
+            coros[c] = sleeper(sked, 1, 100);
+            assertTrue(coros[c].isValid());
+        }
+        SkedCoro extra = sleeper(sked, 1, 100);
+        assertTrue(!extra.isValid());
+
+        sked.getCoroStats(&stats);
+        assertEquals((unsigned long)SKED_CORO_FRAMES,
+            (unsigned long)stats.in_use);
+        assertEquals(2UL, (unsigned long)stats.fails);
+        assertTrue(stats.max_size > SKED_CORO_FRAME_SIZE);
+    }
+
+    /* Dropping them gave the blocks back */
+    sked.getCoroStats(&stats);
+    assertEquals(0, stats.in_use);
+
+    /* Resumed by hand rather than by Sked, the sleep doesn't wait */
+    SkedCoro coro = stray(sked, &stray_ret);
+    void *frame = coro.release();
+    std::coroutine_handle<>::from_address(frame).resume();
+    assertEquals(SKED_E_INVALID_OPERATION, stray_ret);
+    assertTrue(std::coroutine_handle<>::from_address(frame).done());
+    std::coroutine_handle<>::from_address(frame).destroy();
+
+    sked.reset();
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,217 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests the countdown kernels behind timerISR() on the host backend
+ * (host/SkedCountdown.h) against each other, and times them on tables of
+ * 1k, 10k and 100k tasks. Build and run with make -f host.mk test.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <SkedCountdown.h>
+#include <Sked.h>
+#include "../utest.h"
+#include "util.h"
+
+TestSuite ts;
+
+#define BENCH_MAX 100000U
+
+static uint16_t ref_counts[BENCH_MAX];
+static uint16_t counts[BENCH_MAX];
+static uint64_t ref_mask[(BENCH_MAX + 63) / 64];
+static uint64_t mask[(BENCH_MAX + 63) / 64];
+
+/**
+ * Every kernel counts down and flags releases exactly like the scalar loop,
+ * including around the edges of a vector and of a mask word.
+ */
+Test(test_countdown_kernels, ts) {
+    static const uint32_t sizes[] = {
+        0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 1000, 1023
+    };
+    const sked_countdown_t *kernels;
+    uint8_t kernel_count = skedCountdownKernels(&kernels);
+
+    Serial.print("Kernels:");
+    for (uint8_t k = 0; k < kernel_count; k++) {
+        Serial.print(" ");
+        Serial.print(kernels[k].name);
+    }
+    Serial.println();
+    assertTrue(kernels[0].fcn == skedCountdownScalar);
+
+    srand(1);
+    for (uint8_t k = 1; k < kernel_count; k++) {
+        for (uint8_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            uint32_t n = sizes[s];
+            uint32_t words = (n + 63U) / 64U;
+
+            /* Mostly about to run out, some already out, some far off */
+            for (uint32_t i = 0; i < n; i++) {
+                ref_counts[i] = (rand() % 4 == 0) ? (uint16_t)rand()
+                    : (uint16_t)(rand() % 3);
+            }
+            memcpy(counts, ref_counts, n * sizeof(counts[0]));
+
+            for (uint8_t tick = 0; tick < 4; tick++) {
+                /* Stale bits the kernels have to clear */
+                memset(ref_mask, 0xA5, sizeof(ref_mask));
+                memset(mask, 0x5A, sizeof(mask));
+
+                uint32_t ref = skedCountdownScalar(ref_counts, n, ref_mask);
+                uint32_t got = kernels[k].fcn(counts, n, mask);
+
+                assertEquals((unsigned long)ref, (unsigned long)got);
+                assertEquals(0, memcmp(ref_counts, counts,
+                        n * sizeof(counts[0])));
+                assertEquals(0, memcmp(ref_mask, mask,
+                        words * sizeof(mask[0])));
+            }
+        }
+    }
+
+    /* Counters out of bounds are left alone */
+    counts[0] = 5;
+    counts[1] = 7;
+    skedCountdownScalar(counts, 1, mask);
+    assertEquals(4, counts[0]);
+    assertEquals(7, counts[1]);
+}
+
+/**
+ * Nanoseconds per tick for a kernel over n tasks: the best of a few runs,
+ * releases reloading their count as releaseTask() would.
+ */
+static uint64_t benchKernel(sked_countdown_fcn_t fcn, uint32_t n) {
+    uint32_t ticks = 20000000U / n + 10U;
+    uint64_t best = ~0ULL;
+
+    srand(2);
+    for (uint32_t i = 0; i < n; i++) {
+        counts[i] = (uint16_t)(1 + rand() % 1000);
+    }
+
+    for (uint8_t run = 0; run < 5; run++) {
+        uint64_t start = nowNs();
+
+        for (uint32_t t = 0; t < ticks; t++) {
+            if (fcn(counts, n, mask) != 0U) {
+                for (uint32_t w = 0; w < (n + 63U) / 64U; w++) {
+                    uint64_t bits = mask[w];
+
+                    while (bits != 0U) {
+                        counts[w * 64U + __builtin_ctzll(bits)] = 1000U;
+                        bits &= bits - 1U;
+                    }
+                }
+            }
+        }
+
+        uint64_t ns = (nowNs() - start) / ticks;
+        if (ns < best) {
+            best = ns;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * Vector kernels beat the scalar loop on big tables.
+ */
+Test(test_countdown_bench, ts) {
+    static const uint32_t sizes[] = {1000, 10000, 100000};
+    const sked_countdown_t *kernels;
+    uint8_t kernel_count = skedCountdownKernels(&kernels);
+    uint64_t scalar_ns = 0;
+    uint64_t best_ns = 0;
+
+    for (uint8_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        Serial.print(sizes[s]);
+        Serial.print(" tasks:");
+
+        for (uint8_t k = 0; k < kernel_count; k++) {
+            uint64_t ns = benchKernel(kernels[k].fcn, sizes[s]);
+
+            Serial.print(" ");
+            Serial.print(kernels[k].name);
+            Serial.print(" ");
+            Serial.print((unsigned long)ns);
+            Serial.print("ns/tick");
+
+            if (k == 0) {
+                scalar_ns = ns;
+            }
+            best_ns = ns;
+        }
+        Serial.println();
+    }
+
+    /* At 100k tasks the vector kernels should be several times faster */
+    if (kernel_count > 1) {
+        assertTrue(best_ns < scalar_ns);
+    }
+}
+
+volatile uint32_t runs;
+
+void task_count(void) {
+    runs++;
+}
+
+/**
+ * getCountdown() reads the counts the host keeps out of the task table.
+ */
+Test(test_countdown_sked, ts) {
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 500, 0, task_count));
+    assertEquals(SKED_E_OK, sked.schedule(2000, 1500, 1, task_count));
+    assertEquals(0, sked.getCountdown(2));
+
+    /* Tasks keep the slot they were scheduled into */
+    assertEquals(5, sked.getCountdown(0));
+    assertEquals(15, sked.getCountdown(1));
+
+    runs = 0;
+    assertEquals(SKED_E_OK, sked.start());
+    uint32_t start = millis();
+    while ((millis() - start) < 50) {
+        sked.loop();
+    }
+    assertTrue(runs >= 70 && runs <= 76);
+    assertTrue(sked.getCountdown(0) <= 10);
+    assertTrue(sked.getCountdown(1) <= 20);
+
+    sked.reset();
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
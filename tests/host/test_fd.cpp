@@ -0,0 +1,280 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests fd-triggered tasks on the host backend (scheduleFd()). Build and run
+ * with make -f host.mk test.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <array>
+#include <utility>
+#include <Sked.h>
+#include "../utest.h"
+
+TestSuite ts;
+
+int pipe_fds[2];
+volatile uint32_t reads;
+volatile uint32_t bytes;
+volatile uint32_t read_us;
+volatile uint16_t ticks_10ms;
+
+void task_pipe(void) {
+    char buf[64];
+    ssize_t n = read(pipe_fds[0], buf, sizeof(buf));
+
+    if (n > 0) {
+        read_us = micros();
+        bytes += n;
+        reads++;
+    }
+}
+
+void task_10ms(void) {
+    ticks_10ms++;
+}
+
+/* More fd tasks than SKED_MAX_TASKS, each with its own eventfd */
+#define MANY_FDS 40
+
+int many_fds[MANY_FDS];
+volatile uint32_t many_reads[MANY_FDS];
+
+template <size_t N>
+void task_eventfd(void) {
+    uint64_t value;
+
+    if (read(many_fds[N], &value, sizeof(value)) == sizeof(value)) {
+        many_reads[N]++;
+    }
+}
+
+template <size_t... N>
+static constexpr std::array<sked_task_fcn_t, sizeof...(N)> eventfdFcns(
+        std::index_sequence<N...>) {
+    return {{task_eventfd<N>...}};
+}
+
+static const std::array<sked_task_fcn_t, MANY_FDS> eventfd_tasks =
+    eventfdFcns(std::make_index_sequence<MANY_FDS>());
+
+static bool openPipe(void) {
+    if (pipe(pipe_fds) != 0) {
+        return false;
+    }
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+    reads = 0;
+    bytes = 0;
+    ticks_10ms = 0;
+
+    return true;
+}
+
+static void closePipe(void) {
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+}
+
+/**
+ * Only fds epoll can watch, once each, after init().
+ */
+Test(test_fd_invalid, ts) {
+    sked.reset();
+    assertTrue(openPipe());
+    assertEquals(SKED_E_NOT_INITIALIZED, sked.scheduleFd(pipe_fds[0],
+            EPOLLIN, 0, task_pipe));
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+
+    /* Regular files are always ready, so epoll won't have them */
+    FILE *file = tmpfile();
+    assertEquals(SKED_E_INVALID_OPERATION, sked.scheduleFd(fileno(file),
+            EPOLLIN, 0, task_pipe));
+    fclose(file);
+    assertEquals(SKED_E_INVALID_OPERATION, sked.scheduleFd(-1, EPOLLIN, 0,
+            task_pipe));
+
+    assertEquals(SKED_E_OK, sked.scheduleFd(pipe_fds[0], EPOLLIN, 0,
+            task_pipe));
+    assertEquals(SKED_E_INVALID_OPERATION, sked.scheduleFd(pipe_fds[0],
+            EPOLLIN, 1, task_10ms));
+    assertTrue(sked.getTaskInfo(0)->flags & SKED_TASK_EVENT);
+
+    sked.reset();
+    closePipe();
+}
+
+/**
+ * Each write releases the task straight away, from the tick thread's epoll
+ * set, and periodic tasks carry on alongside.
+ */
+Test(test_fd_preemptive, ts) {
+    const uint16_t writes = 100;
+    uint32_t total_us = 0;
+    uint32_t max_us = 0;
+
+    sked.reset();
+    sked.setRealtime(false);
+    assertTrue(openPipe());
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 0, task_10ms));
+    assertEquals(SKED_E_OK, sked.start());
+    /* Scheduled after start() too */
+    assertEquals(SKED_E_OK, sked.scheduleFd(pipe_fds[0], EPOLLIN, 5,
+            task_pipe));
+
+    for (uint16_t w = 0; w < writes; w++) {
+        uint32_t before = reads;
+
+        delayMicroseconds(500 + (w % 7) * 30);
+        uint32_t wrote_us = micros();
+        assertEquals(1, (int)write(pipe_fds[1], "x", 1));
+        while (reads == before) {
+            if ((micros() - wrote_us) > 100000) {
+                fail("Timeout occurred");
+            }
+            delayMicroseconds(10);
+        }
+
+        uint32_t took = read_us - wrote_us;
+        total_us += took;
+        if (took > max_us) {
+            max_us = took;
+        }
+    }
+
+    Serial.print("write() to read(): mean ");
+    Serial.print(total_us / writes);
+    Serial.print("us max ");
+    Serial.print(max_us);
+    Serial.println("us");
+
+    assertEquals((unsigned long)writes, (unsigned long)bytes);
+    assertEquals((unsigned long)writes, (unsigned long)reads);
+    assertTrue(ticks_10ms > 0);
+    /* Well under a tick on average; there's no polling interval */
+    assertTrue(total_us / writes < 1000);
+
+    sked.reset();
+    closePipe();
+}
+
+/**
+ * In non-preemptive mode, fd tasks run from loop() in priority order with
+ * the periodic ones, and loop() still sleeps in between.
+ */
+Test(test_fd_loop, ts) {
+    sked.reset();
+    assertTrue(openPipe());
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.scheduleFd(pipe_fds[0], EPOLLIN, 5,
+            task_pipe));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 0, task_10ms));
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    uint32_t loops = 0;
+    uint16_t wrote = 0;
+    while ((millis() - start) < 100) {
+        if (wrote < 10 && (millis() - start) >= wrote * 5U) {
+            assertEquals(3, (int)write(pipe_fds[1], "abc", 3));
+            wrote++;
+        }
+        sked.loop();
+        loops++;
+    }
+
+    Serial.print("loop() calls: ");
+    Serial.print(loops);
+    Serial.print(" reads: ");
+    Serial.println(reads);
+
+    assertEquals(30UL, (unsigned long)bytes);
+    assertTrue(reads >= 1);
+    assertTrue(ticks_10ms >= 9);
+    assertTrue(loops < 200);
+
+    sked.reset();
+    closePipe();
+}
+
+/**
+ * However many fds are watched, each one releases only its own task.
+ */
+Test(test_fd_many, ts) {
+    uint64_t one = 1U;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    for (uint8_t f = 0; f < MANY_FDS; f++) {
+        many_fds[f] = eventfd(0, EFD_NONBLOCK);
+        assertTrue(many_fds[f] >= 0);
+        many_reads[f] = 0;
+        assertEquals(SKED_E_OK, sked.scheduleFd(many_fds[f], EPOLLIN, 0,
+                eventfd_tasks[f]));
+    }
+    assertEquals(SKED_E_OK, sked.start());
+
+    assertEquals(8, (int)write(many_fds[MANY_FDS - 1], &one, sizeof(one)));
+    uint32_t start = millis();
+    while ((millis() - start) < 20) {
+        sked.loop();
+    }
+    assertEquals(1UL, (unsigned long)many_reads[MANY_FDS - 1]);
+    for (uint8_t f = 0; f < MANY_FDS - 1; f++) {
+        assertEquals(0UL, (unsigned long)many_reads[f]);
+    }
+
+    for (uint8_t f = 0; f < MANY_FDS; f++) {
+        assertEquals(8, (int)write(many_fds[f], &one, sizeof(one)));
+    }
+    start = millis();
+    while ((millis() - start) < 20) {
+        sked.loop();
+    }
+    for (uint8_t f = 0; f < MANY_FDS - 1; f++) {
+        assertEquals(1UL, (unsigned long)many_reads[f]);
+    }
+    assertEquals(2UL, (unsigned long)many_reads[MANY_FDS - 1]);
+
+    sked.reset();
+    for (uint8_t f = 0; f < MANY_FDS; f++) {
+        close(many_fds[f]);
+    }
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
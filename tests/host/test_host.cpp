@@ -0,0 +1,207 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests the Linux host backend: the tick thread, worker threads per priority
+ * in preemptive mode and loop() in non-preemptive mode. Build and run with
+ * make -f host.mk test.
+ */
+
+#include <Sked.h>
+#include "../utest.h"
+#include "../util.h"
+
+TestSuite ts;
+
+uint32_t tstamps_10ms[20];
+struct time_array_t times_10ms = {tstamps_10ms, 0, 20};
+volatile bool done;
+volatile uint16_t fast_runs;
+volatile uint16_t slow_runs;
+
+void task_10ms(void) {
+    done = markTime(&times_10ms);
+}
+
+void task_fast(void) {
+    fast_runs++;
+}
+
+void task_slow(void) {
+    /* Hog a CPU for 20ms */
+    uint32_t start = micros();
+    while ((micros() - start) < 20000) {
+    }
+    slow_runs++;
+}
+
+void task_spin(void) {
+    /* Run for 3ms on a 1ms period so every job overruns */
+    uint32_t start = micros();
+    while ((micros() - start) < 3000) {
+    }
+}
+
+/**
+ * Only the monotonic clock is available on the host.
+ */
+Test(test_host_init, ts) {
+    sked.reset();
+    assertEquals(SKED_E_NOT_IMPLEMENTED, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_DEFAULT));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 0, task_fast));
+    sked.debugPrintState(&Serial);
+    sked.reset();
+}
+
+/**
+ * The tick thread sleeps to absolute deadlines, so the period doesn't drift
+ * no matter how late individual wakeups are.
+ */
+Test(test_host_period, ts) {
+    done = false;
+    times_10ms.count = 0;
+
+    sked.reset();
+    sked.setRealtime(false);
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 0, task_10ms));
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    while (!done) {
+        if ((millis() - start) > 2000) {
+            fail("Timeout occurred");
+        }
+        delay(1);
+    }
+
+    /* 19 periods, give or take one tick at each end plus scheduling noise */
+    uint32_t span = times_10ms.tstamps[19] - times_10ms.tstamps[0];
+    Serial.print("19 periods took (us): ");
+    Serial.println(span);
+    assertTrue(span > 190000 - 2000);
+    assertTrue(span < 190000 + 2000);
+    assertEquals(0, sked.getTaskInfo(0)->misses);
+
+    sked.reset();
+}
+
+/**
+ * A slow low priority task runs on its own worker, so it doesn't hold up a
+ * fast high priority one.
+ */
+Test(test_host_priorities, ts) {
+    fast_runs = 0;
+    slow_runs = 0;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(2000, 0, 10, task_fast));
+    assertEquals(SKED_E_OK, sked.schedule(50000, 0, 0, task_slow));
+    assertEquals(SKED_E_OK, sked.start());
+
+    Serial.print("Realtime: ");
+    Serial.println(sked.isRealtime() ? "yes" : "no");
+
+    delay(200);
+
+    /* About 100 releases of the fast task, most while the slow one ran */
+    assertTrue(slow_runs >= 3);
+    assertTrue(fast_runs > 80);
+    Serial.print("Fast task misses: ");
+    Serial.println(sked.getTaskInfo(0)->misses);
+    assertTrue(sked.getTaskInfo(0)->misses < 10);
+
+    sked.reset();
+}
+
+/**
+ * Overruns are counted the same way as on AVR, and a task scheduled after
+ * start() at a new priority gets a worker.
+ */
+Test(test_host_overrun, ts) {
+    fast_runs = 0;
+
+    sked.reset();
+    sked.setRealtime(false);
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 0, task_spin));
+    assertEquals(SKED_E_OK, sked.start());
+
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 5, task_fast));
+    delay(50);
+
+    sked_task_t *spin = sked.getTaskInfo(0);
+    assertTrue(spin->overruns > 10);
+    assertTrue(spin->completions < spin->activations);
+    assertTrue(fast_runs > 30);
+
+    sked.reset();
+}
+
+/**
+ * In non-preemptive mode tasks run from loop(), which sleeps between
+ * releases rather than spinning.
+ */
+Test(test_host_loop, ts) {
+    done = false;
+    times_10ms.count = 0;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 0, task_10ms));
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    uint32_t loops = 0;
+    while (!done) {
+        if ((millis() - start) > 2000) {
+            fail("Timeout occurred");
+        }
+        assertEquals(SKED_E_OK, sked.loop());
+        loops++;
+    }
+
+    /* Two passes per release (one runs the task, one finds nothing and
+     * sleeps), not millions */
+    Serial.print("loop() calls: ");
+    Serial.println(loops);
+    assertTrue(loops < 200);
+    assertEquals(0, sked.getTaskInfo(0)->misses);
+
+    sked.reset();
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,152 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests partitioned scheduling on the host backend: packing tasks onto cores
+ * and running one Sked instance per core. Build and run with
+ * make -f host.mk test.
+ */
+
+#include <Sked.h>
+#include <SkedPartition.h>
+#include "../utest.h"
+
+TestSuite ts;
+
+volatile uint16_t runs_a;
+volatile uint16_t runs_b;
+
+void task_a(void) {
+    runs_a++;
+}
+
+void task_b(void) {
+    runs_b++;
+}
+
+/**
+ * First-fit decreasing: pinned tasks first, then the largest utilization
+ * down, each onto the first core with room.
+ */
+Test(test_partition_pack, ts) {
+    SkedPartition part(2);
+
+    assertEquals(2, part.getCoreCount());
+    assertEquals(SKED_E_INVALID_OPERATION, part.schedule(10000, 0, 0, task_a,
+            1000, 2));
+    assertEquals(SKED_E_INVALID_PERIOD, part.schedule(10000, 0, 0, task_a,
+            20000));
+
+    assertEquals(SKED_E_OK, part.schedule(10000, 0, 0, task_a, 3000));
+    assertEquals(SKED_E_OK, part.schedule(10000, 0, 0, task_a, 6000));
+    assertEquals(SKED_E_OK, part.schedule(10000, 0, 0, task_a, 1000, 1));
+    assertEquals(SKED_E_OK, part.schedule(10000, 0, 0, task_a, 5000));
+    assertEquals(SKED_E_OK, part.schedule(10000, 0, 0, task_a, 4000));
+    assertEquals(SKED_CORE_ANY, part.getTaskCore(0));
+
+    part.setRealtime(false);
+    assertEquals(SKED_E_OK, part.start());
+
+    /* Core 1 starts at 10% (pinned); then 60% -> 0, 50% -> 1, 40% -> 0,
+     * 30% -> 1 */
+    assertEquals(1, part.getTaskCore(2));
+    assertEquals(0, part.getTaskCore(1));
+    assertEquals(1, part.getTaskCore(3));
+    assertEquals(0, part.getTaskCore(4));
+    assertEquals(1, part.getTaskCore(0));
+    assertEquals(1000000UL, part.getLoad(0));
+    assertEquals(900000UL, part.getLoad(1));
+    assertEquals(2, part.getCore(0)->getTaskCount());
+    assertEquals(3, part.getCore(1)->getTaskCount());
+    assertEquals(SKED_E_BUSY, part.schedule(10000, 0, 0, task_a, 0));
+
+    part.reset();
+    assertEquals(0, part.getTaskCount());
+}
+
+/**
+ * Tasks that don't fit within the capacity aren't started at all.
+ */
+Test(test_partition_full, ts) {
+    SkedPartition part(2);
+
+    part.setCapacity(69);
+    assertEquals(SKED_E_OK, part.schedule(10000, 0, 0, task_a, 4000));
+    assertEquals(SKED_E_OK, part.schedule(10000, 0, 0, task_a, 4000));
+    assertEquals(SKED_E_OK, part.schedule(10000, 0, 0, task_a, 4000));
+    assertEquals(SKED_E_TOO_MANY_TASKS, part.start());
+    assertEquals(0, part.getCore(0)->getTaskCount());
+    assertEquals(0, part.getCore(1)->getTaskCount());
+
+    /* Pinning may go past it */
+    part.reset();
+    assertEquals(SKED_E_OK, part.schedule(10000, 0, 0, task_a, 4000, 0));
+    assertEquals(SKED_E_OK, part.schedule(10000, 0, 0, task_a, 4000, 0));
+    part.setRealtime(false);
+    assertEquals(SKED_E_OK, part.start());
+    assertEquals(800000UL, part.getLoad(0));
+}
+
+/**
+ * Each core ticks, releases and counts its own tasks.
+ */
+Test(test_partition_run, ts) {
+    SkedPartition part(2);
+
+    runs_a = 0;
+    runs_b = 0;
+
+    part.setRealtime(false);
+    assertEquals(SKED_E_OK, part.init(SKED_MODE_PREEMPTIVE));
+    assertEquals(SKED_E_OK, part.schedule(1000, 0, 0, task_a, 100, 0));
+    assertEquals(SKED_E_OK, part.schedule(2000, 0, 0, task_b, 100, 1));
+    assertEquals(SKED_E_OK, part.start());
+
+    delay(100);
+
+    Sked *core0 = part.getCore(0);
+    Sked *core1 = part.getCore(1);
+    Serial.print("Core 0 ticks: ");
+    Serial.print(core0->getTicks());
+    Serial.print(" runs: ");
+    Serial.println(runs_a);
+    Serial.print("Core 1 ticks: ");
+    Serial.print(core1->getTicks());
+    Serial.print(" runs: ");
+    Serial.println(runs_b);
+
+    assertTrue(core0->getTicks() > 800);
+    assertTrue(core1->getTicks() > 800);
+    assertTrue(runs_a > 80);
+    assertTrue(runs_b > 40);
+    assertTrue(core0->getTaskInfo(0)->completions + 1U >= runs_a);
+    assertTrue(core1->getTaskInfo(0)->completions + 1U >= runs_b);
+    assertEquals(0, sked.getTaskCount());
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
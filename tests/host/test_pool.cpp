@@ -0,0 +1,190 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests the work-stealing worker pool for non-preemptive mode on the host
+ * backend. Build and run with make -f host.mk test.
+ */
+
+#include <unistd.h>
+#include <atomic>
+#include <Sked.h>
+#include "../utest.h"
+
+TestSuite ts;
+
+#define POOL_TASKS 8
+
+std::atomic<uint8_t> in_flight[POOL_TASKS];
+std::atomic<uint32_t> runs[POOL_TASKS];
+std::atomic<uint32_t> overlaps;
+volatile uint32_t job_us;
+
+template <uint8_t N>
+void task_job(void) {
+    if (in_flight[N]++ != 0U) {
+        overlaps++;
+    }
+
+    uint32_t start = micros();
+    while ((micros() - start) < job_us) {
+    }
+
+    runs[N]++;
+    in_flight[N]--;
+}
+
+sked_task_fcn_t jobs[POOL_TASKS] = {
+    task_job<0>, task_job<1>, task_job<2>, task_job<3>,
+    task_job<4>, task_job<5>, task_job<6>, task_job<7>
+};
+
+static bool startPool(uint8_t workers, uint32_t period_us) {
+    for (uint8_t i = 0; i < POOL_TASKS; i++) {
+        in_flight[i] = 0U;
+        runs[i] = 0U;
+    }
+    overlaps = 0U;
+
+    sked.reset();
+    sked.setRealtime(false);
+    if (sked.setWorkers(workers) != SKED_E_OK
+            || sked.init(SKED_MODE_NON_PREEMPTIVE, SKED_SRC_MONOTONIC)
+            != SKED_E_OK) {
+        return false;
+    }
+    for (uint8_t i = 0; i < POOL_TASKS; i++) {
+        if (sked.schedule(period_us, 0, 0, jobs[i]) != SKED_E_OK) {
+            return false;
+        }
+    }
+
+    return sked.start() == SKED_E_OK;
+}
+
+static uint32_t runLoopFor(uint32_t ms) {
+    uint32_t start = millis();
+    uint32_t loops = 0;
+
+    while ((millis() - start) < ms) {
+        sked.loop();
+        loops++;
+    }
+
+    return loops;
+}
+
+/**
+ * The pool size is checked and only changes while stopped.
+ */
+Test(test_pool_config, ts) {
+    sked_worker_stats_t stats;
+
+    sked.reset();
+    assertEquals(SKED_E_INVALID_OPERATION, sked.setWorkers(255));
+    assertTrue(startPool(2, 10000));
+    assertEquals(SKED_E_BUSY, sked.setWorkers(4));
+    assertEquals(SKED_E_OK, sked.getWorkerStats(1, &stats));
+    assertEquals(SKED_E_NO_DATA, sked.getWorkerStats(2, &stats));
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.setWorkers(0));
+    assertEquals(SKED_E_NO_DATA, sked.getWorkerStats(0, &stats));
+}
+
+/**
+ * Every released job runs once, never alongside another job of the same
+ * task, and the counts in the task table add up with the workers'.
+ */
+Test(test_pool_run, ts) {
+    job_us = 50;
+    assertTrue(startPool(4, 2000));
+
+    /* loop() only does background work now, so it sleeps a lot */
+    uint32_t loops = runLoopFor(200);
+
+    uint32_t total_runs = 0;
+    uint32_t total_steals = 0;
+    sked_worker_stats_t stats;
+    for (uint8_t w = 0; sked.getWorkerStats(w, &stats) == SKED_E_OK; w++) {
+        total_runs += stats.runs;
+        total_steals += stats.steals;
+    }
+
+    uint32_t completions = 0;
+    for (uint8_t i = 0; i < POOL_TASKS; i++) {
+        completions += sked.getTaskInfo(i)->completions;
+        assertTrue(runs[i] > 80);
+    }
+
+    Serial.print("loop() calls: ");
+    Serial.print(loops);
+    Serial.print(" runs: ");
+    Serial.print(total_runs);
+    Serial.print(" steals: ");
+    Serial.println(total_steals);
+
+    assertEquals(0UL, (unsigned long)overlaps);
+    assertTrue(loops < 100);
+    assertTrue(total_runs + POOL_TASKS >= completions);
+    assertTrue(completions + POOL_TASKS >= total_runs);
+
+    sked.reset();
+}
+
+/**
+ * Jobs per second with more work released than one thread can get through.
+ * Scales with the CPUs available; a single CPU just keeps up the same rate.
+ */
+Test(test_pool_throughput, ts) {
+    uint8_t counts[] = {1, 2, 4};
+
+    job_us = 300;
+    Serial.print("CPUs: ");
+    Serial.println(sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (uint8_t k = 0; k < sizeof(counts); k++) {
+        assertTrue(startPool(counts[k], 1000));
+        runLoopFor(200);
+
+        uint32_t total = 0;
+        for (uint8_t i = 0; i < POOL_TASKS; i++) {
+            total += runs[i];
+        }
+        sked.reset();
+
+        Serial.print(counts[k]);
+        Serial.print(" workers: ");
+        Serial.print(total * 5UL);
+        Serial.println(" jobs/s");
+        assertTrue(total > 0);
+        assertEquals(0UL, (unsigned long)overlaps);
+    }
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,304 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests post() on the host backend: activations from other threads, how fast
+ * they get to the task, and enqueue cost with 1 to 32 producers. Build and
+ * run with make -f host.mk test.
+ */
+
+#include <pthread.h>
+#include <array>
+#include <atomic>
+#include <utility>
+#include <Sked.h>
+#include "../utest.h"
+#include "util.h"
+
+TestSuite ts;
+
+#define POST_TASKS 8
+#define POSTS_PER_PRODUCER 20000
+
+std::atomic<uint32_t> task_runs[POST_TASKS];
+volatile uint32_t started_us;
+
+template <uint8_t N>
+void task_posted(void) {
+    if (N == 0) {
+        started_us = micros();
+    }
+    task_runs[N]++;
+}
+
+sked_task_fcn_t posted[POST_TASKS] = {
+    task_posted<0>, task_posted<1>, task_posted<2>, task_posted<3>,
+    task_posted<4>, task_posted<5>, task_posted<6>, task_posted<7>
+};
+
+void task_unscheduled(void) {
+}
+
+/* More distinct functions than SKED_MAX_TASKS */
+#define MANY_FUNCTIONS 64
+
+std::atomic<uint32_t> many_runs[MANY_FUNCTIONS];
+
+template <size_t N>
+void task_many(void) {
+    many_runs[N]++;
+}
+
+template <size_t... N>
+static constexpr std::array<sked_task_fcn_t, sizeof...(N)> manyFcns(
+        std::index_sequence<N...>) {
+    return {{task_many<N>...}};
+}
+
+static const std::array<sked_task_fcn_t, MANY_FUNCTIONS> many =
+    manyFcns(std::make_index_sequence<MANY_FUNCTIONS>());
+
+typedef struct {
+    uint8_t index;
+    pthread_t thread;
+    uint64_t elapsed_ns;
+    uint64_t max_ns;
+} producer_t;
+
+static void *producerMain(void *arg) {
+    producer_t *producer = (producer_t *)arg;
+    sked_task_fcn_t fcn = posted[producer->index % POST_TASKS];
+
+    producer->max_ns = 0;
+    uint64_t start = nowNs();
+    for (uint32_t n = 0; n < POSTS_PER_PRODUCER; n++) {
+        /* Time one post in 64 on its own for the worst case */
+        if ((n & 63U) == 0U) {
+            uint64_t before = nowNs();
+            sked.post(fcn);
+            uint64_t took = nowNs() - before;
+            if (took > producer->max_ns) {
+                producer->max_ns = took;
+            }
+        } else {
+            sked.post(fcn);
+        }
+    }
+    producer->elapsed_ns = nowNs() - start;
+
+    return NULL;
+}
+
+static bool startPosted(void) {
+    sked.reset();
+    sked.setRealtime(false);
+    if (sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_MONOTONIC) != SKED_E_OK) {
+        return false;
+    }
+
+    /* Long periods and offsets, so only post() releases them here */
+    for (uint8_t i = 0; i < POST_TASKS; i++) {
+        task_runs[i] = 0;
+        if (sked.schedule(6000000, 6000000, 0, posted[i]) != SKED_E_OK) {
+            return false;
+        }
+    }
+
+    return sked.start() == SKED_E_OK;
+}
+
+/**
+ * Only scheduled task functions can be posted.
+ */
+Test(test_post_invalid, ts) {
+    assertTrue(startPosted());
+    assertEquals(SKED_E_INVALID_FUNCTION, sked.post(task_unscheduled));
+    assertEquals(SKED_E_OK, sked.post(posted[0]));
+    sked.reset();
+    assertEquals(SKED_E_INVALID_FUNCTION, sked.post(posted[0]));
+}
+
+/**
+ * Every scheduled function can be posted, however many there are. A post()
+ * releases each task running it, and unschedule() only takes out its own.
+ */
+Test(test_post_many, ts) {
+    sked.reset();
+    sked.setRealtime(false);
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    for (uint8_t i = 0; i < MANY_FUNCTIONS; i++) {
+        many_runs[i] = 0;
+        assertEquals(SKED_E_OK, sked.schedule(6000000, 6000000, 0, many[i]));
+    }
+    /* A second task for the first function, at index MANY_FUNCTIONS */
+    assertEquals(SKED_E_OK, sked.schedule(6000000, 6000000, 0, many[0]));
+    assertEquals(SKED_E_OK, sked.start());
+
+    for (uint8_t i = 0; i < MANY_FUNCTIONS; i++) {
+        assertEquals(SKED_E_OK, sked.post(many[i]));
+    }
+    delay(20);
+    assertEquals(2UL, (unsigned long)many_runs[0]);
+    for (uint8_t i = 1; i < MANY_FUNCTIONS; i++) {
+        assertEquals(1UL, (unsigned long)many_runs[i]);
+    }
+
+    assertEquals(SKED_E_OK, sked.unschedule(0));
+    assertEquals(SKED_E_OK, sked.post(many[0]));
+    assertEquals(SKED_E_OK, sked.post(many[MANY_FUNCTIONS - 1]));
+    delay(20);
+    assertEquals(3UL, (unsigned long)many_runs[0]);
+    assertEquals(2UL, (unsigned long)many_runs[MANY_FUNCTIONS - 1]);
+
+    /* Still a function post() knows, with nothing left to release */
+    assertEquals(SKED_E_OK, sked.unschedule(MANY_FUNCTIONS));
+    assertEquals(SKED_E_OK, sked.post(many[0]));
+    delay(20);
+    assertEquals(3UL, (unsigned long)many_runs[0]);
+
+    sked.reset();
+}
+
+/**
+ * A post() to an idle Sked wakes the parked tick thread instead of waiting
+ * for the next tick.
+ */
+Test(test_post_latency, ts) {
+    const uint16_t rounds = 200;
+    uint32_t total_us = 0;
+    uint32_t max_us = 0;
+
+    assertTrue(startPosted());
+
+    for (uint16_t r = 0; r < rounds; r++) {
+        uint32_t runs = task_runs[0];
+
+        /* Let the tick thread park */
+        delayMicroseconds(150 + (r % 7) * 10);
+
+        uint32_t posted_us = micros();
+        assertEquals(SKED_E_OK, sked.post(posted[0]));
+        while (task_runs[0] == runs) {
+            if ((micros() - posted_us) > 100000) {
+                fail("Timeout occurred");
+            }
+            /* Don't take the CPU from the threads being measured */
+            delayMicroseconds(10);
+        }
+
+        uint32_t took = started_us - posted_us;
+        total_us += took;
+        if (took > max_us) {
+            max_us = took;
+        }
+    }
+
+    sked_post_stats_t stats;
+    sked.getPostStats(&stats);
+    Serial.print("post() to start: mean ");
+    Serial.print(total_us / rounds);
+    Serial.print("us max ");
+    Serial.print(max_us);
+    Serial.print("us, wakeups ");
+    Serial.println(stats.wakeups);
+
+    assertEquals((unsigned long)rounds, (unsigned long)stats.posts);
+    assertEquals((unsigned long)rounds, (unsigned long)stats.released);
+    assertTrue(stats.wakeups > 0);
+    assertEquals((unsigned long)rounds, (unsigned long)task_runs[0]);
+
+    sked.reset();
+}
+
+/**
+ * Enqueue cost and throughput with 1 to 32 producer threads. Every post is
+ * counted, and every task posted to runs at least once.
+ */
+Test(test_post_producers, ts) {
+    static producer_t producers[32];
+    uint8_t counts[] = {1, 2, 4, 8, 16, 32};
+
+    for (uint8_t k = 0; k < sizeof(counts); k++) {
+        uint8_t count = counts[k];
+
+        assertTrue(startPosted());
+
+        uint64_t start = nowNs();
+        for (uint8_t p = 0; p < count; p++) {
+            producers[p].index = p;
+            pthread_create(&producers[p].thread, NULL, producerMain,
+                    &producers[p]);
+        }
+
+        uint64_t thread_ns = 0;
+        uint64_t max_ns = 0;
+        for (uint8_t p = 0; p < count; p++) {
+            pthread_join(producers[p].thread, NULL);
+            thread_ns += producers[p].elapsed_ns;
+            if (producers[p].max_ns > max_ns) {
+                max_ns = producers[p].max_ns;
+            }
+        }
+        uint64_t wall_ns = nowNs() - start;
+
+        /* Let the last batch drain */
+        delay(5);
+
+        sked_post_stats_t stats;
+        sked.getPostStats(&stats);
+        uint32_t total = (uint32_t)count * POSTS_PER_PRODUCER;
+
+        Serial.print(count);
+        Serial.print(" producers: ");
+        Serial.print((unsigned long)((uint64_t)total * 1000000ULL / wall_ns));
+        Serial.print(" posts/ms, mean ");
+        Serial.print((unsigned long)(thread_ns / total));
+        Serial.print("ns, max ");
+        Serial.print((unsigned long)max_ns);
+        Serial.print("ns, queued ");
+        Serial.print(stats.enqueued);
+        Serial.print(", drains ");
+        Serial.print(stats.drains);
+        Serial.print(", max batch ");
+        Serial.print(stats.max_batch);
+        Serial.print(", wakeups ");
+        Serial.println(stats.wakeups);
+
+        assertEquals((unsigned long)total, (unsigned long)stats.posts);
+        assertEquals((unsigned long)stats.enqueued,
+                (unsigned long)(stats.released + stats.coalesced));
+        for (uint8_t i = 0; i < POST_TASKS && i < count; i++) {
+            assertTrue(task_runs[i] > 0);
+        }
+
+        sked.reset();
+    }
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,328 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests the host backend's growable task table: 100k tasks with their own
+ * context, stable handles, unschedule() and the READY queues. Build and run
+ * with make -f host.mk test.
+ */
+
+#include <atomic>
+#include <Sked.h>
+#include "../utest.h"
+#include "util.h"
+
+TestSuite ts;
+
+/* The next-due engine brings every count up to date when a task is added,
+ * so it's only tested at a size where that doesn't matter */
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+#define SCALE_TASKS 5000U
+#else
+#define SCALE_TASKS 100000U
+#endif
+
+typedef struct {
+    uint32_t id;
+    std::atomic<uint32_t> runs;
+} device_t;
+
+static device_t devices[SCALE_TASKS];
+static uint32_t wrong_arg;
+
+void task_device(void *arg) {
+    device_t *device = (device_t *)arg;
+
+    if (device < devices || device >= devices + SCALE_TASKS) {
+        wrong_arg++;
+        return;
+    }
+    device->runs++;
+}
+
+static void resetDevices(void) {
+    for (uint32_t d = 0; d < SCALE_TASKS; d++) {
+        devices[d].id = d;
+        devices[d].runs = 0U;
+    }
+    wrong_arg = 0U;
+}
+
+/**
+ * Adding and removing tasks costs the same at 100k as it does at 10, and
+ * a task's handle is its index for as long as it's scheduled.
+ */
+Test(test_scale_table, ts) {
+    sked_index_t handle = 0U;
+
+    resetDevices();
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+
+    uint64_t start = nowNs();
+    for (uint32_t d = 0; d < SCALE_TASKS; d++) {
+        assertEquals(SKED_E_OK, sked.scheduleArg(1000000, 0, (int8_t)(d % 8),
+                task_device, &devices[d], &handle));
+        assertEquals((unsigned long)d, (unsigned long)handle);
+    }
+    uint64_t insert_ns = (nowNs() - start) / SCALE_TASKS;
+
+    Serial.print("schedule: ");
+    Serial.print((unsigned long)insert_ns);
+    Serial.print(" ns per task, ");
+    Serial.print((unsigned long)(sizeof(sked_task_t) + sizeof(uint16_t)));
+    Serial.println(" bytes per task");
+    assertEquals((unsigned long)SCALE_TASKS,
+        (unsigned long)sked.getTaskCount());
+    assertTrue(sked.getTaskInfo(SCALE_TASKS - 1U)->arg
+        == &devices[SCALE_TASKS - 1U]);
+
+    /* Take every other one out */
+    start = nowNs();
+    for (uint32_t d = 0; d < SCALE_TASKS; d += 2) {
+        assertEquals(SKED_E_OK, sked.unschedule(d));
+    }
+    uint64_t remove_ns = (nowNs() - start) / (SCALE_TASKS / 2U);
+    Serial.print("unschedule: ");
+    Serial.print((unsigned long)remove_ns);
+    Serial.println(" ns per task");
+
+    assertTrue(sked.getTaskInfo(0) == NULL);
+    assertTrue(sked.getTaskInfo(1)->arg == &devices[1]);
+    assertEquals(SKED_E_INVALID_OPERATION, sked.unschedule(0));
+    assertEquals(SKED_E_INVALID_OPERATION, sked.unschedule(SCALE_TASKS));
+
+    /* New tasks take the freed slots, and nobody else's moves */
+    assertEquals(SKED_E_OK, sked.scheduleArg(1000000, 0, 0, task_device,
+            &devices[0], &handle));
+    assertEquals((unsigned long)(SCALE_TASKS - 2U), (unsigned long)handle);
+    assertTrue(sked.getTaskInfo(SCALE_TASKS - 1U)->arg
+        == &devices[SCALE_TASKS - 1U]);
+    assertEquals((unsigned long)SCALE_TASKS,
+        (unsigned long)sked.getTaskCount());
+
+#if (SKED_RELEASE != SKED_RELEASE_NEXT_DUE)
+    /* Both are O(1), so say within a microsecond each even on a slow
+     * machine */
+    assertTrue(insert_ns < 1000U);
+    assertTrue(remove_ns < 1000U);
+#endif
+
+    sked.reset();
+    assertEquals(0, sked.getTaskCount());
+}
+
+/**
+ * 100k tasks with their own context all run, each with its own.
+ */
+Test(test_scale_run, ts) {
+    resetDevices();
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+
+    /* One release a second each, spread over the second */
+    for (uint32_t d = 0; d < SCALE_TASKS; d++) {
+        uint32_t offset = (d % 5000U) * 200U;
+        assertEquals(SKED_E_OK, sked.scheduleArg(1000000,
+                (offset < 200U) ? 0U : offset, (int8_t)(d % 4), task_device,
+                &devices[d], NULL));
+    }
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    while ((millis() - start) < 1300) {
+        sked.loop();
+    }
+    sked.reset();
+
+    uint32_t idle = 0U;
+    for (uint32_t d = 0; d < SCALE_TASKS; d++) {
+        if (devices[d].runs == 0U) {
+            idle++;
+        }
+    }
+    Serial.print("Devices that never ran: ");
+    Serial.println(idle);
+    assertEquals(0, idle);
+    assertEquals(0, wrong_arg);
+}
+
+static sked_index_t self_handle;
+static std::atomic<uint32_t> self_runs;
+
+void task_self(void *arg) {
+    self_runs++;
+    sked.unschedule(self_handle);
+}
+
+static int8_t order[4];
+static uint8_t order_len;
+
+template <int8_t P>
+void task_order(void) {
+    if (order_len < 4U) {
+        order[order_len++] = P;
+    }
+}
+
+/**
+ * A task can take itself out; its slot is only reused once the job is over.
+ * READY tasks still run highest priority first.
+ */
+Test(test_scale_unschedule, ts) {
+    self_runs = 0U;
+    order_len = 0U;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.scheduleArg(1000, 0, 0, task_self, NULL,
+            &self_handle));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 1, task_order<1>));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 5, task_order<5>));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 3, task_order<3>));
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    while ((millis() - start) < 20) {
+        sked.loop();
+    }
+
+    assertEquals(1, self_runs);
+    assertTrue(sked.getTaskInfo(self_handle) == NULL);
+    assertTrue(order_len >= 3U);
+    assertEquals(5, order[0]);
+    assertEquals(3, order[1]);
+    assertEquals(1, order[2]);
+
+    sked_index_t handle;
+    assertEquals(SKED_E_OK, sked.scheduleArg(1000, 0, 0, task_device,
+            &devices[0], &handle));
+    assertEquals((unsigned long)self_handle, (unsigned long)handle);
+
+    sked.reset();
+}
+
+/**
+ * With far more READY jobs than workers, the queues take them all and every
+ * task still runs.
+ */
+Test(test_scale_pool, ts) {
+    resetDevices();
+    sked.reset();
+    sked.setRealtime(false);
+    assertEquals(SKED_E_OK, sked.setWorkers(2));
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    for (uint32_t d = 0; d < 1000U; d++) {
+        assertEquals(SKED_E_OK, sked.scheduleArg(50000, 0, (int8_t)(d % 3),
+                task_device, &devices[d], NULL));
+    }
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    while ((millis() - start) < 200) {
+        sked.loop();
+    }
+    sked.reset();
+    sked.setWorkers(0);
+
+    for (uint32_t d = 0; d < 1000U; d++) {
+        assertTrue(devices[d].runs >= 2U);
+    }
+    assertEquals(0, wrong_arg);
+}
+
+/* Keeps the last telemetry frame idle() wrote */
+class FrameSink : public Print {
+public:
+    uint8_t frame[SKED_TELEMETRY_BUF_SIZE];
+    uint16_t len;
+
+    size_t write(uint8_t b) {
+        if (len < sizeof(frame)) {
+            frame[len++] = b;
+        }
+        return 1;
+    }
+
+    int availableForWrite(void) {
+        return sizeof(frame);
+    }
+};
+
+static uint32_t frameGet32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16)
+        | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * A table bigger than a status frame goes out SKED_MAX_TASKS slots at a time,
+ * and each frame says which.
+ */
+Test(test_scale_telemetry, ts) {
+    const uint32_t count = SKED_MAX_TASKS * 2U + 8U;
+    FrameSink sink;
+
+    resetDevices();
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    for (uint32_t d = 0; d < count; d++) {
+        assertEquals(SKED_E_OK, sked.scheduleArg(50000, 0, 0, task_device,
+                &devices[d], NULL));
+    }
+    sked.telemetryBegin(&sink);
+
+    uint32_t firsts[] = {0U, SKED_MAX_TASKS, SKED_MAX_TASKS * 2U, 0U};
+    for (uint8_t f = 0; f < 4; f++) {
+        uint32_t expect = (count - firsts[f] < SKED_MAX_TASKS)
+            ? count - firsts[f] : SKED_MAX_TASKS;
+
+        sink.len = 0U;
+        assertEquals(SKED_E_OK, sked.telemetrySnapshot());
+        while (sked.telemetryPending() > 0U) {
+            sked.idle();
+        }
+        assertEquals(SKED_FRAME_OVERHEAD + SKED_STATUS_HDR_LEN
+                + expect * SKED_STATUS_TASK_LEN, (unsigned long)sink.len);
+        assertEquals(SKED_STATUS_VERSION, sink.frame[2]);
+        assertEquals((unsigned long)expect, (unsigned long)sink.frame[8]);
+        assertEquals((unsigned long)firsts[f],
+                (unsigned long)frameGet32(&sink.frame[16]));
+        assertEquals((unsigned long)count,
+                (unsigned long)frameGet32(&sink.frame[20]));
+    }
+
+    sked.telemetryBegin(NULL);
+    sked.reset();
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
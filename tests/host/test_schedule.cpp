@@ -0,0 +1,254 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests schedule files with loadSchedule() and saveSchedule() on the host
+ * backend. Build and run with make -f host.mk test.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <Sked.h>
+#include "../utest.h"
+#include "util.h"
+
+TestSuite ts;
+
+#define SCHED_PATH "/tmp/sked_test_schedule"
+
+/* The next-due engine brings every count up to date when a task is added,
+ * so scheduleArg() is only timed at a size where that doesn't matter */
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+#define SCHED_TASKS 5000U
+#else
+#define SCHED_TASKS 100000U
+#endif
+
+static volatile uint32_t fast_runs;
+static uint32_t arg_runs[4];
+
+void task_fast(void) {
+    fast_runs++;
+}
+
+/* arg is an index, as it would be coming from a file */
+void task_indexed(void *arg) {
+    arg_runs[(uintptr_t)arg]++;
+}
+
+static long fileSize(const char *path) {
+    FILE *file = fopen(path, "rb");
+    long size;
+
+    if (file == NULL) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+/**
+ * A saved schedule loads back the same, and runs.
+ */
+Test(test_schedule_round_trip, ts) {
+    sked_task_t before[3];
+
+    fast_runs = 0U;
+    memset(arg_runs, 0, sizeof(arg_runs));
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 2, task_fast));
+    assertEquals(SKED_E_OK, sked.scheduleArg(2000, 300, 3, task_indexed,
+            (void *)1, NULL));
+    assertEquals(SKED_E_OK, sked.scheduleArg(5000, 0, 1, task_indexed,
+            (void *)3, NULL));
+    assertEquals(SKED_E_OK, sked.setSlack(task_fast, 400));
+    for (sked_index_t i = 0; i < 3U; i++) {
+        before[i] = *sked.getTaskInfo(i);
+    }
+    assertEquals(SKED_E_OK, sked.saveSchedule(SCHED_PATH));
+    assertEquals((long)(sizeof(sked_sched_header_t)
+            + 3U * sizeof(sked_sched_record_t)), fileSize(SCHED_PATH));
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.loadSchedule(SCHED_PATH));
+    assertEquals(3, sked.getTaskCount());
+    for (sked_index_t i = 0; i < 3U; i++) {
+        const sked_task_t *task = sked.getTaskInfo(i);
+
+        assertTrue(task->fcn == before[i].fcn);
+        assertTrue(task->arg == before[i].arg);
+        assertEquals(before[i].period, task->period);
+        assertEquals(before[i].offset, task->offset);
+        assertEquals(before[i].slack, task->slack);
+        assertEquals(before[i].priority, task->priority);
+        assertEquals(before[i].host_flags, task->host_flags);
+    }
+    assertEquals(3, sked.getCountdown(1));
+
+    assertEquals(SKED_E_OK, sked.start());
+    runFor(30);
+    assertTrue(fast_runs > 10U);
+    assertTrue(arg_runs[1] > 5U);
+    assertTrue(arg_runs[3] > 2U);
+    assertEquals(0UL, (unsigned long)arg_runs[0]);
+
+    /* Loading adds to the tasks there are */
+    assertEquals(SKED_E_OK, sked.loadSchedule(SCHED_PATH));
+    assertEquals(6, sked.getTaskCount());
+
+    sked.reset();
+    unlink(SCHED_PATH);
+}
+
+/**
+ * Nothing goes in from a file that's missing, cut short, for another build
+ * or with a task schedule() wouldn't take.
+ */
+Test(test_schedule_checks, ts) {
+    sked_sched_header_t header;
+    sked_sched_record_t record;
+    int fds[2];
+
+    sked.reset();
+    assertEquals(SKED_E_NOT_INITIALIZED, sked.loadSchedule(SCHED_PATH));
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    unlink(SCHED_PATH);
+    assertEquals(SKED_E_NO_DATA, sked.loadSchedule(SCHED_PATH));
+
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 2, task_fast));
+    assertEquals(SKED_E_OK, sked.saveSchedule(SCHED_PATH));
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+
+    FILE *file = fopen(SCHED_PATH, "r+b");
+    assertTrue(file != NULL);
+    assertEquals(1UL, (unsigned long)fread(&header, sizeof(header), 1U,
+            file));
+    assertEquals(1UL, (unsigned long)fread(&record, sizeof(record), 1U,
+            file));
+
+    /* Cut short */
+    assertEquals(0, ftruncate(fileno(file), sizeof(header)));
+    fflush(file);
+    assertEquals(SKED_E_NO_DATA, sked.loadSchedule(SCHED_PATH));
+
+    /* Another build */
+    header.build_id[0] ^= 0xFFU;
+    rewind(file);
+    fwrite(&header, sizeof(header), 1U, file);
+    fwrite(&record, sizeof(record), 1U, file);
+    fflush(file);
+    assertEquals(SKED_E_INVALID_FUNCTION, sked.loadSchedule(SCHED_PATH));
+    header.build_id[0] ^= 0xFFU;
+
+    /* A good task, then one schedule() wouldn't take */
+    header.task_count = 2U;
+    rewind(file);
+    fwrite(&header, sizeof(header), 1U, file);
+    fwrite(&record, sizeof(record), 1U, file);
+    record.period_us = 50U;
+    fwrite(&record, sizeof(record), 1U, file);
+    fflush(file);
+    assertEquals(SKED_E_INVALID_PERIOD, sked.loadSchedule(SCHED_PATH));
+    assertEquals(0, sked.getTaskCount());
+
+    /* A function outside the program */
+    record.period_us = 1000U;
+    record.fcn = ~0ULL >> 8;
+    fseek(file, sizeof(header) + sizeof(record), SEEK_SET);
+    fwrite(&record, sizeof(record), 1U, file);
+    fclose(file);
+    assertEquals(SKED_E_INVALID_FUNCTION, sked.loadSchedule(SCHED_PATH));
+    assertEquals(0, sked.getTaskCount());
+
+    /* An fd task has nothing to go in a file as */
+    assertEquals(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    assertEquals(SKED_E_OK, sked.scheduleFd(fds[0], 0x001U, 1, task_fast));
+    assertEquals(SKED_E_INVALID_OPERATION, sked.saveSchedule(SCHED_PATH));
+
+    sked.reset();
+    close(fds[0]);
+    close(fds[1]);
+    unlink(SCHED_PATH);
+}
+
+/**
+ * A big schedule loads in a fraction of the time adding it a task at a
+ * time takes.
+ */
+Test(test_schedule_scale, ts) {
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    uint64_t start = nowNs();
+    for (uint32_t d = 0; d < SCHED_TASKS; d++) {
+        assertEquals(SKED_E_OK, sked.scheduleArg(1000000,
+                (d % 5000U) * 200U, (int8_t)(d % 8), task_indexed,
+                (void *)(uintptr_t)(d % 4U), NULL));
+    }
+    uint64_t schedule_us = (nowNs() - start) / 1000U;
+    assertEquals(SKED_E_OK, sked.saveSchedule(SCHED_PATH));
+    sked.reset();
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    start = nowNs();
+    assertEquals(SKED_E_OK, sked.loadSchedule(SCHED_PATH));
+    uint64_t load_us = (nowNs() - start) / 1000U;
+
+    Serial.print("Schedule of ");
+    Serial.print((unsigned long)SCHED_TASKS);
+    Serial.print(" tasks: ");
+    Serial.print((unsigned long)schedule_us);
+    Serial.print(" us with scheduleArg(), ");
+    Serial.print((unsigned long)load_us);
+    Serial.println(" us with loadSchedule()");
+
+    assertEquals((unsigned long)SCHED_TASKS,
+        (unsigned long)sked.getTaskCount());
+    assertEquals(4, sked.getCountdown(2));
+    assertEquals(5, sked.getTaskInfo(SCHED_TASKS - 3U)->priority);
+    assertTrue(sked.getTaskInfo(6)->arg == (void *)2);
+    assertTrue(load_us < schedule_us);
+
+    sked.reset();
+    unlink(SCHED_PATH);
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,341 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests the shared-memory stats export on the host backend (exportStats()),
+ * reading it the way a monitor would. Build and run with
+ * make -f host.mk test.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <Sked.h>
+#include "../utest.h"
+
+TestSuite ts;
+
+#define SHM_PATH "/tmp/sked_test_shm"
+
+volatile uint32_t busy_runs;
+
+void task_busy(void) {
+    uint32_t start = micros();
+
+    while ((micros() - start) < 200) {
+    }
+    busy_runs++;
+}
+
+void task_quick(void) {
+}
+
+typedef struct {
+    const uint8_t *map;
+    std::atomic<bool> stop;
+    uint32_t reads;
+    uint32_t retries;
+    uint32_t torn;
+} reader_t;
+
+static const sked_shm_header_t *shmHeader(const uint8_t *map) {
+    return (const sked_shm_header_t *)map;
+}
+
+static const sked_shm_task_t *shmTask(const uint8_t *map, uint32_t i) {
+    return (const sked_shm_task_t *)(map + sizeof(sked_shm_header_t)
+        + i * shmHeader(map)->task_size);
+}
+
+/**
+ * Seqlock read of a record (or the header) into out.
+ *
+ * @return How many tries it took, or 0 if it never got a clean copy
+ */
+template <typename T>
+static uint32_t shmRead(const T *rec, T *out) {
+    for (uint32_t tries = 1; tries <= 100000; tries++) {
+        uint32_t before = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+
+        if (before & 1U) {
+            /* Mid-write; on one CPU the writer needs us out of the way */
+            sched_yield();
+            continue;
+        }
+        memcpy(out, (const void *)rec, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) == before) {
+            return tries;
+        }
+    }
+
+    return 0;
+}
+
+static uint32_t histSum(const sked_shm_task_t *rec) {
+    uint32_t sum = 0;
+
+    for (uint8_t b = 0; b < SKED_LATENCY_BUCKETS; b++) {
+        sum += rec->exec_hist[b];
+    }
+
+    return sum;
+}
+
+static const uint8_t *shmMap(void) {
+    int fd = open(SHM_PATH, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    void *map = mmap(NULL, sizeof(sked_shm_header_t)
+        + SKED_HOST_MAX_TASKS * sizeof(sked_shm_task_t), PROT_READ, MAP_SHARED,
+        fd, 0);
+    close(fd);
+
+    return (map != MAP_FAILED) ? (const uint8_t *)map : NULL;
+}
+
+static void shmUnmap(const uint8_t *map) {
+    munmap((void *)map, sizeof(sked_shm_header_t)
+        + SKED_HOST_MAX_TASKS * sizeof(sked_shm_task_t));
+}
+
+/**
+ * The file has the documented layout and matches what getTaskInfo() says.
+ */
+Test(test_shm_layout, ts) {
+    sked_shm_header_t header;
+    sked_shm_task_t rec;
+
+    sked.reset();
+    assertEquals(SKED_E_INVALID_OPERATION,
+            sked.exportStats("/nonexistent/sked_shm"));
+    assertEquals(SKED_E_OK, sked.exportStats(SHM_PATH));
+
+    const uint8_t *map = shmMap();
+    assertTrue(map != NULL);
+    assertEquals((unsigned long)SKED_SHM_MAGIC,
+        (unsigned long)shmHeader(map)->magic);
+    assertEquals(SKED_SHM_VERSION, shmHeader(map)->version);
+    assertEquals(sizeof(sked_shm_task_t), shmHeader(map)->task_size);
+    assertEquals((unsigned long)SKED_HOST_MAX_TASKS,
+        (unsigned long)shmHeader(map)->max_tasks);
+    assertEquals(0, shmHeader(map)->task_count);
+
+    busy_runs = 0;
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 1, task_busy));
+    assertEquals(SKED_E_OK, sked.schedule(5000, 0, 0, task_quick));
+    assertTrue(shmRead(shmHeader(map), &header) > 0);
+    assertEquals(2, header.task_count);
+    assertEquals(SKED_E_OK, sked.start());
+
+    uint32_t start = millis();
+    while ((millis() - start) < 100) {
+        sked.loop();
+    }
+
+    for (uint8_t i = 0; i < 2; i++) {
+        sked_task_t *task = sked.getTaskInfo(i);
+
+        assertTrue(shmRead(shmTask(map, i), &rec) > 0);
+        assertEquals(task->priority, rec.priority);
+        assertEquals((unsigned long)task->period * 100UL,
+            (unsigned long)rec.period_us);
+        assertEquals((unsigned long)task->completions,
+            (unsigned long)rec.completions);
+        assertEquals((unsigned long)rec.completions,
+            (unsigned long)histSum(&rec));
+        assertEquals((unsigned long)task->max_exec_us,
+            (unsigned long)rec.max_exec_us);
+        assertTrue(rec.fcn == (uint64_t)(uintptr_t)task->fcn);
+        assertTrue(rec.total_exec_us == task->total_exec_us);
+    }
+
+    /* task_busy spins for 200us a job */
+    assertTrue(shmRead(shmTask(map, 0), &rec) > 0);
+    assertTrue(rec.completions >= 50);
+    assertTrue(rec.total_exec_us >= 150ULL * rec.completions);
+    assertTrue(rec.exec_hist[8] > 0);
+
+    /* Stopping leaves the last of it in the file */
+    assertEquals(SKED_E_OK, sked.exportStats(NULL));
+    sked.reset();
+    assertTrue(shmRead(shmHeader(map), &header) > 0);
+    assertEquals(2, header.task_count);
+
+    shmUnmap(map);
+}
+
+/**
+ * Every slot goes out, not just the first SKED_MAX_TASKS, and counts that
+ * move on without a job finishing catch up from the tick thread.
+ */
+Test(test_shm_all_slots, ts) {
+    const uint32_t count = SKED_MAX_TASKS * 4U;
+    sked_shm_header_t header;
+    sked_shm_task_t rec;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.exportStats(SHM_PATH));
+    const uint8_t *map = shmMap();
+    assertTrue(map != NULL);
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    for (uint32_t i = 0; i < count; i++) {
+        assertEquals(SKED_E_OK, sked.schedule(1000, 0, 0, task_quick));
+    }
+    assertTrue(shmRead(shmHeader(map), &header) > 0);
+    assertEquals((unsigned long)count, (unsigned long)header.task_count);
+    assertTrue(shmRead(shmTask(map, count - 1U), &rec) > 0);
+    assertTrue(rec.fcn == (uint64_t)(uintptr_t)task_quick);
+
+    /* Released but never run, so only the tick thread exports them */
+    assertEquals(SKED_E_OK, sked.start());
+    /* Longer than SKED_HOST_SHM_TICKS */
+    delay(250);
+    assertTrue(shmRead(shmTask(map, count - 1U), &rec) > 0);
+    assertTrue(rec.activations > 0);
+    assertEquals(0UL, (unsigned long)rec.completions);
+
+    assertEquals(SKED_E_OK, sked.unschedule(count - 1U));
+    assertTrue(shmRead(shmTask(map, count - 1U), &rec) > 0);
+    assertTrue(rec.fcn == 0U);
+
+    /* Exporting to the file again clears what this run left in it */
+    assertEquals(SKED_E_OK, sked.exportStats(NULL));
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.exportStats(SHM_PATH));
+    assertTrue(shmRead(shmHeader(map), &header) > 0);
+    assertEquals(0, header.task_count);
+    for (uint32_t i = 0; i < count; i++) {
+        assertTrue(shmRead(shmTask(map, i), &rec) > 0);
+        assertTrue(rec.fcn == 0U);
+        assertEquals(0UL, (unsigned long)rec.activations);
+    }
+
+    /* Sized for the whole table, but sparse */
+    struct stat st;
+    assertEquals(0, stat(SHM_PATH, &st));
+    assertEquals((unsigned long)(sizeof(sked_shm_header_t)
+        + SKED_HOST_MAX_TASKS * sizeof(sked_shm_task_t)),
+        (unsigned long)st.st_size);
+    assertTrue(st.st_blocks * 512UL < 1024UL * 1024UL);
+
+    assertEquals(SKED_E_OK, sked.exportStats(NULL));
+    shmUnmap(map);
+}
+
+void *readerMain(void *arg) {
+    reader_t *reader = (reader_t *)arg;
+    sked_shm_header_t header;
+    sked_shm_task_t rec;
+
+    while (!reader->stop) {
+        uint32_t tries = shmRead(shmHeader(reader->map), &header);
+
+        for (uint32_t i = 0; i < header.task_count && tries > 0; i++) {
+            uint32_t task_tries = shmRead(shmTask(reader->map, i), &rec);
+
+            if (task_tries == 0) {
+                tries = 0;
+                break;
+            }
+            reader->retries += task_tries - 1;
+
+            /* A torn copy would have these out of step */
+            if (histSum(&rec) != rec.completions
+                    || rec.completions > rec.activations
+                    || rec.max_exec_us > rec.total_exec_us) {
+                reader->torn++;
+            }
+        }
+
+        if (tries == 0) {
+            reader->torn++;
+        }
+        reader->reads++;
+    }
+
+    return NULL;
+}
+
+/**
+ * A reader going flat out while the tasks run never sees a half-written
+ * record, and never holds the scheduler up.
+ */
+Test(test_shm_concurrent, ts) {
+    reader_t reader;
+    pthread_t thread;
+
+    sked.reset();
+    sked.setRealtime(false);
+    assertEquals(SKED_E_OK, sked.exportStats(SHM_PATH));
+    reader.map = shmMap();
+    assertTrue(reader.map != NULL);
+    reader.stop = false;
+    reader.reads = 0;
+    reader.retries = 0;
+    reader.torn = 0;
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 1, task_busy));
+    assertEquals(SKED_E_OK, sked.schedule(300, 0, 2, task_quick));
+    assertEquals(SKED_E_OK, sked.start());
+    assertEquals(0, pthread_create(&thread, NULL, readerMain, &reader));
+
+    delay(200);
+    reader.stop = true;
+    pthread_join(thread, NULL);
+
+    Serial.print("Reads: ");
+    Serial.print(reader.reads);
+    Serial.print(" retries: ");
+    Serial.println(reader.retries);
+
+    assertTrue(reader.reads > 100);
+    assertEquals(0UL, (unsigned long)reader.torn);
+    /* Both kept running; on one CPU the reader takes its share of it */
+    assertTrue(sked.getTaskInfo(0)->completions > 20);
+    assertTrue(sked.getTaskInfo(1)->completions > 100);
+
+    sked.reset();
+    sked.exportStats(NULL);
+    shmUnmap(reader.map);
+    unlink(SHM_PATH);
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,209 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests the tickless tick thread and release slack on the host backend
+ * (setTickless(), setSlack()). Build and run with make -f host.mk test.
+ */
+
+#include <Sked.h>
+#include "../utest.h"
+
+TestSuite ts;
+
+#define SLACK_TASKS 8
+
+volatile uint32_t runs[SLACK_TASKS];
+
+template <uint8_t N>
+void task_loose(void) {
+    runs[N]++;
+}
+
+sked_task_fcn_t loose[SLACK_TASKS] = {
+    task_loose<0>, task_loose<1>, task_loose<2>, task_loose<3>,
+    task_loose<4>, task_loose<5>, task_loose<6>, task_loose<7>
+};
+
+void task_unscheduled(void) {
+}
+
+/**
+ * Runs SLACK_TASKS 10ms tasks, each offset 1ms from the last so no two share
+ * a release, for 200ms.
+ */
+static bool runLoose(bool tickless, uint32_t slack_us,
+        sked_wake_stats_t *stats) {
+    sked.reset();
+    sked.setRealtime(false);
+    sked.setTickless(tickless);
+    for (uint8_t t = 0; t < SLACK_TASKS; t++) {
+        runs[t] = 0;
+    }
+
+    if (sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_MONOTONIC) != SKED_E_OK) {
+        return false;
+    }
+    for (uint8_t t = 0; t < SLACK_TASKS; t++) {
+        if (sked.schedule(10000, 1000 * (t + 1), 0, loose[t]) != SKED_E_OK
+                || sked.setSlack(loose[t], slack_us) != SKED_E_OK) {
+            return false;
+        }
+    }
+    if (sked.start() != SKED_E_OK) {
+        return false;
+    }
+
+    delay(200);
+    sked.getWakeStats(stats);
+    sked.reset();
+    sked.setTickless(false);
+
+    Serial.print(tickless ? "tickless" : "ticking");
+    Serial.print(", slack ");
+    Serial.print(slack_us);
+    Serial.print("us: ");
+    Serial.print(stats->wakeups * 10000UL / stats->ticks);
+    Serial.print(" wakeups/s, ");
+    Serial.print(stats->releases);
+    Serial.print(" releases, late mean ");
+    Serial.print((unsigned long)(stats->late_total_us
+        / (stats->releases ? stats->releases : 1)));
+    Serial.print("us max ");
+    Serial.print(stats->late_max_us);
+    Serial.println("us");
+
+    return true;
+}
+
+/**
+ * Going tickless cuts wakeups to one per distinct release time, slack cuts
+ * them further, and releases are late by less than the slack on average
+ * (the worst case is the slack plus scheduling noise).
+ */
+Test(test_slack_wakeups, ts) {
+    sked_wake_stats_t ticking;
+    sked_wake_stats_t tickless;
+    sked_wake_stats_t slack;
+
+    assertTrue(runLoose(false, 0, &ticking));
+    assertTrue(runLoose(true, 0, &tickless));
+    uint32_t tickless_runs = 0;
+    for (uint8_t t = 0; t < SLACK_TASKS; t++) {
+        tickless_runs += runs[t];
+    }
+    assertTrue(runLoose(true, 5000, &slack));
+
+    /* About 10000/s, 800/s and 200/s */
+    assertTrue(ticking.wakeups > 10 * tickless.wakeups);
+    assertTrue(tickless.wakeups > 2 * slack.wakeups);
+
+    /* The same work got done each time */
+    for (uint8_t t = 0; t < SLACK_TASKS; t++) {
+        assertTrue(runs[t] >= 17 && runs[t] <= 20);
+    }
+    assertTrue(tickless_runs >= 17 * SLACK_TASKS);
+    assertTrue(slack.releases >= 17 * SLACK_TASKS);
+
+    /* Slack is where the extra lateness comes from */
+    assertTrue(slack.late_total_us > tickless.late_total_us);
+    assertTrue(slack.late_total_us / slack.releases < 5000);
+}
+
+volatile uint32_t fast_runs;
+volatile uint32_t fast_first_us;
+
+void task_fast(void) {
+    if (fast_runs++ == 0) {
+        fast_first_us = micros();
+    }
+}
+
+void task_slow(void) {
+}
+
+/**
+ * A task scheduled while the tick thread is asleep until a far off release
+ * still starts on time.
+ */
+Test(test_slack_schedule_running, ts) {
+    sked_wake_stats_t stats;
+
+    sked.reset();
+    sked.setRealtime(false);
+    sked.setTickless(true);
+    fast_runs = 0;
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(5000000, 5000000, 0, task_slow));
+    assertEquals(SKED_E_OK, sked.start());
+
+    delay(20);
+    uint32_t scheduled_us = micros();
+    assertEquals(SKED_E_OK, sked.schedule(2000, 2000, 1, task_fast));
+
+    delay(50);
+    sked.getWakeStats(&stats);
+    Serial.print("first run after ");
+    Serial.print(fast_first_us - scheduled_us);
+    Serial.print("us, wakeups ");
+    Serial.println(stats.wakeups);
+    assertTrue(fast_runs >= 20);
+    assertTrue(fast_first_us - scheduled_us >= 1900);
+    assertTrue(fast_first_us - scheduled_us < 10000);
+    /* One per run of task_fast, not one per tick */
+    assertTrue(stats.wakeups < 40);
+
+    sked.reset();
+    sked.setTickless(false);
+}
+
+/**
+ * setSlack() needs a scheduled task and a slack a count can hold.
+ */
+Test(test_slack_invalid, ts) {
+    sked_wake_stats_t stats;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 0, loose[0]));
+    assertEquals(SKED_E_INVALID_FUNCTION, sked.setSlack(task_unscheduled,
+            1000));
+    assertEquals(SKED_E_INVALID_PERIOD, sked.setSlack(loose[0], 7000000));
+    assertEquals(SKED_E_OK, sked.setSlack(loose[0], 1000));
+    assertEquals(10, sked.getTaskInfo(0)->slack);
+
+    /* Nothing to report until it's running */
+    sked.getWakeStats(&stats);
+    assertEquals(0UL, (unsigned long)stats.wakeups);
+
+    sked.reset();
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
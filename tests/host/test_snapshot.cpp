@@ -0,0 +1,329 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests warm restarts with snapshot() and restore() on the host backend.
+ * Build and run with make -f host.mk test.
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <Sked.h>
+#include "../utest.h"
+#include "util.h"
+
+TestSuite ts;
+
+/* The next-due engine brings every count up to date when a task is added,
+ * so it's only tested at a size where that doesn't matter */
+#if (SKED_RELEASE == SKED_RELEASE_NEXT_DUE)
+#define SNAP_TASKS 5000U
+#else
+#define SNAP_TASKS 100000U
+#endif
+
+static volatile uint32_t fast_runs;
+static volatile uint32_t slow_runs;
+static uint32_t arg_runs[2];
+
+void task_fast(void) {
+    fast_runs++;
+}
+
+void task_slow(void) {
+    slow_runs++;
+}
+
+void task_counted(void *arg) {
+    (*(uint32_t *)arg)++;
+}
+
+#if (SKED_LATE_HOOKS == SKED_ON)
+void hook_late(sked_task_fcn_t fcn, uint8_t events) {
+}
+#endif
+
+/**
+ * Everything about a task comes back, statistics and handles included, and
+ * the functions still work in the new run.
+ */
+Test(test_snapshot_round_trip, ts) {
+    sked_index_t handle;
+    sked_task_t before[3];
+    size_t len = 0U;
+
+    fast_runs = 0U;
+    slow_runs = 0U;
+    arg_runs[0] = arg_runs[1] = 0U;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 2, task_fast));
+    assertEquals(SKED_E_OK, sked.schedule(5000, 300, 1, task_slow));
+    assertEquals(SKED_E_OK, sked.scheduleArg(2000, 0, 3, task_counted,
+            &arg_runs[0], &handle));
+    assertEquals(2, handle);
+#if (SKED_LATE_HOOKS == SKED_ON)
+    assertEquals(SKED_E_OK, sked.setLateHook(task_slow, hook_late));
+#endif
+    assertEquals(SKED_E_OK, sked.start());
+    runFor(30);
+
+    size_t size = sked.snapshotSize();
+    uint8_t *buf = (uint8_t *)malloc(size);
+    assertEquals(SKED_E_OK, sked.snapshot(buf, size, &len));
+    assertEquals((unsigned long)size, (unsigned long)len);
+    for (sked_index_t i = 0; i < 3U; i++) {
+        before[i] = *sked.getTaskInfo(i);
+    }
+    uint32_t ticks = sked.getTicks();
+    assertTrue(before[0].completions > 10U);
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.restore(buf, len));
+    assertEquals(3, sked.getTaskCount());
+    assertTrue(sked.getTicks() >= ticks - 10U && sked.getTicks() <= ticks);
+    for (sked_index_t i = 0; i < 3U; i++) {
+        sked_task_t *task = sked.getTaskInfo(i);
+
+        assertTrue(task->fcn == before[i].fcn);
+        assertEquals(before[i].period, task->period);
+        assertEquals(before[i].priority, task->priority);
+        assertEquals(before[i].completions, task->completions);
+        assertEquals(IDLE, task->state);
+    }
+#if (SKED_LATE_HOOKS == SKED_ON)
+    assertTrue(sked.getTaskInfo(1)->late_hook == hook_late);
+#endif
+
+    /* The arg didn't survive, and nobody else's handle takes one */
+    assertTrue(sked.getTaskInfo(2)->arg == NULL);
+    assertEquals(SKED_E_INVALID_OPERATION, sked.setArg(0, &arg_runs[1]));
+    assertEquals(SKED_E_OK, sked.setArg(2, &arg_runs[1]));
+
+    uint32_t fast = fast_runs;
+    assertEquals(SKED_E_OK, sked.start());
+    runFor(20);
+    sked.reset();
+    free(buf);
+
+    assertTrue(fast_runs > fast + 10U);
+    assertTrue(arg_runs[1] > 5U);
+}
+
+static uint64_t beats[32];
+static volatile uint8_t beat_count;
+
+void task_beat(void) {
+    if (beat_count < 32U) {
+        beats[beat_count++] = nowNs();
+    }
+}
+
+/**
+ * A restored table keeps its beat: releases after the restart land on the
+ * same 10 ms grid as before it, not wherever start() happened to be.
+ */
+Test(test_snapshot_phase, ts) {
+    size_t len;
+
+    beat_count = 0U;
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 1, task_beat));
+    assertEquals(SKED_E_OK, sked.start());
+    runFor(35);
+
+    size_t size = sked.snapshotSize();
+    uint8_t *buf = (uint8_t *)malloc(size);
+    assertEquals(SKED_E_OK, sked.snapshot(buf, size, &len));
+    uint32_t ticks = sked.getTicks();
+    uint64_t first = beats[0];
+    sked.reset();
+
+    /* Down for two and a half periods */
+    usleep(25000);
+
+    beat_count = 0U;
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.restore(buf, len));
+    assertEquals(SKED_E_OK, sked.start());
+    runFor(35);
+
+    /* The tick count carried on through the downtime */
+    assertTrue(sked.getTicks() >= ticks + 250U + 300U);
+    sked.reset();
+    free(buf);
+
+    assertTrue(beat_count >= 3U);
+    for (uint8_t b = 0; b < beat_count; b++) {
+        int64_t phase = (int64_t)((beats[b] - first) % 10000000ULL);
+
+        if (phase > 5000000) {
+            phase -= 10000000;
+        }
+        Serial.print("Beat phase after restart: ");
+        Serial.print((long)(phase / 1000));
+        Serial.println(" us");
+        assertTrue(phase > -2000000 && phase < 2000000);
+    }
+}
+
+/**
+ * What restore() and snapshot() turn away.
+ */
+Test(test_snapshot_checks, ts) {
+    size_t len = 0U;
+    uint8_t small[8];
+    int fds[2];
+
+    sked.reset();
+    assertEquals(SKED_E_NOT_INITIALIZED, sked.snapshot(small, sizeof(small),
+            &len));
+    assertEquals(SKED_E_NOT_INITIALIZED, sked.restore(small, sizeof(small)));
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 2, task_fast));
+    assertEquals(SKED_E_OK, sked.schedule(5000, 0, 1, task_slow));
+
+    /* Too small, and how big it has to be */
+    assertEquals(SKED_E_TOO_MANY_TASKS, sked.snapshot(small, sizeof(small),
+            &len));
+    assertEquals((unsigned long)sked.snapshotSize(), (unsigned long)len);
+
+    uint8_t *buf = (uint8_t *)malloc(len);
+    assertEquals(SKED_E_OK, sked.snapshot(buf, len, NULL));
+
+    /* Only into an empty table */
+    assertEquals(SKED_E_BUSY, sked.restore(buf, len));
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_WRONG_MODE, sked.restore(buf, len));
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_NO_DATA, sked.restore(buf, len - 1U));
+    assertEquals(SKED_E_NO_DATA, sked.restore(NULL, len));
+    buf[len - 5U] ^= 0x10U;
+    assertEquals(SKED_E_NO_DATA, sked.restore(buf, len));
+    assertEquals(0, sked.getTaskCount());
+    buf[len - 5U] ^= 0x10U;
+
+    /* Not while running */
+    assertEquals(SKED_E_OK, sked.start());
+    assertEquals(SKED_E_BUSY, sked.restore(buf, len));
+    sked.reset();
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.restore(buf, len));
+    assertEquals(2, sked.getTaskCount());
+
+    /* An fd doesn't outlive the process */
+    assertEquals(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    assertEquals(SKED_E_OK, sked.scheduleFd(fds[0], 0x001U, 1, task_slow));
+    assertEquals(SKED_E_INVALID_OPERATION, sked.snapshot(buf, len + 1024U,
+            NULL));
+
+    sked.reset();
+    close(fds[0]);
+    close(fds[1]);
+    free(buf);
+}
+
+/**
+ * A big table comes back in one go, free slots and all.
+ */
+Test(test_snapshot_scale, ts) {
+    static uint32_t counters[SNAP_TASKS];
+    size_t len;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    for (uint32_t d = 0; d < SNAP_TASKS; d++) {
+        assertEquals(SKED_E_OK, sked.scheduleArg(1000000, (d % 5000U) * 200U,
+                (int8_t)(d % 8), task_counted, &counters[d], NULL));
+    }
+    assertEquals(SKED_E_OK, sked.unschedule(7));
+    assertEquals(SKED_E_OK, sked.unschedule(SNAP_TASKS - 1U));
+
+    size_t size = sked.snapshotSize();
+    uint8_t *buf = (uint8_t *)malloc(size);
+    uint64_t start = nowNs();
+    assertEquals(SKED_E_OK, sked.snapshot(buf, size, &len));
+    uint64_t snap_us = (nowNs() - start) / 1000U;
+    sked.reset();
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    start = nowNs();
+    assertEquals(SKED_E_OK, sked.restore(buf, len));
+    uint64_t restore_us = (nowNs() - start) / 1000U;
+
+    Serial.print("Snapshot of ");
+    Serial.print((unsigned long)SNAP_TASKS);
+    Serial.print(" tasks: ");
+    Serial.print((unsigned long)len);
+    Serial.print(" bytes, ");
+    Serial.print((unsigned long)snap_us);
+    Serial.print(" us to take, ");
+    Serial.print((unsigned long)restore_us);
+    Serial.println(" us to restore");
+
+    assertEquals((unsigned long)SNAP_TASKS,
+        (unsigned long)sked.getTaskCount());
+    assertTrue(sked.getTaskInfo(7) == NULL);
+    assertEquals(4, sked.getCountdown(2));
+    assertEquals(5, sked.getTaskInfo(SNAP_TASKS - 3U)->priority);
+
+    /* The freed slots are still there to take */
+    sked_index_t handle;
+    assertEquals(SKED_E_OK, sked.scheduleArg(1000000, 0, 0, task_counted,
+            &counters[7], &handle));
+    assertTrue(handle == 7U || handle == SNAP_TASKS - 1U);
+    assertEquals((unsigned long)SNAP_TASKS,
+        (unsigned long)sked.getTaskCount());
+
+    /* Well under what scheduling them took */
+    assertTrue(restore_us < 200000U);
+
+    sked.reset();
+    free(buf);
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,212 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests sleep-then-spin wakeups for chosen priority bands on the host backend
+ * (setSpin()). Build and run with make -f host.mk test.
+ */
+
+#include <unistd.h>
+#include <Sked.h>
+#include "../utest.h"
+
+TestSuite ts;
+
+volatile uint32_t critical_runs;
+volatile uint32_t bulk_runs;
+
+void task_critical(void) {
+    critical_runs++;
+}
+
+void task_bulk(void) {
+    bulk_runs++;
+}
+
+typedef struct {
+    sked_wake_stats_t wake;
+    sked_spin_stats_t spin;
+    uint32_t late_mean_us;
+    /* The critical task's band */
+    sked_latency_t critical;
+    uint32_t critical_mean_us;
+} spin_run_t;
+
+/**
+ * @return The histogram bucket holding the median latency
+ */
+static uint8_t medianBucket(const sked_latency_t *latency) {
+    uint32_t seen = 0;
+
+    for (uint8_t b = 0; b < SKED_LATENCY_BUCKETS; b++) {
+        seen += latency->hist[b];
+        if (2 * seen >= latency->count) {
+            return b;
+        }
+    }
+
+    return SKED_LATENCY_BUCKETS - 1;
+}
+
+/**
+ * Runs a 1ms critical task (priority 1) and a 700us bulk one (priority 0),
+ * so their releases mostly fall on different ticks, for 300ms.
+ */
+static bool runSpin(bool tickless, bool spin, spin_run_t *run) {
+    sked.reset();
+    sked.setTickless(tickless);
+    critical_runs = 0;
+    bulk_runs = 0;
+
+    if (sked.setSpin(1, spin) != SKED_E_OK
+            || sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_MONOTONIC)
+            != SKED_E_OK
+            || sked.schedule(1000, 0, 1, task_critical) != SKED_E_OK
+            || sked.schedule(700, 0, 0, task_bulk) != SKED_E_OK
+            || sked.start() != SKED_E_OK) {
+        return false;
+    }
+
+    delay(300);
+    sked.getWakeStats(&run->wake);
+    sked.getSpinStats(&run->spin);
+    if (sked.getDispatchLatency(0, &run->critical) != SKED_E_OK) {
+        return false;
+    }
+    sked.reset();
+    sked.setTickless(false);
+    sked.setSpin(1, false);
+
+    run->late_mean_us = (uint32_t)(run->wake.late_total_us
+        / (run->wake.releases ? run->wake.releases : 1));
+    run->critical_mean_us = (uint32_t)(run->critical.total_us
+        / (run->critical.count ? run->critical.count : 1));
+
+    Serial.print(tickless ? "tickless" : "ticking");
+    Serial.print(spin ? ", spinning: " : ": ");
+    Serial.print(run->wake.releases);
+    Serial.print(" releases, late mean ");
+    Serial.print(run->late_mean_us);
+    Serial.print("us max ");
+    Serial.print(run->wake.late_max_us);
+    Serial.print("us, critical band mean ");
+    Serial.print(run->critical_mean_us);
+    Serial.print("us median <");
+    Serial.print(1UL << medianBucket(&run->critical));
+    Serial.print("us max ");
+    Serial.print(run->critical.max_us);
+    Serial.print("us; ");
+    Serial.print(run->spin.spins);
+    Serial.print(" spins (");
+    Serial.print(run->spin.overshoots);
+    Serial.print(" too late), ");
+    Serial.print((unsigned long)run->spin.spin_total_us);
+    Serial.print("us spinning, margin ");
+    Serial.print(run->spin.margin_ns);
+    Serial.print("ns, timer late ");
+    Serial.print(run->spin.timer_late_ns);
+    Serial.println("ns");
+
+    return true;
+}
+
+static void checkSpin(TestCase *test, bool tickless) {
+    spin_run_t sleeping;
+    spin_run_t spinning;
+
+    assertTrue(runSpin(tickless, false, &sleeping));
+    assertTrue(runSpin(tickless, true, &spinning));
+
+    /* The same work got done both ways. Each task gets nearly all of its
+     * 300ms worth of jobs, short of what a VM's stalls cost. */
+    assertTrue(critical_runs >= 250 && critical_runs <= 301);
+    assertTrue(bulk_runs >= 360 && bulk_runs <= 430);
+    assertEquals(0UL, (unsigned long)sleeping.spin.spins);
+
+    /* With one CPU, the tick thread would spin the workers off it, so it
+     * doesn't */
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+        assertEquals(0UL, (unsigned long)spinning.spin.spins);
+        return;
+    }
+
+    /* Only the critical band's releases spin... */
+    assertTrue(spinning.spin.spins >= 250);
+    assertTrue(spinning.spin.spins <= critical_runs + 10);
+    assertTrue(spinning.spin.margin_ns >= 2000UL);
+    assertTrue(spinning.spin.margin_ns <= 500000UL);
+
+    /* ...and the critical task starts sooner for it. The VM's odd stall of
+     * a millisecond or more throws the means about, so go by the median. */
+    assertTrue(medianBucket(&spinning.critical)
+        <= medianBucket(&sleeping.critical));
+}
+
+/**
+ * Ticking, the timerfd goes off the margin early before each of the
+ * critical task's ticks and every other tick as normal.
+ */
+Test(test_spin_ticking, ts) {
+    checkSpin(test, false);
+}
+
+/**
+ * Tickless, the one wakeup per release goes off early when it's for the
+ * critical task.
+ */
+Test(test_spin_tickless, ts) {
+    checkSpin(test, true);
+}
+
+/**
+ * setSpin() holds a priority per task at most; turning one on twice or off
+ * when it isn't on are no-ops.
+ */
+Test(test_spin_invalid, ts) {
+    sked_spin_stats_t stats;
+
+    sked.reset();
+    for (uint8_t p = 0; p < SKED_MAX_TASKS; p++) {
+        assertEquals(SKED_E_OK, sked.setSpin((int8_t)p, true));
+    }
+    assertEquals(SKED_E_OK, sked.setSpin(0, true));
+    assertEquals(SKED_E_INVALID_PRIORITY, sked.setSpin(-1, true));
+    assertEquals(SKED_E_OK, sked.setSpin(0, false));
+    assertEquals(SKED_E_OK, sked.setSpin(0, false));
+    assertEquals(SKED_E_OK, sked.setSpin(-1, true));
+    for (int8_t p = -1; p < SKED_MAX_TASKS; p++) {
+        assertEquals(SKED_E_OK, sked.setSpin(p, false));
+    }
+
+    /* Nothing to report until it's running */
+    sked.getSpinStats(&stats);
+    assertEquals(0UL, (unsigned long)stats.spins);
+    assertEquals(0UL, (unsigned long)stats.margin_ns);
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,266 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests the shared timebase on the host backend (shareTimebase(),
+ * joinTimebase()), with a second instance standing in for the other
+ * process. Build and run with make -f host.mk test.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <Sked.h>
+#include "../utest.h"
+#include "util.h"
+
+TestSuite ts;
+
+#define TIMEBASE_PATH "/tmp/sked_test_timebase"
+
+static Sked peer;
+
+static uint64_t beats[2][32];
+static volatile uint8_t beat_count[2];
+
+void task_beat_host(void) {
+    if (beat_count[0] < 32U) {
+        beats[0][beat_count[0]++] = nowNs();
+    }
+}
+
+void task_beat_peer(void) {
+    if (beat_count[1] < 32U) {
+        beats[1][beat_count[1]++] = nowNs();
+    }
+}
+
+/**
+ * @return How far t is from the nearest 10 ms after first, in us
+ */
+static long beatPhaseUs(uint64_t t, uint64_t first) {
+    int64_t phase = (int64_t)((t - first) % 10000000ULL);
+
+    if (phase > 5000000) {
+        phase -= 10000000;
+    }
+
+    return (long)(phase / 1000);
+}
+
+/**
+ * A peer started part way through a period counts the same ticks as the
+ * host, and its task releases on the host's 10 ms grid.
+ */
+Test(test_timebase_join, ts) {
+    unlink(TIMEBASE_PATH);
+    beat_count[0] = beat_count[1] = 0U;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.shareTimebase(TIMEBASE_PATH));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 1, task_beat_host));
+    assertEquals(SKED_E_OK, sked.start());
+    runFor(23);
+
+    peer.reset();
+    assertEquals(SKED_E_OK, peer.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, peer.joinTimebase(TIMEBASE_PATH));
+    assertEquals(SKED_E_OK, peer.schedule(10000, 0, 1, task_beat_peer));
+    assertEquals(SKED_E_OK, peer.start());
+
+    int32_t apart = (int32_t)(sked.getTicks() - peer.getTicks());
+    assertTrue(sked.getTicks() >= 230U);
+    assertTrue(apart >= -1 && apart <= 1);
+
+    runFor(45, &peer);
+    peer.reset();
+    sked.reset();
+
+    assertTrue(beat_count[0] >= 5U);
+    assertTrue(beat_count[1] >= 3U);
+    for (uint8_t b = 0; b < beat_count[1]; b++) {
+        long phase = beatPhaseUs(beats[1][b], beats[0][0]);
+
+        Serial.print("Peer beat phase: ");
+        Serial.print(phase);
+        Serial.println(" us");
+        assertTrue(phase > -2000 && phase < 2000);
+    }
+}
+
+/**
+ * The host can restart without moving the beat: the file keeps its epoch,
+ * and the tick count carries on from it.
+ */
+Test(test_timebase_restart, ts) {
+    unlink(TIMEBASE_PATH);
+    beat_count[0] = 0U;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.shareTimebase(TIMEBASE_PATH));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 1, task_beat_host));
+    assertEquals(SKED_E_OK, sked.start());
+    runFor(25);
+    uint64_t first = beats[0][0];
+    sked.reset();
+
+    usleep(15000);
+
+    beat_count[0] = 0U;
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.shareTimebase(TIMEBASE_PATH));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 1, task_beat_host));
+    assertEquals(SKED_E_OK, sked.start());
+    assertTrue(sked.getTicks() >= 400U);
+    runFor(35);
+    sked.reset();
+
+    assertTrue(beat_count[0] >= 3U);
+    for (uint8_t b = 0; b < beat_count[0]; b++) {
+        long phase = beatPhaseUs(beats[0][b], first);
+
+        assertTrue(phase > -2000 && phase < 2000);
+    }
+
+    /* Let go of it, and start() counts from 0 again */
+    assertEquals(SKED_E_OK, sked.joinTimebase(NULL));
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.start());
+    assertTrue(sked.getTicks() < 10U);
+    sked.reset();
+}
+
+#if (SKED_SNAPSHOT == SKED_ON)
+/**
+ * A snapshot taken on the shared timebase picks up from the shared tick
+ * count after the restart, still in phase.
+ */
+Test(test_timebase_restore, ts) {
+    size_t len;
+
+    unlink(TIMEBASE_PATH);
+    beat_count[0] = 0U;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.shareTimebase(TIMEBASE_PATH));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 3000, 1, task_beat_host));
+    assertEquals(SKED_E_OK, sked.start());
+    runFor(25);
+
+    size_t size = sked.snapshotSize();
+    uint8_t *buf = (uint8_t *)malloc(size);
+    assertEquals(SKED_E_OK, sked.snapshot(buf, size, &len));
+    uint64_t first = beats[0][0];
+    sked.reset();
+
+    usleep(12000);
+
+    beat_count[0] = 0U;
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.restore(buf, len));
+    assertEquals(SKED_E_OK, sked.start());
+    assertTrue(sked.getTicks() >= 370U);
+    runFor(35);
+    sked.reset();
+    free(buf);
+
+    assertTrue(beat_count[0] >= 3U);
+    for (uint8_t b = 0; b < beat_count[0]; b++) {
+        long phase = beatPhaseUs(beats[0][b], first);
+
+        assertTrue(phase > -2000 && phase < 2000);
+    }
+
+    assertEquals(SKED_E_OK, sked.joinTimebase(NULL));
+}
+#endif
+
+/**
+ * What shareTimebase() and joinTimebase() turn away.
+ */
+Test(test_timebase_checks, ts) {
+    sked_timebase_t timebase;
+
+    unlink(TIMEBASE_PATH);
+    sked.reset();
+    assertEquals(SKED_E_INVALID_OPERATION,
+            sked.joinTimebase(TIMEBASE_PATH));
+    assertEquals(SKED_E_INVALID_OPERATION,
+            sked.shareTimebase("/nonexistent/sked_timebase"));
+
+    /* Made, but not written yet */
+    int fd = open(TIMEBASE_PATH, O_RDWR | O_CREAT, 0644);
+    assertTrue(fd >= 0);
+    assertEquals(SKED_E_NO_DATA, sked.joinTimebase(TIMEBASE_PATH));
+    memset(&timebase, 0, sizeof(timebase));
+    assertEquals((long)sizeof(timebase),
+            (long)write(fd, &timebase, sizeof(timebase)));
+    assertEquals(SKED_E_NO_DATA, sked.joinTimebase(TIMEBASE_PATH));
+
+    /* Another tick */
+    timebase.magic = SKED_TIMEBASE_MAGIC;
+    timebase.version = SKED_TIMEBASE_VERSION;
+    timebase.tick_ns = 1000000U;
+    timebase.epoch_ns = nowNs();
+    assertEquals((long)sizeof(timebase),
+            (long)pwrite(fd, &timebase, sizeof(timebase), 0));
+    assertEquals(SKED_E_NO_DATA, sked.joinTimebase(TIMEBASE_PATH));
+
+    /* Sharing it puts a new one in its place */
+    assertEquals(SKED_E_OK, sked.shareTimebase(TIMEBASE_PATH));
+    assertEquals((long)sizeof(timebase),
+            (long)pread(fd, &timebase, sizeof(timebase), 0));
+    close(fd);
+    assertEquals(100000UL, (unsigned long)timebase.tick_ns);
+    assertEquals(0UL, (unsigned long)(timebase.seq & 1U));
+    assertEquals(SKED_E_OK, sked.joinTimebase(TIMEBASE_PATH));
+
+    /* Not while running */
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_MONOTONIC));
+    assertEquals(SKED_E_OK, sked.start());
+    assertEquals(SKED_E_BUSY, sked.joinTimebase(NULL));
+    assertEquals(SKED_E_BUSY, sked.shareTimebase(TIMEBASE_PATH));
+    sked.reset();
+
+    assertEquals(SKED_E_OK, sked.joinTimebase(NULL));
+    unlink(TIMEBASE_PATH);
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
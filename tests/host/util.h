@@ -0,0 +1,51 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef TESTS_HOST_UTIL_H_
+#define TESTS_HOST_UTIL_H_
+
+#include <time.h>
+#include <Sked.h>
+
+/**
+ * @return CLOCK_MONOTONIC in ns, for timing things finer than micros()
+ */
+static inline uint64_t nowNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Run sked's loop(), and peer's too if there is one, for ms milliseconds.
+ */
+static inline void runFor(uint32_t ms, Sked *peer = NULL) {
+    uint32_t start = millis();
+
+    while ((millis() - start) < ms) {
+        sked.loop();
+        if (peer != NULL) {
+            peer->loop();
+        }
+    }
+}
+
+#endif  // TESTS_HOST_UTIL_H_
@@ -172,6 +172,205 @@ Test(test_prio, ts) {
     sked.start();
 }
 
+void task_spin(void) {
+    /* Run for 3ms on a 1ms period so every job overruns */
+    uint32_t start = micros();
+    while ((micros() - start) < 3000) {
+    }
+}
+
+/**
+ * Test activation/completion counting, last-event ticks and resetStats()
+ */
+Test(test_stats, ts) {
+    sked.reset();
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 1, task_stub));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 0, task_spin));
+    sked.start();
+
+    uint32_t start = millis();
+    while ((millis() - start) < 50) {
+    }
+
+    sked_task_t *stub = sked.getTaskInfo(0);
+    sked_task_t *spin = sked.getTaskInfo(1);
+
+    /* The stub keeps up with every release */
+    assertTrue(stub->activations >= 40);
+    assertTrue((stub->activations - stub->completions) <= 1);
+    assertEquals(0, stub->misses);
+
+    /* The spinner overruns, and completes a third as often as it's released */
+    assertTrue(spin->overruns > 10);
+    assertTrue(spin->completions < spin->activations);
+    assertTrue(spin->last_overrun_tick > 0);
+    assertTrue(spin->last_overrun_tick <= sked.getTicks());
+
+    /* Everything starts again from zero */
+    sked.resetStats();
+    assertTrue(stub->activations <= 1);
+    assertTrue(spin->overruns <= 1);
+
+    sked.reset();
+}
+
+/**
+ * A Print sink that keeps what telemetry and logging write to it, with as
+ * much room for writes as the test says
+ */
+class FrameSink : public Print {
+public:
+    uint8_t buf[192];
+    uint16_t bytes;
+    int room;
+
+    FrameSink(void) : bytes(0), room(64) {}
+
+    void clear(void) {
+        bytes = 0;
+        room = 64;
+    }
+
+    virtual int availableForWrite(void) {
+        return room;
+    }
+
+    virtual size_t write(uint8_t b) {
+        if (bytes < sizeof(buf)) {
+            buf[bytes] = b;
+        }
+        bytes++;
+        return 1;
+    }
+};
+
+static FrameSink sink;
+
+/**
+ * @return Whether a whole frame of the given type and payload length starts
+ * at `at` in the sink, with a good checksum (see tools/skeddecode.py)
+ */
+static bool frameOk(uint16_t at, uint8_t type, uint8_t version,
+        uint16_t len) {
+    const uint8_t *f = &sink.buf[at];
+    uint16_t a = 0U;
+    uint16_t b = 0U;
+
+    if (at + SKED_FRAME_OVERHEAD + len > sizeof(sink.buf)
+            || f[0] != SKED_FRAME_SYNC || f[1] != type || f[2] != version
+            || (uint16_t)(f[3] | (f[4] << 8)) != len) {
+        return false;
+    }
+
+    for (uint16_t i = 1; i < 5U + len; i++) {
+        a += f[i];
+        a = (a & 0xFFU) + (a >> 8);
+        b += a;
+        b = (b & 0xFFU) + (b >> 8);
+    }
+
+    return f[5U + len] == (uint8_t)a && f[6U + len] == (uint8_t)b;
+}
+
+/**
+ * Test that telemetry frames are well formed and trickled out by idle()
+ * without ever writing more than the stream has room for (when it can tell)
+ */
+Test(test_telemetry, ts) {
+    const uint16_t len = SKED_STATUS_HDR_LEN + 2 * SKED_STATUS_TASK_LEN;
+
+    sink.clear();
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 0, task_stub));
+    assertEquals(SKED_E_OK, sked.schedule(2000, 0, 1, task_stub));
+
+    /* No stream yet */
+    assertEquals(SKED_E_NOT_INITIALIZED, sked.telemetrySnapshot());
+
+    sked.telemetryBegin(&sink);
+    assertEquals(SKED_E_OK, sked.telemetrySnapshot());
+    assertEquals(SKED_FRAME_OVERHEAD + len, sked.telemetryPending());
+
+    /* Only one frame in flight at a time */
+    assertEquals(SKED_E_BUSY, sked.telemetrySnapshot());
+
+    /* idle() must never write more than a chunk at a time */
+    sked.idle();
+    assertEquals(SKED_TELEMETRY_CHUNK, sink.bytes);
+    assertEquals(SKED_FRAME_SYNC, sink.buf[0]);
+
+#if (SKED_TX_ROOM == SKED_ON)
+    /* ... or more than the stream has room for */
+    sink.room = 0;
+    sked.idle();
+    assertEquals(SKED_TELEMETRY_CHUNK, sink.bytes);
+    sink.room = 5;
+    sked.idle();
+    assertEquals(SKED_TELEMETRY_CHUNK + 5, sink.bytes);
+#endif
+
+    sink.room = 64;
+    while (sked.telemetryPending() > 0) {
+        sked.idle();
+    }
+    assertEquals(SKED_FRAME_OVERHEAD + len, sink.bytes);
+    assertTrue(frameOk(0, SKED_FRAME_STATUS, SKED_STATUS_VERSION, len));
+
+    sked.telemetryBegin(NULL);
+}
+
+SKED_LOG_FORMAT(LOG_TEST_VALUE, 1, "value %u");
+
+/**
+ * Test that log messages are queued, dropped when full and sent by idle()
+ */
+Test(test_log, ts) {
+    uint16_t value = 42;
+    uint8_t queued = 0;
+
+    sink.clear();
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+
+    assertEquals(SKED_E_INVALID_OPERATION, sked.logMsg(LOG_TEST_VALUE,
+            &value, SKED_LOG_MAX_ARGS + 1));
+
+    /* Fill the buffer without a stream attached */
+    while (sked.logMsg(LOG_TEST_VALUE, &value, sizeof(value)) == SKED_E_OK) {
+        queued++;
+    }
+    assertEquals(SKED_LOG_BUF_SIZE / (2 + sizeof(value)), queued);
+    assertEquals(1, sked.getLogDropped());
+
+    sked.logBegin(&sink);
+#if (SKED_TX_ROOM == SKED_ON)
+    /* A message stays queued until its whole frame fits */
+    sink.room = SKED_FRAME_OVERHEAD + sizeof(value);
+    sked.idle();
+    assertEquals(0, sink.bytes);
+    sink.room = 64;
+#endif
+
+    /* Each idle() sends one message, then the drop report */
+    for (uint8_t i = 0; i < queued + 1; i++) {
+        sked.idle();
+    }
+    assertEquals(queued * (SKED_FRAME_OVERHEAD + 1 + sizeof(value))
+            + (SKED_FRAME_OVERHEAD + 3), sink.bytes);
+    assertTrue(frameOk(0, SKED_FRAME_LOG, SKED_LOG_VERSION,
+            1 + sizeof(value)));
+
+    /* Nothing left */
+    sked.idle();
+    assertEquals(queued * (SKED_FRAME_OVERHEAD + 1 + sizeof(value))
+            + (SKED_FRAME_OVERHEAD + 3), sink.bytes);
+
+    sked.logBegin(NULL);
+}
+
 void setup(void) {
     Serial.begin(115200);
     ts.setup();
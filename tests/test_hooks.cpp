@@ -0,0 +1,151 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests the per-task late (miss/overrun) hooks. Build with SKED_LATE_HOOKS=1.
+ */
+
+#include <Sked.h>
+#include "./utest.h"
+#include "./util.h"
+
+TestSuite ts;
+
+volatile uint16_t miss_calls;
+volatile uint16_t overrun_calls;
+volatile bool hook_wrong_fcn;
+volatile bool hook_nested;
+volatile bool in_hook;
+
+void task_stub(void) {
+}
+
+void task_spin(void) {
+    /* Run for 3ms on a 1ms period so every job overruns */
+    uint32_t start = micros();
+    while ((micros() - start) < 3000) {
+    }
+}
+
+void late_hook(sked_task_fcn_t fcn, uint8_t events) {
+    if (in_hook) {
+        hook_nested = true;
+    }
+    in_hook = true;
+
+    if (fcn != task_spin && fcn != task_stub) {
+        hook_wrong_fcn = true;
+    }
+    if (events & SKED_LATE_MISS) {
+        miss_calls++;
+    }
+    if (events & SKED_LATE_OVERRUN) {
+        overrun_calls++;
+    }
+
+    in_hook = false;
+}
+
+/**
+ * Hooks can only be set on scheduled tasks.
+ */
+Test(test_hook_rules, ts) {
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 0, task_stub));
+
+    assertEquals(SKED_E_INVALID_FUNCTION, sked.setLateHook(task_spin,
+            late_hook));
+    assertEquals(SKED_E_OK, sked.setLateHook(task_stub, late_hook));
+    assertTrue(sked.getTaskInfo(0)->late_hook == late_hook);
+    assertEquals(SKED_E_OK, sked.setLateHook(task_stub, NULL));
+    assertTrue(sked.getTaskInfo(0)->late_hook == NULL);
+
+    sked.reset();
+}
+
+/**
+ * A task that overruns every period gets its hook called for each overrun,
+ * never nested, and a task without a hook costs nothing.
+ */
+Test(test_hook_overrun, ts) {
+    miss_calls = 0;
+    overrun_calls = 0;
+    hook_wrong_fcn = false;
+    hook_nested = false;
+    in_hook = false;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 0, task_spin));
+    assertEquals(SKED_E_OK, sked.setLateHook(task_spin, late_hook));
+    sked.start();
+
+    uint32_t start = millis();
+    while ((millis() - start) < 50) {
+    }
+
+    sked_task_t *task = sked.getTaskInfo(0);
+    assertTrue(overrun_calls > 10);
+    assertTrue(overrun_calls <= task->overruns);
+    assertEquals(0, miss_calls);
+    assertTrue(!hook_wrong_fcn);
+    assertTrue(!hook_nested);
+
+    sked.reset();
+}
+
+/**
+ * In non-preemptive mode, a task starved by a slow one misses and its hook is
+ * called from loop().
+ */
+Test(test_hook_miss, ts) {
+    miss_calls = 0;
+    overrun_calls = 0;
+    hook_wrong_fcn = false;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_NON_PREEMPTIVE,
+            SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 1, task_spin));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 0, task_stub));
+    assertEquals(SKED_E_OK, sked.setLateHook(task_stub, late_hook));
+    sked.start();
+
+    uint32_t start = millis();
+    while ((millis() - start) < 50) {
+        sked.loop();
+    }
+
+    assertTrue(miss_calls > 5);
+    assertTrue(!hook_wrong_fcn);
+
+    sked.reset();
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
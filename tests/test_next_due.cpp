@@ -0,0 +1,144 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests the next-due release engine against the same timing the linear one
+ * gives. Build with SKED_RELEASE=SKED_RELEASE_NEXT_DUE.
+ */
+
+#include <Sked.h>
+#include "./utest.h"
+#include "./util.h"
+
+TestSuite ts;
+
+uint32_t tstamps_10ms[5];
+uint32_t tstamps_25ms[5];
+uint32_t tstamps_7ms[5];
+struct time_array_t times_10ms = {tstamps_10ms, 0, 5};
+struct time_array_t times_25ms = {tstamps_25ms, 0, 5};
+struct time_array_t times_7ms = {tstamps_7ms, 0, 5};
+volatile bool done_25ms;
+volatile bool done_7ms;
+
+void task_10ms(void) {
+    markTime(&times_10ms);
+}
+
+void task_25ms(void) {
+    done_25ms = markTime(&times_25ms);
+}
+
+void task_7ms(void) {
+    done_7ms = markTime(&times_7ms);
+}
+
+/**
+ * @return Whether every gap between releases is the period, give or take a
+ * tick
+ */
+static bool onPeriod(time_array_t *times, uint32_t period_us) {
+    for (uint8_t i = 1; i < times->count; i++) {
+        uint32_t delta = times->tstamps[i] - times->tstamps[i-1];
+        if (delta + 100 < period_us || delta > period_us + 100) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Offsets and periods of tasks scheduled before start().
+ */
+Test(test_next_due_periods, ts) {
+    times_10ms.count = 0;
+    times_25ms.count = 0;
+    done_25ms = false;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 1, task_10ms));
+    assertEquals(SKED_E_OK, sked.schedule(25000, 5000, 0, task_25ms));
+    sked.start();
+
+    while (!done_25ms) {
+        if (millis() > 2000) {
+            fail("Timeout occurred");
+        }
+    }
+
+    assertTrue(onPeriod(&times_10ms, 10000));
+    assertTrue(onPeriod(&times_25ms, 25000));
+
+    /* The 25ms task trails the 10ms one by its offset */
+    uint32_t lag = times_25ms.tstamps[0] - times_10ms.tstamps[0];
+    assertTrue(lag + 100 >= 5000);
+    assertTrue(lag <= 5000 + 100);
+
+    sked.reset();
+}
+
+/**
+ * A task scheduled while the scheduler runs starts counting from then, not
+ * from the last release the engine saw.
+ */
+Test(test_next_due_late_schedule, ts) {
+    times_10ms.count = 0;
+    times_7ms.count = 0;
+    done_7ms = false;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(10000, 0, 1, task_10ms));
+    sked.start();
+
+    /* Land somewhere between two releases of the 10ms task */
+    uint32_t start = millis();
+    while ((millis() - start) < 14) {
+    }
+
+    uint32_t scheduled = micros();
+    assertEquals(SKED_E_OK, sked.schedule(7000, 3000, 0, task_7ms));
+
+    while (!done_7ms) {
+        if ((millis() - start) > 2000) {
+            fail("Timeout occurred");
+        }
+    }
+
+    uint32_t first = times_7ms.tstamps[0] - scheduled;
+    assertTrue(first + 100 >= 3000);
+    assertTrue(first <= 3000 + 200);
+    assertTrue(onPeriod(&times_7ms, 7000));
+    assertTrue(onPeriod(&times_10ms, 10000));
+
+    sked.reset();
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,134 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests EEPROM post-mortem snapshots. Build with SKED_POSTMORTEM=1. Note that
+ * this writes to the top of EEPROM.
+ */
+
+#include <Sked.h>
+#include <EEPROM.h>
+#include "./utest.h"
+#include "./util.h"
+
+TestSuite ts;
+
+volatile bool done;
+
+void task_overrun(void) {
+    uint32_t start = millis();
+
+    /* Run for longer than our 1ms period */
+    while ((millis() - start) < 3) {
+    }
+
+    done = true;
+}
+
+/**
+ * An overrun should leave a snapshot behind once idle() gets to run, and it
+ * should hold the statistics and the trace.
+ */
+Test(test_overrun_snapshot, ts) {
+    sked_pm_snapshot_t snap;
+    uint16_t seq_before = 0;
+
+    if (sked.loadSnapshot(&snap) == SKED_E_OK) {
+        seq_before = snap.seq;
+    }
+
+    done = false;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 0, task_overrun));
+    sked.start();
+
+    while (!done) {
+        if (millis() > 2000) {
+            fail("Timeout occurred");
+        }
+    }
+
+    /* The overrun asked for a snapshot, idle() saves it */
+    sked.idle();
+    sked.reset();
+
+    assertEquals(SKED_E_OK, sked.loadSnapshot(&snap));
+    assertEquals(SKED_PM_VERSION, snap.version);
+    assertEquals(SKED_PM_REASON_OVERRUN, snap.reason);
+    assertEquals((uint16_t)(seq_before + 1), snap.seq);
+    assertEquals(1, snap.task_count);
+    assertTrue(snap.tasks[0].overruns > 0);
+    assertTrue(snap.tasks[0].max_exec_us > 1000);
+    assertTrue(snap.trace_count > 0);
+
+    bool saw_overrun = false;
+    for (uint8_t i = 0; i < snap.trace_count; i++) {
+        if (snap.trace[i].event == SKED_TRACE_OVERRUN) {
+            saw_overrun = true;
+        }
+    }
+    assertTrue(saw_overrun);
+}
+
+/**
+ * A snapshot that was cut short must not be used; the previous one should be
+ * returned instead.
+ */
+Test(test_torn_snapshot, ts) {
+    sked_pm_snapshot_t snap;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+
+    assertEquals(SKED_E_OK, sked.saveSnapshot(SKED_PM_REASON_USER));
+    assertEquals(SKED_E_OK, sked.loadSnapshot(&snap));
+    uint16_t good_seq = snap.seq;
+
+    assertEquals(SKED_E_OK, sked.saveSnapshot(SKED_PM_REASON_USER + 1));
+    assertEquals(SKED_E_OK, sked.loadSnapshot(&snap));
+    assertEquals((uint16_t)(good_seq + 1), snap.seq);
+
+    /* Corrupt the body of the newest slot, as if power failed mid-write */
+    uint16_t slot_size = 1 + sizeof(sked_pm_snapshot_t) + 2;
+    uint16_t base = E2END + 1 - SKED_PM_SLOTS * slot_size;
+    for (uint8_t i = 0; i < SKED_PM_SLOTS; i++) {
+        uint16_t addr = base + i * slot_size;
+        if (EEPROM.read(addr + 2) == (uint8_t)snap.seq
+                && EEPROM.read(addr + 3) == (uint8_t)(snap.seq >> 8)) {
+            EEPROM.write(addr + 10, EEPROM.read(addr + 10) ^ 0xFF);
+        }
+    }
+
+    assertEquals(SKED_E_OK, sked.loadSnapshot(&snap));
+    assertEquals(good_seq, snap.seq);
+    assertEquals(SKED_PM_REASON_USER, snap.reason);
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,153 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests stack high-water-mark measurement with nested preemption and the
+ * preemption depth limit. Build with SKED_STACK_MONITOR=1.
+ */
+
+#include <Sked.h>
+#include "./utest.h"
+#include "./util.h"
+
+TestSuite ts;
+
+volatile bool done;
+volatile uint8_t fast_runs;
+
+void task_fast(void) {
+    fast_runs++;
+}
+
+void task_slow(void) {
+    /* Use a chunk of stack that the compiler can't optimize away */
+    volatile uint8_t scratch[64];
+    uint32_t start = millis();
+
+    for (uint8_t i = 0; i < sizeof(scratch); i++) {
+        scratch[i] = i;
+    }
+
+    /* Spin for 20ms so the fast task preempts us several times */
+    while ((millis() - start) < 20) {
+    }
+
+    done = true;
+}
+
+/**
+ * A slow low priority task preempted by a fast high priority task should show
+ * up as two dispatch levels, the second deeper than the first.
+ */
+Test(test_watermark, ts) {
+    done = false;
+    fast_runs = 0;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 10, task_fast));
+    assertEquals(SKED_E_OK, sked.schedule(1000000, 0, 0, task_slow));
+
+    /* Nothing is known until start() paints the stack */
+    assertEquals(0, sked.getStackFree());
+    assertEquals(0xFFFFU, sked.getStackLevel(2)->min_sp);
+    assertTrue(sked.getStackLevel(SKED_STACK_LEVELS) == NULL);
+
+    sked.start();
+
+    while (!done) {
+        if (millis() > 2000) {
+            fail("Timeout occurred");
+        }
+    }
+
+    assertTrue(fast_runs > 10);
+
+    /* Level 1: the slow task (index 1) on its own or the fast task alone.
+     * Level 2: the fast task (index 0) on top of the slow one. */
+    const sked_stack_level_t *l1 = sked.getStackLevel(1);
+    const sked_stack_level_t *l2 = sked.getStackLevel(2);
+    assertTrue(l1->min_sp != 0xFFFFU);
+    assertTrue(l2->min_sp != 0xFFFFU);
+    assertTrue(l2->min_sp < l1->min_sp);
+    assertEquals(1, l2->chain[0]);
+    assertEquals(0, l2->chain[1]);
+
+    /* Some of the painted region must be left */
+    uint16_t free_bytes = sked.getStackFree();
+    assertTrue(free_bytes > 0);
+
+    Serial.print("Stack free: ");
+    Serial.println(free_bytes);
+    Serial.print("Level 1 used: ");
+    Serial.println(RAMEND - l1->min_sp);
+    Serial.print("Level 2 used: ");
+    Serial.println(RAMEND - l2->min_sp);
+
+    sked.reset();
+}
+
+/**
+ * With the preemption depth limited to 1, the fast task must wait for the slow
+ * one to finish instead of stacking on top of it.
+ */
+Test(test_depth_limit, ts) {
+    done = false;
+    fast_runs = 0;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(1000, 0, 10, task_fast));
+    assertEquals(SKED_E_OK, sked.schedule(1000000, 500, 0, task_slow));
+    sked.setMaxPreemptionDepth(1);
+
+    sked.start();
+
+    while (!done) {
+        if (millis() > 2000) {
+            fail("Timeout occurred");
+        }
+    }
+
+    /* The fast task was held back while the slow one ran, which counts
+     * once however many ticks it waited */
+    assertEquals(1, sked.getPreemptionDeferrals());
+    assertTrue(sked.getTaskInfo(0)->misses > 10);
+    assertEquals(0xFFFFU, sked.getStackLevel(2)->min_sp);
+
+    /* And picked up again once it finished */
+    uint8_t runs = fast_runs;
+    uint32_t start = millis();
+    while ((millis() - start) < 5) {
+    }
+    assertTrue(fast_runs > runs);
+
+    sked.reset();
+}
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -0,0 +1,174 @@
+/**
+ * Sked: Task scheduling library for Arduino.
+ *
+ * Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * --------------------------------------------------------------------------
+ *
+ * Tests watchdog recovery of a wedged task. Build with SKED_WATCHDOG=1. If the
+ * abort stage doesn't work, the board resets and the test never finishes.
+ */
+
+#include <Sked.h>
+#include <avr/wdt.h>
+#include "./utest.h"
+#include "./util.h"
+
+TestSuite ts;
+
+volatile bool wedge;
+volatile uint16_t runs;
+
+void task_critical(void) {
+    runs++;
+
+    /* Hang until something gets us out of here */
+    while (wedge) {
+    }
+}
+
+void task_stub(void) {
+}
+
+/**
+ * Only critical tasks with periods shorter than the timeout are accepted.
+ */
+Test(test_watchdog_rules, ts) {
+    sked.reset();
+    assertEquals(SKED_E_NOT_INITIALIZED, sked.watchdogEnable(WDTO_30MS));
+
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(100000, 0, 0, task_stub));
+    assertEquals(SKED_E_INVALID_OPERATION, sked.watchdogEnable(WDTO_30MS));
+
+    assertEquals(SKED_E_INVALID_FUNCTION, sked.setCritical(task_critical,
+            true));
+    assertEquals(SKED_E_OK, sked.setCritical(task_stub, true));
+    assertEquals(SKED_E_INVALID_PERIOD, sked.watchdogEnable(WDTO_30MS));
+
+    sked.reset();
+}
+
+/**
+ * A critical task that hangs gets aborted by the first stage and the
+ * scheduler carries on feeding the watchdog afterwards.
+ */
+Test(test_watchdog_abort, ts) {
+    runs = 0;
+    wedge = true;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(5000, 0, 0, task_critical));
+    assertEquals(SKED_E_OK, sked.setCritical(task_critical, true));
+    assertEquals(SKED_E_OK, sked.watchdogEnable(WDTO_30MS));
+    sked.start();
+
+    /* The first run hangs; wait for the watchdog to get us out */
+    while (sked.getWatchdogAborts() == 0) {
+        if (millis() > 2000) {
+            fail("Timeout occurred");
+        }
+    }
+    wedge = false;
+
+    uint16_t runs_after_abort = runs;
+    uint32_t start = millis();
+    while ((millis() - start) < 100) {
+    }
+
+    /* Back on schedule and the stages were undone */
+    assertTrue(runs > runs_after_abort + 10);
+    assertEquals(0, sked.getWatchdogStage());
+    assertEquals(1, sked.getWatchdogAborts());
+
+    sked.reset();
+}
+
+/**
+ * A task added after setCritical() that sorts in ahead of the critical one
+ * doesn't take over its place in the watchdog's eyes: the critical task
+ * still feeds it on its own.
+ */
+Test(test_watchdog_moved, ts) {
+    runs = 0;
+    wedge = false;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(5000, 0, 0, task_critical));
+    assertEquals(SKED_E_OK, sked.setCritical(task_critical, true));
+    /* Higher priority, so it goes in at index 0; far slower than the
+     * watchdog's timeout */
+    assertEquals(SKED_E_OK, sked.schedule(1000000, 0, 1, task_stub));
+    assertTrue(sked.getTaskInfo(1)->flags & SKED_TASK_CRITICAL);
+    assertTrue(!(sked.getTaskInfo(0)->flags & SKED_TASK_CRITICAL));
+    assertEquals(SKED_E_OK, sked.watchdogEnable(WDTO_30MS));
+    sked.start();
+
+    uint32_t start = millis();
+    while ((millis() - start) < 200) {
+    }
+
+    assertTrue(runs >= 30);
+    assertEquals(0, sked.getWatchdogStage());
+    assertEquals(0, sked.getWatchdogAborts());
+
+    sked.reset();
+}
+
+#if (SKED_POSTMORTEM == SKED_ON)
+/**
+ * The shed-load stage has idle() save the post-mortem snapshot, instead of
+ * the watchdog interrupt writing the EEPROM itself.
+ */
+Test(test_watchdog_snapshot, ts) {
+    sked_pm_snapshot_t snap;
+
+    runs = 0;
+    wedge = false;
+
+    sked.reset();
+    assertEquals(SKED_E_OK, sked.init(SKED_MODE_PREEMPTIVE, SKED_SRC_TIMER1));
+    assertEquals(SKED_E_OK, sked.schedule(5000, 0, 0, task_critical));
+    assertEquals(SKED_E_OK, sked.setCritical(task_critical, true));
+    assertEquals(SKED_E_OK, sked.watchdogEnable(WDTO_2S));
+
+    /* Two timeouts' worth of stages, without waiting for them. Nothing is
+     * running, so nothing is fed. */
+    sked.watchdogISR();
+    sked.watchdogISR();
+    assertEquals(2, sked.getWatchdogStage());
+
+    sked.idle();
+    assertEquals(SKED_E_OK, sked.loadSnapshot(&snap));
+    assertEquals(SKED_PM_REASON_WATCHDOG, snap.reason);
+    assertEquals(1, snap.task_count);
+
+    sked.reset();
+}
+#endif
+
+void setup(void) {
+    Serial.begin(115200);
+    ts.setup();
+}
+
+void loop() {
+    ts.run();
+    finish();
+}
@@ -145,11 +145,11 @@ int8_t TestCase::_assertEquals(char *msg, uint32_t expected, uint32_t actual,
         if (msg == NULL) {
             snprintf(bufExpected, sizeof(bufExpected),
                 "Assertion failed. Expected %lu, but got %lu",
-                expected, actual);
+                (unsigned long)expected, (unsigned long)actual);
         } else {
             snprintf(bufExpected, sizeof(bufExpected),
                 "Assertion failed. Expected %lu, but got %lu\n\t%s",
-                expected, actual, msg);
+                (unsigned long)expected, (unsigned long)actual, msg);
         }
         _fail(bufExpected, file, line);
 
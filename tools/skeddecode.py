@@ -0,0 +1,298 @@
+#!/usr/bin/env python
+#
+# Decoder for the binary frames that Sked writes from idle().
+#
+# Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# Usage:
+#   skeddecode.py /dev/tty.usbmodem1421 [sources...]  (serial port at 115200)
+#   skeddecode.py capture.bin [sources...]            (raw capture file)
+#
+# Log messages are expanded using the SKED_LOG_FORMAT(name, id, "fmt")
+# declarations found in the given source files.
+#
+# Frame layout (see Sked.h):
+#   SYNC(0xA5) | TYPE | VERSION | LEN (u16 LE) | PAYLOAD | CHECKSUM (2)
+#
+
+import os
+import re
+import struct
+import sys
+
+FRAME_SYNC = 0xA5
+FRAME_OVERHEAD = 7
+
+FRAME_STATUS = 0x01
+FRAME_LOG = 0x02
+
+LOG_ID_DROPPED = 0
+
+LOG_FORMAT_RE = re.compile(
+    r'SKED_LOG_FORMAT\(\s*(\w+)\s*,\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+CONVERSION_RE = re.compile(
+    r'%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l)?([diuxXcs%])')
+
+TASK_STATES = {0: "IDLE", 1: "READY", 2: "RUNNING"}
+MODES = {0: "PREEMPTIVE", 1: "NON_PREEMPTIVE"}
+CLK_SRCS = {1: "TIMER1"}
+
+TICK_US = 100
+
+
+def fletcher16(data):
+    """Matches skedFletcher16() in Sked.cpp (end-around carry folding)."""
+    a = 0
+    b = 0
+    for byte in bytearray(data):
+        a += byte
+        a = (a & 0xFF) + (a >> 8)
+        b += a
+        b = (b & 0xFF) + (b >> 8)
+    return a, b
+
+
+class FrameReader(object):
+    """Pulls checksummed frames out of a byte stream and resynchronizes on
+    the SYNC byte after noise or a bad checksum."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.bad_frames = 0
+
+    def feed(self, data):
+        self.buf.extend(data)
+        frames = []
+
+        while True:
+            start = self.buf.find(bytearray([FRAME_SYNC]))
+            if start < 0:
+                del self.buf[:]
+                break
+            del self.buf[:start]
+
+            if len(self.buf) < 5:
+                break
+
+            ftype, version, length = struct.unpack_from("<BBH", self.buf, 1)
+            total = FRAME_OVERHEAD + length
+            if len(self.buf) < total:
+                break
+
+            a, b = fletcher16(self.buf[1:5 + length])
+            if a != self.buf[5 + length] or b != self.buf[6 + length]:
+                self.bad_frames += 1
+                del self.buf[:1]
+                continue
+
+            frames.append((ftype, version, bytes(self.buf[5:5 + length])))
+            del self.buf[:total]
+
+        return frames
+
+
+def decode_status(version, payload):
+    if version not in (1, 2, 3):
+        raise ValueError("Unsupported status frame version %d" % version)
+
+    state, mode, clk_src, count, cur_prio = struct.unpack_from("<BBBBb",
+                                                               payload, 0)
+    status = {
+        "initialized": state != 0,
+        "mode": MODES.get(mode, str(mode)),
+        "clk_src": CLK_SRCS.get(clk_src, str(clk_src)),
+        "current_priority": cur_prio,
+        "ticks": None,
+        "first": 0,
+        "total": count,
+        "tasks": [],
+    }
+
+    # v1 has byte-wide misses/overruns and nothing else. v2 says how wide
+    # the statistics are (SKED_STATS_32BIT) and adds the tick count,
+    # activations, completions and max execution time. v3 (the host) has
+    # only some of the table: the slot it starts at and how many there are.
+    offset = 5
+    stat_fmt, count_fmt = "B", None
+    if version >= 2:
+        stat_width, count_width, ticks = struct.unpack_from("<BBI", payload,
+                                                            offset)
+        offset += 6
+        stat_fmt = {1: "B", 4: "I"}[stat_width]
+        count_fmt = {2: "H", 4: "I"}[count_width]
+        status["ticks"] = ticks
+    if version >= 3:
+        status["first"], status["total"] = struct.unpack_from("<II", payload,
+                                                              offset)
+        offset += 8
+
+    task_fmt = "<bBHHH" + stat_fmt * 2
+    if count_fmt:
+        task_fmt += count_fmt * 2 + "I"
+    task_len = struct.calcsize(task_fmt)
+
+    for i in range(count):
+        fields = struct.unpack_from(task_fmt, payload, offset)
+        offset += task_len
+        task = {
+            "priority": fields[0],
+            "state": TASK_STATES.get(fields[1], str(fields[1])),
+            "period_us": fields[2] * TICK_US,
+            "offset_us": fields[3] * TICK_US,
+            "count": fields[4],
+            "misses": fields[5],
+            "overruns": fields[6],
+        }
+        if count_fmt:
+            task["activations"] = fields[7]
+            task["completions"] = fields[8]
+            task["max_exec_us"] = fields[9]
+        status["tasks"].append(task)
+
+    return status
+
+
+def load_log_formats(paths):
+    """Collects {id: format} from SKED_LOG_FORMAT() declarations."""
+    formats = {}
+    for path in paths:
+        with open(path) as f:
+            for name, fid, fmt in LOG_FORMAT_RE.findall(f.read()):
+                formats[int(fid, 0)] = fmt.encode().decode("unicode_escape")
+    return formats
+
+
+def expand_log(fmt, args):
+    """Unpacks little-endian arguments using AVR type sizes (int is 2
+    bytes) and substitutes them into the printf-style format."""
+    values = []
+    offset = [0]
+
+    def take(size, signed):
+        raw = args[offset[0]:offset[0] + size]
+        offset[0] += size
+        if len(raw) < size:
+            return 0
+        code = {1: "b", 2: "h", 4: "i", 8: "q"}[size]
+        return struct.unpack("<" + (code if signed else code.upper()), raw)[0]
+
+    def convert(m):
+        flags, length, conv = m.groups()
+        if conv == "%":
+            return "%%"
+        if conv == "s":
+            values.append("?")
+            return "%" + flags + "s"
+        if conv == "c" or length == "hh":
+            size = 1
+        elif length == "l":
+            size = 4
+        elif length == "ll":
+            size = 8
+        else:
+            size = 2
+        values.append(take(size, conv in "di"))
+        return "%" + flags + (conv if conv != "u" else "d")
+
+    return CONVERSION_RE.sub(convert, fmt) % tuple(values)
+
+
+def decode_log(version, payload, formats):
+    if version != 1:
+        raise ValueError("Unsupported log frame version %d" % version)
+
+    fid = bytearray(payload)[0]
+    args = payload[1:]
+    if fid == LOG_ID_DROPPED:
+        return "*** %d log messages dropped" % struct.unpack("<H", args)[0]
+    if fid not in formats:
+        return "<log %d: %s>" % (fid, " ".join(
+            "%02X" % b for b in bytearray(args)))
+    return expand_log(formats[fid], args)
+
+
+def render_status(status, out):
+    out.write("### Sked is %s (%s, %s, prio %d)\n" % (
+        "INITIALIZED" if status["initialized"] else "UNINITIALIZED",
+        status["mode"], status["clk_src"], status["current_priority"]))
+    if status["ticks"] is not None:
+        out.write("### Uptime %.1fs\n" % (status["ticks"] * TICK_US / 1e6))
+    if len(status["tasks"]) < status["total"]:
+        out.write("### Tasks %d-%d of %d\n" % (
+            status["first"], status["first"] + len(status["tasks"]) - 1,
+            status["total"]))
+    out.write("### %-4s %5s %10s %10s %6s %-8s %6s %8s %10s %10s %8s\n" % (
+        "Task", "Prio", "Period_us", "Offset_us", "Count", "State", "Misses",
+        "Overruns", "Activ", "Compl", "Max_us"))
+    for i, t in enumerate(status["tasks"], status["first"]):
+        out.write("### %-4d %5d %10d %10d %6d %-8s %6d %8d %10s %10s %8s\n" % (
+            i, t["priority"], t["period_us"], t["offset_us"], t["count"],
+            t["state"], t["misses"], t["overruns"],
+            t.get("activations", "-"), t.get("completions", "-"),
+            t.get("max_exec_us", "-")))
+    out.flush()
+
+
+def handle_frame(ftype, version, payload, out, formats=None):
+    if ftype == FRAME_STATUS:
+        render_status(decode_status(version, payload), out)
+    elif ftype == FRAME_LOG:
+        out.write(decode_log(version, payload, formats or {}) + "\n")
+        out.flush()
+    else:
+        out.write("### Unknown frame type 0x%02X (%d bytes)\n" % (
+            ftype, len(payload)))
+
+
+def open_source(path):
+    if os.path.isfile(path):
+        f = open(path, "rb")
+        return lambda: f.read(256)
+
+    import serial
+    s = serial.Serial(path, 115200, timeout=0.1)
+    return lambda: s.read(256)
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write("usage: %s <serial port | capture file> "
+                         "[sources...]\n" % argv[0])
+        return 2
+
+    formats = load_log_formats(argv[2:])
+    read = open_source(argv[1])
+    is_file = os.path.isfile(argv[1])
+    reader = FrameReader()
+
+    while True:
+        data = read()
+        if not data:
+            if is_file:
+                break
+            continue
+        for ftype, version, payload in reader.feed(data):
+            handle_frame(ftype, version, payload, sys.stdout, formats)
+
+    if reader.bad_frames:
+        sys.stderr.write("%d frames dropped (bad checksum)\n" %
+                         reader.bad_frames)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
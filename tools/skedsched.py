@@ -0,0 +1,198 @@
+#!/usr/bin/env python
+#
+# Build a schedule file for Sked::loadSchedule() from a task list.
+#
+# Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# A host build with a big, fixed set of tasks can load them all from one
+# file at startup instead of calling schedule() for each. This does the
+# work schedule() would have done once, at build time: it finds each task
+# function in the linked program with nm, checks the times as schedule()
+# checks them, and writes the records in the order loadSchedule() adds
+# them. The file carries the program's build ID (readelf -n), and
+# loadSchedule() won't take a file made for another build.
+#
+# Task list (JSON), one object per task:
+#   [{"fcn": "blink", "period_us": 1000, "offset_us": 0, "priority": 3},
+#    {"fcn": "poll(void*)", "period_us": 500, "priority": 2, "arg": 7,
+#     "slack_us": 200}]
+# fcn is the symbol as nm shows it, mangled or not, or just its name if
+# that's unique. arg makes it a scheduleArg() task; it's passed as the
+# number it is.
+#
+# Usage:
+#   skedsched.py --elf app -o app.sked tasks.json
+#
+# File layout (see sked_sched_header_t and sked_sched_record_t in Sked.h):
+#   HEADER (40) | RECORD (32) * task_count, in the host's byte order
+#
+
+import argparse
+import json
+import re
+import struct
+import subprocess
+import sys
+
+SCHED_MAGIC = 0x48534B53
+SCHED_VERSION = 1
+BUILD_ID_LEN = 20
+
+HEADER = struct.Struct('=IHHI8x20s')
+RECORD = struct.Struct('=QQIIIbBH')
+
+# sked_task_t's flag for a scheduleArg() task
+HOST_TASK_ARG = 0x01
+
+# As schedule() takes them: a tick is 100 us, up to 0xFFFF ticks
+TICK_US = 100
+MAX_PERIOD_US = 0xFFFF * TICK_US
+MIN_PRIORITY = -128
+
+NM_LINE_RE = re.compile(r'^([0-9a-fA-F]+)\s+([TtWw])\s+(.+)$')
+BUILD_ID_RE = re.compile(r'Build ID:\s*([0-9a-fA-F]+)')
+
+
+def base_name(name):
+    """Reduces 'ns::poll(void*)' to 'poll', for a task list that just
+    names the function."""
+    name = name.split('(')[0].strip()
+    return name.split('::')[-1] if name else name
+
+
+def load_symbols(nm, elf):
+    """Maps every name a task can go by to the addresses it could mean:
+    the mangled symbol, the demangled one and the bare name."""
+    symbols = {}
+    for demangle in ([], ['-C']):
+        out = subprocess.check_output(
+            [nm, '--defined-only'] + demangle + [elf],
+            universal_newlines=True)
+        for line in out.splitlines():
+            m = NM_LINE_RE.match(line)
+            if not m:
+                continue
+            addr = int(m.group(1), 16)
+            for name in set([m.group(3), base_name(m.group(3))]):
+                symbols.setdefault(name, set()).add(addr)
+    return symbols
+
+
+def load_build_id(readelf, elf):
+    out = subprocess.check_output([readelf, '-n', elf],
+                                  universal_newlines=True)
+    m = BUILD_ID_RE.search(out)
+    if not m:
+        return b'\0' * BUILD_ID_LEN
+    build_id = bytes(bytearray.fromhex(m.group(1)))[:BUILD_ID_LEN]
+    return build_id + b'\0' * (BUILD_ID_LEN - len(build_id))
+
+
+def check_us(task, key, value, allow_zero):
+    if not isinstance(value, int) or value < 0:
+        raise ValueError("%s: %s must be a whole number of us" %
+                         (task["fcn"], key))
+    if value % TICK_US:
+        raise ValueError("%s: %s %d isn't a multiple of the %d us tick" %
+                         (task["fcn"], key, value, TICK_US))
+    if value > MAX_PERIOD_US or (value < TICK_US and
+                                 not (allow_zero and value == 0)):
+        raise ValueError("%s: %s %d is out of range" %
+                         (task["fcn"], key, value))
+    return value
+
+
+def make_record(task, symbols):
+    if not isinstance(task, dict) or "fcn" not in task:
+        raise ValueError("every task needs an fcn")
+    addrs = symbols.get(task["fcn"], set())
+    if not addrs:
+        raise ValueError("%s isn't in the program" % task["fcn"])
+    if len(addrs) > 1:
+        raise ValueError("%s could be any of %d functions, give its full "
+                         "name" % (task["fcn"], len(addrs)))
+
+    period_us = check_us(task, "period_us", task.get("period_us"), False)
+    offset_us = check_us(task, "offset_us", task.get("offset_us", 0), True)
+    slack_us = task.get("slack_us", 0)
+    if not isinstance(slack_us, int) or slack_us < 0 or \
+            slack_us // TICK_US > 0xFFFF:
+        raise ValueError("%s: slack_us is out of range" % task["fcn"])
+    priority = task.get("priority")
+    if not isinstance(priority, int) or priority <= MIN_PRIORITY or \
+            priority > 127:
+        raise ValueError("%s: priority must be %d to 127" %
+                         (task["fcn"], MIN_PRIORITY + 1))
+
+    flags = 0
+    arg = 0
+    if "arg" in task:
+        arg = task["arg"]
+        if not isinstance(arg, int) or arg < 0 or arg >= 1 << 64:
+            raise ValueError("%s: arg must be a number" % task["fcn"])
+        flags |= HOST_TASK_ARG
+
+    return (priority, period_us,
+            RECORD.pack(next(iter(addrs)), arg, period_us, offset_us,
+                        slack_us, priority, flags, 0))
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description='Build a Sked schedule file for loadSchedule()')
+    parser.add_argument('tasks', help='JSON task list')
+    parser.add_argument('--elf', required=True,
+                        help='the linked program that will load it')
+    parser.add_argument('-o', '--output', required=True,
+                        help='schedule file to write')
+    parser.add_argument('--nm', default='nm', help='nm to use')
+    parser.add_argument('--readelf', default='readelf',
+                        help='readelf to use')
+    args = parser.parse_args(argv[1:])
+
+    try:
+        with open(args.tasks) as f:
+            tasks = json.load(f)
+        if not isinstance(tasks, list):
+            raise ValueError("%s isn't a list of tasks" % args.tasks)
+        symbols = load_symbols(args.nm, args.elf)
+        build_id = load_build_id(args.readelf, args.elf)
+        records = [make_record(task, symbols) for task in tasks]
+    except (IOError, OSError, ValueError,
+            subprocess.CalledProcessError) as e:
+        sys.stderr.write("skedsched: %s\n" % e)
+        return 1
+
+    # Highest priority first, shortest period first within one, as
+    # schedule() would have ordered them; ties keep the list's order
+    records.sort(key=lambda r: (-r[0], r[1]))
+
+    try:
+        with open(args.output, 'wb') as f:
+            f.write(HEADER.pack(SCHED_MAGIC, SCHED_VERSION, RECORD.size,
+                                len(records), build_id))
+            for record in records:
+                f.write(record[2])
+    except (IOError, OSError) as e:
+        sys.stderr.write("skedsched: %s\n" % e)
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,265 @@
+#!/usr/bin/env python
+#
+# Static worst-case stack analysis for Sked task sets.
+#
+# Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# Sked runs every task on one stack, so the worst case is the background
+# stack plus one dispatch per preemption level stacked on top of it. A task
+# can only preempt a task of strictly lower priority (timerISR() checks
+# _current_task_priority), so there is at most one level per distinct
+# priority, and the deepest chain takes the hungriest task of each one.
+#
+# Inputs:
+#   - The .su files written by avr-gcc -fstack-usage (frame sizes)
+#   - avr-objdump -d of the linked ELF (the static call graph)
+#   - The task list, parsed from schedule() calls in the given sources or
+#     given with --task fcn:priority
+#
+# Usage:
+#   skedstack.py --elf test.elf --budget 1024 --sources app.cpp *.su
+#
+# Exits with 1 if the worst case exceeds the budget.
+#
+
+import argparse
+import re
+import subprocess
+import sys
+
+# Bytes pushed by a call or an interrupt on devices with a 16-bit PC
+RET_ADDR_BYTES = 2
+
+SU_LINE_RE = re.compile(r'^(.*?):\d+:\d+:(.*)\t(\d+)\t(\w+(?:,\w+)?)$')
+FUNC_HDR_RE = re.compile(r'^[0-9a-f]+ <(.+)>:$')
+CALL_RE = re.compile(r'\s(?:r?call|r?jmp)\s.*<([^>+]+)>')
+ICALL_RE = re.compile(r'\s(?:e?icall|e?ijmp)\b')
+SCHEDULE_RE = re.compile(
+    r'\.schedule\(\s*[^,]+,\s*[^,]+,\s*(-?\w+)\s*,\s*(\w+)\s*\)')
+MODE_RE = re.compile(r'\.init\(\s*(SKED_MODE_\w+)')
+
+
+def base_name(name):
+    """Reduces 'void Sked::timerISR()' or 'Sked::timerISR()' to
+    'Sked::timerISR' so .su names and objdump names line up."""
+    name = name.split('(')[0].strip()
+    return name.split()[-1] if name else name
+
+
+def load_su(paths):
+    frames = {}
+    dynamic = set()
+    for path in paths:
+        with open(path) as f:
+            for line in f:
+                m = SU_LINE_RE.match(line.rstrip('\n'))
+                if not m:
+                    continue
+                name = base_name(m.group(2))
+                frames[name] = max(frames.get(name, 0), int(m.group(3)))
+                if 'dynamic' in m.group(4) and 'bounded' not in m.group(4):
+                    dynamic.add(name)
+    return frames, dynamic
+
+
+def load_call_graph(lines):
+    graph = {}
+    indirect = set()
+    current = None
+    for line in lines:
+        m = FUNC_HDR_RE.match(line)
+        if m:
+            current = base_name(m.group(1))
+            graph.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+        m = CALL_RE.search(line)
+        if m:
+            callee = base_name(m.group(1))
+            if callee != current:
+                graph[current].add(callee)
+        elif ICALL_RE.search(line):
+            indirect.add(current)
+    return graph, indirect
+
+
+def load_tasks(paths, explicit):
+    tasks = {}
+    mode = 'SKED_MODE_PREEMPTIVE'
+    for path in paths:
+        with open(path) as f:
+            text = f.read()
+        for prio, fcn in SCHEDULE_RE.findall(text):
+            try:
+                tasks[fcn] = int(prio, 0)
+            except ValueError:
+                sys.stderr.write("skedstack: can't evaluate priority '%s' of "
+                                 "%s in %s, use --task\n" % (prio, fcn, path))
+        m = MODE_RE.search(text)
+        if m:
+            mode = m.group(1)
+    for spec in explicit:
+        fcn, prio = spec.rsplit(':', 1)
+        tasks[fcn] = int(prio, 0)
+    return tasks, mode
+
+
+class StackModel(object):
+    def __init__(self, frames, graph):
+        self.frames = frames
+        self.graph = graph
+        self.memo = {}
+        self.unknown = set()
+        self.recursive = set()
+
+    def worst(self, fcn, path=()):
+        """Deepest stack use of fcn and everything it can call."""
+        if fcn in self.memo:
+            return self.memo[fcn]
+        if fcn in path:
+            self.recursive.add(fcn)
+            return 0
+        if fcn not in self.frames:
+            self.unknown.add(fcn)
+        deepest = 0
+        for callee in self.graph.get(fcn, ()):
+            deepest = max(deepest, RET_ADDR_BYTES
+                          + self.worst(callee, path + (fcn,)))
+        total = self.frames.get(fcn, 0) + deepest
+        self.memo[fcn] = total
+        return total
+
+
+def analyze(model, tasks, mode, tick_vector, base, vectors, max_depth=0):
+    """Returns (total, rows) where rows describe each stacked level. With
+    a preemption depth limit (setMaxPreemptionDepth()), only the max_depth
+    hungriest levels can be stacked at once."""
+    rows = []
+    total = model.worst(base)
+    rows.append(("background (%s)" % base, total))
+
+    # Every dispatch sits on an interrupt entry plus the tick handler's
+    # frame, then an indirect call into the task.
+    overhead = RET_ADDR_BYTES + model.worst(tick_vector) + RET_ADDR_BYTES
+
+    by_prio = {}
+    for fcn, prio in tasks.items():
+        by_prio.setdefault(prio, []).append(fcn)
+
+    if mode == 'SKED_MODE_NON_PREEMPTIVE':
+        # Tasks run one at a time from loop(), on top of the background
+        worst_fcn = max(tasks, key=model.worst) if tasks else None
+        if worst_fcn:
+            cost = RET_ADDR_BYTES + model.worst(worst_fcn)
+            rows.append(("task %s" % worst_fcn, cost))
+            total += cost
+    else:
+        levels = []
+        for prio in sorted(by_prio):
+            worst_fcn = max(by_prio[prio], key=model.worst)
+            cost = overhead + model.worst(worst_fcn)
+            levels.append((prio, worst_fcn, cost))
+        if max_depth > 0 and len(levels) > max_depth:
+            keep = sorted(levels, key=lambda l: l[2])[-max_depth:]
+            levels = [l for l in levels if l in keep]
+        for prio, worst_fcn, cost in levels:
+            rows.append(("prio %d: %s" % (prio, worst_fcn), cost))
+            total += cost
+
+    # Whatever interrupt lands on top of the deepest point
+    top = max([RET_ADDR_BYTES + model.worst(v) for v in vectors] or [0])
+    rows.append(("interrupt on top", top))
+    total += top
+
+    return total, rows
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description='Worst-case nested-preemption stack for a Sked build')
+    parser.add_argument('su', nargs='*', help='.su files from -fstack-usage')
+    parser.add_argument('--elf', help='linked ELF to disassemble')
+    parser.add_argument('--disasm', help='saved avr-objdump -d output')
+    parser.add_argument('--objdump', default='avr-objdump')
+    parser.add_argument('--sources', action='append', default=[],
+                        help='source to scan for schedule() calls')
+    parser.add_argument('--task', action='append', default=[],
+                        help='fcn:priority, overrides the sources')
+    parser.add_argument('--mode', help='override the mode found in sources')
+    parser.add_argument('--tick-vector', default='__vector_10',
+                        help='vector of the tick ISR (TIMER1_CAPT)')
+    parser.add_argument('--max-depth', type=int, default=0,
+                        help='preemption depth limit (0 is no limit)')
+    parser.add_argument('--base', default='main')
+    parser.add_argument('--budget', type=int,
+                        help='fail if the worst case is above this')
+    args = parser.parse_args(argv[1:])
+
+    if args.disasm:
+        with open(args.disasm) as f:
+            disasm = f.read().splitlines()
+    elif args.elf:
+        disasm = subprocess.check_output(
+            [args.objdump, '-d', '-C', args.elf]).decode().splitlines()
+    else:
+        parser.error('one of --elf or --disasm is required')
+
+    frames, dynamic = load_su(args.su)
+    graph, indirect = load_call_graph(disasm)
+    tasks, mode = load_tasks(args.sources, args.task)
+    mode = args.mode or mode
+
+    if not tasks:
+        sys.stderr.write("skedstack: warning: no tasks found, only the "
+                         "background is counted\n")
+
+    vectors = [f for f in graph if re.match(r'__vector_\d+$', f)]
+    model = StackModel(frames, graph)
+    total, rows = analyze(model, tasks, mode, args.tick_vector, args.base,
+                          vectors, args.max_depth)
+
+    print("### Worst-case stack (%s)" % mode)
+    for what, cost in rows:
+        print("###   %-40s %6d" % (what, cost))
+    print("###   %-40s %6d" % ("TOTAL", total))
+
+    for fcn in sorted(model.unknown & set(tasks)):
+        sys.stderr.write("skedstack: warning: no frame size for task %s, "
+                         "was it built with -fstack-usage?\n" % fcn)
+    for fcn in sorted(model.recursive):
+        sys.stderr.write("skedstack: warning: %s is recursive, result is "
+                         "not a bound\n" % fcn)
+    for fcn in sorted(dynamic & set(model.memo)):
+        sys.stderr.write("skedstack: warning: %s has a dynamic frame\n" % fcn)
+    others = (indirect & set(model.memo)) - set([args.tick_vector,
+                                                  'Sked::timerISR',
+                                                  'Sked::loop'])
+    for fcn in sorted(others):
+        sys.stderr.write("skedstack: warning: %s makes indirect calls that "
+                         "aren't counted\n" % fcn)
+
+    if args.budget is not None and total > args.budget:
+        sys.stderr.write("skedstack: worst-case stack %d exceeds the budget "
+                         "of %d bytes\n" % (total, args.budget))
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,242 @@
+#!/usr/bin/env python
+#
+# Live per-task load from the stats file a host build exports.
+#
+# Copyright (c) 2013, Christopher Myers.  All Rights Reserved.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# The scheduler calls sked.exportStats("/dev/shm/app.sked") and keeps the
+# file up to date as jobs finish; this maps it read-only and never blocks
+# it. Each sample shows, per task, the CPU it used since the last one, how
+# often it ran and how its execution times are spread. Percentiles come from
+# the power-of-two histogram, so they're the top of their bucket.
+#
+# Usage:
+#   skedtop.py /dev/shm/app.sked               (refresh every second)
+#   skedtop.py --interval 0.2 /dev/shm/app.sked
+#   skedtop.py --once /dev/shm/app.sked        (totals since start)
+#
+# File layout (see sked_shm_header_t and sked_shm_task_t in Sked.h):
+#   HEADER (40) | TASK RECORD (task_size) * max_tasks, all little endian
+#
+
+import argparse
+import mmap
+import struct
+import sys
+import time
+
+SHM_MAGIC = 0x4D48534B
+SHM_VERSION = 2
+
+HEADER = struct.Struct('<IHHIB3xIIIIQ')
+HEADER_SEQ = 8
+TASK = struct.Struct('<IbBBBIIIIIIIIQQ16I')
+TASK_SEQ = 0
+HIST_BUCKETS = 16
+
+TASK_STATES = {0: "IDLE", 1: "READY", 2: "RUNNING"}
+MODES = {0: "PREEMPTIVE", 1: "NON_PREEMPTIVE"}
+
+# Tries at a record before giving up on this sample
+READ_TRIES = 1000
+
+
+class StatsFile(object):
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        if len(self.map) < HEADER.size:
+            raise ValueError("%s is too short for a Sked stats file" % path)
+        magic, version = struct.unpack_from('<IH', self.map, 0)
+        if magic != SHM_MAGIC:
+            raise ValueError("%s isn't a Sked stats file (or isn't ready "
+                             "yet)" % path)
+        if version != SHM_VERSION:
+            raise ValueError("%s is version %d, expected %d" %
+                             (path, version, SHM_VERSION))
+
+    def read_seq(self, offset, size):
+        """Copies size bytes at offset once the writer isn't in the middle
+        of them: seq is odd while it writes and moves on when it's done."""
+        for _ in range(READ_TRIES):
+            before = struct.unpack_from('<I', self.map, offset)[0]
+            if before & 1:
+                time.sleep(0)
+                continue
+            data = self.map[offset:offset + size]
+            if struct.unpack_from('<I', self.map, offset)[0] == before:
+                return data
+        return None
+
+    def header(self):
+        data = self.read_seq(HEADER_SEQ, HEADER.size - HEADER_SEQ)
+        if data is None:
+            return None
+        fields = HEADER.unpack(self.map[:HEADER_SEQ] + data)
+        return {
+            "max_tasks": fields[5],
+            "task_count": fields[6],
+            "mode": MODES.get(fields[4], str(fields[4])),
+            "ticks": fields[7],
+            "tick_us": fields[8],
+            "updated_ns": fields[9],
+            "task_size": fields[2],
+        }
+
+    def task(self, header, i):
+        offset = HEADER.size + i * header["task_size"]
+        data = self.read_seq(offset + TASK_SEQ, TASK.size)
+        if data is None:
+            return None
+        fields = TASK.unpack(data)
+        return {
+            "priority": fields[1],
+            "state": TASK_STATES.get(fields[2], str(fields[2])),
+            "flags": fields[3],
+            "period_us": fields[5],
+            "activations": fields[6],
+            "completions": fields[7],
+            "misses": fields[8],
+            "overruns": fields[9],
+            "max_exec_us": fields[10],
+            "last_exec_us": fields[11],
+            "total_exec_us": fields[13],
+            "fcn": fields[14],
+            "hist": list(fields[15:15 + HIST_BUCKETS]),
+        }
+
+    def sample(self):
+        header = self.header()
+        if header is None:
+            return None, []
+        tasks = [self.task(header, i)
+                 for i in range(min(header["task_count"],
+                                    header["max_tasks"]))]
+        return header, tasks
+
+
+def percentile(hist, p):
+    """Top of the bucket the p-th percentile falls in: bucket b holds times
+    under 2^b us, the last one everything else."""
+    total = sum(hist)
+    if total == 0:
+        return None
+    want = total * p / 100.0
+    seen = 0
+    for b, count in enumerate(hist):
+        seen += count
+        if seen >= want:
+            return (1 << b) if b < len(hist) - 1 else None
+    return None
+
+
+def fmt_us(us):
+    if us is None:
+        return "-"
+    return "%d" % us
+
+
+def delta(now, prev, key):
+    return (now[key] - prev[key]) if prev else now[key]
+
+
+def render(header, tasks, prev, wall_us, out):
+    out.write("### %s, %d tasks, tick %.1fs\n" % (
+        header["mode"], header["task_count"],
+        header["ticks"] * header["tick_us"] / 1e6))
+    out.write("### %-4s %-18s %5s %-8s %7s %8s %6s %8s %8s %8s %8s %8s\n" % (
+        "Task", "Fcn", "Prio", "State", "Load%", "Runs/s", "Misses",
+        "Overruns", "Mean_us", "P50_us", "P99_us", "Max_us"))
+    for i, t in enumerate(tasks):
+        if t is None:
+            out.write("### %-4d (busy, skipped)\n" % i)
+            continue
+        if t["fcn"] == 0:
+            # A slot unschedule() freed
+            continue
+        # A task added since the last sample starts from zero
+        p = prev[i] if prev and i < len(prev) and prev[i] and \
+            prev[i]["fcn"] == t["fcn"] else None
+        runs = delta(t, p, "completions")
+        exec_us = delta(t, p, "total_exec_us")
+        hist = [h - (p["hist"][b] if p else 0)
+                for b, h in enumerate(t["hist"])]
+        out.write("### %-4d 0x%-16x %5d %-8s %7.2f %8.1f %6d %8d %8s %8s "
+                  "%8s %8d\n" % (
+                      i, t["fcn"], t["priority"], t["state"],
+                      100.0 * exec_us / wall_us if wall_us else 0.0,
+                      runs * 1e6 / wall_us if wall_us else 0.0,
+                      t["misses"], t["overruns"],
+                      fmt_us(exec_us // runs if runs else None),
+                      fmt_us(percentile(hist, 50)),
+                      fmt_us(percentile(hist, 99)),
+                      t["max_exec_us"]))
+    out.flush()
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description='Live per-task load of a Sked host build')
+    parser.add_argument('path', help='file given to exportStats()')
+    parser.add_argument('--interval', type=float, default=1.0,
+                        help='seconds between samples')
+    parser.add_argument('--once', action='store_true',
+                        help='print the totals since start and exit')
+    parser.add_argument('--count', type=int, default=0,
+                        help='samples to print (0 is until interrupted)')
+    args = parser.parse_args(argv[1:])
+
+    try:
+        stats = StatsFile(args.path)
+    except (IOError, OSError, ValueError) as e:
+        sys.stderr.write("skedtop: %s\n" % e)
+        return 1
+
+    header, tasks = stats.sample()
+    if header is None:
+        sys.stderr.write("skedtop: couldn't get a clean read of the header\n")
+        return 1
+    if args.once:
+        render(header, tasks, None,
+               header["ticks"] * header["tick_us"], sys.stdout)
+        return 0
+
+    # The records are current as of each job, so this is the time between
+    # samples, on the same CLOCK_MONOTONIC as updated_ns
+    sampled = time.monotonic()
+    printed = 0
+    try:
+        while args.count == 0 or printed < args.count:
+            time.sleep(args.interval)
+            prev_header, prev = header, tasks
+            header, tasks = stats.sample()
+            if header is None:
+                header, tasks = prev_header, prev
+                continue
+            now = time.monotonic()
+            wall_us = int((now - sampled) * 1e6)
+            sampled = now
+            render(header, tasks, prev, wall_us, sys.stdout)
+            printed += 1
+    except KeyboardInterrupt:
+        pass
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))